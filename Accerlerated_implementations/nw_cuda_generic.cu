@@ -2,8 +2,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <libgen.h>
 #include <cuda_runtime.h>
+#include "../common/fasta_reader.h"
+#include "../common/util.h"
 
 // 점수 체계 정의 (일치, 불일치, 갭 패널티)
 #define MATCH 1
@@ -83,64 +84,6 @@ __global__ void compute_diagonal(
     }
 }
 
-// 문자열 뒤집기 함수 (역추적 후 결과를 바로잡기 위함)
-void rev(char *str) {
-    int len = strlen(str);
-    for (int i = 0; i < len / 2; i++) {
-        char tmp = str[i];
-        str[i] = str[len - 1 - i];
-        str[len - 1 - i] = tmp;
-    }
-}
-
-// FASTA 파일 읽기 함수
-char* read_fasta(const char* filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        printf("Cannot open file: %s\n", filename);
-        return NULL;
-    }
-
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    rewind(file);
-
-    char *sequence = (char*)malloc(fsize + 1);
-    if (!sequence) {
-        printf("Memory allocation failed\n");
-        fclose(file);
-        return NULL;
-    }
-
-    char line[1024];
-    int pos = 0;
-
-    while (fgets(line, sizeof(line), file)) {
-        if (line[0] == '>') continue; // 헤더 라인 건너뛰기
-
-        for (int i = 0; line[i]; i++) {
-            if (line[i] >= 'A' && line[i] <= 'Z') {
-                sequence[pos++] = line[i];
-            }
-        }
-    }
-    sequence[pos] = '\0';
-    fclose(file);
-    return sequence;
-}
-
-// 파일 경로에서 확장자를 제외한 파일명만 추출
-char* get_basename_without_ext(const char* path) {
-    char* path_copy = strdup(path);
-    char* base = basename(path_copy);
-    char* dot = strrchr(base, '.');
-    if (dot) *dot = '\0';
-
-    char* result = strdup(base);
-    free(path_copy);
-    return result;
-}
-
 // 정렬 결과를 담을 구조체
 typedef struct {
     int score;          // 최종 정렬 점수
@@ -318,8 +261,8 @@ int main(int argc, char* argv[]) {
     printf("컴퓨트 성능: %d.%d\n\n", prop.major, prop.minor);
 
     // 입력 파일에서 서열 읽기
-    char* seq1 = read_fasta(argv[1]);
-    char* seq2 = read_fasta(argv[2]);
+    char* seq1 = fasta_read_first(argv[1]);
+    char* seq2 = fasta_read_first(argv[2]);
 
     if (!seq1 || !seq2) {
         printf("서열을 읽는데 실패했습니다.\n");
@@ -2,7 +2,21 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <libgen.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/fasta_reader.h"
+#include "../common/util.h"
+#include "../common/nt_code.h"
+#include "../common/scoring.h"
+#include "../common/aln_output.h"
+#include "../common/aln_mode.h"
+#include "../common/bench.h"
+#include "../common/instrument.h"
+#include "../common/linear_fill.h"
 
 #ifdef __APPLE__
 #include <OpenCL/opencl.h>
@@ -10,76 +24,335 @@
 #include <CL/cl.h>
 #endif
 
-#define MATCH 1
-#define MISMATCH -1
-#define GAP -1
+// 타일 크기: 열 폭은 커널의 TILE_W 와 같아야 하고, 행 높이는 작업 그룹 크기
+#define OCL_TILE_W 256
+#define OCL_TILE_H 64
+
+// 버퍼 풀: 크기 등급은 2의 거듭제곱마다 4단계 (낭비 최대 25%), 등급마다 최대 POOL_KEEP 개 보관
+#define POOL_MIN_SHIFT 12
+#define POOL_CLASSES 256
+#define POOL_KEEP 4
+
+static int num_threads = 1;   // --hetero 의 CPU 작업 스레드 수
+
+// 서열은 읽을 때 한 번 nt_code.h 의 코드로 바꾸고, CPU 와 디바이스 모두 scoring.table 로 점수를 찾는다
+// (점수 체계는 실행 시 scoring.h 옵션으로 정한다. 커널은 선형 갭만 지원)
+static Scoring scoring;
+static LinearFillEngine cpu_engine = LINEAR_FILL_ROWS;   // --hetero CPU 레인의 채우기 (main 이 CPU 와 점수 체계로 고른다)
+static AlnFormat out_format = ALN_TEXT;   // --format: text 는 기존 보고서 / TSV
+static int aln_mode = ALN_GLOBAL;         // --mode / --free-ends (aln_mode.h)
+
+#ifdef _OPENMP
+#define thread_id() omp_get_thread_num()
+#define in_parallel() omp_in_parallel()
+#else
+#define thread_id() 0
+#define in_parallel() 0
+#endif
 
 // -------------------------------------------------------------------------
 // GPU에서 실행될 커널 소스코드
 // -------------------------------------------------------------------------
 // 
 const char *kernel_source = "\
-#define MATCH_SCORE 1\n\
-#define MISMATCH_PENALTY -1\n\
-#define GAP_PENALTY -1\n\
+#define TILE_W 256\n\
 \n\
 // 세 값 중 최댓값을 반환하는 헬퍼 함수\n\
 int max3(int a, int b, int c) {\n\
     return (a >= b && a >= c) ? a : (b >= c ? b : c);\n\
 }\n\
 \n\
-// 두 문자가 같으면 매치 점수, 다르면 불일치 벌점 반환\n\
-int score_func(char a, char b) {\n\
-    return (a == b) ? MATCH_SCORE : MISMATCH_PENALTY;\n\
+// 정렬 모드 (mode) 비트는 aln_mode.h 와 같다:\n\
+// 1 A 시작, 2 A 끝, 4 B 시작, 8 B 끝이 자유, 16 local (0 아래로 내려가지 않음), 32 어디서나 끝남.\n\
+// 행 i 에서 끝날 수 있는 셀: row_any 면 모든 열, row_last 면 마지막 열 (aln_end_cell 과 같은 조건)\n\
+int end_row_any(int mode, int i, int lenA) {\n\
+    return (mode & 48) || ((mode & 8) && i == lenA);\n\
 }\n\
+int end_row_last(int mode, int i, int lenA) {\n\
+    return end_row_any(mode, i, lenA) || (mode & 2) || i == lenA;\n\
+}\n\
+\n\
+// 서열은 nt_code.h 의 코드 (uchar) 로 받는다. NT_CODES 와 GAP_PENALTY 는 빌드 옵션 -D 로 정해진다.\n\
+// 점수는 score_table[a * NT_CODES + b] (__constant). 각 행은 자기 a 코드의 한 줄\n\
+// (query profile 의 한 행) 만 잡아 두고 b 코드로 인덱싱하므로 비교와 분기가 없다.\n\
 \n\
-// 대각선 계산을 위한 커널 함수\n\
-__kernel void compute_diagonal(\n\
-    __global const char* seq_a,\n\
-    __global const char* seq_b,\n\
-    __global int* dp_matrix,\n\
-    __global char* traceback_matrix,\n\
+// 타일 커널: 작업 그룹 하나가 (작업 그룹 크기) 행 x TILE_W 열 블록을 계산한다.\n\
+// 작업 항목 t 는 행 r0 + t 를 맡아 한 단계에 한 열씩, 위 행보다 한 단계 늦게 진행한다.\n\
+// 위 행의 값은 __local 이중 버퍼 pass 로 이웃 작업 항목에게서 받으므로\n\
+// 호스트는 타일 대각선마다 한 번만 커널을 실행하면 된다 (셀 대각선마다가 아니라).\n\
+// 그룹 사이 동기화는 커널 경계뿐이라 PoCL 같은 CPU 런타임에서도 그대로 동작한다.\n\
+//\n\
+// 점수 행렬은 디바이스에 두지 않는다. 타일끼리는 경계만 주고받는다.\n\
+//   H[j]       위 타일의 마지막 행 (dp[r0-1][j])\n\
+//   V[i]       왼쪽 타일의 마지막 열 (dp[i][c0-1])\n\
+//   corner[ti] 타일 행 ti 의 다음 타일이 쓸 dp[r0-1][c0-1]\n\
+// traceback 은 셀당 2비트 (1 대각선, 2 위, 3 왼쪽), 행마다 (seq_b_len + 3) / 4 바이트.\n\
+// 한 바이트의 네 셀은 같은 작업 항목이 연달아 계산하므로 바이트 단위로 한 번에 쓴다.\n\
+// scan 이면 traceback 대신 행마다 끝날 수 있는 셀 중 첫 최고점 (점수, 열) 을 best[row] 에 남긴다.\n\
+// 같은 행의 타일은 tj 순서대로 실행되므로 앞 타일의 값을 이어받으면 행 전체에서 첫 최고점이 된다.\n\
+__kernel void compute_tile(\n\
+    __global const uchar* seq_a,\n\
+    __global const uchar* seq_b,\n\
+    __global int* H,\n\
+    __global int* V,\n\
+    __global int* corner,\n\
+    __global uchar* trace,\n\
     const int seq_a_len,\n\
     const int seq_b_len,\n\
-    const int diagonal_sum,  // 현재 처리 중인 대각선의 인덱스 합 (row + col)\n\
-    const int start_row,\n\
-    const int end_row)\n\
+    const int tile_diag,       // 타일 대각선 번호 (ti + tj)\n\
+    const int first_tile_row,  // 이 대각선의 첫 타일 행\n\
+    const int mode,            // 정렬 모드 (scan 일 때만 의미 있음)\n\
+    const int scan,            // 1 이면 점수 전용 탐색 (trace 대신 best)\n\
+    __global int2* best,       // scan 일 때 행마다 최고점과 그 열\n\
+    __constant char* score_table,\n\
+    __local int* pass)         // 2 * 작업 그룹 크기\n\
 {\n\
-    int thread_id = get_global_id(0);\n\
-    int row = start_row + thread_id;\n\
+    int t = get_local_id(0);\n\
+    int tile_h = get_local_size(0);\n\
+    int ti = first_tile_row + get_group_id(0);\n\
+    int tj = tile_diag - ti;\n\
+    int trace_stride = (seq_b_len + 3) / 4;\n\
+    int r0 = ti * tile_h + 1;\n\
+    int row = r0 + t;\n\
+    int last_row = min(r0 + tile_h - 1, seq_a_len);\n\
+    int c0 = tj * TILE_W + 1;\n\
+    int c1 = min(c0 + TILE_W - 1, seq_b_len);\n\
+    int active = row <= seq_a_len;\n\
     \n\
-    if (row <= end_row) {\n\
-        // 현재 대각선 합(diagonal_sum)에서 row를 빼면 col이 나옴\n\
-        int col = diagonal_sum - row;\n\
-        \n\
-        if (col >= 1 && col <= seq_b_len) {\n\
-            // 1차원 배열로 펼쳐진 행렬의 인덱스 계산\n\
-            int current_idx = row * (seq_b_len + 1) + col;\n\
-            \n\
-            // 이전 셀들의 인덱스 (대각선 위, 위, 왼쪽)\n\
-            int diagonal_idx = (row - 1) * (seq_b_len + 1) + (col - 1);\n\
-            int upper_idx = (row - 1) * (seq_b_len + 1) + col;\n\
-            int left_idx = row * (seq_b_len + 1) + (col - 1);\n\
+    // 타일 왼쪽 경계 (이전 실행에서 계산됨). V 는 반복이 끝난 뒤에만 쓴다.\n\
+    int left = 0, diag = 0;\n\
+    __constant char* srow = score_table;\n\
+    int2 rb = (int2)(0, -1);\n\
+    int row_any = 0, row_last = 0;\n\
+    if (active) {\n\
+        left = V[row];\n\
+        diag = (t == 0) ? corner[ti] : V[row - 1];\n\
+        srow = score_table + seq_a[row - 1] * NT_CODES;\n\
+        if (scan) {\n\
+            rb = best[row];\n\
+            row_any = end_row_any(mode, row, seq_a_len);\n\
+            row_last = end_row_last(mode, row, seq_a_len);\n\
+        }\n\
+    }\n\
+    barrier(CLK_GLOBAL_MEM_FENCE);\n\
+    \n\
+    uchar packed = 0;\n\
+    int steps = (c1 - c0 + 1) + tile_h - 1;\n\
+    for (int s = 0; s < steps; s++) {\n\
+        int col = c0 + s - t;\n\
+        if (active && col >= c0 && col <= c1) {\n\
+            // 첫 행은 위 타일의 마지막 행을, 나머지는 한 단계 전 이웃의 값을 쓴다\n\
+            int up = (t == 0) ? H[col] : pass[((s + 1) & 1) * tile_h + t - 1];\n\
+            int match_score = diag + srow[seq_b[col - 1]];\n\
+            int delete_score = up + GAP_PENALTY;\n\
+            int insert_score = left + GAP_PENALTY;\n\
+            int optimal_score = max3(match_score, delete_score, insert_score);\n\
             \n\
-            // 점수 계산\n\
-            int match_score = dp_matrix[diagonal_idx] + score_func(seq_a[row - 1], seq_b[col - 1]);\n\
-            int delete_score = dp_matrix[upper_idx] + GAP_PENALTY;\n\
-            int insert_score = dp_matrix[left_idx] + GAP_PENALTY;\n\
+            if (scan) {\n\
+                if ((mode & 16) && optimal_score < 0) optimal_score = 0;\n\
+                if ((row_any || (row_last && col == seq_b_len)) && optimal_score > rb.x) rb = (int2)(optimal_score, col);\n\
+            } else {\n\
+                int code = (optimal_score == match_score) ? 1 : (optimal_score == delete_score) ? 2 : 3;\n\
+                packed |= (uchar)(code << (2 * ((col - 1) & 3)));\n\
+                if (((col - 1) & 3) == 3 || col == c1) {\n\
+                    trace[(row - 1) * trace_stride + (col - 1) / 4] = packed;\n\
+                    packed = 0;\n\
+                }\n\
+            }\n\
             \n\
-            // 최적 점수 선택 및 저장\n\
+            if (t == 0 && col == c1) corner[ti] = up;\n\
+            if (row == last_row) H[col] = optimal_score;\n\
+            pass[(s & 1) * tile_h + t] = optimal_score;\n\
+            left = optimal_score;\n\
+            diag = up;\n\
+        }\n\
+        barrier(CLK_LOCAL_MEM_FENCE);\n\
+    }\n\
+    if (active) V[row] = left;\n\
+    if (active && scan) best[row] = rb;\n\
+}\n\
+\n\
+// 점수 전용 커널: 대각선 버퍼 3개만 사용 (행 인덱스 기준)\n\
+// 각 셀은 (점수, 일치 수, 갭 수) 를 들고 다닌다. 경계 셀도 이 커널이 채운다.\n\
+__kernel void score_diagonal(\n\
+    __global const uchar* seq_a,\n\
+    __global const uchar* seq_b,\n\
+    __global const int4* diag_prev2,  // 대각선 k-2\n\
+    __global const int4* diag_prev,   // 대각선 k-1\n\
+    __global int4* diag_curr,         // 대각선 k\n\
+    const int diagonal_sum,\n\
+    const int start_row,\n\
+    const int end_row,\n\
+    __constant char* score_table)\n\
+{\n\
+    int row = start_row + get_global_id(0);\n\
+    if (row > end_row) return;\n\
+    int col = diagonal_sum - row;\n\
+    \n\
+    int4 out;\n\
+    if (row == 0) {\n\
+        out = (int4)(col * GAP_PENALTY, 0, col, 0);\n\
+    } else if (col == 0) {\n\
+        out = (int4)(row * GAP_PENALTY, 0, row, 0);\n\
+    } else {\n\
+        int4 d = diag_prev2[row - 1];\n\
+        int4 u = diag_prev[row - 1];\n\
+        int4 l = diag_prev[row];\n\
+        int is_match = seq_a[row - 1] == seq_b[col - 1];\n\
+        int match_score = d.x + score_table[seq_a[row - 1] * NT_CODES + seq_b[col - 1]];\n\
+        int delete_score = u.x + GAP_PENALTY;\n\
+        int insert_score = l.x + GAP_PENALTY;\n\
+        int optimal_score = max3(match_score, delete_score, insert_score);\n\
+        \n\
+        // 전체 traceback 과 같은 우선순위 (D > U > L) 로 경로의 개수를 이어받음\n\
+        if (optimal_score == match_score) {\n\
+            out = (int4)(optimal_score, d.y + is_match, d.z, 0);\n\
+        } else if (optimal_score == delete_score) {\n\
+            out = (int4)(optimal_score, u.y, u.z + 1, 0);\n\
+        } else {\n\
+            out = (int4)(optimal_score, l.y, l.z + 1, 0);\n\
+        }\n\
+    }\n\
+    diag_curr[row] = out;\n\
+}\n\
+\n\
+// 배치 커널: 작업 항목 하나가 서열 쌍 하나를 처음부터 끝까지 정렬한다.\n\
+// 짧은 서열이 많을 때는 쌍 사이 병렬성이 대각선 안의 병렬성보다 훨씬 크다.\n\
+// 서열은 버퍼 하나에 이어 붙이고 (오프셋, 길이) 배열로 찾는다 (SoA).\n\
+// 점수 행은 rows[j * npairs + gid] 로 섞어 두어, 같은 열을 처리하는\n\
+// 이웃 작업 항목들의 접근이 연속된 주소로 모인다.\n\
+// traceback 은 쌍마다 2비트 packed 로 디바이스에만 두고, 디바이스에서 역추적해\n\
+// BAM 방식 CIGAR (길이 << 4 | 연산, 연산은 = 7, X 8, I 1, D 2) 만 돌려준다.\n\
+// 쌍마다 lenA + lenB 칸을 받아 뒤에서부터 채우므로, 마지막 out_ops 칸이 순서대로 된 CIGAR 이다.\n\
+// global 이 아닌 mode 는 aln_locate 와 같은 순서로 작업 항목 안에서 푼다: batch_scan 으로 끝 셀을,\n\
+// 뒤집은 접두사의 batch_scan 으로 시작 셀을 찾고, 그 구간만 global 로 채우고 역추적한다.\n\
+// 그래서 동점일 때의 구간과 CIGAR 도 --pairs, --hetero, CPU 프로그램, libnw 와 같다.\n\
+// 정렬된 구간은 out_region 에 (A 시작, A 끝, B 시작, B 끝) 으로 돌려준다.\n\
+\n\
+// 점수 전용 탐색: aln_scan_into 와 같은 점화식과 끝 셀 규칙 (행 우선 순서의 첫 최고점).\n\
+// rev 면 a, b 를 뒤에서부터 읽는다 (aln_locate 의 뒤집은 접두사). (최고점, i, j) 를 돌려준다\n\
+int4 batch_scan(__global const uchar* a, int lenA, __global const uchar* b, int lenB, int rev, int mode,\n\
+                __global int* rows, int npairs, int gid, __constant char* score_table)\n\
+{\n\
+    int bs = INT_MIN, bi = 0, bj = 0;\n\
+    int row_any = end_row_any(mode, 0, lenA), row_last = end_row_last(mode, 0, lenA);\n\
+    for (int j = 0; j <= lenB; j++) {\n\
+        int h = (mode & 4) ? 0 : j * GAP_PENALTY;\n\
+        rows[j * npairs + gid] = h;\n\
+        if ((row_any || (row_last && j == lenB)) && h > bs) { bs = h; bi = 0; bj = j; }\n\
+    }\n\
+    for (int i = 1; i <= lenA; i++) {\n\
+        int diag = rows[gid];\n\
+        int left = (mode & 1) ? 0 : i * GAP_PENALTY;\n\
+        rows[gid] = left;\n\
+        row_any = end_row_any(mode, i, lenA);\n\
+        row_last = end_row_last(mode, i, lenA);\n\
+        if ((row_any || (row_last && lenB == 0)) && left > bs) { bs = left; bi = i; bj = 0; }\n\
+        __constant char* srow = score_table + a[rev ? lenA - i : i - 1] * NT_CODES;\n\
+        for (int j = 1; j <= lenB; j++) {\n\
+            int up = rows[j * npairs + gid];\n\
+            int h = max3(diag + srow[b[rev ? lenB - j : j - 1]], up + GAP_PENALTY, left + GAP_PENALTY);\n\
+            if ((mode & 16) && h < 0) h = 0;\n\
+            if ((row_any || (row_last && j == lenB)) && h > bs) { bs = h; bi = i; bj = j; }\n\
+            rows[j * npairs + gid] = h;\n\
+            diag = up;\n\
+            left = h;\n\
+        }\n\
+    }\n\
+    return (int4)(bs, bi, bj, 0);\n\
+}\n\
+\n\
+__kernel void align_batch(\n\
+    __global const uchar* seqs,\n\
+    __global const int* a_off,\n\
+    __global const int* a_len,\n\
+    __global const int* b_off,\n\
+    __global const int* b_len,\n\
+    __global int* rows,\n\
+    __global uchar* trace,\n\
+    __global const ulong* trace_off,\n\
+    __global uint* cigar,\n\
+    __global const int* cigar_off,\n\
+    __global int* out_score,\n\
+    __global int* out_ops,\n\
+    __global int4* out_region,\n\
+    const int npairs,\n\
+    const int mode,\n\
+    __constant char* score_table)\n\
+{\n\
+    int gid = get_global_id(0);\n\
+    if (gid >= npairs) return;\n\
+    __global const uchar* a = seqs + a_off[gid];\n\
+    __global const uchar* b = seqs + b_off[gid];\n\
+    int fullA = a_len[gid];\n\
+    int fullB = b_len[gid];\n\
+    __global uchar* tr = trace + trace_off[gid];\n\
+    \n\
+    // 구간 [a0, a1) x [b0, b1): global 이면 전체. 뒤쪽 탐색의 mode 는 aln_mode_reverse 와 같다\n\
+    int a0 = 0, a1 = fullA, b0 = 0, b1 = fullB;\n\
+    if (mode) {\n\
+        int4 end = batch_scan(a, fullA, b, fullB, 0, mode, rows, npairs, gid, score_table);\n\
+        int rmode = (mode & 16) ? 32 : ((mode & 1) ? 2 : 0) | ((mode & 4) ? 8 : 0);\n\
+        int4 start = batch_scan(a, end.y, b, end.z, 1, rmode, rows, npairs, gid, score_table);\n\
+        a1 = end.y;\n\
+        b1 = end.z;\n\
+        a0 = a1 - start.y;\n\
+        b0 = b1 - start.z;\n\
+        a += a0;\n\
+        b += b0;\n\
+    }\n\
+    int lenA = a1 - a0;\n\
+    int lenB = b1 - b0;\n\
+    int stride = (lenB + 3) / 4;\n\
+    \n\
+    for (int j = 0; j <= lenB; j++) rows[j * npairs + gid] = j * GAP_PENALTY;\n\
+    for (int i = 1; i <= lenA; i++) {\n\
+        int diag = rows[gid];\n\
+        int left = i * GAP_PENALTY;\n\
+        rows[gid] = left;\n\
+        __constant char* srow = score_table + a[i - 1] * NT_CODES;\n\
+        uchar packed = 0;\n\
+        for (int j = 1; j <= lenB; j++) {\n\
+            int up = rows[j * npairs + gid];\n\
+            int match_score = diag + srow[b[j - 1]];\n\
+            int delete_score = up + GAP_PENALTY;\n\
+            int insert_score = left + GAP_PENALTY;\n\
             int optimal_score = max3(match_score, delete_score, insert_score);\n\
-            dp_matrix[current_idx] = optimal_score;\n\
             \n\
-            // 역추적(Traceback)을 위한 방향 기록 (D: 대각선, U: 위, L: 왼쪽)\n\
-            if (optimal_score == match_score) {\n\
-                traceback_matrix[current_idx] = 'D';\n\
-            } else if (optimal_score == delete_score) {\n\
-                traceback_matrix[current_idx] = 'U';\n\
-            } else {\n\
-                traceback_matrix[current_idx] = 'L';\n\
+            int code = (optimal_score == match_score) ? 1 : (optimal_score == delete_score) ? 2 : 3;\n\
+            packed |= (uchar)(code << (2 * ((j - 1) & 3)));\n\
+            if (((j - 1) & 3) == 3 || j == lenB) {\n\
+                tr[(i - 1) * stride + (j - 1) / 4] = packed;\n\
+                packed = 0;\n\
             }\n\
+            rows[j * npairs + gid] = optimal_score;\n\
+            diag = up;\n\
+            left = optimal_score;\n\
         }\n\
     }\n\
+    out_score[gid] = rows[lenB * npairs + gid];\n\
+    \n\
+    // 역추적: 끝에서부터 연산을 모아 run-length 로 슬롯 뒤쪽부터 기록한다 (뒤집기 없음)\n\
+    __global uint* cg = cigar + cigar_off[gid] + fullA + fullB;\n\
+    int n = 0, i = lenA, j = lenB;\n\
+    uint prev = 0, run = 0;\n\
+    while (i > 0 || j > 0) {\n\
+        int code = (i == 0) ? 3 : (j == 0) ? 2 : (tr[(i - 1) * stride + (j - 1) / 4] >> (2 * ((j - 1) & 3))) & 3;\n\
+        uint op;\n\
+        if (code == 1) { op = (a[i - 1] == b[j - 1]) ? 7 : 8; i--; j--; }\n\
+        else if (code == 2) { op = 1; i--; }\n\
+        else { op = 2; j--; }\n\
+        if (op == prev) {\n\
+            run++;\n\
+        } else {\n\
+            if (run) cg[-++n] = (run << 4) | prev;\n\
+            prev = op;\n\
+            run = 1;\n\
+        }\n\
+    }\n\
+    if (run) cg[-++n] = (run << 4) | prev;\n\
+    out_ops[gid] = n;\n\
+    out_region[gid] = (int4)(a0, a1, b0, b1);\n\
 }";
 
 // OpenCL 에러 처리 헬퍼 함수
@@ -90,268 +363,1737 @@ void handle_opencl_error(cl_int error_code, const char *operation) {
     }
 }
 
-// 문자열 뒤집기 함수 (역추적 한 결과를 뒤집어야 정렬결과)
-void rev(char *str) {
-    int len = strlen(str);
-    for (int i = 0; i < len / 2; i++) {
-        char tmp = str[i];
-        str[i] = str[len - 1 - i];
-        str[len - 1 - i] = tmp;
+// FASTA 첫 레코드를 읽어 바로 코드로 바꾼다 (len + 1 바이트). 문자는 정렬 결과를 만들 때 되살린다.
+uint8_t* read_fasta_codes(const char* path, int* len) {
+    INSTR_SCOPE("fasta");
+    char* seq = fasta_read_first(path);
+    if (!seq) return NULL;
+    *len = strlen(seq);
+    uint8_t* codes = nt_encode_dup(seq, *len);
+    free(seq);
+    return codes;
+}
+
+// 정렬 결과를 담을 구조체
+typedef struct {
+    int score;          // 최종 정렬 점수
+    int length;         // 정렬된 길이
+    int matches;        // 일치 개수
+    int mismatches;     // 불일치 개수
+    int gaps;           // 갭 개수
+    double similarity;  // 유사도 (%)
+    Cigar cigar;        // 정렬 경로 (정렬 문자열은 text 출력을 쓸 때만 cigar_gapped_codes 로 만든다)
+    AlnRegion region;   // 정렬된 구간 (global 이면 두 서열 전체). cigar 는 이 구간만 덮는다
+} AlignmentResult;
+
+double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+// -------------------------------------------------------------------------
+// 재사용 가능한 OpenCL 정렬기 핸들
+// 컨텍스트, 큐, 빌드된 프로그램과 커널, 디바이스 버퍼 풀을 한 번 만들어
+// 여러 정렬에 걸쳐 재사용한다. 프로그램 바이너리는 디스크에 캐시한다.
+// -------------------------------------------------------------------------
+typedef struct {
+    cl_mem* items;
+    int count;
+    int capacity;
+} PoolClass;
+
+typedef struct {
+    cl_platform_id platform;
+    cl_device_id device;
+    cl_context context;
+    cl_command_queue queue;          // 계산
+    cl_command_queue upload_queue;   // 호스트 -> 디바이스
+    cl_command_queue download_queue; // 디바이스 -> 호스트
+    cl_program program;
+    cl_kernel tile_kernel;      // compute_tile
+    cl_kernel score_kernel;     // score_diagonal
+    cl_kernel batch_kernel;     // align_batch
+    cl_mem score_buf;           // score_table (NT_CODES x NT_CODES, 커널의 __constant 인자)
+    cl_mem score_buf_t;         // 전치한 score_table (점수 전용 경로가 서열을 바꿨을 때)
+    size_t tile_rows;           // 타일 높이 (= compute_tile 작업 그룹 크기)
+    cl_ulong max_alloc;         // CL_DEVICE_MAX_MEM_ALLOC_SIZE
+    int program_cached;         // 디스크 캐시의 바이너리로 만들었으면 1
+    PoolClass pool[POOL_CLASSES];
+    long pool_allocs;           // clCreateBuffer 호출 수
+    long pool_reuses;           // 풀에서 꺼내 재사용한 수
+} OclAligner;
+
+// 요청 크기를 등급 크기로 올리고 등급 번호를 돌려준다
+size_t pool_class_size(size_t size, int* cls) {
+    int e = POOL_MIN_SHIFT;
+    while (e < 62 && ((size_t)1 << (e + 1)) <= size) e++;
+    size_t step = (size_t)1 << (e - 2);
+    size_t q = (size + step - 1) / step;
+    if (q < 4) q = 4;
+    *cls = (e - POOL_MIN_SHIFT) * 4 + (int)(q - 4);
+    return q * step;
+}
+
+// size 바이트 이상인 읽기/쓰기 버퍼를 풀에서 꺼내거나 새로 만든다
+cl_mem pool_acquire(OclAligner* al, size_t size) {
+    int cls;
+    size_t class_size = pool_class_size(size, &cls);
+    PoolClass* pc = &al->pool[cls];
+    if (pc->count > 0) {
+        al->pool_reuses++;
+        return pc->items[--pc->count];
     }
+    cl_int err;
+    cl_mem buf = clCreateBuffer(al->context, CL_MEM_READ_WRITE, class_size, NULL, &err);
+    handle_opencl_error(err, "clCreateBuffer (pool)");
+    al->pool_allocs++;
+    return buf;
 }
 
-// FASTA 파일 읽기 함수
-char* read_fasta(const char* filename) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        printf("Cannot open file: %s\n", filename);
-        return NULL;
+// 다 쓴 버퍼를 풀에 돌려놓는다 (size 는 pool_acquire 에 넘긴 값)
+void pool_release(OclAligner* al, cl_mem buf, size_t size) {
+    int cls;
+    pool_class_size(size, &cls);
+    PoolClass* pc = &al->pool[cls];
+    if (pc->count == POOL_KEEP) {
+        clReleaseMemObject(buf);
+        return;
     }
+    if (pc->count == pc->capacity) {
+        pc->capacity = pc->capacity ? pc->capacity * 2 : 2;
+        pc->items = (cl_mem*)realloc(pc->items, pc->capacity * sizeof(cl_mem));
+    }
+    pc->items[pc->count++] = buf;
+}
+
+// 호스트 데이터를 올린 풀 버퍼
+cl_mem pool_upload(OclAligner* al, const void* data, size_t size) {
+    cl_mem buf = pool_acquire(al, size);
+    if (size > 0) {
+        cl_int err = clEnqueueWriteBuffer(al->queue, buf, CL_TRUE, 0, size, data, 0, NULL, NULL);
+        handle_opencl_error(err, "clEnqueueWriteBuffer (pool)");
+        INSTR_COUNT(INSTR_H2D_BYTES, size);
+    }
+    return buf;
+}
 
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    rewind(file);
+uint64_t fnv1a(uint64_t h, const void* data, size_t n) {
+    const unsigned char* p = (const unsigned char*)data;
+    for (size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
 
-    char *sequence = (char*)malloc(fsize + 1);
-    if (!sequence) {
-        printf("Memory allocation failed\n");
-        fclose(file);
-        return NULL;
+// 캐시 파일 경로: <캐시 디렉터리>/<디바이스, 드라이버, 빌드 옵션, 커널 소스의 해시>.bin
+// 디렉터리는 NW_OCL_CACHE_DIR (빈 값이면 캐시 끔), $XDG_CACHE_HOME/nw_ocl, ~/.cache/nw_ocl 순
+int program_cache_path(OclAligner* al, const char* options, char* path, size_t size) {
+    const char* dir = getenv("NW_OCL_CACHE_DIR");
+    char dirbuf[768];
+    if (dir) {
+        if (!*dir) return 0;
+        mkdir(dir, 0755);
+    } else if (getenv("XDG_CACHE_HOME") && *getenv("XDG_CACHE_HOME")) {
+        mkdir(getenv("XDG_CACHE_HOME"), 0755);
+        snprintf(dirbuf, sizeof(dirbuf), "%s/nw_ocl", getenv("XDG_CACHE_HOME"));
+        mkdir(dirbuf, 0755);
+        dir = dirbuf;
+    } else if (getenv("HOME")) {
+        snprintf(dirbuf, sizeof(dirbuf), "%s/.cache", getenv("HOME"));
+        mkdir(dirbuf, 0755);
+        strncat(dirbuf, "/nw_ocl", sizeof(dirbuf) - strlen(dirbuf) - 1);
+        mkdir(dirbuf, 0755);
+        dir = dirbuf;
+    } else {
+        return 0;
     }
 
-    char line[1024];
-    int pos = 0;
-    
-    // 헤더 라인 건너뛰기 
-    while (fgets(line, sizeof(line), file)) {
-        if (line[0] == '>') continue; 
+    const cl_device_info keys[] = {CL_DEVICE_NAME, CL_DEVICE_VENDOR, CL_DEVICE_VERSION, CL_DRIVER_VERSION};
+    uint64_t h = 14695981039346656037ULL;
+    for (int k = 0; k < 4; k++) {
+        char info[256] = "";
+        clGetDeviceInfo(al->device, keys[k], sizeof(info), info, NULL);
+        h = fnv1a(h, info, strlen(info) + 1);
+    }
+    h = fnv1a(h, options, strlen(options) + 1);
+    h = fnv1a(h, kernel_source, strlen(kernel_source));
+    snprintf(path, size, "%s/%016llx.bin", dir, (unsigned long long)h);
+    return 1;
+}
 
-        for (int i = 0; line[i]; i++) {
-            if (line[i] >= 'A' && line[i] <= 'Z') {
-                sequence[pos++] = line[i];
-            }
+// 캐시된 바이너리가 있으면 그것으로, 없거나 거부되면 소스에서 빌드하고 캐시에 저장한다
+cl_program build_program(OclAligner* al, const char* options) {
+    cl_int err;
+    char path[1024];
+    int use_cache = program_cache_path(al, options, path, sizeof(path));
+
+    FILE* f = use_cache ? fopen(path, "rb") : NULL;
+    if (f) {
+        fseek(f, 0, SEEK_END);
+        size_t size = ftell(f);
+        rewind(f);
+        unsigned char* binary = (unsigned char*)malloc(size + 1);
+        size_t got = fread(binary, 1, size, f);
+        fclose(f);
+
+        cl_int status = CL_INVALID_BINARY;
+        cl_program program = NULL;
+        if (got == size && size > 0) {
+            const unsigned char* bins[1] = {binary};
+            program = clCreateProgramWithBinary(al->context, 1, &al->device, &size, bins, &status, &err);
+            if (err != CL_SUCCESS || status != CL_SUCCESS) status = CL_INVALID_BINARY;
+            else status = clBuildProgram(program, 1, &al->device, options, NULL, NULL);
         }
+        free(binary);
+        if (status == CL_SUCCESS) {
+            al->program_cached = 1;
+            return program;
+        }
+        // 드라이버가 바뀌었거나 파일이 깨졌으면 소스에서 다시 빌드
+        if (program) clReleaseProgram(program);
     }
-    sequence[pos] = '\0';
-    fclose(file);
-    return sequence;
+
+    // 프로그램 객체 생성 (소스 코드 로드)
+    cl_program program = clCreateProgramWithSource(al->context, 1, &kernel_source, NULL, &err);
+    handle_opencl_error(err, "clCreateProgramWithSource");
+
+    // 프로그램 빌드 (컴파일)
+    err = clBuildProgram(program, 1, &al->device, options, NULL, NULL);
+    if (err != CL_SUCCESS) {
+        // 빌드 실패 시 로그 출력
+        size_t log_size;
+        clGetProgramBuildInfo(program, al->device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
+        char *log = (char *)malloc(log_size);
+        clGetProgramBuildInfo(program, al->device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
+        fprintf(stderr, "커널 빌드 에러:\n%s\n", log);
+        free(log);
+        exit(EXIT_FAILURE);
+    }
+
+    // 빌드된 바이너리를 임시 파일에 쓴 뒤 rename 으로 교체 (동시 실행 시에도 깨진 파일이 보이지 않도록)
+    size_t size = 0;
+    if (use_cache && clGetProgramInfo(program, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, NULL) == CL_SUCCESS && size > 0) {
+        unsigned char* binary = (unsigned char*)malloc(size);
+        unsigned char* bins[1] = {binary};
+        char tmp[1100];
+        snprintf(tmp, sizeof(tmp), "%s.%d.tmp", path, (int)getpid());
+        FILE* out = NULL;
+        if (clGetProgramInfo(program, CL_PROGRAM_BINARIES, sizeof(bins), bins, NULL) == CL_SUCCESS &&
+            (out = fopen(tmp, "wb")) != NULL) {
+            int ok = fwrite(binary, 1, size, out) == size;
+            ok = (fclose(out) == 0) && ok;
+            if (!ok || rename(tmp, path) != 0) remove(tmp);
+        }
+        free(binary);
+    }
+    return program;
 }
 
-// 파일 경로에서 확장자를 제외한 파일명만 추출
-char* get_basename_without_ext(const char* path) {
-    char* path_copy = strdup(path);
-    char* base = basename(path_copy);
-    char* dot = strrchr(base, '.');
-    if (dot) *dot = '\0';
+// 플랫폼, 디바이스, 컨텍스트, 큐, 프로그램, 커널을 준비한다. 실패하면 종료.
+void ocl_aligner_init(OclAligner* al) {
+    INSTR_SCOPE("ocl init");
+    cl_int err;
+    memset(al, 0, sizeof(*al));
 
-    char* result = strdup(base);
-    free(path_copy);
-    return result;
+    // 플랫폼 가져오기
+    err = clGetPlatformIDs(1, &al->platform, NULL);
+    handle_opencl_error(err, "clGetPlatformIDs");
+
+    // GPU 디바이스 시도, 실패 시 CPU 사용
+    err = clGetDeviceIDs(al->platform, CL_DEVICE_TYPE_GPU, 1, &al->device, NULL);
+    if (err != CL_SUCCESS) {
+        fprintf(stderr, "GPU 디바이스를 찾을 수 없어 CPU를 사용합니다.\n");
+        err = clGetDeviceIDs(al->platform, CL_DEVICE_TYPE_CPU, 1, &al->device, NULL);
+        handle_opencl_error(err, "clGetDeviceIDs CPU");
+    }
+
+    // 컨텍스트 생성
+    al->context = clCreateContext(NULL, 1, &al->device, NULL, NULL, &err);
+    handle_opencl_error(err, "clCreateContext");
+
+    // 커맨드 큐 생성: 업로드, 계산, 다운로드를 서로 다른 큐에 두고 이벤트로 잇는다
+    // 단계별 시간을 재기 위해 프로파일링을 켠다
+    al->queue = clCreateCommandQueue(al->context, al->device, CL_QUEUE_PROFILING_ENABLE, &err);
+    handle_opencl_error(err, "clCreateCommandQueue");
+    al->upload_queue = clCreateCommandQueue(al->context, al->device, CL_QUEUE_PROFILING_ENABLE, &err);
+    handle_opencl_error(err, "clCreateCommandQueue upload");
+    al->download_queue = clCreateCommandQueue(al->context, al->device, CL_QUEUE_PROFILING_ENABLE, &err);
+    handle_opencl_error(err, "clCreateCommandQueue download");
+
+    // 서열 코드의 종류 수와 갭 점수는 빌드 옵션으로 넘긴다 (캐시 키에도 들어감)
+    // 갭 점수가 커널 안에서 상수가 되므로 갭 점수마다 따로 컴파일된 프로그램이 캐시된다
+    char options[96];
+    snprintf(options, sizeof(options), "-DNT_CODES=%d -DGAP_PENALTY=%d", NT_CODES, scoring.gap);
+    al->program = build_program(al, options);
+
+    // 커널 객체 생성
+    al->tile_kernel = clCreateKernel(al->program, "compute_tile", &err);
+    handle_opencl_error(err, "clCreateKernel compute_tile");
+    al->score_kernel = clCreateKernel(al->program, "score_diagonal", &err);
+    handle_opencl_error(err, "clCreateKernel score_diagonal");
+    al->batch_kernel = clCreateKernel(al->program, "align_batch", &err);
+    handle_opencl_error(err, "clCreateKernel align_batch");
+
+    // 점수표는 모든 실행에서 같으므로 한 번 올려 두고 커널 인자도 한 번만 설정한다
+    al->score_buf = clCreateBuffer(al->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                   sizeof(scoring.table), scoring.table, &err);
+    handle_opencl_error(err, "clCreateBuffer score_table");
+    int8_t transposed[NT_CODES * NT_CODES];
+    scoring_transpose(scoring.table, transposed);
+    al->score_buf_t = clCreateBuffer(al->context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                                     sizeof(transposed), transposed, &err);
+    handle_opencl_error(err, "clCreateBuffer score_table (transposed)");
+    clSetKernelArg(al->tile_kernel, 13, sizeof(cl_mem), &al->score_buf);
+    clSetKernelArg(al->batch_kernel, 15, sizeof(cl_mem), &al->score_buf);
+
+    // 타일 높이는 디바이스가 허용하는 작업 그룹 크기 안에서 정한다
+    size_t max_group;
+    err = clGetKernelWorkGroupInfo(al->tile_kernel, al->device, CL_KERNEL_WORK_GROUP_SIZE, sizeof(max_group), &max_group, NULL);
+    handle_opencl_error(err, "clGetKernelWorkGroupInfo");
+    al->tile_rows = OCL_TILE_H;
+    while (al->tile_rows > max_group) al->tile_rows /= 2;
+
+    err = clGetDeviceInfo(al->device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(al->max_alloc), &al->max_alloc, NULL);
+    handle_opencl_error(err, "clGetDeviceInfo");
 }
 
-// 정렬 결과를 담을 구조체
+void ocl_aligner_release(OclAligner* al) {
+    for (int c = 0; c < POOL_CLASSES; c++) {
+        for (int k = 0; k < al->pool[c].count; k++) clReleaseMemObject(al->pool[c].items[k]);
+        free(al->pool[c].items);
+    }
+    clReleaseKernel(al->tile_kernel);
+    clReleaseKernel(al->score_kernel);
+    clReleaseKernel(al->batch_kernel);
+    clReleaseMemObject(al->score_buf);
+    clReleaseMemObject(al->score_buf_t);
+    clReleaseProgram(al->program);
+    clReleaseCommandQueue(al->queue);
+    clReleaseCommandQueue(al->upload_queue);
+    clReleaseCommandQueue(al->download_queue);
+    clReleaseContext(al->context);
+}
+
+// -------------------------------------------------------------------------
+// 정렬 작업 (OclJob)
+// 한 쌍의 정렬을 제출(업로드 -> 계산 -> 다운로드를 큐에 넣기)과
+// 완료(대기 후 CPU traceback) 로 나눈다. 세 단계는 각각 다른 커맨드 큐에서
+// 이벤트로 이어지므로, 제출과 완료 사이에 다른 쌍을 제출하면 서로 겹쳐 실행된다.
+// -------------------------------------------------------------------------
+#define JOB_MAX_BUFFERS 7
+
 typedef struct {
-    int score;          // 최종 정렬 점수
-    int length;         // 정렬된 길이
-    int matches;        // 일치 개수
-    int mismatches;     // 불일치 개수
-    int gaps;           // 갭 개수
-    double similarity;  // 유사도 (%)
-    char* alignedA;     // 정렬된 서열 A
-    char* alignedB;     // 정렬된 서열 B
-} AlignmentResult;
+    int score_only;
+    int scan;                   // 모드 탐색 (ocl_scan): traceback 대신 행마다 끝 후보의 최고점
+    cl_int2 *best;              // scan 의 행별 (점수, 열) (다운로드 대상)
+    AlnRegion region;           // 정렬할 구간 (a, b 는 이미 이 구간을 가리킨다)
+    const uint8_t *a, *b;       // 서열 코드 (완료될 때까지 호출자가 들고 있음)
+    int lenA, lenB;
+    int tilesA;
+    int *H, *V, *corner;        // 업로드가 끝날 때까지 살아 있어야 하는 호스트 경계
+    unsigned char *trace;       // 2비트 packed traceback (다운로드 대상)
+    size_t trace_stride, trace_size;
+    int final_score;
+    cl_int4 last;               // 점수 전용 경로의 (점수, 일치 수, 갭 수)
+    cl_mem buf[JOB_MAX_BUFFERS];
+    size_t buf_size[JOB_MAX_BUFFERS];
+    int nbuf;
+    cl_event up_first, up_last;     // 업로드 큐
+    cl_event run_first, run_last;   // 계산 큐
+    cl_event down_first, down_last; // 다운로드 큐
+} OclJob;
+
+// 단계별 누적 시간 (초). 디바이스 단계는 이벤트 프로파일링 값
+typedef struct {
+    double read;        // FASTA 읽기 (호스트)
+    double upload;      // 호스트 -> 디바이스
+    double compute;     // 커널 실행
+    double download;    // 디바이스 -> 호스트
+    double traceback;   // traceback 과 통계, 출력 (호스트)
+    double stall;       // 호스트가 디바이스 결과를 기다린 시간
+} StageTimes;
+
+// 단계마다 첫 이벤트와 마지막 이벤트만 들고 있는다 (시간 측정과 의존성 연결용)
+void job_track(cl_event* first, cl_event* last, cl_event ev) {
+    if (!*first) {
+        *first = ev;
+        return;
+    }
+    if (*last) clReleaseEvent(*last);
+    *last = ev;
+}
+
+// 지금까지 제출한 마지막 명령의 이벤트
+cl_event job_tail(const OclJob* job) {
+    if (job->down_first) return job->down_last ? job->down_last : job->down_first;
+    if (job->run_first) return job->run_last ? job->run_last : job->run_first;
+    return job->up_last ? job->up_last : job->up_first;
+}
+
+cl_mem job_buffer(OclAligner* al, OclJob* job, size_t size) {
+    cl_mem buf = pool_acquire(al, size);
+    job->buf[job->nbuf] = buf;
+    job->buf_size[job->nbuf++] = size;
+    return buf;
+}
+
+// 업로드 큐에 비동기 쓰기를 넣고 첫/마지막 이벤트를 남긴다
+cl_mem job_upload(OclAligner* al, OclJob* job, const void* data, size_t size) {
+    cl_mem buf = job_buffer(al, job, size);
+    cl_event ev;
+    cl_int err = clEnqueueWriteBuffer(al->upload_queue, buf, CL_FALSE, 0, size, data, 0, NULL, &ev);
+    handle_opencl_error(err, "clEnqueueWriteBuffer");
+    INSTR_COUNT(INSTR_H2D_BYTES, size);
+    job_track(&job->up_first, &job->up_last, ev);
+    return buf;
+}
+
+// 계산 큐에 커널을 넣는다. 첫 커널은 업로드가 끝나기를 기다린다.
+void job_launch(OclAligner* al, OclJob* job, cl_kernel kernel, size_t global, const size_t* local, const char* what) {
+    cl_event wait = job_tail(job);
+    cl_event ev;
+    cl_int err = clEnqueueNDRangeKernel(al->queue, kernel, 1, NULL, &global, local,
+                                        job->run_first ? 0 : 1, job->run_first ? NULL : &wait, &ev);
+    handle_opencl_error(err, what);
+    INSTR_COUNT(INSTR_LAUNCHES, 1);
+    job_track(&job->run_first, &job->run_last, ev);
+}
+
+// 다운로드 큐에 비동기 읽기를 넣는다. 마지막 커널 (없으면 업로드) 이 끝나기를 기다린다.
+void job_download(OclAligner* al, OclJob* job, cl_mem buf, size_t offset, size_t size, void* dst) {
+    cl_event wait = job_tail(job);
+    cl_event ev;
+    cl_int err = clEnqueueReadBuffer(al->download_queue, buf, CL_FALSE, offset, size, dst, 1, &wait, &ev);
+    handle_opencl_error(err, "clEnqueueReadBuffer");
+    INSTR_COUNT(INSTR_D2H_BYTES, size);
+    job_track(&job->down_first, &job->down_last, ev);
+}
+
+// first 의 시작부터 last (없으면 first) 의 끝까지 (초)
+double event_span(cl_event first, cl_event last) {
+    if (!first) return 0.0;
+    cl_ulong start = 0, end = 0;
+    clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(start), &start, NULL);
+    clGetEventProfilingInfo(last ? last : first, CL_PROFILING_COMMAND_END, sizeof(end), &end, NULL);
+    return end > start ? (end - start) * 1e-9 : 0.0;
+}
+
+void job_release_event(cl_event* ev) {
+    if (*ev) clReleaseEvent(*ev);
+    *ev = NULL;
+}
 
 // -------------------------------------------------------------------------
-// Needleman-Wunsch 알고리즘 메인 함수 (OpenCL 호스트 코드)
+// Needleman-Wunsch 알고리즘 제출 (OpenCL 호스트 코드)
+// scan 이면 traceback 없이 mode 의 끝 후보만 찾는 점수 전용 탐색 (ocl_scan 참고)
 // -------------------------------------------------------------------------
-AlignmentResult needleman_wunsch_ocl(char *a, char *b, cl_context context, cl_command_queue queue, cl_kernel kernel) {
-    int lenA = strlen(a);
-    int lenB = strlen(b);
-    cl_int err;
+void ocl_tile_submit(OclAligner *al, OclJob *job, const uint8_t *a, int lenA, const uint8_t *b, int lenB, int mode, int scan) {
+    INSTR_SCOPE("submit");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    memset(job, 0, sizeof(*job));
+    cl_kernel kernel = al->tile_kernel;
+    size_t tile_rows = al->tile_rows;
+    job->scan = scan;
+    job->a = a;
+    job->b = b;
+    job->lenA = lenA;
+    job->lenB = lenB;
+    job->region = aln_region_full(lenA, lenB, 0);
 
-    // DP 행렬 및 역추적 행렬 크기 설정
-    int dp_matrix_size = (lenA + 1) * (lenB + 1);
-    int *dp_matrix = (int *)malloc(sizeof(int) * dp_matrix_size);
-    char *traceback_matrix = (char *)malloc(sizeof(char) * dp_matrix_size);
+    int tilesA = (lenA + tile_rows - 1) / tile_rows;
+    int tilesB = (lenB + OCL_TILE_W - 1) / OCL_TILE_W;
+    job->tilesA = tilesA;
 
-    // 행렬 초기화 (첫 행과 첫 열에 갭 패널티 누적)
-    for (int i = 0; i <= lenA; i++) dp_matrix[i * (lenB + 1)] = i * GAP;
-    for (int j = 0; j <= lenB; j++) dp_matrix[j] = j * GAP;
+    // 타일 경계 초기화 (첫 행과 첫 열에 갭 패널티 누적, 자유 시작이면 0)
+    // 점수 행렬 대신 O(lenA + lenB) 경계만 디바이스로 보낸다
+    job->H = (int *)malloc(sizeof(int) * (lenB + 1));
+    job->V = (int *)malloc(sizeof(int) * (lenA + 1));
+    job->corner = (int *)malloc(sizeof(int) * (tilesA + 1));
+    for (int j = 0; j <= lenB; j++) job->H[j] = aln_edge_score(&scoring, mode, ALN_FREE_B_START, j);
+    for (int i = 0; i <= lenA; i++) job->V[i] = aln_edge_score(&scoring, mode, ALN_FREE_A_START, i);
+    for (int t = 0; t <= tilesA; t++) job->corner[t] = job->V[t * (int)tile_rows < lenA ? t * (int)tile_rows : lenA];
 
-    // [중요] OpenCL 메모리 버퍼 생성 (호스트 -> 디바이스)
-    cl_mem buf_seq_a = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(char) * lenA, a, &err);
-    cl_mem buf_seq_b = clCreateBuffer(context, CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR, sizeof(char) * lenB, b, &err);
-    cl_mem buf_dp_matrix = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR, sizeof(int) * dp_matrix_size, dp_matrix, &err);
-    cl_mem buf_traceback_matrix = clCreateBuffer(context, CL_MEM_WRITE_ONLY, sizeof(char) * dp_matrix_size, NULL, &err);
+    // 2비트 packed traceback (내부 셀만, 행마다 trace_stride 바이트). scan 이면 행별 최고점만
+    job->trace_stride = ((size_t)lenB + 3) / 4;
+    job->trace_size = scan ? 0 : (size_t)lenA * job->trace_stride;
+    job->trace = (unsigned char *)malloc(job->trace_size + 1);
+    size_t best_size = sizeof(cl_int2) * (lenA + 1);
+    if (scan) {
+        job->best = (cl_int2 *)malloc(best_size);
+        for (int i = 0; i <= lenA; i++) {
+            job->best[i].s[0] = ALN_NEG_INF;
+            job->best[i].s[1] = -1;
+        }
+    }
+
+    // [중요] OpenCL 메모리 버퍼 준비 (호스트 -> 디바이스), 풀에서 재사용
+    // 빈 서열이어도 버퍼 크기가 0 이 되지 않도록 +1 (코드 버퍼는 len + 1 바이트)
+    cl_mem buf_seq_a = job_upload(al, job, a, lenA + 1);
+    cl_mem buf_seq_b = job_upload(al, job, b, lenB + 1);
+    cl_mem buf_H = job_upload(al, job, job->H, sizeof(int) * (lenB + 1));
+    cl_mem buf_V = job_upload(al, job, job->V, sizeof(int) * (lenA + 1));
+    cl_mem buf_corner = job_upload(al, job, job->corner, sizeof(int) * (tilesA + 1));
+    cl_mem buf_trace = job_buffer(al, job, job->trace_size + 1);
+    cl_mem buf_best = scan ? job_upload(al, job, job->best, best_size) : buf_H;
 
     // 커널 인자 설정 (변하지 않는 값들 먼저 설정)
     clSetKernelArg(kernel, 0, sizeof(cl_mem), &buf_seq_a);
     clSetKernelArg(kernel, 1, sizeof(cl_mem), &buf_seq_b);
-    clSetKernelArg(kernel, 2, sizeof(cl_mem), &buf_dp_matrix);
-    clSetKernelArg(kernel, 3, sizeof(cl_mem), &buf_traceback_matrix);
-    clSetKernelArg(kernel, 4, sizeof(int), &lenA);
-    clSetKernelArg(kernel, 5, sizeof(int), &lenB);
-
-    // [핵심] 대각선(Wavefront) 루프
-    // DP 테이블 채우기는 데이터 의존성 때문에 한 번에 병렬화할 수 없습니다.
-    // 하지만 대각선(k) 상의 셀들은 서로 의존성이 없으므로 동시에 계산 가능합니다.
-    for (int k = 1; k <= lenA + lenB; k++) {
-        // 현재 대각선 k에서 계산해야 할 행(row)의 범위 계산
-        int start_row = (k > lenB) ? k - lenB : 1;
-        int end_row = (k > lenA) ? lenA : k - 1;
-
-        // 대각선마다 변하는 인자 설정
-        clSetKernelArg(kernel, 6, sizeof(int), &k); // k = diagonal_sum (row + col)
-        clSetKernelArg(kernel, 7, sizeof(int), &start_row);
-        clSetKernelArg(kernel, 8, sizeof(int), &end_row);
-
-        // 작업 항목 개수(Global Work Size) 설정 및 커널 실행 요청
-        size_t global_work_size = end_row - start_row + 1;
-        if (global_work_size > 0) {
-            err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_work_size, NULL, 0, NULL, NULL);
-            handle_opencl_error(err, "clEnqueueNDRangeKernel");
-        }
+    clSetKernelArg(kernel, 2, sizeof(cl_mem), &buf_H);
+    clSetKernelArg(kernel, 3, sizeof(cl_mem), &buf_V);
+    clSetKernelArg(kernel, 4, sizeof(cl_mem), &buf_corner);
+    clSetKernelArg(kernel, 5, sizeof(cl_mem), &buf_trace);
+    clSetKernelArg(kernel, 6, sizeof(int), &lenA);
+    clSetKernelArg(kernel, 7, sizeof(int), &lenB);
+    clSetKernelArg(kernel, 10, sizeof(int), &mode);
+    clSetKernelArg(kernel, 11, sizeof(int), &scan);
+    clSetKernelArg(kernel, 12, sizeof(cl_mem), &buf_best);
+    clSetKernelArg(kernel, 14, sizeof(int) * 2 * tile_rows, NULL);
+
+    // [핵심] 타일 대각선(Wavefront) 루프
+    // 행렬을 tile_rows x OCL_TILE_W 타일로 나누면 같은 타일 대각선의 타일들은 서로 독립이다.
+    // 타일 안의 셀 대각선은 작업 그룹 안에서 barrier 로 진행하므로,
+    // 커널 실행 횟수는 lenA + lenB 에서 (lenA / tile_rows + lenB / OCL_TILE_W) 로 줄어든다.
+    // 한쪽이 빈 서열이면 내부 셀이 없으므로 커널을 실행하지 않는다.
+    for (int d = 0; tilesA > 0 && tilesB > 0 && d < tilesA + tilesB - 1; d++) {
+        int first = (d > tilesB - 1) ? d - tilesB + 1 : 0;
+        int last = (d < tilesA - 1) ? d : tilesA - 1;
+
+        clSetKernelArg(kernel, 8, sizeof(int), &d);
+        clSetKernelArg(kernel, 9, sizeof(int), &first);
+
+        // 타일 하나에 작업 그룹 하나
+        size_t local_work_size = tile_rows;
+        job_launch(al, job, kernel, (last - first + 1) * tile_rows, &local_work_size, "clEnqueueNDRangeKernel compute_tile");
+    }
+
+    // 계산 완료 후 packed traceback 과 마지막 셀 점수만 (scan 이면 행별 최고점만) 읽어온다
+    job->final_score = (lenA + lenB) * scoring.gap;
+    if (scan && job->run_first) {
+        job_download(al, job, buf_best, 0, best_size, job->best);
+    } else if (job->trace_size > 0) {
+        job_download(al, job, buf_H, sizeof(int) * lenB, sizeof(int), &job->final_score);
+        job_download(al, job, buf_trace, 0, job->trace_size, job->trace);
+    }
+
+    clFlush(al->upload_queue);
+    clFlush(al->queue);
+    clFlush(al->download_queue);
+}
+
+void needleman_wunsch_ocl_submit(OclAligner *al, OclJob *job, const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    ocl_tile_submit(al, job, a, lenA, b, lenB, ALN_GLOBAL, 0);
+}
+
+// -------------------------------------------------------------------------
+// 점수 전용 경로 제출 (traceback 없음)
+// 디바이스에는 (lenA+1) 크기의 대각선 버퍼 3개만 두고 돌려 쓴다.
+// 짧은 서열을 행 방향으로 두므로 메모리는 O(min(n, m))
+// -------------------------------------------------------------------------
+void needleman_wunsch_ocl_score_submit(OclAligner *al, OclJob *job, const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    INSTR_SCOPE("submit score");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    memset(job, 0, sizeof(*job));
+    job->region = aln_region_full(lenA, lenB, 0);
+    // 서열을 바꾸면 비대칭 치환 행렬도 원래 (a, b) 순서로 읽도록 전치한 표를 쓴다
+    cl_mem table = al->score_buf;
+    if (lenA > lenB) {
+        const uint8_t *tmp = a; a = b; b = tmp;
+        int t = lenA; lenA = lenB; lenB = t;
+        table = al->score_buf_t;
+    }
+    cl_kernel kernel = al->score_kernel;
+    job->score_only = 1;
+    job->a = a;
+    job->b = b;
+    job->lenA = lenA;
+    job->lenB = lenB;
+
+    // 빈 서열이어도 버퍼 크기가 0 이 되지 않도록 +1
+    cl_mem buf_seq_a = job_upload(al, job, a, lenA + 1);
+    cl_mem buf_seq_b = job_upload(al, job, b, lenB + 1);
+    cl_mem buf_diag[3];
+    for (int d = 0; d < 3; d++) buf_diag[d] = job_buffer(al, job, sizeof(cl_int4) * (lenA + 1));
+
+    clSetKernelArg(kernel, 0, sizeof(cl_mem), &buf_seq_a);
+    clSetKernelArg(kernel, 1, sizeof(cl_mem), &buf_seq_b);
+    clSetKernelArg(kernel, 8, sizeof(cl_mem), &table);
+
+    // 대각선 k 는 경계 셀 (row == 0, col == 0) 까지 포함해서 계산
+    for (int k = 0; k <= lenA + lenB; k++) {
+        int start_row = (k > lenB) ? k - lenB : 0;
+        int end_row = (k > lenA) ? lenA : k;
+
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &buf_diag[(k + 1) % 3]);
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &buf_diag[(k + 2) % 3]);
+        clSetKernelArg(kernel, 4, sizeof(cl_mem), &buf_diag[k % 3]);
+        clSetKernelArg(kernel, 5, sizeof(int), &k);
+        clSetKernelArg(kernel, 6, sizeof(int), &start_row);
+        clSetKernelArg(kernel, 7, sizeof(int), &end_row);
+
+        job_launch(al, job, kernel, end_row - start_row + 1, NULL, "clEnqueueNDRangeKernel score_diagonal");
     }
-    
-    // 계산 완료 후 결과 행렬을 디바이스에서 호스트로 읽어옴
-    clEnqueueReadBuffer(queue, buf_dp_matrix, CL_TRUE, 0, sizeof(int) * dp_matrix_size, dp_matrix, 0, NULL, NULL);
-    clEnqueueReadBuffer(queue, buf_traceback_matrix, CL_TRUE, 0, sizeof(char) * dp_matrix_size, traceback_matrix, 0, NULL, NULL);
 
+    // 마지막 대각선의 (lenA, lenB) 셀만 읽어온다
+    job_download(al, job, buf_diag[(lenA + lenB) % 3], sizeof(cl_int4) * lenA, sizeof(cl_int4), &job->last);
+
+    clFlush(al->upload_queue);
+    clFlush(al->queue);
+    clFlush(al->download_queue);
+}
+
+// 2비트 packed traceback (1 대각선, 2 위, 3 왼쪽) 으로 CIGAR 와 통계를 만든다
+AlignmentResult traceback_packed(const uint8_t *a, const uint8_t *b, int lenA, int lenB,
+                                 const unsigned char *trace, size_t trace_stride, int score) {
+    INSTR_SCOPE("traceback");
     // ---------------------------------------------------------------------
-    // 역추적 (Traceback) 단계 - CPU에서 수행
+    // 역추적 (Traceback) 단계 - CPU에서 수행 (common/linear_fill.h 의 linear_traceback)
     // 행렬의 우하단 끝에서부터 좌상단(0,0)으로 이동하며 경로 복원
+    // 첫 행은 항상 왼쪽, 첫 열은 항상 위쪽이다
+    // CIGAR 를 앞쪽으로 쌓으므로 끝나면 이미 순서대로이다 (뒤집기, 정렬 문자열 없음)
     // ---------------------------------------------------------------------
-    char *alignedA = (char*)malloc(lenA + lenB + 1);
-    char *alignedB = (char*)malloc(lenA + lenB + 1);
-    int ai = 0, bi = 0;
-    int i = lenA, j = lenB;
-
-    while (i > 0 || j > 0) {
-        if (i > 0 && j > 0 && traceback_matrix[i * (lenB + 1) + j] == 'D') {
-            // 대각선 이동: 매치 또는 미스매치
-            alignedA[ai++] = a[i - 1];
-            alignedB[bi++] = b[j - 1];
-            i--; j--;
-        } else if (i > 0 && traceback_matrix[i * (lenB + 1) + j] == 'U') {
-            // 위쪽 이동: 서열 B에 갭(_) 추가
-            alignedA[ai++] = a[i - 1];
-            alignedB[bi++] = '_';
-            i--;
-        } else if (j > 0 && traceback_matrix[i * (lenB + 1) + j] == 'L') {
-            // 왼쪽 이동: 서열 A에 갭(_) 추가
-            alignedA[ai++] = '_';
-            alignedB[bi++] = b[j - 1];
-            j--;
-        } else break; // 오류 방지용 탈출
-    }
-
-    // 문자열 끝 처리 및 뒤집기 (역추적했으므로 순서가 반대임)
-    alignedA[ai] = '\0';
-    alignedB[bi] = '\0';
-    rev(alignedA);
-    rev(alignedB);
+    AlignmentResult result;
+    cigar_init(&result.cigar);
+    linear_traceback(trace, trace_stride, a, b, lenA, lenB, &result.cigar);
 
     // 결과 통계 계산
-    int matches = 0, mismatches = 0, gaps = 0;
-    for (int k = 0; alignedA[k] && alignedB[k]; k++) {
-        if (alignedA[k] == '_' || alignedB[k] == '_') {
-            gaps++;
-        } else if (alignedA[k] == alignedB[k]) {
-            matches++;
+    result.score = score; // 마지막 셀의 값이 최종 점수
+    result.length = cigar_stats(&result.cigar, &result.matches, &result.mismatches, &result.gaps);
+    result.similarity = result.length > 0 ? (double)result.matches / result.length * 100.0 : 0.0;
+    result.region = aln_region_full(lenA, lenB, score);
+    return result;
+}
+
+// --format 이 text 가 아닐 때 쌍 하나를 레코드로 쓴다
+void write_pair_record(FILE* out, const char* name1, int len1, const char* name2, int len2, const AlignmentResult* r) {
+    INSTR_SCOPE("output");
+    AlnRecord rec = aln_record_region(name1, len1, name2, len2, &r->region, &r->cigar);
+    aln_write(out, out_format, &rec);
+}
+
+// 작업이 쓴 호스트 메모리, 디바이스 버퍼 (풀로), 이벤트를 놓는다
+void ocl_job_release(OclAligner *al, OclJob *job) {
+    free(job->H);
+    free(job->V);
+    free(job->corner);
+    free(job->trace);
+    free(job->best);
+    for (int k = 0; k < job->nbuf; k++) pool_release(al, job->buf[k], job->buf_size[k]);
+    job_release_event(&job->up_first);
+    job_release_event(&job->up_last);
+    job_release_event(&job->run_first);
+    job_release_event(&job->run_last);
+    job_release_event(&job->down_first);
+    job_release_event(&job->down_last);
+}
+
+// -------------------------------------------------------------------------
+// 작업 완료: 다운로드를 기다린 뒤 traceback 과 통계 계산 (CPU)
+// times 가 있으면 단계별 시간을 더한다
+// -------------------------------------------------------------------------
+AlignmentResult ocl_job_finish(OclAligner *al, OclJob *job, StageTimes *times) {
+    double wait_start = wall_time();
+    cl_event done = job_tail(job);
+    if (done) {
+        INSTR_SCOPE("wait");
+        clWaitForEvents(1, &done);
+    }
+    double host_start = wall_time();
+
+    int lenA = job->lenA, lenB = job->lenB;
+    const uint8_t *a = job->a, *b = job->b;
+    AlignmentResult result;
+
+    if (job->score_only) {
+        result.score = job->last.s[0];
+        result.matches = job->last.s[1];
+        result.gaps = job->last.s[2];
+        result.mismatches = (lenA + lenB - result.gaps) / 2 - result.matches;
+        result.length = result.matches + result.mismatches + result.gaps;
+        result.similarity = result.length > 0 ? (double)result.matches / result.length * 100.0 : 0.0;
+        cigar_init(&result.cigar);
+    } else {
+        result = traceback_packed(a, b, lenA, lenB, job->trace, job->trace_stride, job->final_score);
+    }
+    result.region = job->region;
+    result.region.score = result.score;
+
+    if (times) {
+        times->stall += host_start - wait_start;
+        times->upload += event_span(job->up_first, job->up_last);
+        times->compute += event_span(job->run_first, job->run_last);
+        times->download += event_span(job->down_first, job->down_last);
+        times->traceback += wall_time() - host_start;
+    }
+
+    // 메모리 해제 (버퍼는 풀로)
+    ocl_job_release(al, job);
+    return result;
+}
+
+// 한 쌍을 동기적으로 정렬
+AlignmentResult needleman_wunsch_ocl(const uint8_t *a, int lenA, const uint8_t *b, int lenB, OclAligner *al) {
+    OclJob job;
+    needleman_wunsch_ocl_submit(al, &job, a, lenA, b, lenB);
+    return ocl_job_finish(al, &job, NULL);
+}
+
+// -------------------------------------------------------------------------
+// 정렬 모드 (--mode, --free-ends)
+// 디바이스에서 점수 전용 탐색으로 끝 셀을, 뒤집은 접두사를 한 번 더 탐색해 시작 셀을 찾고
+// (aln_locate 와 같은 두 단계), 그 구간만 기존 global 경로로 정렬한다.
+// -------------------------------------------------------------------------
+
+// aln_scan 의 디바이스 판: compute_tile 의 행별 최고점에 경계 셀을 행 우선 순서로 더해 고른다
+AlnEnd ocl_scan(OclAligner *al, int mode, const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    OclJob job;
+    ocl_tile_submit(al, &job, a, lenA, b, lenB, mode, 1);
+    cl_event done = job_tail(&job);
+    if (done) {
+        INSTR_SCOPE("wait");
+        clWaitForEvents(1, &done);
+    }
+
+    AlnEnd best = {ALN_NEG_INF, -1, -1};
+    for (int i = 0; i <= lenA; i++) {
+        if (i == 0) {
+            for (int j = 0; j <= lenB; j++)
+                if (aln_end_cell(mode, 0, j, lenA, lenB)) aln_end_offer(&best, job.H[j], 0, j);
+            continue;
+        }
+        if (aln_end_cell(mode, i, 0, lenA, lenB)) aln_end_offer(&best, job.V[i], i, 0);
+        if (job.best[i].s[1] > 0) aln_end_offer(&best, job.best[i].s[0], i, job.best[i].s[1]);
+    }
+    ocl_job_release(al, &job);
+    return best;
+}
+
+// aln_locate 의 디바이스 판
+AlnRegion ocl_locate(OclAligner *al, int mode, const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    INSTR_SCOPE("locate");
+    AlnEnd end = ocl_scan(al, mode, a, lenA, b, lenB);
+    uint8_t *ra = aln_reverse_dup(a, end.i);
+    uint8_t *rb = aln_reverse_dup(b, end.j);
+    AlnEnd start = ocl_scan(al, aln_mode_reverse(mode), ra, end.i, rb, end.j);
+    free(ra);
+    free(rb);
+    AlnRegion r = {end.score, end.i - start.i, end.i, end.j - start.j, end.j};
+    return r;
+}
+
+// aln_mode 에 따라 구간을 찾고 (global 이면 전체) 그 구간의 정렬을 제출한다.
+// 구간 탐색은 동기적이고, 이어지는 정렬은 다른 제출과 겹쳐 실행된다.
+void ocl_align_submit(OclAligner *al, OclJob *job, const uint8_t *a, int lenA, const uint8_t *b, int lenB, int score_only) {
+    AlnRegion region = aln_mode == ALN_GLOBAL ? aln_region_full(lenA, lenB, 0)
+                                              : ocl_locate(al, aln_mode, a, lenA, b, lenB);
+    const uint8_t *sa = a + region.a_start, *sb = b + region.b_start;
+    int subA = region.a_end - region.a_start, subB = region.b_end - region.b_start;
+    if (score_only) needleman_wunsch_ocl_score_submit(al, job, sa, subA, sb, subB);
+    else needleman_wunsch_ocl_submit(al, job, sa, subA, sb, subB);
+    job->region = region;
+}
+
+AlignmentResult ocl_align(OclAligner *al, const uint8_t *a, int lenA, const uint8_t *b, int lenB, int score_only) {
+    OclJob job;
+    ocl_align_submit(al, &job, a, lenA, b, lenB, score_only);
+    return ocl_job_finish(al, &job, NULL);
+}
+
+// -------------------------------------------------------------------------
+// 배치 경로 (쌍 하나에 작업 항목 하나)
+// -------------------------------------------------------------------------
+typedef struct {
+    char* name;
+    uint8_t* seq;   // 코드, 디바이스로 그대로 복사된다
+    int len;
+} SeqRecord;
+
+typedef struct {
+    SeqRecord* items;
+    int count;
+    int capacity;
+} SeqTable;
+
+// 한 번에 디바이스로 보내는 쌍 수와 묶음 하나의 디바이스 메모리 상한 (batch_device_bytes)
+#define BATCH_MAX_PAIRS 65536
+#define BATCH_DEVICE_BYTES (256UL << 20)
+
+void seq_table_add(SeqTable* table, char* name, const char* seq, size_t len) {
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 16;
+        table->items = (SeqRecord*)realloc(table->items, table->capacity * sizeof(SeqRecord));
+    }
+    SeqRecord* rec = &table->items[table->count++];
+    rec->name = name;
+    rec->seq = nt_encode_dup(seq, len);
+    rec->len = len;
+}
+
+void seq_table_free(SeqTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i].name);
+        free(table->items[i].seq);
+    }
+    free(table->items);
+}
+
+// 정렬 비용(lenA * lenB) 내림차순 정렬용
+static const SeqRecord *sort_reads, *sort_targets;
+static const int *sort_target_of;
+
+void seq_table_add_record(SeqTable* table, const FastaReader* r) {
+    seq_table_add(table, strdup(r->name), r->seq, r->seq_len);
+}
+
+int compare_pair_cost(const void* x, const void* y) {
+    int p = *(const int*)x, q = *(const int*)y;
+    long cp = (long)sort_reads[p].len * sort_targets[sort_target_of[p]].len;
+    long cq = (long)sort_reads[q].len * sort_targets[sort_target_of[q]].len;
+    return (cp < cq) - (cp > cq);
+}
+
+// 배치 전체의 누적 통계
+typedef struct {
+    int pairs;
+    int host_pairs;     // 혼자서도 디바이스 상한을 넘어 CPU 에서 정렬한 쌍
+    long long cells;
+    int launches;
+    double seconds;
+} BatchStats;
+
+// 묶음에서 쌍 수와 길이에 따라 커지는 버퍼 세 개 (쌍마다 B 길이의 행 하나, traceback, CIGAR) 가
+// 풀에서 실제로 차지하는 바이트 (등급 크기로 올림). 합이 상한 안이면 버퍼 하나하나도 max_alloc 안이다
+size_t batch_device_bytes(int pairs, int max_lenB, size_t trace_bytes, size_t cigar_ops) {
+    int cls;
+    return pool_class_size(sizeof(int) * (size_t)(max_lenB + 1) * pairs, &cls)
+         + pool_class_size(trace_bytes + 1, &cls)
+         + pool_class_size(sizeof(cl_uint) * (cigar_ops + 1), &cls);
+}
+
+AlignmentResult needleman_wunsch_cpu_mode(const uint8_t *a, int lenA, const uint8_t *b, int lenB);
+
+// reads[k] 를 targets[target_of[k]] 에 정렬하고 입력 순서대로 TSV 한 줄씩 출력한다.
+// 비용이 비슷한 쌍끼리 같은 작업 그룹에 모이도록 비용순으로 정렬한 뒤
+// 메모리 상한 안에서 잘라 여러 번 실행한다.
+int needleman_wunsch_ocl_batch(SeqTable* reads, SeqTable* targets, const int* target_of, OclAligner* al, FILE* out, BatchStats* stats) {
+    INSTR_SCOPE("batch");
+    int npairs = reads->count;
+    cl_command_queue queue = al->queue;
+    cl_kernel kernel = al->batch_kernel;
+    cl_int err;
+
+    int* order = (int*)malloc(sizeof(int) * (npairs + 1));
+    for (int k = 0; k < npairs; k++) order[k] = k;
+    sort_reads = reads->items;
+    sort_targets = targets->items;
+    sort_target_of = target_of;
+    qsort(order, npairs, sizeof(int), compare_pair_cost);
+
+    int* scores = (int*)malloc(sizeof(int) * (npairs + 1));
+    AlnRegion* regions = (AlnRegion*)malloc(sizeof(AlnRegion) * (npairs + 1));
+    Cigar* cigars = (Cigar*)calloc(npairs + 1, sizeof(Cigar));
+    size_t budget = al->max_alloc < BATCH_DEVICE_BYTES ? al->max_alloc : BATCH_DEVICE_BYTES;
+
+    double start = wall_time();
+    long long cells = 0;
+    int launches = 0;
+
+    // 혼자서도 상한을 넘는 쌍은 디바이스에 보내지 않고 CPU 에서 정렬한다 (order 의 앞쪽 ndev 개만 디바이스로)
+    int ndev = 0, nhost = 0;
+    int* host = (int*)malloc(sizeof(int) * (npairs + 1));
+    for (int k = 0; k < npairs; k++) {
+        const SeqRecord* ra = &reads->items[order[k]];
+        const SeqRecord* rb = &targets->items[target_of[order[k]]];
+        size_t t = (size_t)ra->len * ((rb->len + 3) / 4);
+        if (batch_device_bytes(1, rb->len, t, (size_t)ra->len + rb->len) > budget) host[nhost++] = order[k];
+        else order[ndev++] = order[k];
+    }
+    for (int k = 0; k < nhost; k++) {
+        int p = host[k];
+        const SeqRecord* ra = &reads->items[p];
+        const SeqRecord* rb = &targets->items[target_of[p]];
+        AlignmentResult r = needleman_wunsch_cpu_mode(ra->seq, ra->len, rb->seq, rb->len);
+        scores[p] = r.score;
+        regions[p] = r.region;
+        cigars[p] = r.cigar;
+        cells += (long long)ra->len * rb->len;
+    }
+    free(host);
+
+    for (int first = 0; first < ndev; ) {
+        // 이번 묶음의 범위 결정: 행 버퍼, traceback, CIGAR 를 합쳐 상한 안에서 (첫 쌍은 위에서 확인함)
+        size_t trace_bytes = 0, seq_bytes = 0, cigar_ops = 0;
+        int max_lenB = 0, last = first;
+        while (last < ndev && last - first < BATCH_MAX_PAIRS) {
+            const SeqRecord* ra = &reads->items[order[last]];
+            const SeqRecord* rb = &targets->items[target_of[order[last]]];
+            size_t t = (size_t)ra->len * ((rb->len + 3) / 4);
+            int lenB = rb->len > max_lenB ? rb->len : max_lenB;
+            if (last > first &&
+                batch_device_bytes(last - first + 1, lenB, trace_bytes + t, cigar_ops + ra->len + rb->len) > budget)
+                break;
+            trace_bytes += t;
+            seq_bytes += ra->len + rb->len;
+            cigar_ops += ra->len + rb->len;
+            max_lenB = lenB;
+            last++;
+        }
+        int n = last - first;
+
+        // SoA 입력 구성
+        uint8_t* seqs = (uint8_t*)malloc(seq_bytes + 1);
+        int* a_off = (int*)malloc(sizeof(int) * n);
+        int* a_len = (int*)malloc(sizeof(int) * n);
+        int* b_off = (int*)malloc(sizeof(int) * n);
+        int* b_len = (int*)malloc(sizeof(int) * n);
+        cl_ulong* trace_off = (cl_ulong*)malloc(sizeof(cl_ulong) * n);
+        int* cigar_off = (int*)malloc(sizeof(int) * n);
+        size_t pos = 0, tpos = 0, cpos = 0;
+        for (int k = 0; k < n; k++) {
+            const SeqRecord* ra = &reads->items[order[first + k]];
+            const SeqRecord* rb = &targets->items[target_of[order[first + k]]];
+            a_off[k] = pos; a_len[k] = ra->len;
+            memcpy(seqs + pos, ra->seq, ra->len); pos += ra->len;
+            b_off[k] = pos; b_len[k] = rb->len;
+            memcpy(seqs + pos, rb->seq, rb->len); pos += rb->len;
+            trace_off[k] = tpos; tpos += (size_t)ra->len * ((rb->len + 3) / 4);
+            cigar_off[k] = cpos; cpos += ra->len + rb->len;
+            cells += (long long)ra->len * rb->len;
+        }
+
+        // 빈 서열만 있어도 버퍼 크기가 0 이 되지 않도록 +1
+        size_t rows_size = sizeof(int) * (size_t)(max_lenB + 1) * n;
+        cl_mem buf_seqs = pool_upload(al, seqs, seq_bytes + 1);
+        cl_mem buf_a_off = pool_upload(al, a_off, sizeof(int) * n);
+        cl_mem buf_a_len = pool_upload(al, a_len, sizeof(int) * n);
+        cl_mem buf_b_off = pool_upload(al, b_off, sizeof(int) * n);
+        cl_mem buf_b_len = pool_upload(al, b_len, sizeof(int) * n);
+        cl_mem buf_rows = pool_acquire(al, rows_size);
+        cl_mem buf_trace = pool_acquire(al, trace_bytes + 1);
+        cl_mem buf_trace_off = pool_upload(al, trace_off, sizeof(cl_ulong) * n);
+        cl_mem buf_cigar = pool_acquire(al, sizeof(cl_uint) * (cigar_ops + 1));
+        cl_mem buf_cigar_off = pool_upload(al, cigar_off, sizeof(int) * n);
+        cl_mem buf_score = pool_acquire(al, sizeof(int) * n);
+        cl_mem buf_ops = pool_acquire(al, sizeof(int) * n);
+        cl_mem buf_region = pool_acquire(al, sizeof(cl_int4) * n);
+
+        clSetKernelArg(kernel, 0, sizeof(cl_mem), &buf_seqs);
+        clSetKernelArg(kernel, 1, sizeof(cl_mem), &buf_a_off);
+        clSetKernelArg(kernel, 2, sizeof(cl_mem), &buf_a_len);
+        clSetKernelArg(kernel, 3, sizeof(cl_mem), &buf_b_off);
+        clSetKernelArg(kernel, 4, sizeof(cl_mem), &buf_b_len);
+        clSetKernelArg(kernel, 5, sizeof(cl_mem), &buf_rows);
+        clSetKernelArg(kernel, 6, sizeof(cl_mem), &buf_trace);
+        clSetKernelArg(kernel, 7, sizeof(cl_mem), &buf_trace_off);
+        clSetKernelArg(kernel, 8, sizeof(cl_mem), &buf_cigar);
+        clSetKernelArg(kernel, 9, sizeof(cl_mem), &buf_cigar_off);
+        clSetKernelArg(kernel, 10, sizeof(cl_mem), &buf_score);
+        clSetKernelArg(kernel, 11, sizeof(cl_mem), &buf_ops);
+        clSetKernelArg(kernel, 12, sizeof(cl_mem), &buf_region);
+        clSetKernelArg(kernel, 13, sizeof(int), &n);
+        clSetKernelArg(kernel, 14, sizeof(int), &aln_mode);
+
+        size_t global_work_size = n;
+        err = clEnqueueNDRangeKernel(queue, kernel, 1, NULL, &global_work_size, NULL, 0, NULL, NULL);
+        handle_opencl_error(err, "clEnqueueNDRangeKernel align_batch");
+        launches++;
+        INSTR_COUNT(INSTR_LAUNCHES, 1);
+
+        // 점수와 CIGAR 만 읽어온다 (traceback 은 디바이스에 남김)
+        int* batch_score = (int*)malloc(sizeof(int) * n);
+        int* batch_ops = (int*)malloc(sizeof(int) * n);
+        cl_int4* batch_region = (cl_int4*)malloc(sizeof(cl_int4) * n);
+        cl_uint* ops = (cl_uint*)malloc(sizeof(cl_uint) * (cigar_ops + 1));
+        err = clEnqueueReadBuffer(queue, buf_score, CL_TRUE, 0, sizeof(int) * n, batch_score, 0, NULL, NULL);
+        handle_opencl_error(err, "clEnqueueReadBuffer score");
+        err = clEnqueueReadBuffer(queue, buf_ops, CL_TRUE, 0, sizeof(int) * n, batch_ops, 0, NULL, NULL);
+        handle_opencl_error(err, "clEnqueueReadBuffer ops");
+        err = clEnqueueReadBuffer(queue, buf_region, CL_TRUE, 0, sizeof(cl_int4) * n, batch_region, 0, NULL, NULL);
+        handle_opencl_error(err, "clEnqueueReadBuffer region");
+        if (cigar_ops > 0) {
+            err = clEnqueueReadBuffer(queue, buf_cigar, CL_TRUE, 0, sizeof(cl_uint) * cigar_ops, ops, 0, NULL, NULL);
+            handle_opencl_error(err, "clEnqueueReadBuffer cigar");
+        }
+        INSTR_COUNT(INSTR_D2H_BYTES, (sizeof(int) * 2 + sizeof(cl_int4)) * n + sizeof(cl_uint) * cigar_ops);
+
+        // 쌍마다 슬롯 끝의 batch_ops[k] 칸이 CIGAR 이다. 출력은 입력 순서이므로 복사해 둔다
+        for (int k = 0; k < n; k++) {
+            int p = order[first + k];
+            int slot = a_len[k] + b_len[k];
+            cl_uint* cg = ops + cigar_off[k] + slot - batch_ops[k];
+            for (int e = 0; e < batch_ops[k]; e++) cigar_append(&cigars[p], cg[e] & 15, cg[e] >> 4);
+            scores[p] = batch_score[k];
+            AlnRegion r = {batch_score[k], batch_region[k].s[0], batch_region[k].s[1],
+                           batch_region[k].s[2], batch_region[k].s[3]};
+            regions[p] = r;
+        }
+
+        free(batch_score);
+        free(batch_ops);
+        free(batch_region);
+        free(ops);
+        free(seqs);
+        free(a_off);
+        free(a_len);
+        free(b_off);
+        free(b_len);
+        free(trace_off);
+        free(cigar_off);
+        pool_release(al, buf_seqs, seq_bytes + 1);
+        pool_release(al, buf_a_off, sizeof(int) * n);
+        pool_release(al, buf_a_len, sizeof(int) * n);
+        pool_release(al, buf_b_off, sizeof(int) * n);
+        pool_release(al, buf_b_len, sizeof(int) * n);
+        pool_release(al, buf_rows, rows_size);
+        pool_release(al, buf_trace, trace_bytes + 1);
+        pool_release(al, buf_trace_off, sizeof(cl_ulong) * n);
+        pool_release(al, buf_cigar, sizeof(cl_uint) * (cigar_ops + 1));
+        pool_release(al, buf_cigar_off, sizeof(int) * n);
+        pool_release(al, buf_score, sizeof(int) * n);
+        pool_release(al, buf_ops, sizeof(int) * n);
+        pool_release(al, buf_region, sizeof(cl_int4) * n);
+
+        first = last;
+    }
+
+    stats->pairs += npairs;
+    stats->host_pairs += nhost;
+    stats->cells += cells;
+    INSTR_COUNT(INSTR_CELLS, cells);
+    stats->launches += launches;
+    stats->seconds += wall_time() - start;
+
+    for (int p = 0; p < npairs; p++) {
+        const SeqRecord* ra = &reads->items[p];
+        const SeqRecord* rb = &targets->items[target_of[p]];
+        if (out_format == ALN_TEXT) {
+            int matches, mismatches, gaps;
+            cigar_stats(&cigars[p], &matches, &mismatches, &gaps);
+            fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t", ra->name, rb->name, ra->len, rb->len,
+                    scores[p], matches, mismatches, gaps);
+            if (aln_mode != ALN_GLOBAL)
+                fprintf(out, "%d\t%d\t%d\t%d\t", regions[p].a_start, regions[p].a_end, regions[p].b_start, regions[p].b_end);
+            cigar_write(out, &cigars[p]);
+            putc('\n', out);
         } else {
-            mismatches++;
+            AlnRecord rec = aln_record_region(ra->name, ra->len, rb->name, rb->len, &regions[p], &cigars[p]);
+            aln_write(out, out_format, &rec);
         }
+        cigar_free(&cigars[p]);
     }
+    fflush(out);
 
-    double similarity = (double)matches / (matches + mismatches + gaps) * 100.0;
+    free(order);
+    free(scores);
+    free(regions);
+    free(cigars);
+    return 0;
+}
 
-    // 결과 구조체 생성
-    AlignmentResult result;
-    result.score = dp_matrix[dp_matrix_size - 1]; // 마지막 셀의 값이 최종 점수
-    result.length = ai;
-    result.matches = matches;
-    result.mismatches = mismatches;
-    result.gaps = gaps;
-    result.similarity = similarity;
-    result.alignedA = alignedA;
-    result.alignedB = alignedB;
-
-    // 메모리 해제
-    free(dp_matrix);
-    free(traceback_matrix);
-    clReleaseMemObject(buf_seq_a);
-    clReleaseMemObject(buf_seq_b);
-    clReleaseMemObject(buf_dp_matrix);
-    clReleaseMemObject(buf_traceback_matrix);
+// --batch: reads 를 BATCH_MAX_PAIRS 개씩 읽으면서 바로 정렬하고 출력한다 (파일 전체를 먼저 읽지 않음).
+// targets 가 레코드 하나면 모든 read 를 그 서열에, 아니면 같은 순서의 레코드끼리 정렬한다.
+int ocl_batch_stream(const char* reads_path, const char* targets_path, OclAligner* al, FILE* out) {
+    FastaReader rr, tr;
+    if (fasta_open(&rr, reads_path) != 0) return 1;
+    if (fasta_open(&tr, targets_path) != 0) {
+        fasta_close(&rr);
+        return 1;
+    }
+    if (fasta_next(&tr) <= 0) {
+        printf("targets 에 레코드가 없습니다: %s\n", targets_path);
+        fasta_close(&rr);
+        fasta_close(&tr);
+        return 1;
+    }
+
+    // 첫 target 뒤에 레코드가 더 있으면 (pending) 같은 순서끼리 짝짓는다
+    int paired = tr.pending;
+    int have_target = paired;   // tr 에 아직 쓰지 않은 target 이 들어 있음
+    SeqTable fixed = {NULL, 0, 0};
+    if (!paired) seq_table_add_record(&fixed, &tr);
+
+    if (out_format == ALN_TEXT) {
+        fprintf(out, "#query\ttarget\tlenA\tlenB\tscore\tmatches\tmismatches\tgaps\t%scigar\n",
+                aln_mode != ALN_GLOBAL ? "startA\tendA\tstartB\tendB\t" : "");
+    } else if (paired) {
+        aln_write_header(out, out_format, "nw_ocl_generic", NULL, NULL, 0);
+    } else {
+        const char* target = fixed.items[0].name;
+        aln_write_header(out, out_format, "nw_ocl_generic", &target, &fixed.items[0].len, 1);
+    }
+    BatchStats stats = {0, 0, 0, 0, 0.0};
+    int* target_of = (int*)malloc(sizeof(int) * BATCH_MAX_PAIRS);
+    int done = 0, mismatch = 0;
+
+    while (!done) {
+        SeqTable reads = {NULL, 0, 0}, targets = {NULL, 0, 0};
+        {
+            INSTR_SCOPE("fasta");
+            while (reads.count < BATCH_MAX_PAIRS) {
+                if (fasta_next(&rr) <= 0) {
+                    done = 1;
+                    break;
+                }
+                if (paired) {
+                    if (!have_target && fasta_next(&tr) <= 0) {
+                        mismatch = done = 1;
+                        break;
+                    }
+                    have_target = 0;
+                    seq_table_add_record(&targets, &tr);
+                }
+                target_of[reads.count] = paired ? reads.count : 0;
+                seq_table_add_record(&reads, &rr);
+            }
+        }
+        if (reads.count > 0) needleman_wunsch_ocl_batch(&reads, paired ? &targets : &fixed, target_of, al, out, &stats);
+        seq_table_free(&reads);
+        seq_table_free(&targets);
+    }
+    if (paired && (have_target || fasta_next(&tr) > 0)) mismatch = 1;
+    if (mismatch) printf("reads 와 targets 의 레코드 수가 다릅니다 (짝이 있는 %d 쌍만 정렬).\n", stats.pairs);
+
+    fprintf(stderr, "%d 쌍 정렬 완료: %.4f 초, 커널 실행 %d 회, %.3f GCUPS\n", stats.pairs, stats.seconds, stats.launches,
+            stats.seconds > 0 ? stats.cells / stats.seconds / 1e9 : 0.0);
+    if (stats.host_pairs > 0)
+        fprintf(stderr, "  그중 %d 쌍은 혼자서도 디바이스 메모리 상한을 넘어 CPU 에서 정렬\n", stats.host_pairs);
+
+    free(target_of);
+    seq_table_free(&fixed);
+    fasta_close(&rr);
+    fasta_close(&tr);
+    return mismatch;
+}
+
+// global 이 아닌 모드의 TSV 는 줄 끝에 정렬된 구간 (startA endA startB endB) 을 붙인다
+void print_region_columns(FILE* out, const AlnRegion* r) {
+    if (aln_mode != ALN_GLOBAL) fprintf(out, "\t%d\t%d\t%d\t%d", r->a_start, r->a_end, r->b_start, r->b_end);
+}
+
+// 파이프라인에서 기다리는 쌍 하나
+typedef struct {
+    OclJob job;
+    uint8_t *seq1, *seq2;
+    int len1, len2;
+    char *name1, *name2;
+    double submitted;
+} PendingPair;
+
+// 완료를 기다려 결과 한 줄을 출력하고 슬롯을 비운다
+void pending_pair_finish(OclAligner* al, PendingPair* p, StageTimes* times, FILE* out) {
+    AlignmentResult result = ocl_job_finish(al, &p->job, times);
+    double host_start = wall_time();
+    if (out_format == ALN_TEXT) {
+        fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2f\t%.4f",
+                p->name1, p->name2, p->len1, p->len2, result.score, result.length,
+                result.matches, result.mismatches, result.gaps, result.similarity, wall_time() - p->submitted);
+        print_region_columns(out, &result.region);
+        putc('\n', out);
+    } else {
+        write_pair_record(out, p->name1, p->len1, p->name2, p->len2, &result);
+    }
+    fflush(out);
+    cigar_free(&result.cigar);
+    free(p->seq1);
+    free(p->seq2);
+    free(p->name1);
+    free(p->name2);
+    times->traceback += wall_time() - host_start;
+}
+
+// 쌍 목록: 한 줄에 "<fasta_a> <fasta_b>", '#' 은 주석. 정렬기 핸들 하나로 모든 쌍을 처리한다.
+// 쌍 k 를 제출한 다음 쌍 k-1 을 완료하므로, 쌍 k+1 의 읽기/업로드와 쌍 k 의 계산,
+// 쌍 k-1 의 traceback/출력이 겹친다. seconds 열은 제출부터 출력까지의 시간.
+int ocl_pair_list(const char* list_path, OclAligner* al, int score_only, FILE* out) {
+    FILE* list = fopen(list_path, "r");
+    if (!list) {
+        printf("Cannot open file: %s\n", list_path);
+        return 1;
+    }
+
+    if (out_format == ALN_TEXT)
+        fprintf(out, "#seqA\tseqB\tlenA\tlenB\tscore\taligned_len\tmatches\tmismatches\tgaps\tsimilarity\tseconds%s\n",
+                aln_mode != ALN_GLOBAL ? "\tstartA\tendA\tstartB\tendB" : "");
+    else
+        aln_write_header(out, out_format, "nw_ocl_generic", NULL, NULL, 0);
+    char line[2048], pathA[1024], pathB[1024];
+    PendingPair slots[2];
+    StageTimes times = {0, 0, 0, 0, 0, 0};
+    int submitted = 0;
+    double batch_start = wall_time();
+
+    while (fgets(line, sizeof(line), list)) {
+        if (line[0] == '#' || sscanf(line, "%1023s %1023s", pathA, pathB) != 2) continue;
+        double read_start = wall_time();
+        int len1 = 0, len2 = 0;
+        uint8_t* seq1 = read_fasta_codes(pathA, &len1);
+        uint8_t* seq2 = read_fasta_codes(pathB, &len2);
+        times.read += wall_time() - read_start;
+        if (!seq1 || !seq2) {
+            free(seq1);
+            free(seq2);
+            continue;
+        }
+
+        PendingPair* p = &slots[submitted % 2];
+        p->seq1 = seq1;
+        p->seq2 = seq2;
+        p->len1 = len1;
+        p->len2 = len2;
+        p->name1 = get_basename_without_ext(pathA);
+        p->name2 = get_basename_without_ext(pathB);
+        p->submitted = wall_time();
+        ocl_align_submit(al, &p->job, seq1, len1, seq2, len2, score_only);
 
+        // 방금 제출한 쌍이 디바이스에서 도는 동안 이전 쌍을 마무리
+        if (submitted > 0) pending_pair_finish(al, &slots[(submitted - 1) % 2], &times, out);
+        submitted++;
+    }
+    if (submitted > 0) pending_pair_finish(al, &slots[(submitted - 1) % 2], &times, out);
+    fclose(list);
+
+    double total = wall_time() - batch_start;
+    fprintf(stderr, "%d 쌍 정렬 완료: %.4f 초 (버퍼 생성 %ld 회, 재사용 %ld 회)\n",
+            submitted, total, al->pool_allocs, al->pool_reuses);
+    fprintf(stderr, "단계별 시간 합계 (초):\n");
+    fprintf(stderr, "  FASTA 읽기     %.4f\n", times.read);
+    fprintf(stderr, "  업로드         %.4f (디바이스)\n", times.upload);
+    fprintf(stderr, "  계산           %.4f (디바이스)\n", times.compute);
+    fprintf(stderr, "  다운로드       %.4f (디바이스)\n", times.download);
+    fprintf(stderr, "  traceback/출력 %.4f\n", times.traceback);
+    fprintf(stderr, "  결과 대기      %.4f (호스트가 디바이스를 기다린 시간)\n", times.stall);
+    return 0;
+}
+
+// -------------------------------------------------------------------------
+// CPU + OpenCL 이기종 분배 (--hetero)
+// 쌍마다 예상 시간 = overhead + cells * per_cell 을 장치별로 추정하고,
+// 큰 쌍부터 가장 먼저 끝날 장치에 배정한다 (CPU 는 스레드 수만큼의 레인).
+// 실행할 때는 스레드 0 이 OpenCL 몫을 파이프라인으로 돌리고,
+// 나머지 스레드가 CPU 몫을 하나씩 가져간다.
+// -------------------------------------------------------------------------
+typedef struct {
+    char* name;
+    uint8_t* seq;   // 코드
+    int len;
+} PairSeq;
+
+typedef struct {
+    int a, b;           // PairSeq 인덱스
+    long cells;
+    int on_device;      // 1 이면 OpenCL, 0 이면 CPU
+} HeteroPair;
+
+typedef struct {
+    double overhead[2];  // [0] CPU, [1] OpenCL (초)
+    double per_cell[2];  // 셀당 초
+} CostModel;
+
+#define CALIBRATE_SMALL 128
+#define CALIBRATE_LARGE 1024
+
+// CPU 경로: common/linear_fill.h 의 채우기 (nw_linear, libnw 와 같은 코드).
+// match/mismatch 점수면 SSE4.1/AVX2 anti-diagonal, 치환 행렬이면 b 의 query profile 행 DP.
+// tie 순서 (D > U > L) 가 OpenCL 경로와 같으므로 CIGAR 도 같다
+AlignmentResult needleman_wunsch_cpu(const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    size_t trace_stride = ((size_t)lenB + 3) / 4;
+    unsigned char *trace = (unsigned char *)calloc((size_t)lenA * trace_stride + 1, 1);
+    int score;
+#ifdef LINEAR_FILL_SIMD
+    if (cpu_engine != LINEAR_FILL_ROWS)
+        score = linear_fill_diag(&scoring, cpu_engine, a, b, lenA, lenB, trace, trace_stride);
+    else
+#endif
+    {
+        NtProfile prof;
+        nt_profile_build(&prof, b, lenB, a, lenA, scoring.table);
+        int *row = (int *)malloc(sizeof(int) * (lenB + 1));
+        score = linear_fill_rows(&scoring, a, lenA, lenB, &prof, row, trace, trace_stride);
+        free(row);
+        nt_profile_free(&prof);
+    }
+
+    AlignmentResult result = traceback_packed(a, b, lenA, lenB, trace, trace_stride, score);
+    free(trace);
     return result;
 }
 
+// CPU 레인의 모드 처리: aln_locate 로 구간을 찾고 그 구간만 needleman_wunsch_cpu 로 정렬
+AlignmentResult needleman_wunsch_cpu_mode(const uint8_t *a, int lenA, const uint8_t *b, int lenB) {
+    if (aln_mode == ALN_GLOBAL) return needleman_wunsch_cpu(a, lenA, b, lenB);
+    AlnRegion region = aln_locate(&scoring, aln_mode, a, lenA, b, lenB);
+    AlignmentResult result = needleman_wunsch_cpu(a + region.a_start, region.a_end - region.a_start,
+                                                  b + region.b_start, region.b_end - region.b_start);
+    result.region = region;
+    result.region.score = result.score;
+    return result;
+}
+
+// 무작위 A/C/G/T 서열의 코드 (len + 1 바이트)
+uint8_t* random_dna(int len, unsigned int* seed) {
+    uint8_t* s = (uint8_t*)malloc(len + 1);
+    for (int i = 0; i < len; i++) {
+        *seed = *seed * 1103515245u + 12345u;
+        s[i] = (*seed >> 16) & 3;
+    }
+    s[len] = 0;
+    return s;
+}
+
+// 작은 쌍과 큰 쌍의 실행 시간으로 두 장치의 (overhead, per_cell) 을 구한다
+void calibrate_cost_model(OclAligner* al, CostModel* model) {
+    unsigned int seed = 12345;
+    int sizes[2] = {CALIBRATE_SMALL, CALIBRATE_LARGE};
+    double t[2][2];
+    uint8_t* seqs[2][2];
+    for (int k = 0; k < 2; k++) {
+        seqs[k][0] = random_dna(sizes[k], &seed);
+        seqs[k][1] = random_dna(sizes[k], &seed);
+    }
+
+    // 첫 실행의 버퍼 생성, 커널 컴파일 지연을 빼기 위한 예열
+    AlignmentResult warm = needleman_wunsch_ocl(seqs[0][0], sizes[0], seqs[0][1], sizes[0], al);
+    cigar_free(&warm.cigar);
+
+    for (int k = 0; k < 2; k++) {
+        for (int dev = 0; dev < 2; dev++) {
+            int reps = (k == 0) ? 5 : 1;
+            double start = wall_time();
+            for (int r = 0; r < reps; r++) {
+                AlignmentResult res = dev ? needleman_wunsch_ocl(seqs[k][0], sizes[k], seqs[k][1], sizes[k], al)
+                                          : needleman_wunsch_cpu(seqs[k][0], sizes[k], seqs[k][1], sizes[k]);
+                cigar_free(&res.cigar);
+            }
+            t[dev][k] = (wall_time() - start) / reps;
+        }
+    }
+
+    double cells[2] = {(double)sizes[0] * sizes[0], (double)sizes[1] * sizes[1]};
+    for (int dev = 0; dev < 2; dev++) {
+        double slope = (t[dev][1] - t[dev][0]) / (cells[1] - cells[0]);
+        if (slope < 1e-12) slope = 1e-12;
+        double base = t[dev][0] - slope * cells[0];
+        model->per_cell[dev] = slope;
+        model->overhead[dev] = base > 0 ? base : 0;
+    }
+
+    for (int k = 0; k < 2; k++) {
+        free(seqs[k][0]);
+        free(seqs[k][1]);
+    }
+}
+
+// 프로파일 파일: "cpu <overhead> <per_cell>" 와 "ocl <overhead> <per_cell>" 두 줄
+int load_cost_model(const char* path, CostModel* model) {
+    FILE* f = fopen(path, "r");
+    if (!f) return 0;
+    char line[256], dev[16];
+    double overhead, per_cell;
+    int found = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#' || sscanf(line, "%15s %lf %lf", dev, &overhead, &per_cell) != 3) continue;
+        int d = strcmp(dev, "ocl") == 0 ? 1 : strcmp(dev, "cpu") == 0 ? 0 : -1;
+        if (d < 0 || per_cell <= 0) continue;
+        model->overhead[d] = overhead;
+        model->per_cell[d] = per_cell;
+        found |= 1 << d;
+    }
+    fclose(f);
+    return found == 3;
+}
+
+void save_cost_model(const char* path, const CostModel* model) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        printf("Cannot open file: %s\n", path);
+        return;
+    }
+    fprintf(f, "# nw_ocl_generic 비용 모델: 초 = overhead + cells * per_cell\n");
+    fprintf(f, "cpu %.9g %.9g\n", model->overhead[0], model->per_cell[0]);
+    fprintf(f, "ocl %.9g %.9g\n", model->overhead[1], model->per_cell[1]);
+    fclose(f);
+}
+
+double predict_seconds(const CostModel* model, int dev, long cells) {
+    return model->overhead[dev] + model->per_cell[dev] * cells;
+}
+
+int compare_hetero_cells(const void* x, const void* y) {
+    long cx = ((const HeteroPair*)x)->cells;
+    long cy = ((const HeteroPair*)y)->cells;
+    return (cx < cy) - (cx > cy);
+}
+
+// 큰 쌍부터, 배정했을 때 끝나는 시각이 가장 이른 레인으로 (레인 0 은 OpenCL)
+double assign_pairs(HeteroPair* pairs, int npairs, const CostModel* model, int cpu_lanes) {
+    double* lane_end = (double*)calloc(cpu_lanes + 1, sizeof(double));
+    qsort(pairs, npairs, sizeof(HeteroPair), compare_hetero_cells);
+    for (int k = 0; k < npairs; k++) {
+        int best_cpu = 1;
+        for (int l = 2; l <= cpu_lanes; l++) {
+            if (lane_end[l] < lane_end[best_cpu]) best_cpu = l;
+        }
+        double cpu_end = lane_end[best_cpu] + predict_seconds(model, 0, pairs[k].cells);
+        double ocl_end = lane_end[0] + predict_seconds(model, 1, pairs[k].cells);
+        pairs[k].on_device = ocl_end <= cpu_end;
+        if (pairs[k].on_device) lane_end[0] = ocl_end;
+        else lane_end[best_cpu] = cpu_end;
+    }
+    double makespan = 0;
+    for (int l = 0; l <= cpu_lanes; l++) {
+        if (lane_end[l] > makespan) makespan = lane_end[l];
+    }
+    free(lane_end);
+    return makespan;
+}
+
+void print_hetero_row(FILE* out, const PairSeq* sa, const PairSeq* sb, const AlignmentResult* r, double seconds, int on_device) {
+    #pragma omp critical(hetero_output)
+    {
+        if (out_format == ALN_TEXT) {
+            fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2f\t%.4f\t%s",
+                    sa->name, sb->name, sa->len, sb->len, r->score, r->length,
+                    r->matches, r->mismatches, r->gaps, r->similarity, seconds, on_device ? "ocl" : "cpu");
+            print_region_columns(out, &r->region);
+            putc('\n', out);
+        } else {
+            write_pair_record(out, sa->name, sa->len, sb->name, sb->len, r);
+        }
+        fflush(out);
+    }
+}
+
+// 쌍 목록을 읽어 CPU 와 OpenCL 에 나눠 정렬한다. 결과는 끝나는 순서대로 출력.
+int hetero_pair_list(const char* list_path, OclAligner* al, const char* model_path, FILE* out) {
+    FILE* list = fopen(list_path, "r");
+    if (!list) {
+        printf("Cannot open file: %s\n", list_path);
+        return 1;
+    }
+
+    // 같은 파일은 한 번만 읽는다 (이름 = 확장자 없는 파일명)
+    PairSeq* seqs = NULL;
+    HeteroPair* pairs = NULL;
+    int nseqs = 0, seq_cap = 0, npairs = 0, pair_cap = 0;
+    char line[2048], path[2][1024];
+    while (fgets(line, sizeof(line), list)) {
+        if (line[0] == '#' || sscanf(line, "%1023s %1023s", path[0], path[1]) != 2) continue;
+        int idx[2];
+        for (int s = 0; s < 2; s++) {
+            char* name = get_basename_without_ext(path[s]);
+            idx[s] = -1;
+            for (int k = 0; k < nseqs; k++) {
+                if (strcmp(seqs[k].name, name) == 0) idx[s] = k;
+            }
+            if (idx[s] >= 0) {
+                free(name);
+                continue;
+            }
+            int len = 0;
+            uint8_t* seq = read_fasta_codes(path[s], &len);
+            if (!seq) {
+                free(name);
+                continue;
+            }
+            if (nseqs == seq_cap) {
+                seq_cap = seq_cap ? seq_cap * 2 : 16;
+                seqs = (PairSeq*)realloc(seqs, seq_cap * sizeof(PairSeq));
+            }
+            seqs[nseqs].name = name;
+            seqs[nseqs].seq = seq;
+            seqs[nseqs].len = len;
+            idx[s] = nseqs++;
+        }
+        if (idx[0] < 0 || idx[1] < 0) continue;
+        if (npairs == pair_cap) {
+            pair_cap = pair_cap ? pair_cap * 2 : 64;
+            pairs = (HeteroPair*)realloc(pairs, pair_cap * sizeof(HeteroPair));
+        }
+        pairs[npairs].a = idx[0];
+        pairs[npairs].b = idx[1];
+        pairs[npairs].cells = (long)seqs[idx[0]].len * seqs[idx[1]].len;
+        npairs++;
+    }
+    fclose(list);
+
+    // 비용 모델: 파일이 있으면 읽고, 없으면 측정해서 (경로가 있으면) 저장
+    CostModel model;
+    if (!model_path || !load_cost_model(model_path, &model)) {
+        double start = wall_time();
+        calibrate_cost_model(al, &model);
+        fprintf(stderr, "비용 모델 측정: %.4f 초\n", wall_time() - start);
+        if (model_path) save_cost_model(model_path, &model);
+    }
+    fprintf(stderr, "비용 모델 (overhead 초, GCUPS): CPU %.6f %.3f, OpenCL %.6f %.3f\n",
+            model.overhead[0], 1e-9 / model.per_cell[0], model.overhead[1], 1e-9 / model.per_cell[1]);
+
+    // CPU 작업 스레드 num_threads 개 + OpenCL 을 구동하는 스레드 1 개
+#ifdef _OPENMP
+    int cpu_lanes = num_threads;
+#else
+    int cpu_lanes = 1;
+#endif
+    double predicted = assign_pairs(pairs, npairs, &model, cpu_lanes);
+
+    int* cpu_list = (int*)malloc(sizeof(int) * (npairs + 1));
+    int* ocl_list = (int*)malloc(sizeof(int) * (npairs + 1));
+    int ncpu = 0, nocl = 0;
+    long cpu_cells = 0, ocl_cells = 0;
+    for (int k = 0; k < npairs; k++) {
+        if (pairs[k].on_device) {
+            ocl_list[nocl++] = k;
+            ocl_cells += pairs[k].cells;
+        } else {
+            cpu_list[ncpu++] = k;
+            cpu_cells += pairs[k].cells;
+        }
+    }
+
+    if (out_format == ALN_TEXT)
+        fprintf(out, "#seqA\tseqB\tlenA\tlenB\tscore\taligned_len\tmatches\tmismatches\tgaps\tsimilarity\tseconds\tdevice%s\n",
+                aln_mode != ALN_GLOBAL ? "\tstartA\tendA\tstartB\tendB" : "");
+    else
+        aln_write_header(out, out_format, "nw_ocl_generic", NULL, NULL, 0);
+    fflush(out);
+
+    int next_cpu = 0;
+    double ocl_busy = 0, cpu_end = 0;
+    double batch_start = wall_time();
+
+    #pragma omp parallel num_threads(cpu_lanes + 1)
+    {
+        if (thread_id() == 0) {
+            // OpenCL 몫: 쌍 k 를 제출한 뒤 쌍 k-1 을 마무리 (--pairs 와 같은 방식)
+            OclJob jobs[2];
+            double submitted[2];
+            StageTimes times = {0, 0, 0, 0, 0, 0};
+            for (int k = 0; k <= nocl; k++) {
+                if (k < nocl) {
+                    HeteroPair* p = &pairs[ocl_list[k]];
+                    submitted[k % 2] = wall_time();
+                    ocl_align_submit(al, &jobs[k % 2], seqs[p->a].seq, seqs[p->a].len, seqs[p->b].seq, seqs[p->b].len, 0);
+                }
+                if (k > 0) {
+                    HeteroPair* p = &pairs[ocl_list[k - 1]];
+                    AlignmentResult r = ocl_job_finish(al, &jobs[(k - 1) % 2], &times);
+                    print_hetero_row(out, &seqs[p->a], &seqs[p->b], &r, wall_time() - submitted[(k - 1) % 2], 1);
+                    cigar_free(&r.cigar);
+                }
+            }
+            ocl_busy = wall_time() - batch_start;
+        }
+        // CPU 몫: 남은 쌍을 하나씩 가져간다 (OpenMP 가 없으면 OpenCL 몫이 끝난 뒤 같은 스레드가 처리)
+        if (thread_id() != 0 || !in_parallel()) {
+            for (;;) {
+                int k;
+                #pragma omp atomic capture
+                k = next_cpu++;
+                if (k >= ncpu) break;
+                HeteroPair* p = &pairs[cpu_list[k]];
+                double start = wall_time();
+                AlignmentResult r = needleman_wunsch_cpu_mode(seqs[p->a].seq, seqs[p->a].len, seqs[p->b].seq, seqs[p->b].len);
+                print_hetero_row(out, &seqs[p->a], &seqs[p->b], &r, wall_time() - start, 0);
+                cigar_free(&r.cigar);
+            }
+            double end = wall_time() - batch_start;
+            #pragma omp critical(hetero_output)
+            if (end > cpu_end) cpu_end = end;
+        }
+    }
+
+    double total = wall_time() - batch_start;
+    fprintf(stderr, "%d 쌍 정렬 완료: %.4f 초 (예상 %.4f 초), %.3f GCUPS\n", npairs, total, predicted,
+            total > 0 ? (cpu_cells + ocl_cells) / total / 1e9 : 0.0);
+    fprintf(stderr, "  OpenCL: %d 쌍, %ld 셀, %.4f 초\n", nocl, ocl_cells, ocl_busy);
+    fprintf(stderr, "  CPU   : %d 쌍, %ld 셀, %.4f 초 (%d 스레드)\n", ncpu, cpu_cells, cpu_end, cpu_lanes);
+
+    for (int k = 0; k < nseqs; k++) {
+        free(seqs[k].name);
+        free(seqs[k].seq);
+    }
+    free(seqs);
+    free(pairs);
+    free(cpu_list);
+    free(ocl_list);
+    return 0;
+}
+
+// 쌍 하나의 결과 파일: text 가 아니면 --format 레코드, text 면 정렬 문자열이 든 보고서
+void write_alignment(FILE* fout, const char* name1, int len1, const char* name2, int len2,
+                     const uint8_t* seq1, const uint8_t* seq2, const AlignmentResult* result, double duration) {
+    INSTR_SCOPE("output");
+    const AlnRegion* region = &result->region;
+    if (out_format != ALN_TEXT) {
+        const char* target = name2;
+        aln_write_header(fout, out_format, "nw_ocl_generic", &target, &len2, 1);
+        write_pair_record(fout, name1, len1, name2, len2, result);
+        return;
+    }
+    char scheme[160];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    char *alignedA, *alignedB;
+    cigar_gapped_codes(&result->cigar, seq1 + region->a_start, seq2 + region->b_start, &alignedA, &alignedB);
+    fprintf(fout, "%s vs %s - OpenCL Alignment\n", name1, name2);
+    fprintf(fout, "Scoring: %s\n", scheme);
+    if (aln_mode != ALN_GLOBAL) {
+        char mode[64];
+        aln_mode_describe(aln_mode, mode, sizeof(mode));
+        fprintf(fout, "Mode: %s\n", mode);
+        fprintf(fout, "Region: %s[%d, %d) %s[%d, %d)\n", name1, region->a_start, region->a_end,
+                name2, region->b_start, region->b_end);
+    }
+    fprintf(fout, "Execution Time: %.4f seconds\n", duration);
+    fprintf(fout, "Alignment Score: %d\n", result->score);
+    fprintf(fout, "Aligned Length: %d\n", result->length);
+    fprintf(fout, "Matches: %d, Mismatches: %d, Gaps: %d\n", result->matches, result->mismatches, result->gaps);
+    fprintf(fout, "Similarity: %.2f%%\n\n", result->similarity);
+    fprintf(fout, "Aligned %s:\n%s\n\n", name1, alignedA);
+    fprintf(fout, "Aligned %s:\n%s\n", name2, alignedB);
+    free(alignedA);
+    free(alignedB);
+}
+
+// --bench 에서 쓰는 정렬기와 옵션
+typedef struct {
+    OclAligner* al;
+    int score_only;
+} OclBench;
+
+// bench.h 가 부르는 한 번의 정렬. 코드 변환, 구간 탐색, 업로드, 계산, 다운로드가 채우기,
+// 호스트 traceback 이 traceback, 결과 쓰기가 I/O 이다. 초기화 (프로그램 빌드) 는 들어가지 않는다
+int bench_ocl(void* ctx, const char* a, int lenA, const char* b, int lenB, FILE* io, BenchPhases* t) {
+    const OclBench* opt = (const OclBench*)ctx;
+    double start = wall_time();
+    uint8_t* ca = nt_encode_dup(a, lenA);
+    uint8_t* cb = nt_encode_dup(b, lenB);
+
+    OclJob job;
+    StageTimes times = {0, 0, 0, 0, 0, 0};
+    ocl_align_submit(opt->al, &job, ca, lenA, cb, lenB, opt->score_only);
+    AlignmentResult result = ocl_job_finish(opt->al, &job, &times);
+    double finished = wall_time();
+    t->traceback = times.traceback;
+    t->fill = finished - start - times.traceback;
+
+    if (!opt->score_only) {
+        write_alignment(io, "A", lenA, "B", lenB, ca, cb, &result, 0.0);
+        fflush(io);
+        t->io = wall_time() - finished;
+    }
+    free(ca);
+    free(cb);
+    cigar_free(&result.cigar);
+    return result.score;
+}
+
 int main(int argc, char* argv[]) {
+    INSTR_INIT();
     // 인자 확인
-    if (argc != 3) {
-        printf("사용법: %s <fasta_file1> <fasta_file2>\n", argv[0]);
+    const char* files[2];
+    int nfiles = 0;
+    int score_only = 0;
+    int batch = 0;
+    int hetero = 0;
+    const char* pair_list = NULL;
+    const char* out_path = NULL;
+    const char* model_path = NULL;
+    BenchConfig bench;
+    bench_init(&bench);
+    scoring_init(&scoring);
+    for (int i = 1; i < argc; i++) {
+        int opt = scoring_arg(&scoring, argc, argv, &i);
+        if (opt == 0) opt = aln_mode_arg(&aln_mode, argc, argv, &i);
+        if (opt == 0) opt = bench_arg(&bench, argc, argv, &i);
+        if (opt < 0) return 1;
+        if (opt > 0) continue;
+        if (strcmp(argv[i], "--score-only") == 0) score_only = 1;
+        else if (strcmp(argv[i], "--hetero") == 0) hetero = 1;
+        else if (strcmp(argv[i], "--cost-model") == 0 && i + 1 < argc) model_path = argv[++i];
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) num_threads = 1;
+        }
+        else if (strcmp(argv[i], "--batch") == 0) batch = 1;
+        else if (strcmp(argv[i], "--pairs") == 0 && i + 1 < argc) pair_list = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_path = argv[++i];
+        else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            int f = aln_format_parse(argv[++i]);
+            if (f < 0) return 1;
+            out_format = (AlnFormat)f;
+        }
+        else if (nfiles < 2) files[nfiles++] = argv[i];
+        else nfiles = 3;
+    }
+    int bad_args = bench.enabled ? nfiles != 0 || batch || pair_list || hetero
+                 : pair_list ? nfiles != 0 || batch || (hetero && score_only)
+                 : nfiles != 2 || (batch && score_only) || hetero;
+    if (bad_args) {
+        printf("사용법: %s [--score-only] <fasta_file1> <fasta_file2>\n", argv[0]);
+        printf("        %s [--score-only] [--out results.tsv] --pairs <pair_list>\n", argv[0]);
+        printf("        %s --hetero [--threads N] [--cost-model profile.txt] [--out results.tsv] --pairs <pair_list>\n", argv[0]);
+        printf("        %s --batch [--out results.tsv] <reads.fasta> <targets.fasta>\n", argv[0]);
+        printf("        (targets 가 레코드 하나면 모든 read 를 그 서열에, 아니면 같은 순서의 레코드끼리 정렬)\n");
+        printf("        %s [--score-only] --bench [--bench-...]   (벤치마크: %s)\n", argv[0], BENCH_OPTIONS);
+        printf("점수 옵션 (선형 갭만): %s\n", SCORING_OPTIONS);
+        printf("정렬 모드: %s\n", ALN_MODE_OPTIONS);
+        printf("출력 형식: --format %s (text 는 기존 보고서 / TSV, 나머지는 traceback 필요)\n", ALN_FORMATS);
         printf("예시: %s seq1.fasta seq2.fasta\n", argv[0]);
         return 1;
     }
 
-    printf("=== Needleman-Wunsch OpenCL - 일반 버전 ===\n\n");
+    if (scoring_finish(&scoring, GAP_LINEAR, SCORING_MODEL(GAP_LINEAR)) != 0) return 1;
+    cpu_engine = linear_fill_engine(&scoring);
+    if (score_only && out_format != ALN_TEXT) {
+        printf("--score-only 에는 --format text 만 쓸 수 있습니다 (나머지는 traceback 필요)\n");
+        return 1;
+    }
+    char scheme[160], mode[64];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    aln_mode_describe(aln_mode, mode, sizeof(mode));
+    if (!batch && !pair_list && !bench.enabled) printf("=== Needleman-Wunsch OpenCL - 일반 버전 ===\n점수 체계: %s\n정렬 모드: %s\n\n", scheme, mode);
 
     // ---------------------------------------------------------------------
-    // OpenCL 초기화 (플랫폼, 디바이스, 컨텍스트, 커맨드 큐 설정)
+    // OpenCL 초기화 (플랫폼, 디바이스, 컨텍스트, 커맨드 큐, 프로그램 캐시)
     // ---------------------------------------------------------------------
-    cl_platform_id platform;
-    cl_device_id device;
-    cl_context context;
-    cl_command_queue queue;
-    cl_program program;
-    cl_kernel kernel;
-    cl_int err;
+    OclAligner al;
+    double init_start = wall_time();
+    ocl_aligner_init(&al);
+    double init_time = wall_time() - init_start;
 
-    // 플랫폼 가져오기
-    err = clGetPlatformIDs(1, &platform, NULL);
-    handle_opencl_error(err, "clGetPlatformIDs");
-
-    // GPU 디바이스 시도, 실패 시 CPU 사용
-    err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_GPU, 1, &device, NULL);
-    if (err != CL_SUCCESS) {
-        fprintf(stderr, "GPU 디바이스를 찾을 수 없어 CPU를 사용합니다.\n");
-        err = clGetDeviceIDs(platform, CL_DEVICE_TYPE_CPU, 1, &device, NULL);
-        handle_opencl_error(err, "clGetDeviceIDs CPU");
+    if (bench.enabled) {
+        OclBench opt = {&al, score_only};
+        BenchInfo info = {"nw_ocl_generic", score_only ? "opencl-score-only" : "opencl", 1, scheme, mode};
+        printf("OpenCL 초기화: %.4f 초 (벤치마크 시간에는 들어가지 않음)\n", init_time);
+        int rc = bench_run(&bench, &info, bench_ocl, &opt);
+        ocl_aligner_release(&al);
+        return rc;
     }
 
-    // 컨텍스트 생성
-    context = clCreateContext(NULL, 1, &device, NULL, NULL, &err);
-    handle_opencl_error(err, "clCreateContext");
-
-    // 커맨드 큐 생성
-    queue = clCreateCommandQueue(context, device, 0, &err);
-    handle_opencl_error(err, "clCreateCommandQueue");
-
-    // 프로그램 객체 생성 (소스 코드 로드)
-    program = clCreateProgramWithSource(context, 1, &kernel_source, NULL, &err);
-    handle_opencl_error(err, "clCreateProgramWithSource");
-
-    // 프로그램 빌드 (컴파일)
-    err = clBuildProgram(program, 1, &device, NULL, NULL, NULL);
-    if (err != CL_SUCCESS) {
-        // 빌드 실패 시 로그 출력
-        size_t log_size;
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, 0, NULL, &log_size);
-        char *log = (char *)malloc(log_size);
-        clGetProgramBuildInfo(program, device, CL_PROGRAM_BUILD_LOG, log_size, log, NULL);
-        fprintf(stderr, "커널 빌드 에러:\n%s\n", log);
-        free(log);
-        exit(EXIT_FAILURE);
+    if (batch || pair_list) {
+        FILE* out = out_path ? fopen(out_path, out_format == ALN_BIN ? "wb" : "w") : stdout;
+        int rc = 1;
+        if (!out) {
+            printf("Cannot open file: %s\n", out_path);
+        } else if (pair_list && hetero) {
+            rc = hetero_pair_list(pair_list, &al, model_path, out);
+        } else if (pair_list) {
+            rc = ocl_pair_list(pair_list, &al, score_only, out);
+        } else {
+            rc = ocl_batch_stream(files[0], files[1], &al, out);
+        }
+        if (out && out != stdout) fclose(out);
+        ocl_aligner_release(&al);
+        return rc;
     }
 
-    // 커널 객체 생성
-    kernel = clCreateKernel(program, "compute_diagonal", &err);
-    handle_opencl_error(err, "clCreateKernel");
+    printf("OpenCL 초기화: %.4f 초 (%s)\n", init_time, al.program_cached ? "캐시된 프로그램 사용" : "소스에서 빌드");
 
-    // 입력 파일에서 서열 읽기
-    char* seq1 = read_fasta(argv[1]);
-    char* seq2 = read_fasta(argv[2]);
+    // 입력 파일에서 서열 읽기 (읽으면서 코드로 변환)
+    int len1 = 0, len2 = 0;
+    uint8_t* seq1 = read_fasta_codes(files[0], &len1);
+    uint8_t* seq2 = read_fasta_codes(files[1], &len2);
 
     if (!seq1 || !seq2) {
         printf("서열을 읽는데 실패했습니다.\n");
@@ -360,44 +2102,40 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    char* name1 = get_basename_without_ext(argv[1]);
-    char* name2 = get_basename_without_ext(argv[2]);
-
-    printf("서열 1 (%s): %d bp\n", name1, (int)strlen(seq1));
-    printf("서열 2 (%s): %d bp\n\n", name2, (int)strlen(seq2));
+    char* name1 = get_basename_without_ext(files[0]);
+    char* name2 = get_basename_without_ext(files[1]);
 
-    // 실행 시간 측정 및 알고리즘 실행
-    clock_t start = clock();
-    AlignmentResult result = needleman_wunsch_ocl(seq1, seq2, context, queue, kernel);
-    clock_t end = clock();
+    printf("서열 1 (%s): %d bp\n", name1, len1);
+    printf("서열 2 (%s): %d bp\n\n", name2, len2);
 
-    double duration = (double)(end - start) / CLOCKS_PER_SEC;
+    // 실행 시간 측정 및 알고리즘 실행 (벽시계: clock() 은 디바이스가 일하는 동안을 세지 않는다)
+    double start = wall_time();
+    AlignmentResult result = ocl_align(&al, seq1, len1, seq2, len2, score_only);
+    AlnRegion* region = &result.region;
+    double duration = wall_time() - start;
 
     // 결과 콘솔 출력
     printf("===== OpenCL 정렬 결과 =====\n");
     printf("실행 시간: %.4f 초\n", duration);
     printf("정렬 점수: %d\n", result.score);
+    if (aln_mode != ALN_GLOBAL)
+        printf("정렬 구간: %s[%d, %d) %s[%d, %d)\n", name1, region->a_start, region->a_end, name2, region->b_start, region->b_end);
     printf("정렬 길이: %d\n", result.length);
     printf("일치: %d, 불일치: %d, 갭: %d\n", result.matches, result.mismatches, result.gaps);
     printf("유사도: %.2f%%\n\n", result.similarity);
 
-    // 결과를 파일로 저장
+    // 결과를 파일로 저장 (점수 전용 모드는 정렬 경로가 없으므로 생략)
+    // 정렬 문자열은 text 형식일 때만 CIGAR 에서 만든다
     char output_filename[512];
-    snprintf(output_filename, sizeof(output_filename), "%s_vs_%s_ocl_alignment.txt", name1, name2);
+    snprintf(output_filename, sizeof(output_filename), "%s_vs_%s_ocl_alignment.%s",
+             name1, name2, aln_format_ext(out_format));
 
-    FILE* fout = fopen(output_filename, "w");
+    FILE* fout = score_only ? NULL : fopen(output_filename, out_format == ALN_BIN ? "wb" : "w");
     if (fout) {
-        fprintf(fout, "%s vs %s - OpenCL Alignment\n", name1, name2);
-        fprintf(fout, "Execution Time: %.4f seconds\n", duration);
-        fprintf(fout, "Alignment Score: %d\n", result.score);
-        fprintf(fout, "Aligned Length: %d\n", result.length);
-        fprintf(fout, "Matches: %d, Mismatches: %d, Gaps: %d\n", result.matches, result.mismatches, result.gaps);
-        fprintf(fout, "Similarity: %.2f%%\n\n", result.similarity);
-        fprintf(fout, "Aligned %s:\n%s\n\n", name1, result.alignedA);
-        fprintf(fout, "Aligned %s:\n%s\n", name2, result.alignedB);
+        write_alignment(fout, name1, len1, name2, len2, seq1, seq2, &result, duration);
         fclose(fout);
         printf("결과 저장됨: %s\n", output_filename);
-    } else {
+    } else if (!score_only) {
         printf("결과 파일 저장 실패\n");
     }
 
@@ -406,13 +2144,9 @@ int main(int argc, char* argv[]) {
     free(name2);
     free(seq1);
     free(seq2);
-    free(result.alignedA);
-    free(result.alignedB);
+    cigar_free(&result.cigar);
 
-    clReleaseKernel(kernel);
-    clReleaseProgram(program);
-    clReleaseCommandQueue(queue);
-    clReleaseContext(context);
+    ocl_aligner_release(&al);
 
     return 0;
 }
\ No newline at end of file
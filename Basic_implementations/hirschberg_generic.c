@@ -2,300 +2,1203 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
-#include <libgen.h>
+#include <limits.h>
+#include "../common/fasta_reader.h"
+#include "../common/util.h"
+#include "../common/nt_code.h"
+#include "../common/scoring.h"
+#include "../common/aln_output.h"
+#include "../common/aln_mode.h"
+#include "../common/bench.h"
+#include "../common/instrument.h"
+#include "../common/bitpar.h"
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
-#define MATCH 1
-#define MISMATCH -1
-#define GAP -1
 #define HIRSCHBERG_THRESHOLD 10
-
-int max3(int a, int b, int c) {
-    if (a >= b && a >= c) return a;
-    if (b >= a && b >= c) return b;
-    return c;
-}
-
-int score_match(char a, char b) {
-    return a == b ? MATCH : MISMATCH;
-}
-
-void rev(char* str) {
-    int len = strlen(str);
-    for (int i = 0; i < len / 2; i++) {
-        char tmp = str[i];
-        str[i] = str[len - 1 - i];
-        str[len - 1 - i] = tmp;
-    }
-}
+#define TILE_SIZE 256
+#define TILED_MIN_CELLS (4L * TILE_SIZE * TILE_SIZE)
+#define TASK_MIN_CELLS (64L * 1024)
+#define NEG_INF (INT_MIN / 4)
+
+static int num_threads = 1;
+static int score_only = 0;
+static int band_width = -1;   /* -1: no band, 0: automatic initial width */
+static int bitpar = 0;        /* unbanded linear passes use bitpar.h; off with --no-bitpar */
+static Scoring scoring;       /* --match / --matrix / gap options, see scoring.h */
+static AlnFormat out_format = ALN_TEXT;   /* --format; text is the report / batch TSV */
+static int aln_mode = ALN_GLOBAL;         /* --mode / --free-ends, see aln_mode.h */
+
+#ifdef _OPENMP
+#define thread_id() omp_get_thread_num()
+#define in_parallel() omp_in_parallel()
+#else
+#define thread_id() 0
+#define in_parallel() 0
+#endif
 
 typedef struct {
-    char* alignedA;
-    char* alignedB;
+    Cigar cigar;
     int length;
 } Alignment;
 
-int* nw_score(char* seqA, char* seqB) {
-    int lenA = strlen(seqA);
-    int lenB = strlen(seqB);
+/* Diagonal band: only cells with lo <= j - i <= hi are computed. */
+typedef struct {
+    int lo;
+    int hi;
+} Band;
+
+/*
+ * Hirschberg workspace, allocated once per alignment. The sequences are
+ * nucleotide codes (nt_code.h) and every score is read from the query profile
+ * of seqB, prof.row[code of seqA][position in seqB]. Sub-problems are
+ * (offset, length) views into the original sequences. Sub-problems that can
+ * be live at the same time (task siblings) cover disjoint ranges of seqA and
+ * ranges of seqB that touch at most at one end, so the slot
+ *   base = offA + offB + offA / TILE_SIZE
+ * never overlaps between them:
+ *   rows + k * stride + base   score row k of the sub-problem (k < WS_ROWS)
+ *   ops + offA + offB          its alignment, one CIGAR op per column,
+ *                              at most lenA + lenB columns
+ * Unused output columns stay 0 and are skipped when align_pair() run-length
+ * encodes the columns into the CIGAR.
+ */
+#define WS_ROWS 4
+
+typedef struct {
+    const uint8_t* a;
+    const uint8_t* b;
+    NtProfile prof;
+    int* rows;
+    size_t stride;
+    uint8_t* ops;
+} Workspace;
+
+static inline int* ws_row(const Workspace* ws, int k, int offA, int offB) {
+    return ws->rows + k * ws->stride + offA + offB + offA / TILE_SIZE;
+}
 
-    int* prev_row = (int*)malloc((lenB + 1) * sizeof(int));
-    int* curr_row = (int*)malloc((lenB + 1) * sizeof(int));
+/*
+ * Last DP row of seqA[offA..offA+lenA) x seqB[offB..offB+lenB) into
+ * row[0..lenB], one row updated in place. With reverse set both views are
+ * read back to front, which gives the reverse pass of Hirschberg without
+ * reversed copies. Column j of the view is profile column pb + step * j.
+ */
+void nw_score(const Workspace* ws, int offA, int lenA, int offB, int lenB, int reverse, int* row) {
+    INSTR_SCOPE("score pass");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int gap = scoring.gap;
+    int step = reverse ? -1 : 1;
+    const uint8_t* a = reverse ? ws->a + offA + lenA - 1 : ws->a + offA;
+    int pb = reverse ? offB + lenB : offB - 1;
 
     for (int j = 0; j <= lenB; j++) {
-        prev_row[j] = j * GAP;
+        row[j] = j * gap;
     }
 
     for (int i = 1; i <= lenA; i++) {
-        curr_row[0] = i * GAP;
+        const int8_t* s = ws->prof.row[a[step * (i-1)]] + pb;
+        int diag = row[0];
+        row[0] = i * gap;
         for (int j = 1; j <= lenB; j++) {
-            int diag = prev_row[j-1] + score_match(seqA[i-1], seqB[j-1]);
-            int up = prev_row[j] + GAP;
-            int left = curr_row[j-1] + GAP;
-            curr_row[j] = max3(diag, up, left);
+            int d = diag + s[step * j];
+            int up = row[j] + gap;
+            int left = row[j-1] + gap;
+            diag = row[j];
+            row[j] = max3(d, up, left);
         }
-        int* temp = prev_row;
-        prev_row = curr_row;
-        curr_row = temp;
     }
+}
 
-    int* last_row = (int*)malloc((lenB + 1) * sizeof(int));
-    for (int j = 0; j <= lenB; j++) {
-        last_row[j] = prev_row[j];
-    }
+/*
+ * Bit-parallel version of nw_score() for the small match / mismatch schemes
+ * bitpar_supported() accepts: the same row, 64 cells of a column per word.
+ */
+void nw_score_bitpar(const Workspace* ws, int offA, int lenA, int offB, int lenB, int reverse, int* row) {
+    INSTR_SCOPE("score pass bitpar");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    bitpar_row(&scoring, ws->a + offA, lenA, ws->b + offB, lenB, reverse, row);
+}
 
-    free(prev_row);
-    free(curr_row);
-    return last_row;
+/*
+ * Tiled version of nw_score(). The matrix is cut into TILE_SIZE x TILE_SIZE
+ * tiles and every tile is an OpenMP task. A tile depends on the last writer
+ * of its column block of H and its row block of V, i.e. on the tile above and
+ * the tile to the left, so the tiles run as a wavefront on the current team
+ * and interleave with the other tasks of the recursion:
+ *   H[j]       last row of the tile above      (dp[r0-1][j])
+ *   V[i]       last column of the tile to the left (dp[i][c0-1])
+ *   corner[ti] dp[r0-1][c0-1] for the next tile in tile row ti
+ * V and corner share the scratch row (lenA + 1 + tilesA entries). When every
+ * tile has run, H is the last DP row. Outside a parallel region the tasks
+ * simply run in creation (row-major) order.
+ */
+void nw_score_tiled(const Workspace* ws, int offA, int lenA, int offB, int lenB, int reverse, int* H, int* V) {
+    INSTR_SCOPE("score pass tiled");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    int tilesA = (lenA + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesB = (lenB + TILE_SIZE - 1) / TILE_SIZE;
+    int* corner = V + lenA + 1;
+    const int gap = scoring.gap;
+    int step = reverse ? -1 : 1;
+    const uint8_t* a = reverse ? ws->a + offA + lenA - 1 : ws->a + offA;
+    int pb = reverse ? offB + lenB : offB - 1;
+
+    for (int j = 0; j <= lenB; j++) H[j] = j * gap;
+    for (int i = 0; i <= lenA; i++) V[i] = i * gap;
+    for (int t = 0; t < tilesA; t++) corner[t] = t * TILE_SIZE * gap;
+
+    for (int ti = 0; ti < tilesA; ti++) {
+        for (int tj = 0; tj < tilesB; tj++) {
+            int r0 = ti * TILE_SIZE + 1, r1 = r0 + TILE_SIZE - 1 < lenA ? r0 + TILE_SIZE - 1 : lenA;
+            int c0 = tj * TILE_SIZE + 1, c1 = c0 + TILE_SIZE - 1 < lenB ? c0 + TILE_SIZE - 1 : lenB;
+
+            #pragma omp task depend(inout: H[c0], V[r0])
+            {
+                int rows[2][TILE_SIZE + 1];
+                int* prev_row = rows[0];
+                int* curr_row = rows[1];
+                int w = c1 - c0 + 1;
+
+                prev_row[0] = corner[ti];
+                memcpy(prev_row + 1, H + c0, w * sizeof(int));
+
+                for (int i = r0; i <= r1; i++) {
+                    const int8_t* s = ws->prof.row[a[step * (i-1)]] + pb;
+                    curr_row[0] = V[i];
+                    for (int jj = 1; jj <= w; jj++) {
+                        int diag = prev_row[jj-1] + s[step * (c0+jj-1)];
+                        int up_score = prev_row[jj] + gap;
+                        int left_score = curr_row[jj-1] + gap;
+                        curr_row[jj] = max3(diag, up_score, left_score);
+                    }
+                    V[i] = curr_row[w];
+                    int* temp = prev_row;
+                    prev_row = curr_row;
+                    curr_row = temp;
+                }
+
+                corner[ti] = H[c1];
+                memcpy(H + c0, prev_row + 1, w * sizeof(int));
+            }
+        }
+    }
+    #pragma omp taskwait
+    H[0] = lenA * gap;
 }
 
-Alignment nw_full(char* seqA, char* seqB) {
-    int lenA = strlen(seqA);
-    int lenB = strlen(seqB);
+/*
+ * Banded version of nw_score(). Cells outside the band are NEG_INF; the row
+ * keeps a NEG_INF sentinel on both sides of the band so the inner loop is the
+ * same as nw_score() and runs in O(band width) per row. row needs lenB + 2
+ * entries. The band must contain both corners (lo <= 0 and lenB - lenA <= hi).
+ */
+void nw_score_band(const Workspace* ws, int offA, int lenA, int offB, int lenB, int reverse,
+                   int lo, int hi, int* row) {
+    INSTR_SCOPE("score pass banded");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * (hi - lo + 1));
+    const int gap = scoring.gap;
+    int step = reverse ? -1 : 1;
+    const uint8_t* a = reverse ? ws->a + offA + lenA - 1 : ws->a + offA;
+    int pb = reverse ? offB + lenB : offB - 1;
+
+    int jlo = 0;
+    int jhi = hi < lenB ? hi : lenB;
+    for (int j = 0; j <= jhi; j++) {
+        row[j] = j * gap;
+    }
+    row[jhi + 1] = NEG_INF;
 
-    int** dp = (int**)malloc((lenA + 1) * sizeof(int*));
-    for (int i = 0; i <= lenA; i++) {
-        dp[i] = (int*)malloc((lenB + 1) * sizeof(int));
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = ws->prof.row[a[step * (i-1)]] + pb;
+        jlo = i + lo > 0 ? i + lo : 0;
+        jhi = i + hi < lenB ? i + hi : lenB;
+        int start = jlo;
+        int diag;
+        if (jlo == 0) {
+            diag = row[0];
+            row[0] = i * gap;
+            start = 1;
+        } else {
+            diag = row[jlo - 1];
+            row[jlo - 1] = NEG_INF;
+        }
+        for (int j = start; j <= jhi; j++) {
+            int d = diag + s[step * j];
+            int up = row[j] + gap;
+            int left = row[j-1] + gap;
+            diag = row[j];
+            row[j] = max3(d, up, left);
+        }
+        row[jhi + 1] = NEG_INF;
     }
 
-    dp[0][0] = 0;
-    for (int i = 1; i <= lenA; i++) dp[i][0] = i * GAP;
-    for (int j = 1; j <= lenB; j++) dp[0][j] = j * GAP;
+    for (int j = 0; j < jlo; j++) row[j] = NEG_INF;
+    for (int j = jhi + 1; j <= lenB; j++) row[j] = NEG_INF;
+}
+
+/*
+ * Any path that leaves the band [min(0, d) - w, max(0, d) + w], d = lenB - lenA,
+ * needs at least |d| + 2(w + 1) gaps. Returns the best score such a path can
+ * reach (every aligned pair at the best table score, or 0 if that is
+ * negative); a banded score at or above it is the unrestricted optimum.
+ */
+int band_escape_bound(int lenA, int lenB, int w) {
+    long gaps = labs((long)lenB - lenA) + 2L * (w + 1);
+    if (gaps > (long)lenA + lenB) return NEG_INF;
+    long best_pair = scoring.max_score > 0 ? scoring.max_score : 0;
+    return (int)(best_pair * (((long)lenA + lenB - gaps) / 2) + scoring_gap(&scoring, gaps));
+}
 
+/*
+ * Full DP for the small base cases (lenA or lenB <= HIRSCHBERG_THRESHOLD).
+ * Scores use workspace row 0 and the 2-bit traceback (1 diag, 2 up, 3 left,
+ * preferred in that order on ties) lives in row 1 of the same slot, whose
+ * 4 * (lenA + lenB) bytes hold lenA * lenB / 4 whenever one side is that small.
+ * The alignment is written backwards from the end of the output slot.
+ */
+void nw_full(const Workspace* ws, int offA, int lenA, int offB, int lenB) {
+    INSTR_SCOPE("leaf");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const uint8_t* a = ws->a + offA;
+    const uint8_t* b = ws->b + offB;
+    int* row = ws_row(ws, 0, offA, offB);
+    unsigned char* trace = (unsigned char*)ws_row(ws, 1, offA, offB);
+    const int gap = scoring.gap;
+    memset(trace, 0, ((size_t)lenA * lenB + 3) / 4);
+
+    for (int j = 0; j <= lenB; j++) row[j] = j * gap;
     for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = ws->prof.row[a[i-1]] + offB - 1;
+        int diag = row[0];
+        row[0] = i * gap;
         for (int j = 1; j <= lenB; j++) {
-            int diag = dp[i-1][j-1] + score_match(seqA[i - 1], seqB[j - 1]);
-            int up = dp[i-1][j] + GAP;
-            int left = dp[i][j-1] + GAP;
-            dp[i][j] = max3(diag, up, left);
+            int d = diag + s[j];
+            int up = row[j] + gap;
+            int left = row[j-1] + gap;
+            int code = d >= up && d >= left ? 1 : up >= left ? 2 : 3;
+            size_t cell = (size_t)(i-1) * lenB + (j-1);
+            trace[cell / 4] |= (unsigned char)(code << (2 * (cell % 4)));
+            diag = row[j];
+            row[j] = max3(d, up, left);
         }
     }
 
-    char* alignedA = (char*)malloc(lenA + lenB + 1);
-    char* alignedB = (char*)malloc(lenA + lenB + 1);
-    int ai = 0, bi = 0;
+    int pos = offA + offB + lenA + lenB;
     int i = lenA, j = lenB;
-
     while (i > 0 || j > 0) {
-        if (i > 0 && j > 0 && dp[i][j] == dp[i-1][j-1] + score_match(seqA[i - 1], seqB[j - 1])) {
-            alignedA[ai++] = seqA[i - 1];
-            alignedB[bi++] = seqB[j - 1];
+        int code = 3;
+        if (j == 0) {
+            code = 2;
+        } else if (i > 0) {
+            size_t cell = (size_t)(i-1) * lenB + (j-1);
+            code = (trace[cell / 4] >> (2 * (cell % 4))) & 3;
+        }
+        pos--;
+        if (code == 1) {
             i--; j--;
-        } else if (i > 0 && dp[i][j] == dp[i-1][j] + GAP) {
-            alignedA[ai++] = seqA[i - 1];
-            alignedB[bi++] = '_';
+            ws->ops[pos] = a[i] == b[j] ? CIGAR_EQ : CIGAR_X;
+        } else if (code == 2) {
             i--;
-        } else if (j > 0) {
-            alignedA[ai++] = '_';
-            alignedB[bi++] = seqB[j - 1];
+            ws->ops[pos] = CIGAR_INS;
+        } else {
             j--;
-        } else break;
+            ws->ops[pos] = CIGAR_DEL;
+        }
     }
+}
 
-    alignedA[ai] = '\0';
-    alignedB[bi] = '\0';
-    rev(alignedA);
-    rev(alignedB);
+/*
+ * band is relative to the (offA, lenA) x (offB, lenB) sub-problem, or NULL for
+ * the full matrix. Both halves of a banded split stay inside the band of the
+ * parent, shifted by the split point; the small base cases run unbanded,
+ * which can only find an equal or better path.
+ */
+void hirschberg_align(const Workspace* ws, int offA, int lenA, int offB, int lenB,
+                      const Band* band, int depth) {
+    if (lenA <= HIRSCHBERG_THRESHOLD || lenB <= HIRSCHBERG_THRESHOLD) {
+        nw_full(ws, offA, lenA, offB, lenB);
+        return;
+    }
 
-    Alignment result;
-    result.alignedA = alignedA;
-    result.alignedB = alignedB;
-    result.length = ai;
+    int midA = lenA / 2;
+    int* scoreL = ws_row(ws, 0, offA, offB);
+    int* scoreR = ws_row(ws, 1, offA, offB);
+
+    /*
+     * Inside the parallel region of align_pair() (or a batch worker) the two
+     * half passes and the two sub-problems are tasks; below TASK_MIN_CELLS
+     * they run inline. Large unbanded passes are further split into tile tasks,
+     * unless the bit-parallel pass is on, which beats the tiles on a few threads.
+     */
+    int spawn = in_parallel() && (long)lenA * lenB >= TASK_MIN_CELLS;
+    (void)spawn;    /* only read by the task pragmas, which serial builds ignore */
+    int tiled = !band && !bitpar && in_parallel() && (long)lenA * lenB >= TILED_MIN_CELLS;
+
+    #pragma omp task if(spawn)
+    {
+        if (band) nw_score_band(ws, offA, midA, offB, lenB, 0, band->lo, band->hi, scoreL);
+        else if (tiled) nw_score_tiled(ws, offA, midA, offB, lenB, 0, scoreL, ws_row(ws, 2, offA, offB));
+        else if (bitpar) nw_score_bitpar(ws, offA, midA, offB, lenB, 0, scoreL);
+        else nw_score(ws, offA, midA, offB, lenB, 0, scoreL);
+    }
+    if (band) nw_score_band(ws, offA + midA, lenA - midA, offB, lenB, 1,
+                            lenB - lenA - band->hi, lenB - lenA - band->lo, scoreR);
+    else if (tiled) nw_score_tiled(ws, offA + midA, lenA - midA, offB, lenB, 1, scoreR, ws_row(ws, 3, offA, offB));
+    else if (bitpar) nw_score_bitpar(ws, offA + midA, lenA - midA, offB, lenB, 1, scoreR);
+    else nw_score(ws, offA + midA, lenA - midA, offB, lenB, 1, scoreR);
+    #pragma omp taskwait
+
+    int midB = -1;
+    int max_score = NEG_INF;
+    for (int j = 0; j <= lenB; j++) {
+        if (scoreL[j] == NEG_INF || scoreR[lenB - j] == NEG_INF) continue;
+        int score = scoreL[j] + scoreR[lenB - j];
+        if (midB < 0 || score > max_score) {
+            max_score = score;
+            midB = j;
+        }
+    }
 
-    for (int i = 0; i <= lenA; i++) free(dp[i]);
-    free(dp);
+    Band bandR;
+    if (band) {
+        bandR.lo = band->lo - (midB - midA);
+        bandR.hi = band->hi - (midB - midA);
+    }
 
-    return result;
+    #pragma omp task if(spawn)
+    hirschberg_align(ws, offA, midA, offB, midB, band, depth + 1);
+    hirschberg_align(ws, offA + midA, lenA - midA, offB + midB, lenB - midB,
+                     band ? &bandR : NULL, depth + 1);
+    #pragma omp taskwait
 }
 
-Alignment hirschberg_align(char* seqA, char* seqB, int depth) {
-    int lenA = strlen(seqA);
-    int lenB = strlen(seqB);
-
-    Alignment result;
-    result.alignedA = NULL;
-    result.alignedB = NULL;
-    result.length = 0;
+/*
+ * Affine (Gotoh) version of nw_score(): a gap of length k scores
+ * gap_open + k * gap_extend. Fills the last row of the best score (CC) and
+ * of the best score ending in a vertical gap, i.e. with the last character
+ * of seqA against '_' (DD). tb is the opening cost of a vertical gap starting
+ * at the top-left corner: gap_open, or 0 when it continues a gap of the caller.
+ */
+void nw_score_affine(const Workspace* ws, int offA, int lenA, int offB, int lenB, int reverse,
+                     int tb, int* CC, int* DD) {
+    INSTR_SCOPE("score pass affine");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int gap_open = scoring.gap_open, gap_extend = scoring.gap_extend;
+    int step = reverse ? -1 : 1;
+    const uint8_t* a = reverse ? ws->a + offA + lenA - 1 : ws->a + offA;
+    int pb = reverse ? offB + lenB : offB - 1;
+
+    CC[0] = 0;
+    DD[0] = NEG_INF;
+    for (int j = 1; j <= lenB; j++) {
+        CC[j] = gap_open + j * gap_extend;
+        DD[j] = NEG_INF;
+    }
 
-    if (lenA == 0) {
-        result.alignedA = (char*)malloc(lenB + 1);
-        result.alignedB = (char*)malloc(lenB + 1);
-        for (int i = 0; i < lenB; i++) {
-            result.alignedA[i] = '_';
-            result.alignedB[i] = seqB[i];
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = ws->prof.row[a[step * (i-1)]] + pb;
+        int diag = CC[0];
+        CC[0] = DD[0] = tb + i * gap_extend;
+        int left_gap = NEG_INF;
+        for (int j = 1; j <= lenB; j++) {
+            int up_ext = DD[j] + gap_extend;
+            int up_open = CC[j] + gap_open + gap_extend;
+            DD[j] = up_ext > up_open ? up_ext : up_open;
+            int left_ext = left_gap + gap_extend;
+            int left_open = CC[j-1] + gap_open + gap_extend;
+            left_gap = left_ext > left_open ? left_ext : left_open;
+            int best = max3(diag + s[step * j], DD[j], left_gap);
+            diag = CC[j];
+            CC[j] = best;
         }
-        result.alignedA[lenB] = '\0';
-        result.alignedB[lenB] = '\0';
-        result.length = lenB;
-        return result;
     }
+}
+
+/* Writes n gap columns (CIGAR_INS: seqA against '_', CIGAR_DEL: '_' against seqB) at output position pos. */
+void put_gap_run(const Workspace* ws, int pos, int n, int op) {
+    memset(ws->ops + pos, op, n);
+}
+
+/*
+ * Myers-Miller: hirschberg_align() for affine gaps. The split row midA is
+ * crossed either at a cell (CC + RR, as in the linear version) or inside a
+ * vertical gap that deletes seqA[midA-1] and seqA[midA] (DD + SS, counting
+ * gap_open once). In the second case the halves are recursed with the gap
+ * already open at their shared corner (te = 0 / tb = 0). Uses the four
+ * workspace rows of its slot, so memory stays O(lenA + lenB).
+ */
+void hirschberg_affine(const Workspace* ws, int offA, int lenA, int offB, int lenB,
+                       int tb, int te, int depth) {
+    const int gap_open = scoring.gap_open, gap_extend = scoring.gap_extend;
+    const uint8_t* a = ws->a + offA;
+    const uint8_t* b = ws->b + offB;
+    int pos = offA + offB;
 
     if (lenB == 0) {
-        result.alignedA = (char*)malloc(lenA + 1);
-        result.alignedB = (char*)malloc(lenA + 1);
-        for (int i = 0; i < lenA; i++) {
-            result.alignedA[i] = seqA[i];
-            result.alignedB[i] = '_';
-        }
-        result.alignedA[lenA] = '\0';
-        result.alignedB[lenA] = '\0';
-        result.length = lenA;
-        return result;
+        put_gap_run(ws, pos, lenA, CIGAR_INS);
+        return;
+    }
+    if (lenA == 0) {
+        put_gap_run(ws, pos, lenB, CIGAR_DEL);
+        return;
     }
 
-    if (lenA <= HIRSCHBERG_THRESHOLD || lenB <= HIRSCHBERG_THRESHOLD) {
-        return nw_full(seqA, seqB);
+    if (lenA == 1) {
+        /* Either delete a[0] next to the cheaper open end and insert b... */
+        int ends = tb > te ? tb : te;
+        int best = ends + gap_extend + gap_open + lenB * gap_extend;
+        int midB = -1;
+        /* ...or align it with one character of b. */
+        for (int j = 0; j < lenB; j++) {
+            int score = ws->prof.row[a[0]][offB + j];
+            if (j > 0) score += gap_open + j * gap_extend;
+            if (lenB - 1 - j > 0) score += gap_open + (lenB - 1 - j) * gap_extend;
+            if (score > best) {
+                best = score;
+                midB = j;
+            }
+        }
+
+        if (midB < 0) {
+            int del = te > tb ? pos + lenB : pos;
+            put_gap_run(ws, te > tb ? pos : pos + 1, lenB, CIGAR_DEL);
+            put_gap_run(ws, del, 1, CIGAR_INS);
+            return;
+        }
+        put_gap_run(ws, pos, midB, CIGAR_DEL);
+        ws->ops[pos + midB] = a[0] == b[midB] ? CIGAR_EQ : CIGAR_X;
+        put_gap_run(ws, pos + midB + 1, lenB - midB - 1, CIGAR_DEL);
+        return;
     }
 
     int midA = lenA / 2;
+    int* CC = ws_row(ws, 0, offA, offB);
+    int* DD = ws_row(ws, 1, offA, offB);
+    int* RR = ws_row(ws, 2, offA, offB);
+    int* SS = ws_row(ws, 3, offA, offB);
+
+    /* Same task split as hirschberg_align(). */
+    int spawn = in_parallel() && (long)lenA * lenB >= TASK_MIN_CELLS;
+    (void)spawn;
+
+    #pragma omp task if(spawn)
+    nw_score_affine(ws, offA, midA, offB, lenB, 0, tb, CC, DD);
+    nw_score_affine(ws, offA + midA, lenA - midA, offB, lenB, 1, te, RR, SS);
+    #pragma omp taskwait
+
+    int midB = 0, in_gap = 0;
+    int max_score = CC[0] + RR[lenB];
+    for (int j = 0; j <= lenB; j++) {
+        int score = CC[j] + RR[lenB - j];
+        if (score > max_score) {
+            max_score = score;
+            midB = j;
+            in_gap = 0;
+        }
+        score = DD[j] + SS[lenB - j] - gap_open;
+        if (score > max_score) {
+            max_score = score;
+            midB = j;
+            in_gap = 1;
+        }
+    }
 
-    char* seqA_left = (char*)malloc(midA + 1);
-    strncpy(seqA_left, seqA, midA);
-    seqA_left[midA] = '\0';
-    int* scoreL = nw_score(seqA_left, seqB);
-    free(seqA_left);
+    /* In a gap the split consumes a[midA-1] and a[midA]. */
+    int endL = in_gap ? midA - 1 : midA;
+    int startR = in_gap ? midA + 1 : midA;
+    if (in_gap) put_gap_run(ws, pos + endL + midB, 2, CIGAR_INS);
 
-    char* seqA_right = (char*)malloc((lenA - midA) + 1);
-    char* seqB_rev = (char*)malloc(lenB + 1);
+    #pragma omp task if(spawn)
+    hirschberg_affine(ws, offA, endL, offB, midB, tb, in_gap ? 0 : gap_open, depth + 1);
+    hirschberg_affine(ws, offA + startR, lenA - startR, offB + midB, lenB - midB,
+                      in_gap ? 0 : gap_open, te, depth + 1);
+    #pragma omp taskwait
+}
 
-    for (int i = 0; i < lenA - midA; i++) {
-        seqA_right[i] = seqA[lenA - 1 - i];
+/*
+ * Full alignment, optionally restricted to a diagonal band (--band). The band
+ * starts at band_width (or 1% of the longer sequence + 64 when automatic) and
+ * doubles until its score passes band_escape_bound(); once it would cover the
+ * whole matrix the unbanded path is used. *width is the accepted width, or 0.
+ * The recursion writes into one workspace; the only allocations are the score
+ * rows, the query profile of seqB, the op columns and the CIGAR, plus the
+ * small per-pass bit vectors of nw_score_bitpar().
+ */
+Alignment align_pair(const uint8_t* seqA, int lenA, const uint8_t* seqB, int lenB, int* width) {
+    /* One team for the whole recursion; hirschberg_align() spawns the tasks. */
+    if (num_threads > 1 && !in_parallel()) {
+        Alignment result;
+        #pragma omp parallel
+        #pragma omp single
+        result = align_pair(seqA, lenA, seqB, lenB, width);
+        return result;
+    }
+    INSTR_SCOPE("align");
+
+    int longer = lenA > lenB ? lenA : lenB;
+    int delta = lenB - lenA;
+
+    Workspace ws;
+    ws.a = seqA;
+    ws.b = seqB;
+    nt_profile_build(&ws.prof, seqB, lenB, seqA, lenA, scoring.table);
+    ws.stride = (size_t)lenA + lenB + lenA / TILE_SIZE + 8;
+    ws.rows = (int*)malloc(WS_ROWS * ws.stride * sizeof(int));
+    ws.ops = (uint8_t*)calloc(lenA + lenB + 1, 1);
+    INSTR_ALLOC(WS_ROWS * ws.stride * sizeof(int) + lenA + lenB + 1);
+
+    if (width) *width = 0;
+    if (scoring.gap_model == GAP_AFFINE) {
+        hirschberg_affine(&ws, 0, lenA, 0, lenB, scoring.gap_open, scoring.gap_open, 0);
+    } else {
+        Band band;
+        int banded = 0;
+        for (int w = band_width > 0 ? band_width : longer / 100 + 64; band_width >= 0 && w < longer; w *= 2) {
+            band.lo = (delta < 0 ? delta : 0) - w;
+            band.hi = (delta > 0 ? delta : 0) + w;
+            nw_score_band(&ws, 0, lenA, 0, lenB, 0, band.lo, band.hi, ws.rows);
+            if (ws.rows[lenB] >= band_escape_bound(lenA, lenB, w)) {
+                if (width) *width = w;
+                banded = 1;
+                break;
+            }
+        }
+        hirschberg_align(&ws, 0, lenA, 0, lenB, banded ? &band : NULL, 0);
     }
-    seqA_right[lenA - midA] = '\0';
+    free(ws.rows);
+    nt_profile_free(&ws.prof);
 
-    for (int i = 0; i < lenB; i++) {
-        seqB_rev[i] = seqB[lenB - 1 - i];
+    /* Run-length encode the used columns; the gapped strings are only made for text output. */
+    Alignment result;
+    cigar_init(&result.cigar);
+    result.length = 0;
+    for (int p = 0; p < lenA + lenB; p++) {
+        if (!ws.ops[p]) continue;
+        cigar_append(&result.cigar, ws.ops[p], 1);
+        result.length++;
     }
-    seqB_rev[lenB] = '\0';
+    free(ws.ops);
+    return result;
+}
 
-    int* scoreR = nw_score(seqA_right, seqB_rev);
-    free(seqA_right);
-    free(seqB_rev);
+/*
+ * Part of seqA and seqB the selected mode aligns: both sequences for global,
+ * otherwise the region aln_locate() finds with two linear-space score-only
+ * passes. align_pair() and nw_score_summary() then run on the region, so
+ * local and semi-global alignments keep the O(n + m) memory of the global
+ * recursion.
+ */
+AlnRegion pair_region(const uint8_t* seqA, int lenA, const uint8_t* seqB, int lenB) {
+    if (aln_mode == ALN_GLOBAL) return aln_region_full(lenA, lenB, 0);
+    INSTR_SCOPE("locate");
+    return aln_locate(&scoring, aln_mode, seqA, lenA, seqB, lenB);
+}
 
-    int midB = 0;
-    int max_score = scoreL[0] + scoreR[lenB];
-    for (int j = 1; j <= lenB; j++) {
-        int score = scoreL[j] + scoreR[lenB - j];
-        if (score > max_score) {
-            max_score = score;
-            midB = j;
+typedef struct {
+    int score;
+    int matches;
+    int mismatches;
+    int gaps;
+    double similarity;
+} AlignmentStats;
+
+/* Stats of an alignment of seqA and seqB from its CIGAR; each I or D run is one gap. */
+AlignmentStats summarize_alignment(const Alignment* result, const uint8_t* seqA, const uint8_t* seqB) {
+    AlignmentStats st = {0, 0, 0, 0, 0.0};
+    const uint32_t* ops = cigar_ops(&result->cigar);
+    int i = 0, j = 0;
+    for (int k = 0; k < cigar_count(&result->cigar); k++) {
+        int run = ops[k] >> 4, op = ops[k] & 15;
+        if (op == CIGAR_INS || op == CIGAR_DEL) {
+            st.gaps += run;
+            st.score += scoring_gap(&scoring, run);
+            if (op == CIGAR_INS) i += run;
+            else j += run;
+            continue;
         }
+        if (op == CIGAR_EQ) st.matches += run;
+        else st.mismatches += run;
+        for (int r = 0; r < run; r++, i++, j++) st.score += scoring.table[seqA[i] * NT_CODES + seqB[j]];
     }
+    if (result->length > 0) {
+        st.similarity = (double)st.matches / (st.matches + st.mismatches + st.gaps) * 100.0;
+    }
+    return st;
+}
+
+/*
+ * Score-only pass: the nw_score() two-row recurrence, additionally carrying
+ * the match and gap counts of the path a full traceback would follow
+ * (diag > up > left on ties). The shorter sequence is used for the row, so
+ * memory is O(min(lenA, lenB)) and nothing is traced back. When the inputs
+ * are swapped the tie order becomes diag > left > up, so the counts are
+ * those of an optimal alignment, not necessarily the one nw_full() prints;
+ * the scores come from the transposed table, so an asymmetric matrix still
+ * scores seqA letters against seqB letters.
+ */
+AlignmentStats nw_score_summary(const uint8_t* seqA, int lenA, const uint8_t* seqB, int lenB) {
+    INSTR_SCOPE("fill score-only");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int8_t* table = scoring.table;
+    int8_t transposed[NT_CODES * NT_CODES];
+    if (lenB > lenA) {
+        const uint8_t* tmp = seqA; seqA = seqB; seqB = tmp;
+        int t = lenA; lenA = lenB; lenB = t;
+        scoring_transpose(scoring.table, transposed);
+        table = transposed;
+    }
+    NtProfile prof;
+    nt_profile_build(&prof, seqB, lenB, seqA, lenA, table);
+    const int gap = scoring.gap;
+
+    int* rows = (int*)malloc(6 * (lenB + 1) * sizeof(int));
+    int* prev_row = rows;
+    int* prev_match = rows + (lenB + 1);
+    int* prev_gap = rows + 2 * (lenB + 1);
+    int* curr_row = rows + 3 * (lenB + 1);
+    int* curr_match = rows + 4 * (lenB + 1);
+    int* curr_gap = rows + 5 * (lenB + 1);
 
-    free(scoreL);
-    free(scoreR);
+    for (int j = 0; j <= lenB; j++) {
+        prev_row[j] = j * gap;
+        prev_match[j] = 0;
+        prev_gap[j] = j;
+    }
 
-    char* seqA_L = (char*)malloc(midA + 1);
-    char* seqB_L = (char*)malloc(midB + 1);
-    char* seqA_R = (char*)malloc((lenA - midA) + 1);
-    char* seqB_R = (char*)malloc((lenB - midB) + 1);
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = prof.row[seqA[i-1]] - 1;
+        curr_row[0] = i * gap;
+        curr_match[0] = 0;
+        curr_gap[0] = i;
+        for (int j = 1; j <= lenB; j++) {
+            int is_match = seqA[i-1] == seqB[j-1];
+            int diag = prev_row[j-1] + s[j];
+            int up = prev_row[j] + gap;
+            int left = curr_row[j-1] + gap;
+            int best = max3(diag, up, left);
+            curr_row[j] = best;
+            if (best == diag) {
+                curr_match[j] = prev_match[j-1] + is_match;
+                curr_gap[j] = prev_gap[j-1];
+            } else if (best == up) {
+                curr_match[j] = prev_match[j];
+                curr_gap[j] = prev_gap[j] + 1;
+            } else {
+                curr_match[j] = curr_match[j-1];
+                curr_gap[j] = curr_gap[j-1] + 1;
+            }
+        }
+        int* temp = prev_row; prev_row = curr_row; curr_row = temp;
+        temp = prev_match; prev_match = curr_match; curr_match = temp;
+        temp = prev_gap; prev_gap = curr_gap; curr_gap = temp;
+    }
 
-    strncpy(seqA_L, seqA, midA);
-    seqA_L[midA] = '\0';
-    strncpy(seqB_L, seqB, midB);
-    seqB_L[midB] = '\0';
-    strncpy(seqA_R, seqA + midA, lenA - midA);
-    seqA_R[lenA - midA] = '\0';
-    strncpy(seqB_R, seqB + midB, lenB - midB);
-    seqB_R[lenB - midB] = '\0';
+    AlignmentStats st;
+    st.score = prev_row[lenB];
+    st.matches = prev_match[lenB];
+    st.gaps = prev_gap[lenB];
+    st.mismatches = (lenA + lenB - st.gaps) / 2 - st.matches;
+    int length = st.matches + st.mismatches + st.gaps;
+    st.similarity = length > 0 ? (double)st.matches / length * 100.0 : 0.0;
+
+    free(rows);
+    nt_profile_free(&prof);
+    return st;
+}
 
-    Alignment left = hirschberg_align(seqA_L, seqB_L, depth + 1);
-    Alignment right = hirschberg_align(seqA_R, seqB_R, depth + 1);
+double wall_time(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
-    free(seqA_L);
-    free(seqB_L);
-    free(seqA_R);
-    free(seqB_R);
+/*
+ * Single-pair output: the --format record, or for text the report with the
+ * gapped strings. sub1 / sub2 are the region's codes.
+ */
+void write_alignment(FILE* fout, const char* name1, int len1, const char* name2, int len2,
+                     const uint8_t* sub1, const uint8_t* sub2, const AlnRegion* region,
+                     const Alignment* result, const AlignmentStats* st, double duration) {
+    INSTR_SCOPE("output");
+    if (out_format != ALN_TEXT) {
+        const char* target = name2;
+        AlnRecord rec = aln_record_region(name1, len1, name2, len2, region, &result->cigar);
+        aln_write_header(fout, out_format, "hirschberg_generic", &target, &len2, 1);
+        aln_write(fout, out_format, &rec);
+        return;
+    }
+    char scheme[160];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    char* alignedA;
+    char* alignedB;
+    cigar_gapped_codes(&result->cigar, sub1, sub2, &alignedA, &alignedB);
+    fprintf(fout, "%s vs %s - Hirschberg Alignment\n", name1, name2);
+    fprintf(fout, "Scoring: %s\n", scheme);
+    if (aln_mode != ALN_GLOBAL) {
+        char mode[64];
+        aln_mode_describe(aln_mode, mode, sizeof(mode));
+        fprintf(fout, "Mode: %s\n", mode);
+        fprintf(fout, "Region: %s[%d, %d) %s[%d, %d)\n", name1, region->a_start, region->a_end,
+                name2, region->b_start, region->b_end);
+    }
+    fprintf(fout, "Execution Time: %.4f seconds\n", duration);
+    fprintf(fout, "Alignment Score: %d\n", st->score);
+    fprintf(fout, "Aligned Length: %d\n", result->length);
+    fprintf(fout, "Matches: %d, Mismatches: %d, Gaps: %d\n", st->matches, st->mismatches, st->gaps);
+    fprintf(fout, "Similarity: %.2f%%\n\n", st->similarity);
+    fprintf(fout, "Aligned %s:\n%s\n\n", name1, alignedA);
+    fprintf(fout, "Aligned %s:\n%s\n", name2, alignedB);
+    free(alignedA);
+    free(alignedB);
+}
 
-    result.length = left.length + right.length;
-    result.alignedA = (char*)malloc(result.length + 1);
-    result.alignedB = (char*)malloc(result.length + 1);
+/*
+ * One --bench run (bench.h). The recursion writes the path while it fills,
+ * so there is no separate traceback phase: encoding, the region search and
+ * align_pair() are fill, the stats and the record are I/O.
+ */
+int bench_hirschberg(void* ctx, const char* a, int lenA, const char* b, int lenB, FILE* io, BenchPhases* t) {
+    (void)ctx;
+    double start = wall_time();
+    uint8_t* codesA = nt_encode_dup(a, lenA);
+    uint8_t* codesB = nt_encode_dup(b, lenB);
+    AlnRegion region = pair_region(codesA, lenA, codesB, lenB);
+    const uint8_t* sub1 = codesA + region.a_start;
+    const uint8_t* sub2 = codesB + region.b_start;
+    int sublenA = region.a_end - region.a_start;
+    int sublenB = region.b_end - region.b_start;
+    AlignmentStats st;
+
+    if (score_only) {
+        st = nw_score_summary(sub1, sublenA, sub2, sublenB);
+        t->fill = wall_time() - start;
+    } else {
+        Alignment result = align_pair(sub1, sublenA, sub2, sublenB, NULL);
+        double filled = wall_time();
+        t->fill = filled - start;
+        st = summarize_alignment(&result, sub1, sub2);
+        region.score = st.score;
+        write_alignment(io, "A", lenA, "B", lenB, sub1, sub2, &region, &result, &st, 0.0);
+        fflush(io);
+        t->io = wall_time() - filled;
+        cigar_free(&result.cigar);
+    }
+    free(codesA);
+    free(codesB);
+    return st.score;
+}
 
-    memcpy(result.alignedA, left.alignedA, left.length);
-    memcpy(result.alignedA + left.length, right.alignedA, right.length);
-    result.alignedA[result.length] = '\0';
+/* ---------------------------------------------------------------------
+ * Batch mode
+ * ------------------------------------------------------------------- */
 
-    memcpy(result.alignedB, left.alignedB, left.length);
-    memcpy(result.alignedB + left.length, right.alignedB, right.length);
-    result.alignedB[result.length] = '\0';
+/* Sequences wait in the table 2-bit packed and are unpacked per pair. */
+typedef struct {
+    char* name;
+    NtPacked seq;
+    int len;
+} SeqRecord;
 
-    free(left.alignedA);
-    free(left.alignedB);
-    free(right.alignedA);
-    free(right.alignedB);
+typedef struct {
+    SeqRecord* items;
+    int count;
+    int capacity;
+} SeqTable;
 
-    return result;
+typedef struct {
+    int a;
+    int b;
+    long cost;
+} PairTask;
+
+/* Takes ownership of name; seq is packed into the table and stays with the caller. */
+int seq_table_add(SeqTable* table, char* name, const char* seq, size_t len) {
+    if (table->count == table->capacity) {
+        table->capacity = table->capacity ? table->capacity * 2 : 16;
+        table->items = (SeqRecord*)realloc(table->items, table->capacity * sizeof(SeqRecord));
+    }
+    SeqRecord* rec = &table->items[table->count];
+    rec->name = name;
+    nt_pack(&rec->seq, seq, len);
+    rec->len = len;
+    return table->count++;
+}
+
+/* Byte codes of a record in a new buffer. */
+uint8_t* seq_table_codes(const SeqRecord* rec) {
+    uint8_t* codes = (uint8_t*)malloc(rec->len + 1);
+    nt_unpack(&rec->seq, codes);
+    return codes;
+}
+
+void seq_table_free(SeqTable* table) {
+    for (int i = 0; i < table->count; i++) {
+        free(table->items[i].name);
+        nt_packed_free(&table->items[i].seq);
+    }
+    free(table->items);
 }
 
-char* read_fasta(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        printf("Cannot open file: %s\n", filename);
-        return NULL;
+/* Reads every record of a multi-FASTA file; the record name is the header
+ * up to the first whitespace. Returns the number of records added. */
+int read_fasta_records(const char* filename, SeqTable* table) {
+    INSTR_SCOPE("fasta");
+    FastaReader reader;
+    if (fasta_open(&reader, filename) != 0) return -1;
+
+    int added = 0;
+    while (fasta_next(&reader) > 0) {
+        seq_table_add(table, strdup(reader.name), reader.seq, reader.seq_len);
+        added++;
     }
 
-    fseek(file, 0, SEEK_END);
-    long fsize = ftell(file);
-    rewind(file);
+    fasta_close(&reader);
+    return added;
+}
 
-    char* sequence = (char*)malloc(fsize + 1);
-    char line[1024];
-    int pos = 0;
+/* Looks a FASTA path up in the table (by basename) and loads it on first use. */
+int seq_table_load(SeqTable* table, const char* path) {
+    char* name = get_basename_without_ext(path);
+    for (int i = 0; i < table->count; i++) {
+        if (strcmp(table->items[i].name, name) == 0) {
+            free(name);
+            return i;
+        }
+    }
+    INSTR_SCOPE("fasta");
+    char* seq = fasta_read_first(path);
+    if (!seq) {
+        free(name);
+        return -1;
+    }
+    int index = seq_table_add(table, name, seq, strlen(seq));
+    free(seq);
+    return index;
+}
+
+/*
+ * Work-stealing scheduler. Pairs are sorted by DP cost (lenA * lenB), largest
+ * first, and dealt round-robin into one deque per thread so every deque
+ * starts out sorted and roughly equally loaded. A thread pops the biggest
+ * pair from the head of its own deque; once that is empty it steals the
+ * smallest remaining pair from the tail of another thread's deque. No task
+ * ever spawns new work, so a thread exits when every deque is empty.
+ */
+typedef struct {
+    int* tasks;
+    int head;
+    int tail;
+#ifdef _OPENMP
+    omp_lock_t lock;
+#endif
+} TaskDeque;
+
+#ifdef _OPENMP
+#define deque_lock(d) omp_set_lock(&(d)->lock)
+#define deque_unlock(d) omp_unset_lock(&(d)->lock)
+#else
+#define deque_lock(d) ((void)0)
+#define deque_unlock(d) ((void)0)
+#endif
+
+int deque_pop_head(TaskDeque* d) {
+    int task = -1;
+    deque_lock(d);
+    if (d->head < d->tail) task = d->tasks[d->head++];
+    deque_unlock(d);
+    return task;
+}
+
+int deque_steal_tail(TaskDeque* d) {
+    int task = -1;
+    deque_lock(d);
+    if (d->head < d->tail) task = d->tasks[--d->tail];
+    deque_unlock(d);
+    return task;
+}
+
+int compare_task_cost(const void* x, const void* y) {
+    long cx = ((const PairTask*)x)->cost;
+    long cy = ((const PairTask*)y)->cost;
+    return (cx < cy) - (cx > cy);
+}
+
+void run_batch(SeqTable* table, PairTask* pairs, int npairs, FILE* out) {
+    int nthreads = num_threads < npairs ? num_threads : npairs;
+    if (nthreads < 1) nthreads = 1;
+
+    qsort(pairs, npairs, sizeof(PairTask), compare_task_cost);
+
+    TaskDeque* deques = (TaskDeque*)calloc(nthreads, sizeof(TaskDeque));
+    for (int t = 0; t < nthreads; t++) {
+        deques[t].tasks = (int*)malloc((npairs / nthreads + 1) * sizeof(int));
+#ifdef _OPENMP
+        omp_init_lock(&deques[t].lock);
+#endif
+    }
+    for (int k = 0; k < npairs; k++) {
+        TaskDeque* d = &deques[k % nthreads];
+        d->tasks[d->tail++] = k;
+    }
 
-    while (fgets(line, sizeof(line), file)) {
-        if (line[0] == '>') continue;
-        for (int i = 0; line[i]; i++) {
-            if (line[i] >= 'A' && line[i] <= 'Z') {
-                sequence[pos++] = line[i];
+    if (out_format == ALN_TEXT) {
+        fprintf(out, "#seqA\tseqB\tlenA\tlenB\tscore\taligned_len\tmatches\tmismatches\tgaps\tsimilarity\tseconds%s\n",
+                aln_mode != ALN_GLOBAL ? "\tstartA\tendA\tstartB\tendB" : "");
+    } else {
+        aln_write_header(out, out_format, "hirschberg_generic", NULL, NULL, 0);
+    }
+    fflush(out);
+
+    int done = 0;
+    double batch_start = wall_time();
+
+    #pragma omp parallel num_threads(nthreads)
+    {
+        int tid = thread_id();
+        for (;;) {
+            int task = deque_pop_head(&deques[tid]);
+            for (int v = 1; task < 0 && v < nthreads; v++) {
+                task = deque_steal_tail(&deques[(tid + v) % nthreads]);
             }
+            if (task < 0) break;
+
+            SeqRecord* ra = &table->items[pairs[task].a];
+            SeqRecord* rb = &table->items[pairs[task].b];
+
+            double start = wall_time();
+            uint8_t* codesA = seq_table_codes(ra);
+            uint8_t* codesB = seq_table_codes(rb);
+            AlnRegion region = pair_region(codesA, ra->len, codesB, rb->len);
+            const uint8_t* subA = codesA + region.a_start;
+            const uint8_t* subB = codesB + region.b_start;
+            int subLenA = region.a_end - region.a_start;
+            int subLenB = region.b_end - region.b_start;
+            Alignment result;
+            AlignmentStats st;
+            if (score_only) {
+                st = nw_score_summary(subA, subLenA, subB, subLenB);
+                cigar_init(&result.cigar);
+                result.length = st.matches + st.mismatches + st.gaps;
+            } else {
+                result = align_pair(subA, subLenA, subB, subLenB, NULL);
+                st = summarize_alignment(&result, subA, subB);
+            }
+            region.score = st.score;
+            free(codesA);
+            free(codesB);
+            double duration = wall_time() - start;
+
+            /* Stream each result as soon as it completes. */
+            #pragma omp critical(batch_output)
+            {
+                INSTR_SCOPE("output");
+                if (out_format == ALN_TEXT) {
+                    fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t%.2f\t%.4f",
+                            ra->name, rb->name, ra->len, rb->len, st.score, result.length,
+                            st.matches, st.mismatches, st.gaps, st.similarity, duration);
+                    if (aln_mode != ALN_GLOBAL) {
+                        fprintf(out, "\t%d\t%d\t%d\t%d", region.a_start, region.a_end, region.b_start, region.b_end);
+                    }
+                    putc('\n', out);
+                } else {
+                    AlnRecord rec = aln_record_region(ra->name, ra->len, rb->name, rb->len, &region, &result.cigar);
+                    aln_write(out, out_format, &rec);
+                }
+                fflush(out);
+                done++;
+            }
+
+            cigar_free(&result.cigar);
         }
     }
-    sequence[pos] = '\0';
-    fclose(file);
-    return sequence;
+
+    fprintf(stderr, "Aligned %d pairs in %.4f seconds (%d threads)\n", done, wall_time() - batch_start, nthreads);
+
+    for (int t = 0; t < nthreads; t++) {
+        free(deques[t].tasks);
+#ifdef _OPENMP
+        omp_destroy_lock(&deques[t].lock);
+#endif
+    }
+    free(deques);
 }
 
-char* get_basename_without_ext(const char* path) {
-    char* path_copy = strdup(path);
-    char* base = basename(path_copy);
-    char* dot = strrchr(base, '.');
-    if (dot) *dot = '\0';
+/* Pair list: one "<fasta_a> <fasta_b>" pair per line, '#' starts a comment. */
+int batch_pair_list(const char* list_path, FILE* out) {
+    FILE* list = fopen(list_path, "r");
+    if (!list) {
+        printf("Cannot open file: %s\n", list_path);
+        return 1;
+    }
 
-    char* result = strdup(base);
-    free(path_copy);
-    return result;
+    SeqTable table = {NULL, 0, 0};
+    PairTask* pairs = NULL;
+    int npairs = 0, capacity = 0;
+    char line[2048], pathA[1024], pathB[1024];
+
+    while (fgets(line, sizeof(line), list)) {
+        if (line[0] == '#' || sscanf(line, "%1023s %1023s", pathA, pathB) != 2) continue;
+        int a = seq_table_load(&table, pathA);
+        int b = seq_table_load(&table, pathB);
+        if (a < 0 || b < 0) continue;
+        if (npairs == capacity) {
+            capacity = capacity ? capacity * 2 : 64;
+            pairs = (PairTask*)realloc(pairs, capacity * sizeof(PairTask));
+        }
+        pairs[npairs].a = a;
+        pairs[npairs].b = b;
+        pairs[npairs].cost = (long)table.items[a].len * table.items[b].len;
+        npairs++;
+    }
+    fclose(list);
+
+    run_batch(&table, pairs, npairs, out);
+    free(pairs);
+    seq_table_free(&table);
+    return 0;
+}
+
+/* All-vs-all: every unordered pair of records in one multi-FASTA file. */
+int batch_all_vs_all(const char* fasta_path, FILE* out) {
+    SeqTable table = {NULL, 0, 0};
+    if (read_fasta_records(fasta_path, &table) < 0) return 1;
+
+    int npairs = table.count * (table.count - 1) / 2;
+    PairTask* pairs = (PairTask*)malloc((npairs + 1) * sizeof(PairTask));
+    int k = 0;
+    for (int a = 0; a < table.count; a++) {
+        for (int b = a + 1; b < table.count; b++) {
+            pairs[k].a = a;
+            pairs[k].b = b;
+            pairs[k].cost = (long)table.items[a].len * table.items[b].len;
+            k++;
+        }
+    }
+
+    run_batch(&table, pairs, npairs, out);
+    free(pairs);
+    seq_table_free(&table);
+    return 0;
 }
 
 int main(int argc, char* argv[]) {
-    if (argc != 3) {
-        printf("Usage: %s <fasta_file1> <fasta_file2>\n", argv[0]);
+    INSTR_INIT();
+    const char* files[2];
+    const char* pair_list = NULL;
+    const char* all_vs_all = NULL;
+    const char* out_path = NULL;
+    int nfiles = 0;
+    int no_bitpar = 0;
+    BenchConfig bench;
+    bench_init(&bench);
+    scoring_init(&scoring);
+    for (int i = 1; i < argc; i++) {
+        int opt = scoring_arg(&scoring, argc, argv, &i);
+        if (opt == 0) opt = aln_mode_arg(&aln_mode, argc, argv, &i);
+        if (opt == 0) opt = bench_arg(&bench, argc, argv, &i);
+        if (opt < 0) return 1;
+        if (opt > 0) continue;
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            num_threads = atoi(argv[++i]);
+            if (num_threads < 1) num_threads = 1;
+        } else if (strcmp(argv[i], "--pairs") == 0 && i + 1 < argc) {
+            pair_list = argv[++i];
+        } else if (strcmp(argv[i], "--all-vs-all") == 0 && i + 1 < argc) {
+            all_vs_all = argv[++i];
+        } else if (strcmp(argv[i], "--score-only") == 0) {
+            score_only = 1;
+        } else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+            const char* w = argv[++i];
+            band_width = strcmp(w, "auto") == 0 ? 0 : atoi(w);
+            if (band_width < 0) band_width = 0;
+        } else if (strcmp(argv[i], "--affine") == 0) {
+            scoring.set |= SCORING_SET_AFFINE;
+        } else if (strcmp(argv[i], "--no-bitpar") == 0) {
+            no_bitpar = 1;
+        } else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            int f = aln_format_parse(argv[++i]);
+            if (f < 0) return 1;
+            out_format = (AlnFormat)f;
+        } else if (nfiles < 2) {
+            files[nfiles++] = argv[i];
+        } else {
+            nfiles = -1;
+            break;
+        }
+    }
+
+    int batch = pair_list || all_vs_all;
+    int bad_args = bench.enabled ? nfiles != 0 || batch
+                 : batch ? nfiles != 0 || (pair_list && all_vs_all) : nfiles != 2;
+    if (bad_args) {
+        printf("Usage: %s [--threads N] [--score-only] [--band W|auto] [--affine] [--no-bitpar] <fasta_file1> <fasta_file2>\n", argv[0]);
+        printf("       %s [--threads N] [--score-only] [--band W|auto] [--affine] [--no-bitpar] [--out results.tsv] --pairs <pair_list>\n", argv[0]);
+        printf("       %s [--threads N] [--score-only] [--band W|auto] [--affine] [--no-bitpar] [--out results.tsv] --all-vs-all <multi.fasta>\n", argv[0]);
+        printf("Scoring: %s (--affine = --gap-open -10 --gap-extend -1)\n", SCORING_OPTIONS);
+        printf("Mode: %s (default global)\n", ALN_MODE_OPTIONS);
+        printf("Output: --format %s (text: report / TSV summary, the others need a traceback)\n", ALN_FORMATS);
+        printf("Benchmark: %s (instead of the FASTA files)\n", BENCH_OPTIONS);
         printf("Example: %s seq1.fasta seq2.fasta\n", argv[0]);
         return 1;
     }
+    if (scoring_finish(&scoring, GAP_LINEAR, SCORING_MODEL(GAP_LINEAR) | SCORING_MODEL(GAP_AFFINE)) != 0) {
+        return 1;
+    }
+    bitpar = !no_bitpar && bitpar_supported(&scoring);
+    if (scoring.gap_model == GAP_AFFINE && (score_only || band_width >= 0)) {
+        printf("Affine gaps cannot be combined with --score-only or --band\n");
+        return 1;
+    }
+    if (score_only && out_format != ALN_TEXT) {
+        printf("Only --format text can be combined with --score-only (the others need a traceback)\n");
+        return 1;
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(num_threads);
+#endif
+
+    if (bench.enabled) {
+        char scheme[160], mode[64];
+        scoring_describe(&scoring, scheme, sizeof(scheme));
+        aln_mode_describe(aln_mode, mode, sizeof(mode));
+        const char* engine = score_only ? "score-only"
+                           : scoring.gap_model == GAP_AFFINE ? "hirschberg-affine"
+                           : band_width >= 0 ? "hirschberg+band"
+                           : bitpar ? "hirschberg-bitpar" : "hirschberg";
+        BenchInfo info = {"hirschberg_generic", engine, num_threads, scheme, mode};
+        return bench_run(&bench, &info, bench_hirschberg, NULL);
+    }
 
-    printf("=== Hirschberg Algorithm - Generic Version ===\n\n");
+    if (batch) {
+        FILE* out = out_path ? fopen(out_path, out_format == ALN_BIN ? "wb" : "w") : stdout;
+        if (!out) {
+            printf("Cannot open file: %s\n", out_path);
+            return 1;
+        }
+        int rc = pair_list ? batch_pair_list(pair_list, out) : batch_all_vs_all(all_vs_all, out);
+        if (out != stdout) fclose(out);
+        return rc;
+    }
 
-    char* seq1 = read_fasta(argv[1]);
-    char* seq2 = read_fasta(argv[2]);
+    printf("=== Hirschberg Algorithm - Generic Version ===\n\n");
+    char scheme[160];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    printf("Scoring: %s\n", scheme);
+    char mode[64];
+    aln_mode_describe(aln_mode, mode, sizeof(mode));
+    if (aln_mode != ALN_GLOBAL) printf("Mode: %s\n", mode);
+
+    char* seq1;
+    char* seq2;
+    {
+        INSTR_SCOPE("fasta");
+        seq1 = fasta_read_first(files[0]);
+        seq2 = fasta_read_first(files[1]);
+    }
 
     if (!seq1 || !seq2) {
         printf("Failed to read sequences\n");
@@ -304,55 +1207,81 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
-    char* name1 = get_basename_without_ext(argv[1]);
-    char* name2 = get_basename_without_ext(argv[2]);
-
-    printf("Sequence 1 (%s): %d bp\n", name1, (int)strlen(seq1));
-    printf("Sequence 2 (%s): %d bp\n\n", name2, (int)strlen(seq2));
+    char* name1 = get_basename_without_ext(files[0]);
+    char* name2 = get_basename_without_ext(files[1]);
 
-    clock_t start = clock();
-    Alignment result = hirschberg_align(seq1, seq2, 0);
-    clock_t end = clock();
+    int len1 = strlen(seq1);
+    int len2 = strlen(seq2);
+    printf("Sequence 1 (%s): %d bp\n", name1, len1);
+    printf("Sequence 2 (%s): %d bp\n\n", name2, len2);
 
-    double duration = (double)(end - start) / CLOCKS_PER_SEC;
+    /* Encoded once; the letters are only needed again for the output. */
+    uint8_t* codes1 = nt_encode_dup(seq1, len1);
+    uint8_t* codes2 = nt_encode_dup(seq2, len2);
+    free(seq1);
+    free(seq2);
 
-    int matches = 0, mismatches = 0, gaps = 0, score = 0;
-    for (int i = 0; i < result.length; i++) {
-        if (result.alignedA[i] == '_' || result.alignedB[i] == '_') {
-            gaps++;
-            score += GAP;
-        } else if (result.alignedA[i] == result.alignedB[i]) {
-            matches++;
-            score += MATCH;
-        } else {
-            mismatches++;
-            score += MISMATCH;
+    if (score_only) {
+        double t0 = wall_time();
+        AlnRegion region = pair_region(codes1, len1, codes2, len2);
+        AlignmentStats st = nw_score_summary(codes1 + region.a_start, region.a_end - region.a_start,
+                                             codes2 + region.b_start, region.b_end - region.b_start);
+        double duration = wall_time() - t0;
+
+        printf("===== Hirschberg Score-Only Result =====\n");
+        printf("Execution Time: %.4f seconds\n", duration);
+        if (aln_mode != ALN_GLOBAL) {
+            printf("Region: %s[%d, %d) %s[%d, %d)\n", name1, region.a_start, region.a_end,
+                   name2, region.b_start, region.b_end);
         }
+        printf("Alignment Score: %d\n", st.score);
+        printf("Aligned Length: %d\n", st.matches + st.mismatches + st.gaps);
+        printf("Matches: %d, Mismatches: %d, Gaps: %d\n", st.matches, st.mismatches, st.gaps);
+        printf("Similarity: %.2f%%\n", st.similarity);
+
+        free(name1);
+        free(name2);
+        free(codes1);
+        free(codes2);
+        return 0;
     }
 
-    double similarity = (double)matches / (matches + mismatches + gaps) * 100.0;
+    double start = wall_time();
+    int width;
+    AlnRegion region = pair_region(codes1, len1, codes2, len2);
+    const uint8_t* sub1 = codes1 + region.a_start;
+    const uint8_t* sub2 = codes2 + region.b_start;
+    Alignment result = align_pair(sub1, region.a_end - region.a_start, sub2, region.b_end - region.b_start, &width);
+    double duration = wall_time() - start;
+    if (band_width >= 0) {
+        if (width > 0) printf("Band: +/-%d diagonals\n", width);
+        else printf("Band: widened to the full matrix\n");
+    }
+
+    AlignmentStats st = summarize_alignment(&result, sub1, sub2);
+    int matches = st.matches, mismatches = st.mismatches, gaps = st.gaps, score = st.score;
+    double similarity = st.similarity;
+    region.score = score;
 
     printf("===== Hirschberg Alignment Result =====\n");
     printf("Execution Time: %.4f seconds\n", duration);
+    if (aln_mode != ALN_GLOBAL) {
+        printf("Region: %s[%d, %d) %s[%d, %d)\n", name1, region.a_start, region.a_end,
+               name2, region.b_start, region.b_end);
+    }
     printf("Alignment Score: %d\n", score);
     printf("Aligned Length: %d\n", result.length);
     printf("Matches: %d, Mismatches: %d, Gaps: %d\n", matches, mismatches, gaps);
     printf("Similarity: %.2f%%\n\n", similarity);
 
-    // Save result to file
+    // Save result to file; only the text report spells out the gapped strings
     char output_filename[512];
-    snprintf(output_filename, sizeof(output_filename), "%s_vs_%s_hirschberg_alignment.txt", name1, name2);
+    snprintf(output_filename, sizeof(output_filename), "%s_vs_%s_hirschberg_alignment.%s",
+             name1, name2, aln_format_ext(out_format));
 
-    FILE* fout = fopen(output_filename, "w");
+    FILE* fout = fopen(output_filename, out_format == ALN_BIN ? "wb" : "w");
     if (fout) {
-        fprintf(fout, "%s vs %s - Hirschberg Alignment\n", name1, name2);
-        fprintf(fout, "Execution Time: %.4f seconds\n", duration);
-        fprintf(fout, "Alignment Score: %d\n", score);
-        fprintf(fout, "Aligned Length: %d\n", result.length);
-        fprintf(fout, "Matches: %d, Mismatches: %d, Gaps: %d\n", matches, mismatches, gaps);
-        fprintf(fout, "Similarity: %.2f%%\n\n", similarity);
-        fprintf(fout, "Aligned %s:\n%s\n\n", name1, result.alignedA);
-        fprintf(fout, "Aligned %s:\n%s\n", name2, result.alignedB);
+        write_alignment(fout, name1, len1, name2, len2, sub1, sub2, &region, &result, &st, duration);
         fclose(fout);
         printf("Result saved to: %s\n", output_filename);
     } else {
@@ -361,10 +1290,9 @@ int main(int argc, char* argv[]) {
 
     free(name1);
     free(name2);
-    free(seq1);
-    free(seq2);
-    free(result.alignedA);
-    free(result.alignedB);
+    free(codes1);
+    free(codes2);
+    cigar_free(&result.cigar);
 
     return 0;
 }
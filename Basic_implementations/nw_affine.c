@@ -2,18 +2,31 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/nt_code.h"
+#include "../common/scoring.h"
+#include "../common/aln_output.h"
+#include "../common/aln_mode.h"
+#include "../common/gotoh_fill.h"
+#include "../common/bench.h"
+#include "../common/instrument.h"
 
-#define MATCH 1
-#define MISMATCH -1
-#define GAP_OPEN -10
-#define GAP_EXTEND -1
 #define INF -1000000000
+#define TILE_SIZE 256
 
-typedef enum { STATE_M, STATE_DX, STATE_DY } State;
-
-int score(char a, char b) {
-    return (a == b) ? MATCH : MISMATCH;
-}
+/*
+    점수 체계는 scoring.h 로 실행 시 정한다 (--match/--mismatch 또는 --matrix, 갭 옵션).
+    갭 모델은 affine (gap_open + k * gap_extend) 과 convex 두 가지이다.
+    convex 는 두 affine 조각의 max 로, 긴 갭에서는 두 번째 조각 (gap_open2, gap_extend2) 이 이긴다.
+    채우기 루프는 문자 대신 nt_code.h 의 코드를 읽고, 점수는 B 의 query profile 에서 꺼낸다.
+*/
+static Scoring scoring;
+static AlnFormat out_format = ALN_TEXT;   // --format: text 는 기존 정렬 문자열 파일
+static int aln_mode = ALN_GLOBAL;         // --mode / --free-ends (aln_mode.h)
+static int verbose = 1;                   // --bench 는 반복마다 찍는 진행 메시지를 끈다
 
 char *generate_random_sequence(int length) {
     char *seq = malloc(length + 1);
@@ -25,173 +38,654 @@ char *generate_random_sequence(int length) {
     return seq;
 }
 
-void traceback(int **DP, int **Dx, int **Dy, State **trace, State **traceDx, State **traceDy, char *A, char *B, char **outA, char **outB) {
-    int i = strlen(A), j = strlen(B);
-    State state = STATE_M;
+/*
+    traceback 은 gotoh_fill.h 의 GotohTrace: 셀당 4비트 (한 바이트에 두 셀), convex 이면 두 번째 버퍼 bits2.
+    전체 행렬은 shift = 0, col0 = 1, 띠 행렬은 shift = 1, col0 = dlo 로 띠 폭만큼만 저장한다.
+    점수는 두 행만 유지하므로 10 kbp x 10 kbp 에서 약 50 MB (convex 는 그 두 배) 면 충분하다.
+*/
+GotohTrace trace_alloc(int lenA, int lenB, int convex) {
+    INSTR_SCOPE("trace alloc");
+    size_t bytes = (size_t)lenA * gotoh_trace_stride(lenB) + 1;
+    INSTR_ALLOC(bytes * (convex ? 2 : 1));
+    return gotoh_trace_full(calloc(bytes, 1), convex ? calloc(bytes, 1) : NULL, lenB);
+}
 
-    char *alignedA = malloc(i + j + 1);
-    char *alignedB = malloc(i + j + 1);
-    int idx = 0;
+// j - i 가 [dlo, dhi] 인 셀만 담는 띠 traceback
+GotohTrace trace_alloc_band(int lenA, int dlo, int dhi, int convex) {
+    INSTR_SCOPE("trace alloc");
+    GotohTrace t;
+    t.stride = ((size_t)(dhi - dlo + 1) + 1) / 2;
+    t.shift = 1;
+    t.col0 = dlo;
+    t.bits = calloc((size_t)lenA * t.stride + 1, 1);
+    t.bits2 = convex ? calloc((size_t)lenA * t.stride + 1, 1) : NULL;
+    INSTR_ALLOC(((size_t)lenA * t.stride + 1) * (convex ? 2 : 1));
+    return t;
+}
 
-    while (i > 0 || j > 0) {
-        if (state == STATE_M) {
-            State prev = trace[i][j];
-            if (prev == STATE_M) {
-                alignedA[idx] = A[i - 1];
-                alignedB[idx] = B[j - 1];
-                i--; j--;
-            } else if (prev == STATE_DX) {
-                state = STATE_DX;
-            } else {
-                state = STATE_DY;
-            }
-        } else if (state == STATE_DX) {
-            State prev = traceDx[i][j];
-            alignedA[idx] = A[i - 1];
-            alignedB[idx] = '_';
-            i--;
-            state = prev;
-        } else if (state == STATE_DY) {
-            State prev = traceDy[i][j];
-            alignedA[idx] = '_';
-            alignedB[idx] = B[j - 1];
-            j--;
-            state = prev;
-        }
-        idx++;
+void trace_free(GotohTrace *t) {
+    free(t->bits);
+    free(t->bits2);
+}
+
+// 끝에서부터 역추적한다. 정렬 문자열은 text 출력에서만 만든다
+void traceback(const GotohTrace *tm, const uint8_t *a, const uint8_t *b, int lenA, int lenB, Cigar *cigar) {
+    INSTR_SCOPE("traceback");
+    gotoh_traceback(tm, a, b, lenA, lenB, cigar);
+}
+
+/*
+    단일 스레드 채우기 (gotoh_fill.h 의 gotoh_fill_rows, libnw 와 같은 코드). 반환값은 DP[lenA][lenB]
+    경계는 길이 k 의 갭 하나 (scoring_gap). DP/Dx 는 두 행, Dy 는 왼쪽 값 하나만 유지한다.
+*/
+int fill_affine(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, GotohTrace *trace) {
+    INSTR_SCOPE("fill");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    int *rows = malloc(6 * ((size_t)lenB + 1) * sizeof(int));
+    int final_score = gotoh_fill_rows(&scoring, a, lenA, lenB, prof, rows, trace);
+    free(rows);
+    return final_score;
+}
+
+/*
+    띠(band) 채우기: j - i 가 [dlo, dhi] 인 셀만 계산한다 (dlo <= 0, lenB - lenA <= dhi).
+    띠 밖 이웃은 행 양 끝의 INF 보초로 처리한다.
+*/
+static inline __attribute__((always_inline))
+int fill_affine_banded_impl(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int dlo, int dhi,
+                            GotohTrace *trace, const int convex) {
+    const GotohCosts g = gotoh_costs(&scoring);
+    int *prev_dp = malloc((lenB + 2) * sizeof(int));
+    int *prev_dx = malloc((lenB + 2) * sizeof(int));
+    int *prev_dx2 = malloc((lenB + 2) * sizeof(int));
+    int *curr_dp = malloc((lenB + 2) * sizeof(int));
+    int *curr_dx = malloc((lenB + 2) * sizeof(int));
+    int *curr_dx2 = malloc((lenB + 2) * sizeof(int));
+
+    int jhi = dhi < lenB ? dhi : lenB;
+    prev_dp[0] = 0;
+    for (int j = 1; j <= jhi; j++) {
+        prev_dp[j] = scoring_gap(&scoring, j);
+        prev_dx[j] = prev_dx2[j] = INF;
     }
+    prev_dp[jhi + 1] = prev_dx[jhi + 1] = prev_dx2[jhi + 1] = INF;
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        int jlo = i + dlo > 0 ? i + dlo : 0;
+        jhi = i + dhi < lenB ? i + dhi : lenB;
 
-    alignedA[idx] = '\0';
-    alignedB[idx] = '\0';
+        int start = jlo;
+        if (jlo == 0) {
+            curr_dp[0] = scoring_gap(&scoring, i);
+            start = 1;
+        } else {
+            curr_dp[jlo - 1] = curr_dx[jlo - 1] = curr_dx2[jlo - 1] = INF;
+        }
 
-    *outA = malloc(idx + 1);
-    *outB = malloc(idx + 1);
-    for (int k = 0; k < idx; k++) {
-        (*outA)[k] = alignedA[idx - k - 1];
-        (*outB)[k] = alignedB[idx - k - 1];
+        int left_dy = INF, left_dy2 = INF;
+        for (int j = start; j <= jhi; j++) {
+            int dy, dy2 = INF, cell2 = 0;
+            int cell = gotoh_cell(convex, g, prev_dp[j], prev_dx[j], prev_dx2[j], curr_dp[j - 1], left_dy, left_dy2,
+                                prev_dp[j - 1], s[j], &curr_dp[j], &curr_dx[j], &dy, &curr_dx2[j], &dy2, &cell2);
+            gotoh_trace_set(trace, i, j, cell);
+            if (convex) gotoh_trace_set2(trace, i, j, cell2);
+            left_dy = dy;
+            left_dy2 = dy2;
+        }
+        curr_dp[jhi + 1] = curr_dx[jhi + 1] = curr_dx2[jhi + 1] = INF;
+        int *tmp = prev_dp; prev_dp = curr_dp; curr_dp = tmp;
+        tmp = prev_dx; prev_dx = curr_dx; curr_dx = tmp;
+        tmp = prev_dx2; prev_dx2 = curr_dx2; curr_dx2 = tmp;
     }
-    (*outA)[idx] = '\0';
-    (*outB)[idx] = '\0';
 
-    free(alignedA);
-    free(alignedB);
+    int final_score = prev_dp[lenB];
+    free(prev_dp); free(prev_dx); free(prev_dx2);
+    free(curr_dp); free(curr_dx); free(curr_dx2);
+    return final_score;
 }
 
-int main() {
-    srand(time(NULL));
-    const int TESTS = 10;
-    const int LEN = 10000;
+int fill_affine_banded(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int dlo, int dhi,
+                       GotohTrace *trace) {
+    INSTR_SCOPE("fill banded");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * (dhi - dlo + 1));
+    if (trace->bits2) return fill_affine_banded_impl(a, prof, lenA, lenB, dlo, dhi, trace, 1);
+    return fill_affine_banded_impl(a, prof, lenA, lenB, dlo, dhi, trace, 0);
+}
 
-    for (int run = 1; run <= TESTS; run++) {
-        printf("\n[Run %d] Needleman-Wunsch 정렬 시작...\n", run);
+/*
+    폭 w 의 띠를 벗어나는 경로는 갭이 최소 G = |lenB - lenA| + 2(w + 1) 개이고,
+    그 점수는 나머지 (lenA + lenB - G) / 2 쌍이 모두 표의 최고 점수 (음수면 0) 이고
+    갭이 길이 G 의 한 덩어리일 때를 넘을 수 없다 (갭을 나누면 여는 비용만 늘어난다).
+    띠 안 최적 점수가 이 값 이상이면 전체 DP 와 점수가 같다.
+*/
+int band_escape_bound(int lenA, int lenB, int w) {
+    long gaps = labs((long)lenB - lenA) + 2L * (w + 1);
+    if (gaps > (long)lenA + lenB) return INF;
+    long best_pair = scoring.max_score > 0 ? scoring.max_score : 0;
+    return (int)(best_pair * (((long)lenA + lenB - gaps) / 2) + scoring_gap(&scoring, gaps));
+}
 
-        char *A = generate_random_sequence(LEN);
-        char *B = generate_random_sequence(LEN);
-        int lenA = strlen(A), lenB = strlen(B);
-
-        int **DP = malloc((lenA + 1) * sizeof(int *));
-        int **Dx = malloc((lenA + 1) * sizeof(int *));
-        int **Dy = malloc((lenA + 1) * sizeof(int *));
-        State **trace = malloc((lenA + 1) * sizeof(State *));
-        State **traceDx = malloc((lenA + 1) * sizeof(State *));
-        State **traceDy = malloc((lenA + 1) * sizeof(State *));
-
-        for (int i = 0; i <= lenA; i++) {
-            DP[i] = malloc((lenB + 1) * sizeof(int));
-            Dx[i] = malloc((lenB + 1) * sizeof(int));
-            Dy[i] = malloc((lenB + 1) * sizeof(int));
-            trace[i] = malloc((lenB + 1) * sizeof(State));
-            traceDx[i] = malloc((lenB + 1) * sizeof(State));
-            traceDy[i] = malloc((lenB + 1) * sizeof(State));
-        }
+// 자동 초기 띠 폭: 긴 서열의 1% + 64
+int auto_band_width(int lenA, int lenB) {
+    int longer = lenA > lenB ? lenA : lenB;
+    return longer / 100 + 64;
+}
+
+/*
+    band >= 0 이면 띠 채우기로 시작해 band_escape_bound() 를 만족할 때까지 폭을 두 배로 늘린다.
+    띠가 행렬 전체를 덮으면 0 을 돌려주고, 호출자가 전체 DP 로 계산한다.
+*/
+int fill_affine_adaptive(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int band, int convex,
+                         GotohTrace *trace, int *final_score) {
+    int w = band > 0 ? band : auto_band_width(lenA, lenB);
+    int delta = lenB - lenA;
+    int longer = lenA > lenB ? lenA : lenB;
+    for (; w < longer; w *= 2) {
+        int dlo = (delta < 0 ? delta : 0) - w;
+        int dhi = (delta > 0 ? delta : 0) + w;
+        *trace = trace_alloc_band(lenA, dlo, dhi, convex);
+        *final_score = fill_affine_banded(a, prof, lenA, lenB, dlo, dhi, trace);
+        if (*final_score >= band_escape_bound(lenA, lenB, w)) return w;
+        trace_free(trace);
+    }
+    return 0;
+}
+
+/*
+    타일 wavefront 병렬 채우기 (nw_linear.c 의 fill_tiled 와 같은 구조)
+    위쪽 경계는 DP/Dx(/Dx2), 왼쪽 경계는 DP/Dy(/Dy2), 대각 경계는 DP 만 필요하다.
+    TILE_SIZE 가 짝수라 타일마다 trace 바이트가 겹치지 않는다.
+*/
+static inline __attribute__((always_inline))
+int fill_affine_tiled_impl(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, GotohTrace *trace,
+                           const int convex) {
+    const GotohCosts g = gotoh_costs(&scoring);
+    int tilesA = (lenA + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesB = (lenB + TILE_SIZE - 1) / TILE_SIZE;
+    int *H_dp = malloc((lenB + 1) * sizeof(int));
+    int *H_dx = malloc((lenB + 1) * sizeof(int));
+    int *H_dx2 = malloc((lenB + 1) * sizeof(int));
+    int *V_dp = malloc((lenA + 1) * sizeof(int));
+    int *V_dy = malloc((lenA + 1) * sizeof(int));
+    int *V_dy2 = malloc((lenA + 1) * sizeof(int));
+    int *corner = malloc((tilesA + 1) * sizeof(int));
+
+    H_dp[0] = 0;
+    H_dx[0] = H_dx2[0] = INF;
+    for (int j = 1; j <= lenB; j++) {
+        H_dp[j] = scoring_gap(&scoring, j);
+        H_dx[j] = H_dx2[j] = INF;
+    }
+    V_dp[0] = 0;
+    V_dy[0] = V_dy2[0] = INF;
+    for (int i = 1; i <= lenA; i++) {
+        V_dp[i] = scoring_gap(&scoring, i);
+        V_dy[i] = V_dy2[i] = INF;
+    }
+    for (int t = 0; t < tilesA; t++) corner[t] = V_dp[t * TILE_SIZE];
+
+    #pragma omp parallel
+    {
+        int *prev_dp = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *prev_dx = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *prev_dx2 = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *curr_dp = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *curr_dx = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *curr_dx2 = malloc((TILE_SIZE + 1) * sizeof(int));
+
+        for (int d = 0; d < tilesA + tilesB - 1; d++) {
+            int tlo = d - tilesB + 1 > 0 ? d - tilesB + 1 : 0;
+            int thi = d < tilesA - 1 ? d : tilesA - 1;
 
-        for (int i = 0; i <= lenA; i++) {
-            for (int j = 0; j <= lenB; j++) {
-                DP[i][j] = Dx[i][j] = Dy[i][j] = INF;
+            #pragma omp for schedule(dynamic)
+            for (int ti = tlo; ti <= thi; ti++) {
+                int tj = d - ti;
+                int r0 = ti * TILE_SIZE + 1, r1 = r0 + TILE_SIZE - 1 < lenA ? r0 + TILE_SIZE - 1 : lenA;
+                int c0 = tj * TILE_SIZE + 1, c1 = c0 + TILE_SIZE - 1 < lenB ? c0 + TILE_SIZE - 1 : lenB;
+                int w = c1 - c0 + 1;
+
+                prev_dp[0] = corner[ti];
+                memcpy(prev_dp + 1, H_dp + c0, w * sizeof(int));
+                memcpy(prev_dx + 1, H_dx + c0, w * sizeof(int));
+                if (convex) memcpy(prev_dx2 + 1, H_dx2 + c0, w * sizeof(int));
+
+                for (int i = r0; i <= r1; i++) {
+                    const int8_t *s = prof->row[a[i - 1]] + c0 - 2;
+                    int left_dy = V_dy[i], left_dy2 = V_dy2[i];
+                    curr_dp[0] = V_dp[i];
+                    for (int jj = 1; jj <= w; jj++) {
+                        int dy, dy2 = INF, cell2 = 0;
+                        int cell = gotoh_cell(convex, g, prev_dp[jj], prev_dx[jj], prev_dx2[jj], curr_dp[jj - 1],
+                                            left_dy, left_dy2, prev_dp[jj - 1], s[jj],
+                                            &curr_dp[jj], &curr_dx[jj], &dy, &curr_dx2[jj], &dy2, &cell2);
+                        gotoh_trace_set(trace, i, c0 + jj - 1, cell);
+                        if (convex) gotoh_trace_set2(trace, i, c0 + jj - 1, cell2);
+                        left_dy = dy;
+                        left_dy2 = dy2;
+                    }
+                    V_dp[i] = curr_dp[w];
+                    V_dy[i] = left_dy;
+                    V_dy2[i] = left_dy2;
+                    int *tmp = prev_dp; prev_dp = curr_dp; curr_dp = tmp;
+                    tmp = prev_dx; prev_dx = curr_dx; curr_dx = tmp;
+                    tmp = prev_dx2; prev_dx2 = curr_dx2; curr_dx2 = tmp;
+                }
+
+                corner[ti] = H_dp[c1];
+                memcpy(H_dp + c0, prev_dp + 1, w * sizeof(int));
+                memcpy(H_dx + c0, prev_dx + 1, w * sizeof(int));
+                if (convex) memcpy(H_dx2 + c0, prev_dx2 + 1, w * sizeof(int));
             }
         }
+        free(prev_dp); free(prev_dx); free(prev_dx2);
+        free(curr_dp); free(curr_dx); free(curr_dx2);
+    }
 
-        DP[0][0] = 0;
+    int final_score = lenA == 0 ? H_dp[lenB] : V_dp[lenA];
+    free(H_dp); free(H_dx); free(H_dx2);
+    free(V_dp); free(V_dy); free(V_dy2);
+    free(corner);
+    return final_score;
+}
 
-        for (int i = 1; i <= lenA; i++) {
-            Dx[i][0] = GAP_OPEN + (i - 1) * GAP_EXTEND;
-            DP[i][0] = Dx[i][0];
-            traceDx[i][0] = STATE_DX;
-            trace[i][0] = STATE_DX;
-        }
+int fill_affine_tiled(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, GotohTrace *trace) {
+    INSTR_SCOPE("fill tiled");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    if (trace->bits2) return fill_affine_tiled_impl(a, prof, lenA, lenB, trace, 1);
+    return fill_affine_tiled_impl(a, prof, lenA, lenB, trace, 0);
+}
+
+/*
+    체크포인트 traceback (--checkpoint): 전체 traceback 행렬이 메모리에 들어가지 않는 긴 쌍용
+    앞으로 채울 때 step 행마다 DP/Dx(/Dx2) 행만 남기고 traceback 비트는 저장하지 않는다
+    (Dy 는 행 안에서 왼쪽으로만 이어지므로 남길 필요가 없다).
+    traceback 은 끝 블록부터, 현재 셀 (i, j) 가 든 블록 (r0, i] 를 체크포인트 행 r0 에서
+    열 0..j 만 다시 채워 그 블록의 비트를 만들고, 행 r0 에 닿을 때까지 걷는다.
+    셀마다 많아야 한 번 더 계산하므로 계산은 두 배 이하이고, 메모리는 열마다
+        체크포인트 (lenA / step + 1) 행 * 8 바이트 (convex 12) + 블록 step 행 * 0.5 바이트 (convex 1)
+    이다. 자동 간격은 두 항이 같아지는 step = √(16 lenA) (convex 는 √(12 lenA)) 이다.
+    점화식과 tie 순서가 fill_affine 과 같으므로 CIGAR 도 같다.
+*/
+typedef struct {
+    int *dp, *dx, *dx2;     // [k * (lenB + 1) + j] = 행 k * step 의 값. dx2 는 convex 일 때만
+    int step;
+} Checkpoints;
+
+int auto_checkpoint_step(int lenA, int convex) {
+    long ratio = convex ? 12 : 16;
+    int step = 1;
+    while ((long)step * step < ratio * lenA) step++;
+    return step;
+}
+
+void checkpoints_free(Checkpoints *ck) {
+    free(ck->dp);
+    free(ck->dx);
+    free(ck->dx2);
+}
+
+// 앞으로 채우기: gotoh_fill_rows 와 같은 점화식으로 점수만 계산하고 step 행마다 행을 남긴다
+static inline __attribute__((always_inline))
+int fill_checkpoint_impl(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, Checkpoints *ck,
+                         const int convex) {
+    const GotohCosts g = gotoh_costs(&scoring);
+    const int step = ck->step;
+    size_t row = (size_t)lenB + 1;
+    int *prev_dp = malloc(row * sizeof(int));
+    int *prev_dx = malloc(row * sizeof(int));
+    int *prev_dx2 = malloc(row * sizeof(int));
+    int *curr_dp = malloc(row * sizeof(int));
+    int *curr_dx = malloc(row * sizeof(int));
+    int *curr_dx2 = malloc(row * sizeof(int));
+
+    prev_dp[0] = 0;
+    prev_dx[0] = prev_dx2[0] = curr_dx[0] = curr_dx2[0] = INF;
+    for (int j = 1; j <= lenB; j++) {
+        prev_dp[j] = scoring_gap(&scoring, j);
+        prev_dx[j] = prev_dx2[j] = INF;
+    }
+    memcpy(ck->dp, prev_dp, row * sizeof(int));
+    memcpy(ck->dx, prev_dx, row * sizeof(int));
+    if (convex) memcpy(ck->dx2, prev_dx2, row * sizeof(int));
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        curr_dp[0] = scoring_gap(&scoring, i);
+        int left_dy = INF, left_dy2 = INF;
         for (int j = 1; j <= lenB; j++) {
-            Dy[0][j] = GAP_OPEN + (j - 1) * GAP_EXTEND;
-            DP[0][j] = Dy[0][j];
-            traceDy[0][j] = STATE_DY;
-            trace[0][j] = STATE_DY;
+            int dy, dy2 = INF, cell2 = 0;
+            gotoh_cell(convex, g, prev_dp[j], prev_dx[j], prev_dx2[j], curr_dp[j - 1], left_dy, left_dy2,
+                     prev_dp[j - 1], s[j], &curr_dp[j], &curr_dx[j], &dy, &curr_dx2[j], &dy2, &cell2);
+            left_dy = dy;
+            left_dy2 = dy2;
         }
+        if (i % step == 0) {
+            size_t k = (size_t)(i / step) * row;
+            memcpy(ck->dp + k, curr_dp, row * sizeof(int));
+            memcpy(ck->dx + k, curr_dx, row * sizeof(int));
+            if (convex) memcpy(ck->dx2 + k, curr_dx2, row * sizeof(int));
+        }
+        int *tmp = prev_dp; prev_dp = curr_dp; curr_dp = tmp;
+        tmp = prev_dx; prev_dx = curr_dx; curr_dx = tmp;
+        tmp = prev_dx2; prev_dx2 = curr_dx2; curr_dx2 = tmp;
+    }
 
-        clock_t start = clock();
-
-        for (int i = 1; i <= lenA; i++) {
-            for (int j = 1; j <= lenB; j++) {
-                int up_ext = Dx[i - 1][j] + GAP_EXTEND;
-                int up_open = DP[i - 1][j] + GAP_OPEN + GAP_EXTEND;
-                if (up_ext >= up_open) {
-                    Dx[i][j] = up_ext;
-                    traceDx[i][j] = STATE_DX;
-                } else {
-                    Dx[i][j] = up_open;
-                    traceDx[i][j] = STATE_M;
-                }
+    int final_score = prev_dp[lenB];
+    free(prev_dp); free(prev_dx); free(prev_dx2);
+    free(curr_dp); free(curr_dx); free(curr_dx2);
+    return final_score;
+}
 
-                int left_ext = Dy[i][j - 1] + GAP_EXTEND;
-                int left_open = DP[i][j - 1] + GAP_OPEN + GAP_EXTEND;
-                if (left_ext >= left_open) {
-                    Dy[i][j] = left_ext;
-                    traceDy[i][j] = STATE_DY;
-                } else {
-                    Dy[i][j] = left_open;
-                    traceDy[i][j] = STATE_M;
-                }
+int fill_checkpoint(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int step, int convex,
+                    Checkpoints *ck) {
+    INSTR_SCOPE("fill checkpoint");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    size_t bytes = ((size_t)lenA / step + 1) * ((size_t)lenB + 1) * sizeof(int);
+    ck->step = step;
+    ck->dp = malloc(bytes);
+    ck->dx = malloc(bytes);
+    ck->dx2 = convex ? malloc(bytes) : NULL;
+    INSTR_ALLOC(bytes * (convex ? 3 : 2));
+    if (convex) return fill_checkpoint_impl(a, prof, lenA, lenB, ck, 1);
+    return fill_checkpoint_impl(a, prof, lenA, lenB, ck, 0);
+}
 
-                int m = DP[i - 1][j - 1] + score(A[i - 1], B[j - 1]);
-
-                if (m >= Dx[i][j] && m >= Dy[i][j]) {
-                    DP[i][j] = m;
-                    trace[i][j] = STATE_M;
-                } else if (Dx[i][j] >= Dy[i][j]) {
-                    DP[i][j] = Dx[i][j];
-                    trace[i][j] = STATE_DX;
-                } else {
-                    DP[i][j] = Dy[i][j];
-                    trace[i][j] = STATE_DY;
-                }
-            }
+// 체크포인트 행 r0 에서 행 r0+1..r1, 열 0..w 를 다시 채워 block 의 행 1..r1-r0 에 비트를 쓴다
+static inline __attribute__((always_inline))
+void fill_block_impl(const uint8_t *a, const NtProfile *prof, const Checkpoints *ck, int lenB, int r0, int r1, int w,
+                     GotohTrace *block, const int convex) {
+    const GotohCosts g = gotoh_costs(&scoring);
+    size_t top = (size_t)(r0 / ck->step) * ((size_t)lenB + 1);
+    int *prev_dp = malloc((w + 1) * sizeof(int));
+    int *prev_dx = malloc((w + 1) * sizeof(int));
+    int *prev_dx2 = malloc((w + 1) * sizeof(int));
+    int *curr_dp = malloc((w + 1) * sizeof(int));
+    int *curr_dx = malloc((w + 1) * sizeof(int));
+    int *curr_dx2 = malloc((w + 1) * sizeof(int));
+
+    memset(block->bits, 0, (size_t)(r1 - r0) * block->stride);
+    if (convex) memset(block->bits2, 0, (size_t)(r1 - r0) * block->stride);
+    memcpy(prev_dp, ck->dp + top, (w + 1) * sizeof(int));
+    memcpy(prev_dx, ck->dx + top, (w + 1) * sizeof(int));
+    if (convex) memcpy(prev_dx2, ck->dx2 + top, (w + 1) * sizeof(int));
+
+    for (int i = r0 + 1; i <= r1; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        curr_dp[0] = scoring_gap(&scoring, i);
+        int left_dy = INF, left_dy2 = INF;
+        for (int j = 1; j <= w; j++) {
+            int dy, dy2 = INF, cell2 = 0;
+            int cell = gotoh_cell(convex, g, prev_dp[j], prev_dx[j], prev_dx2[j], curr_dp[j - 1], left_dy, left_dy2,
+                                prev_dp[j - 1], s[j], &curr_dp[j], &curr_dx[j], &dy, &curr_dx2[j], &dy2, &cell2);
+            gotoh_trace_set(block, i - r0, j, cell);
+            if (convex) gotoh_trace_set2(block, i - r0, j, cell2);
+            left_dy = dy;
+            left_dy2 = dy2;
         }
+        int *tmp = prev_dp; prev_dp = curr_dp; curr_dp = tmp;
+        tmp = prev_dx; prev_dx = curr_dx; curr_dx = tmp;
+        tmp = prev_dx2; prev_dx2 = curr_dx2; curr_dx2 = tmp;
+    }
 
-        char *alignedA, *alignedB;
-        traceback(DP, Dx, Dy, trace, traceDx, traceDy, A, B, &alignedA, &alignedB);
-        clock_t end = clock();
-        double time_spent = (double)(end - start) / CLOCKS_PER_SEC;
+    free(prev_dp); free(prev_dx); free(prev_dx2);
+    free(curr_dp); free(curr_dx); free(curr_dx2);
+}
 
-        printf("정렬 완료 | 점수: %d | 시간: %.2f초\n", DP[lenA][lenB], time_spent);
+void fill_block(const uint8_t *a, const NtProfile *prof, const Checkpoints *ck, int lenB, int r0, int r1, int w,
+                GotohTrace *block) {
+    INSTR_SCOPE("fill block");
+    INSTR_COUNT(INSTR_CELLS, (long long)(r1 - r0) * w);
+    if (block->bits2) fill_block_impl(a, prof, ck, lenB, r0, r1, w, block, 1);
+    else fill_block_impl(a, prof, ck, lenB, r0, r1, w, block, 0);
+}
 
-        char filename[50];
-        sprintf(filename, "aligned_result_%d.txt", run);
-        FILE *f = fopen(filename, "w");
+void traceback_checkpoint(const uint8_t *a, const uint8_t *b, const NtProfile *prof, int lenA, int lenB,
+                          const Checkpoints *ck, Cigar *cigar) {
+    INSTR_SCOPE("traceback");
+    int step = ck->step;
+    GotohTrace block = trace_alloc(step < lenA ? step : lenA, lenB, ck->dx2 != NULL);
+    int i = lenA, j = lenB;
+    GotohState state = GOTOH_M;
+
+    while (i > 0 || j > 0) {
+        int r0 = i > 0 ? (i - 1) / step * step : 0;
+        if (i > r0) fill_block(a, prof, ck, lenB, r0, i, j, &block);
+        gotoh_traceback_walk(&block, r0, a, b, &i, &j, &state, cigar);
+        if (i > r0) break;  // 오류 방지용 탈출
+    }
+    trace_free(&block);
+}
+
+/*
+    정렬 한 번: 구간 찾기, 채우기, traceback. 결과는 region 과 cigar 에 담고 점수를 돌려준다.
+    t 가 있으면 채우기 (구간 찾기, profile 포함) 와 traceback 시간을 적는다.
+*/
+int align_codes(const uint8_t *codesA, int fullA, const uint8_t *codesB, int fullB, int threads, int band,
+                int checkpoint, AlnRegion *region_out, Cigar *cigar, BenchPhases *t) {
+    INSTR_SCOPE("align");
+    int convex = scoring.gap_model == GAP_CONVEX;
+    double start = bench_now();
+
+    // local / semi-global: 점수 전용 패스로 최적 정렬의 구간을 찾고 그 구간만 아래에서 정렬한다
+    AlnRegion region = aln_region_full(fullA, fullB, 0);
+    if (aln_mode != ALN_GLOBAL) {
+        INSTR_SCOPE("locate");
+        region = aln_locate(&scoring, aln_mode, codesA, fullA, codesB, fullB);
+        if (verbose) printf("정렬 구간: A[%d, %d) B[%d, %d)\n", region.a_start, region.a_end, region.b_start, region.b_end);
+    }
+    const uint8_t *ca = codesA + region.a_start;
+    const uint8_t *cb = codesB + region.b_start;
+    int lenA = region.a_end - region.a_start;
+    int lenB = region.b_end - region.b_start;
+    NtProfile prof;
+    nt_profile_build(&prof, cb, lenB, ca, lenA, scoring.table);
+
+    GotohTrace trace;
+    int final_score;
+    int w = 0;
+    if (band >= 0) {
+        w = fill_affine_adaptive(ca, &prof, lenA, lenB, band, convex, &trace, &final_score);
+        if (verbose) {
+            if (w > 0) printf("띠 폭 %d 에서 최적 점수 확인\n", w);
+            else printf("띠가 행렬 전체로 넓어짐: 전체 DP 로 계산\n");
+        }
+    }
+
+    // checkpoint >= 0 이면 (0 은 자동 간격) 전체 traceback 행렬 대신 체크포인트 행만 남긴다
+    Checkpoints ck;
+    int use_ck = w == 0 && checkpoint >= 0;
+    if (use_ck) {
+        int step = checkpoint > 0 ? checkpoint : auto_checkpoint_step(lenA, convex);
+        if (verbose) printf("체크포인트: %d 행마다 (점수 행 %d 개)\n", step, lenA / step + 1);
+        final_score = fill_checkpoint(ca, &prof, lenA, lenB, step, convex, &ck);
+    } else if (w == 0) {
+        trace = trace_alloc(lenA, lenB, convex);
+        if (threads > 1)
+            final_score = fill_affine_tiled(ca, &prof, lenA, lenB, &trace);
+        else
+            final_score = fill_affine(ca, &prof, lenA, lenB, &trace);
+    }
+    double filled = bench_now();
+
+    cigar_clear(cigar);
+    if (use_ck) {
+        traceback_checkpoint(ca, cb, &prof, lenA, lenB, &ck, cigar);
+        checkpoints_free(&ck);
+    } else {
+        traceback(&trace, ca, cb, lenA, lenB, cigar);
+        trace_free(&trace);
+    }
+    nt_profile_free(&prof);
+
+    if (t) {
+        t->fill = filled - start;
+        t->traceback = bench_now() - filled;
+    }
+    region.score = final_score;
+    *region_out = region;
+    return final_score;
+}
+
+// 결과 한 건을 --format 으로 쓴다 (text 만 정렬 문자열을 만든다)
+void write_result(FILE *f, int run, const char *A, const char *B, int fullA, int fullB,
+                  const AlnRegion *region, const Cigar *cigar, double time_spent) {
+    INSTR_SCOPE("output");
+    if (out_format == ALN_TEXT) {
+        char *alignedA, *alignedB;
+        char scheme[160];
+        scoring_describe(&scoring, scheme, sizeof(scheme));
+        cigar_gapped(cigar, A + region->a_start, B + region->b_start, &alignedA, &alignedB);
         fprintf(f, "[Run %d]\n", run);
-        fprintf(f, "Alignment Score: %d\n", DP[lenA][lenB]);
+        fprintf(f, "Scoring: %s\n", scheme);
+        if (aln_mode != ALN_GLOBAL) {
+            char mode[64];
+            aln_mode_describe(aln_mode, mode, sizeof(mode));
+            fprintf(f, "Mode: %s\n", mode);
+            fprintf(f, "Region: A[%d, %d) B[%d, %d)\n", region->a_start, region->a_end, region->b_start, region->b_end);
+        }
+        fprintf(f, "Alignment Score: %d\n", region->score);
         fprintf(f, "Execution Time: %.2f seconds\n\n", time_spent);
         fprintf(f, "Aligned A:\n%s\n\n", alignedA);
         fprintf(f, "Aligned B:\n%s\n", alignedB);
+        free(alignedA); free(alignedB);
+    } else {
+        const char *target = "B";
+        AlnRecord rec = aln_record_region("A", fullA, target, fullB, region, cigar);
+        aln_write_header(f, out_format, "nw_affine", &target, &fullB, 1);
+        aln_write(f, out_format, &rec);
+    }
+}
+
+// --bench 에서 쓰는 옵션
+typedef struct {
+    int threads;
+    int band;
+    int checkpoint;
+} AffineBench;
+
+// bench.h 가 부르는 한 번의 정렬. 코드 변환은 채우기 시간에, 결과 쓰기는 I/O 시간에 넣는다
+int bench_affine(void *ctx, const char *a, int lenA, const char *b, int lenB, FILE *io, BenchPhases *t) {
+    const AffineBench *opt = ctx;
+    double start = bench_now();
+    uint8_t *ca = nt_encode_dup(a, lenA);
+    uint8_t *cb = nt_encode_dup(b, lenB);
+    double encoded = bench_now() - start;
+
+    AlnRegion region;
+    Cigar cigar;
+    cigar_init(&cigar);
+    int score = align_codes(ca, lenA, cb, lenB, opt->threads, opt->band, opt->checkpoint, &region, &cigar, t);
+    t->fill += encoded;
+
+    double io_start = bench_now();
+    write_result(io, 1, a, b, lenA, lenB, &region, &cigar, 0.0);
+    fflush(io);
+    t->io = bench_now() - io_start;
+
+    cigar_free(&cigar);
+    free(ca);
+    free(cb);
+    return score;
+}
+
+int main(int argc, char *argv[]) {
+    INSTR_INIT();
+    int threads = 1;
+    int band = -1;
+    int checkpoint = -1;
+    BenchConfig bench;
+    bench_init(&bench);
+    scoring_init(&scoring);
+    for (int i = 1; i < argc; i++) {
+        int opt = scoring_arg(&scoring, argc, argv, &i);
+        if (opt == 0) opt = aln_mode_arg(&aln_mode, argc, argv, &i);
+        if (opt == 0) opt = bench_arg(&bench, argc, argv, &i);
+        if (opt < 0) return 1;
+        if (opt > 0) continue;
+        if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) threads = 1;
+        } else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+            const char *w = argv[++i];
+            band = strcmp(w, "auto") == 0 ? 0 : atoi(w);
+            if (band < 0) band = 0;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            const char *k = argv[++i];
+            checkpoint = strcmp(k, "auto") == 0 ? 0 : atoi(k);
+            if (checkpoint < 0) checkpoint = 0;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            int f = aln_format_parse(argv[++i]);
+            if (f < 0) return 1;
+            out_format = (AlnFormat)f;
+        } else {
+            printf("Usage: %s [--threads N] [--band W|auto] [--checkpoint K|auto] [--format %s]\n", argv[0], ALN_FORMATS);
+            printf("       %s\n", SCORING_OPTIONS);
+            printf("       %s\n", ALN_MODE_OPTIONS);
+            printf("       %s\n", BENCH_OPTIONS);
+            return 1;
+        }
+    }
+    if (scoring_finish(&scoring, GAP_AFFINE, SCORING_MODEL(GAP_AFFINE) | SCORING_MODEL(GAP_CONVEX)) != 0) return 1;
+    char scheme[160];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    printf("점수 체계: %s\n", scheme);
+    char mode[64];
+    aln_mode_describe(aln_mode, mode, sizeof(mode));
+    if (aln_mode != ALN_GLOBAL) printf("정렬 모드: %s (구간을 찾은 뒤 그 구간만 global 엔진으로 정렬)\n", mode);
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#endif
+    if (checkpoint >= 0) printf("채우기 엔진: checkpoint (단일 스레드, 블록마다 다시 채우는 traceback)\n");
+
+    if (bench.enabled) {
+        AffineBench opt = {threads, band, checkpoint};
+        char name[32];
+        snprintf(name, sizeof(name), "%s%s", checkpoint >= 0 ? "gotoh-checkpoint" : threads > 1 ? "gotoh-tiled" : "gotoh",
+                 band >= 0 ? "+band" : "");
+        BenchInfo info = {"nw_affine", name, threads, scheme, mode};
+        verbose = 0;
+        return bench_run(&bench, &info, bench_affine, &opt);
+    }
+
+    srand(time(NULL));
+    const int TESTS = 10;
+    const int LEN = 10000;
+    Cigar cigar;
+    cigar_init(&cigar);
+
+    for (int run = 1; run <= TESTS; run++) {
+        printf("\n[Run %d] Needleman-Wunsch 정렬 시작...\n", run);
+
+        char *A = generate_random_sequence(LEN);
+        char *B = generate_random_sequence(LEN);
+        int fullA = strlen(A), fullB = strlen(B);
+
+        // 벽시계 (CLOCK_MONOTONIC) 로 잰다. clock() 은 OpenMP 스레드의 CPU 시간을 모두 더한다
+        double start = bench_now();
+
+        // 한 번만 코드로 바꾸고 B 의 query profile 을 만든다. 문자는 traceback 출력에만 쓴다
+        uint8_t *codesA = nt_encode_dup(A, fullA);
+        uint8_t *codesB = nt_encode_dup(B, fullB);
+        AlnRegion region;
+        int final_score = align_codes(codesA, fullA, codesB, fullB, threads, band, checkpoint, &region, &cigar, NULL);
+        double time_spent = bench_now() - start;
+        free(codesA);
+        free(codesB);
+
+        printf("정렬 완료 | 점수: %d | 시간: %.2f초\n", final_score, time_spent);
+
+        char filename[50];
+        sprintf(filename, "aligned_result_%d.%s", run, aln_format_ext(out_format));
+        FILE *f = fopen(filename, out_format == ALN_BIN ? "wb" : "w");
+        write_result(f, run, A, B, fullA, fullB, &region, &cigar, time_spent);
         fclose(f);
 
         printf("%s 저장 완료\n", filename);
 
-        free(A); free(B); free(alignedA); free(alignedB);
-        for (int i = 0; i <= lenA; i++) {
-            free(DP[i]); free(Dx[i]); free(Dy[i]);
-            free(trace[i]); free(traceDx[i]); free(traceDy[i]);
-        }
-        free(DP); free(Dx); free(Dy);
-        free(trace); free(traceDx); free(traceDy);
+        free(A); free(B);
     }
+    cigar_free(&cigar);
 
     return 0;
 }
\ No newline at end of file
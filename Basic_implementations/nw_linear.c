@@ -3,12 +3,32 @@
 #include <stdlib.h>
 #include <string.h>
 #include <time.h>
+#include <stdint.h>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include "../common/nt_code.h"
+#include "../common/scoring.h"
+#include "../common/aln_output.h"
+#include "../common/aln_mode.h"
+#include "../common/bench.h"
+#include "../common/instrument.h"
+#include "../common/bitpar.h"
+#include "../common/linear_fill.h"
+
+#ifdef LINEAR_FILL_SIMD
+#define NW_X86_SIMD 1
+#endif
 
-#define MATCH 1
-#define MISMATCH -1
-#define GAP -1
 #define SEQ_LEN 10000
 #define TEST_CASES 25
+#define TILE_SIZE 256
+#define NEG_INF (INT32_MIN / 4)
+
+// traceback 방향: 셀당 2비트 (0 은 비어 있음)
+#define TB_DIAG 1
+#define TB_UP 2
+#define TB_LEFT 3
 
 int max_of_three(int a, int b, int c) {
     if (a >= b && a >= c) return a;
@@ -16,17 +36,68 @@ int max_of_three(int a, int b, int c) {
     return c;
 }
 
-int score(char a, char b) {
-    return a == b ? MATCH : MISMATCH;
+/*
+    채우기 루프는 문자 대신 nt_code.h 의 코드 (A C G T = 0..3, 나머지 문자는 escape) 를 읽는다.
+    점수는 B 의 query profile prof->row[a 의 코드][j - 1] 에서 바로 꺼내므로
+    안쪽 루프에 비교와 분기가 없다.
+    점수 체계 (--match/--mismatch 또는 --matrix, --gap) 는 scoring.h 로 실행 시 정하고,
+    각 채우기 함수는 시작할 때 갭 점수를 지역 상수로 읽어 둔다.
+*/
+static Scoring scoring;
+static AlnFormat out_format = ALN_TEXT;   // --format: text 는 기존 정렬 문자열 파일
+static int aln_mode = ALN_GLOBAL;         // --mode / --free-ends (aln_mode.h)
+static int verbose = 1;                   // --bench 는 반복마다 찍는 진행 메시지를 끈다
+
+/*
+    2비트 packed traceback 행렬 (하나의 연속 버퍼)
+    내부 셀 (i >= 1, j >= 1) 만 저장한다. 행 i 의 j 번째 셀은 열 번호
+        col = j - shift * i - col0
+    의 bits[(i - 1) * stride + col / 4] 안 2 * (col % 4) 비트에 있다.
+    전체 행렬은 shift = 0, col0 = 1 (col = j - 1),
+    띠 행렬은 shift = 1, col0 = dlo (col = j - i - dlo) 로 띠 폭만큼만 저장한다.
+    경계 (i == 0 또는 j == 0) 는 항상 U / L 이므로 저장하지 않는다.
+    TILE_SIZE 가 4 의 배수라 서로 다른 타일이 같은 바이트를 쓰는 일은 없다.
+*/
+typedef struct {
+    uint8_t *bits;
+    size_t stride;
+    int shift;
+    int col0;
+} TraceMatrix;
+
+TraceMatrix trace_alloc(int lenA, int lenB) {
+    INSTR_SCOPE("trace alloc");
+    TraceMatrix t;
+    t.stride = ((size_t)lenB + 3) / 4;
+    t.shift = 0;
+    t.col0 = 1;
+    t.bits = calloc((size_t)lenA * t.stride + 1, 1);
+    INSTR_ALLOC((size_t)lenA * t.stride + 1);
+    return t;
 }
 
-void rev(char *str) {
-    int len = strlen(str);
-    for (int i = 0; i < len / 2; i++) {
-        char tmp = str[i];
-        str[i] = str[len - 1 - i];
-        str[len - 1 - i] = tmp;
-    }
+// j - i 가 [dlo, dhi] 인 셀만 담는 띠 traceback
+TraceMatrix trace_alloc_band(int lenA, int dlo, int dhi) {
+    INSTR_SCOPE("trace alloc");
+    TraceMatrix t;
+    t.stride = ((size_t)(dhi - dlo + 1) + 3) / 4;
+    t.shift = 1;
+    t.col0 = dlo;
+    t.bits = calloc((size_t)lenA * t.stride + 1, 1);
+    INSTR_ALLOC((size_t)lenA * t.stride + 1);
+    return t;
+}
+
+static inline void trace_set(TraceMatrix *t, int i, int j, int code) {
+    int col = j - t->shift * i - t->col0;
+    t->bits[(size_t)(i - 1) * t->stride + col / 4] |= (uint8_t)(code << (2 * (col & 3)));
+}
+
+static inline int trace_get(const TraceMatrix *t, int i, int j) {
+    if (i == 0) return TB_LEFT;
+    if (j == 0) return TB_UP;
+    int col = j - t->shift * i - t->col0;
+    return (t->bits[(size_t)(i - 1) * t->stride + col / 4] >> (2 * (col & 3))) & 3;
 }
 
 char *generate_random_sequence(int len) {
@@ -40,50 +111,549 @@ char *generate_random_sequence(int len) {
 }
 
 int validate_alignment(const char *a, const char *b, int expected_score, int *recomputed) {
+    const int gap = scoring.gap;
     int score_ = 0;
     for (int i = 0; a[i] && b[i]; i++) {
         if (a[i] == '_' && b[i] == '_') 
             return 0;
         else if (a[i] == '_' || b[i] == '_') 
-            score_ += GAP;
+            score_ += gap;
         else 
-            score_ += score(a[i], b[i]);
+            score_ += scoring_pair(&scoring, a[i], b[i]);
+    }
+    *recomputed = score_;
+    return score_ == expected_score;
+}
+
+// 정렬 문자열 없이 CIGAR 와 서열 코드로 점수를 다시 계산한다
+int validate_cigar(const Cigar *cigar, const uint8_t *a, const uint8_t *b, int expected_score, int *recomputed) {
+    const int gap = scoring.gap;
+    const uint32_t *ops = cigar_ops(cigar);
+    int score_ = 0, i = 0, j = 0;
+    for (int k = 0; k < cigar_count(cigar); k++) {
+        int run = ops[k] >> 4, op = ops[k] & 15;
+        if (op == CIGAR_INS) {
+            score_ += run * gap;
+            i += run;
+        } else if (op == CIGAR_DEL) {
+            score_ += run * gap;
+            j += run;
+        } else {
+            for (int r = 0; r < run; r++, i++, j++) score_ += scoring.table[a[i] * NT_CODES + b[j]];
+        }
     }
     *recomputed = score_;
     return score_ == expected_score;
 }
 
-void needleman_wunsch(char *a, char *b, int test_index) {
-    int lenA = strlen(a);
-    int lenB = strlen(b);
+// ENGINE_BITPAR 는 점수 전용 (--score-only), common/bitpar.h 의 비트 병렬 열 계산
+typedef enum { ENGINE_SCALAR, ENGINE_SSE41, ENGINE_AVX2, ENGINE_BITPAR } FillEngine;
+
+const char *engine_name(FillEngine engine) {
+    switch (engine) {
+        case ENGINE_BITPAR: return "bitpar";
+        case ENGINE_AVX2: return "avx2";
+        case ENGINE_SSE41: return "sse4.1";
+        default: return "scalar";
+    }
+}
+
+// CPUID 로 사용 가능한 가장 넓은 벡터 엔진을 고른다
+FillEngine detect_fill_engine(void) {
+    switch (linear_fill_detect()) {
+        case LINEAR_FILL_AVX2: return ENGINE_AVX2;
+        case LINEAR_FILL_SSE41: return ENGINE_SSE41;
+        default: return ENGINE_SCALAR;
+    }
+}
+
+// 행 단위 스칼라 채우기. 점수는 두 행만 유지한다. 반환값은 dp[lenA][lenB]
+int fill_scalar(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, TraceMatrix *trace) {
+    INSTR_SCOPE("fill");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int gap = scoring.gap;
+    int *prev = malloc((lenB + 1) * sizeof(int));
+    int *curr = malloc((lenB + 1) * sizeof(int));
+
+    for (int j = 0; j <= lenB; j++) {
+        prev[j] = j * gap;
+    }
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        curr[0] = i * gap;
+        for (int j = 1; j <= lenB; j++) {
+            int diag = prev[j - 1] + s[j];
+            int up = prev[j] + gap;
+            int left = curr[j - 1] + gap;
+
+            curr[j] = max_of_three(diag, up, left);
+            if (curr[j] == diag) trace_set(trace, i, j, TB_DIAG);
+            else if (curr[j] == up) trace_set(trace, i, j, TB_UP);
+            else trace_set(trace, i, j, TB_LEFT);
+        }
+        int *tmp = prev; prev = curr; curr = tmp;
+    }
+
+    int final_score = prev[lenB];
+    free(prev);
+    free(curr);
+    return final_score;
+}
+
+/*
+    띠(band) 채우기: j - i 가 [dlo, dhi] 인 셀만 계산한다 (dlo <= 0, lenB - lenA <= dhi).
+    띠 밖 이웃은 각 행 양 끝에 NEG_INF 보초를 두어 처리하므로 행마다 O(띠 폭).
+*/
+int fill_banded(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int dlo, int dhi, TraceMatrix *trace) {
+    INSTR_SCOPE("fill banded");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * (dhi - dlo + 1));
+    const int gap = scoring.gap;
+    int *prev = malloc((lenB + 2) * sizeof(int));
+    int *curr = malloc((lenB + 2) * sizeof(int));
+
+    int jhi = dhi < lenB ? dhi : lenB;
+    for (int j = 0; j <= jhi; j++) prev[j] = j * gap;
+    prev[jhi + 1] = NEG_INF;
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        int jlo = i + dlo > 0 ? i + dlo : 0;
+        jhi = i + dhi < lenB ? i + dhi : lenB;
+
+        int start = jlo;
+        if (jlo == 0) {
+            curr[0] = i * gap;
+            start = 1;
+        } else {
+            curr[jlo - 1] = NEG_INF;
+        }
+
+        for (int j = start; j <= jhi; j++) {
+            int diag = prev[j - 1] + s[j];
+            int up = prev[j] + gap;
+            int left = curr[j - 1] + gap;
+
+            curr[j] = max_of_three(diag, up, left);
+            if (curr[j] == diag) trace_set(trace, i, j, TB_DIAG);
+            else if (curr[j] == up) trace_set(trace, i, j, TB_UP);
+            else trace_set(trace, i, j, TB_LEFT);
+        }
+        curr[jhi + 1] = NEG_INF;
+        int *tmp = prev; prev = curr; curr = tmp;
+    }
+
+    int final_score = prev[lenB];
+    free(prev);
+    free(curr);
+    return final_score;
+}
+
+/*
+    폭 w 의 띠 (j - i 가 [min(0, Δ) - w, max(0, Δ) + w], Δ = lenB - lenA) 를 벗어나는
+    경로는 갭이 최소 |Δ| + 2(w + 1) 개 필요하다. 그런 경로가 낼 수 있는 최고 점수를 돌려준다
+    (나머지 쌍이 모두 표의 최고 점수, 그 값이 음수면 0 이라고 가정).
+    띠 안의 최적 점수가 이 값 이상이면 전체 DP 와 점수가 같다.
+*/
+int band_escape_bound(int lenA, int lenB, int w) {
+    long gaps = labs((long)lenB - lenA) + 2L * (w + 1);
+    if (gaps > (long)lenA + lenB) return NEG_INF;
+    long best_pair = scoring.max_score > 0 ? scoring.max_score : 0;
+    return (int)(best_pair * (((long)lenA + lenB - gaps) / 2) + scoring_gap(&scoring, gaps));
+}
+
+// 자동 초기 띠 폭: 긴 서열의 1% + 64
+int auto_band_width(int lenA, int lenB) {
+    int longer = lenA > lenB ? lenA : lenB;
+    return longer / 100 + 64;
+}
+
+/*
+    타일 wavefront 병렬 채우기
+    DP 행렬을 TILE_SIZE x TILE_SIZE 타일로 나누고, 같은 타일 대각선(ti + tj = d)의
+    타일들을 스레드에 나눠준다. 타일 사이 값은 경계 버퍼로만 주고받는다.
+        H[j]      : 위쪽 타일의 마지막 행 (dp[r0-1][j])
+        V[i]      : 왼쪽 타일의 마지막 열 (dp[i][c0-1])
+        corner[ti]: 타일 (ti, tj) 의 왼쪽 위 대각 값 (dp[r0-1][c0-1])
+    같은 대각선의 타일들은 ti, tj 가 모두 다르므로 서로 다른 구간만 읽고 쓴다.
+*/
+int fill_tiled(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, TraceMatrix *trace) {
+    INSTR_SCOPE("fill tiled");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int gap = scoring.gap;
+    int tilesA = (lenA + TILE_SIZE - 1) / TILE_SIZE;
+    int tilesB = (lenB + TILE_SIZE - 1) / TILE_SIZE;
+    int *H = malloc((lenB + 1) * sizeof(int));
+    int *V = malloc((lenA + 1) * sizeof(int));
+    int *corner = malloc((tilesA + 1) * sizeof(int));
+
+    for (int j = 0; j <= lenB; j++) H[j] = j * gap;
+    for (int i = 0; i <= lenA; i++) V[i] = i * gap;
+    for (int t = 0; t < tilesA; t++) corner[t] = t * TILE_SIZE * gap;
+
+    #pragma omp parallel
+    {
+        int *prev = malloc((TILE_SIZE + 1) * sizeof(int));
+        int *curr = malloc((TILE_SIZE + 1) * sizeof(int));
+
+        for (int d = 0; d < tilesA + tilesB - 1; d++) {
+            int tlo = d - tilesB + 1 > 0 ? d - tilesB + 1 : 0;
+            int thi = d < tilesA - 1 ? d : tilesA - 1;
+
+            #pragma omp for schedule(dynamic)
+            for (int ti = tlo; ti <= thi; ti++) {
+                int tj = d - ti;
+                int r0 = ti * TILE_SIZE + 1, r1 = r0 + TILE_SIZE - 1 < lenA ? r0 + TILE_SIZE - 1 : lenA;
+                int c0 = tj * TILE_SIZE + 1, c1 = c0 + TILE_SIZE - 1 < lenB ? c0 + TILE_SIZE - 1 : lenB;
+                int w = c1 - c0 + 1;
+
+                prev[0] = corner[ti];
+                memcpy(prev + 1, H + c0, w * sizeof(int));
+
+                for (int i = r0; i <= r1; i++) {
+                    const int8_t *s = prof->row[a[i - 1]] - 1;
+                    curr[0] = V[i];
+                    for (int jj = 1; jj <= w; jj++) {
+                        int j = c0 + jj - 1;
+                        int diag = prev[jj - 1] + s[j];
+                        int up = prev[jj] + gap;
+                        int left = curr[jj - 1] + gap;
+
+                        curr[jj] = max_of_three(diag, up, left);
+                        if (curr[jj] == diag) trace_set(trace, i, j, TB_DIAG);
+                        else if (curr[jj] == up) trace_set(trace, i, j, TB_UP);
+                        else trace_set(trace, i, j, TB_LEFT);
+                    }
+                    V[i] = curr[w];
+                    int *tmp = prev; prev = curr; curr = tmp;
+                }
+
+                // 오른쪽 타일이 쓸 대각 값은 덮어쓰기 전의 H[c1]
+                corner[ti] = H[c1];
+                memcpy(H + c0, prev + 1, w * sizeof(int));
+            }
+        }
+        free(prev);
+        free(curr);
+    }
+
+    int final_score = H[lenB];
+    free(H); free(V); free(corner);
+    return final_score;
+}
+
+#ifdef NW_X86_SIMD
+/*
+    Anti-diagonal 벡터 채우기 (common/linear_fill.h 의 linear_fill_diag, libnw 와 --hetero CPU 레인도 같은 코드)
+    tie-break (D > U > L) 는 스칼라 경로와 같으므로 trace 가 비트 단위로 동일하다.
+    코드를 바이트 단위로 비교하므로 match/mismatch 점수 (scoring.identity) 에서만 쓰고,
+    치환 행렬이면 main 이 scalar 엔진으로 바꾼다. 전체 행렬 (shift = 0, col0 = 1) 에만 쓴다.
+*/
+int fill_simd(const uint8_t *a, const uint8_t *b, int lenA, int lenB, TraceMatrix *trace, FillEngine engine) {
+    INSTR_SCOPE("fill simd");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    return linear_fill_diag(&scoring, engine == ENGINE_AVX2 ? LINEAR_FILL_AVX2 : LINEAR_FILL_SSE41,
+                            a, b, lenA, lenB, trace->bits, trace->stride);
+}
+#endif
+
+/*
+    체크포인트 traceback (--checkpoint): 전체 traceback 행렬이 메모리에 들어가지 않는 긴 쌍용
+    앞으로 채울 때 step 행마다 점수 행 하나만 남기고 traceback 비트는 저장하지 않는다.
+    traceback 은 끝 블록부터, 현재 셀 (i, j) 가 든 블록 (r0, i] 를 체크포인트 행 r0 에서
+    열 0..j 만 다시 채워 그 블록의 비트를 만들고 행 r0 에 닿을 때까지 걷는다.
+    셀마다 많아야 한 번 더 계산하므로 계산은 두 배 이하이고, 메모리는
+        체크포인트 (lenA / step + 1) * (lenB + 1) * 4 바이트 + 블록 비트 step * lenB / 4 바이트
+    이다. 자동 간격은 두 항이 같아지는 step = √(16 lenA) (= 4√lenA) 이다.
+    점화식과 tie 순서 (D > U > L) 가 fill_scalar 와 같으므로 CIGAR 도 같다.
+*/
+typedef struct {
+    int *rows;      // rows[k * (lenB + 1) + j] = dp[k * step][j]
+    int step;
+} Checkpoints;
+
+int auto_checkpoint_step(int lenA) {
+    int step = 1;
+    while ((long)step * step < 16L * lenA) step++;
+    return step;
+}
+
+// 앞으로 채우기: 점수만 계산하고 step 행마다 행을 남긴다. 반환값은 dp[lenA][lenB]
+int fill_checkpoint(const uint8_t *a, const NtProfile *prof, int lenA, int lenB, int step, Checkpoints *ck) {
+    INSTR_SCOPE("fill checkpoint");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    const int gap = scoring.gap;
+    size_t row = (size_t)lenB + 1;
+    ck->step = step;
+    ck->rows = malloc(((size_t)lenA / step + 1) * row * sizeof(int));
+    INSTR_ALLOC(((size_t)lenA / step + 1) * row * sizeof(int));
+    int *prev = malloc(row * sizeof(int));
+    int *curr = malloc(row * sizeof(int));
+
+    for (int j = 0; j <= lenB; j++) prev[j] = j * gap;
+    memcpy(ck->rows, prev, row * sizeof(int));
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        curr[0] = i * gap;
+        for (int j = 1; j <= lenB; j++)
+            curr[j] = max_of_three(prev[j - 1] + s[j], prev[j] + gap, curr[j - 1] + gap);
+        if (i % step == 0) memcpy(ck->rows + (size_t)(i / step) * row, curr, row * sizeof(int));
+        int *tmp = prev; prev = curr; curr = tmp;
+    }
+
+    int final_score = prev[lenB];
+    free(prev);
+    free(curr);
+    return final_score;
+}
+
+// 체크포인트 행 top (= dp[r0]) 에서 행 r0+1..r1, 열 0..w 를 다시 채워 block 의 행 1..r1-r0 에 비트를 쓴다
+void fill_block(const uint8_t *a, const NtProfile *prof, const int *top, int r0, int r1, int w,
+                TraceMatrix *block, int *prev, int *curr) {
+    INSTR_SCOPE("fill block");
+    INSTR_COUNT(INSTR_CELLS, (long long)(r1 - r0) * w);
+    const int gap = scoring.gap;
+    memset(block->bits, 0, (size_t)(r1 - r0) * block->stride);
+    memcpy(prev, top, (w + 1) * sizeof(int));
 
-    int **dp = malloc((lenA + 1) * sizeof(int *));
-    char **trace = malloc((lenA + 1) * sizeof(char *));
-    for (int i = 0; i <= lenA; i++) {
-        dp[i] = malloc((lenB + 1) * sizeof(int));
-        trace[i] = malloc((lenB + 1) * sizeof(char));
+    for (int i = r0 + 1; i <= r1; i++) {
+        const int8_t *s = prof->row[a[i - 1]] - 1;
+        curr[0] = i * gap;
+        for (int j = 1; j <= w; j++) {
+            int diag = prev[j - 1] + s[j];
+            int up = prev[j] + gap;
+            int left = curr[j - 1] + gap;
+
+            curr[j] = max_of_three(diag, up, left);
+            if (curr[j] == diag) trace_set(block, i - r0, j, TB_DIAG);
+            else if (curr[j] == up) trace_set(block, i - r0, j, TB_UP);
+            else trace_set(block, i - r0, j, TB_LEFT);
+        }
+        int *tmp = prev; prev = curr; curr = tmp;
     }
+}
+
+/*
+    (i, j) 에서 행 row0 에 닿을 때까지 (row0 == 0 이면 (0, 0) 까지) 걸으며 CIGAR 를 앞쪽으로 쌓는다.
+    trace 의 행 번호는 i - row0 이다 (전체 행렬은 row0 = 0).
+*/
+void trace_walk(const TraceMatrix *trace, int row0, const uint8_t *ca, const uint8_t *cb, int *pi, int *pj,
+                Cigar *cigar) {
+    int i = *pi, j = *pj;
+    while (i > row0 || (row0 == 0 && j > 0)) {
+        int dir = trace_get(trace, i - row0, j);
+        if (i > 0 && j > 0 && dir == TB_DIAG) {
+            cigar_prepend(cigar, ca[i - 1] == cb[j - 1] ? CIGAR_EQ : CIGAR_X, 1);
+            i--; j--;
+        } else if (i > 0 && dir == TB_UP) {
+            cigar_prepend(cigar, CIGAR_INS, 1);
+            i--;
+        } else if (j > 0 && dir == TB_LEFT) {
+            cigar_prepend(cigar, CIGAR_DEL, 1);
+            j--;
+        } else break;
+    }
+    *pi = i;
+    *pj = j;
+}
+
+void traceback_checkpoint(const uint8_t *ca, const uint8_t *cb, const NtProfile *prof, int lenA, int lenB,
+                          const Checkpoints *ck, Cigar *cigar) {
+    INSTR_SCOPE("traceback");
+    int step = ck->step;
+    TraceMatrix block = trace_alloc(step < lenA ? step : lenA, lenB);
+    int *prev = malloc((lenB + 1) * sizeof(int));
+    int *curr = malloc((lenB + 1) * sizeof(int));
+
+    int i = lenA, j = lenB;
+    while (i > 0 || j > 0) {
+        int r0 = i > 0 ? (i - 1) / step * step : 0;
+        if (i > r0)
+            fill_block(ca, prof, ck->rows + (size_t)(r0 / step) * (lenB + 1), r0, i, j, &block, prev, curr);
+        trace_walk(&block, r0, ca, cb, &i, &j, cigar);
+        if (i > r0) break;  // 오류 방지용 탈출
+    }
+
+    free(block.bits);
+    free(prev);
+    free(curr);
+}
+
+/*
+    점수만 계산 (traceback 없음)
+    fill_scalar 와 같은 두 행 점화식에, traceback 이 고를 경로 (D > U > L) 의
+    일치/갭 개수를 함께 들고 간다. 짧은 서열을 열 방향으로 두어 메모리는 O(min(n, m)).
+    서열을 바꾼 경우 tie 순서가 D > L > U 가 되므로 개수는 최적 정렬 중 하나의 값이다.
+*/
+typedef struct {
+    int score;
+    int matches;
+    int mismatches;
+    int gaps;
+} ScoreSummary;
+
+ScoreSummary fill_score_only(const uint8_t *a, const uint8_t *b, int lenA, int lenB) {
+    INSTR_SCOPE("fill score-only");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    // 서열을 바꾸면 비대칭 치환 행렬도 원래 (a, b) 순서로 읽도록 전치한 표를 쓴다
+    const int8_t *table = scoring.table;
+    int8_t transposed[NT_CODES * NT_CODES];
+    if (lenB > lenA) {
+        const uint8_t *tmp = a; a = b; b = tmp;
+        int t = lenA; lenA = lenB; lenB = t;
+        scoring_transpose(scoring.table, transposed);
+        table = transposed;
+    }
+    NtProfile prof;
+    nt_profile_build(&prof, b, lenB, a, lenA, table);
+    const int gap = scoring.gap;
+
+    int *rows = malloc(6 * (lenB + 1) * sizeof(int));
+    int *prev = rows, *prev_m = rows + (lenB + 1), *prev_g = rows + 2 * (lenB + 1);
+    int *curr = rows + 3 * (lenB + 1), *curr_m = rows + 4 * (lenB + 1), *curr_g = rows + 5 * (lenB + 1);
+
+    for (int j = 0; j <= lenB; j++) {
+        prev[j] = j * gap;
+        prev_m[j] = 0;
+        prev_g[j] = j;
+    }
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t *s = prof.row[a[i - 1]] - 1;
+        curr[0] = i * gap;
+        curr_m[0] = 0;
+        curr_g[0] = i;
+        for (int j = 1; j <= lenB; j++) {
+            int diag = prev[j - 1] + s[j];
+            int up = prev[j] + gap;
+            int left = curr[j - 1] + gap;
+
+            curr[j] = max_of_three(diag, up, left);
+            if (curr[j] == diag) {
+                curr_m[j] = prev_m[j - 1] + (a[i - 1] == b[j - 1]);
+                curr_g[j] = prev_g[j - 1];
+            } else if (curr[j] == up) {
+                curr_m[j] = prev_m[j];
+                curr_g[j] = prev_g[j] + 1;
+            } else {
+                curr_m[j] = curr_m[j - 1];
+                curr_g[j] = curr_g[j - 1] + 1;
+            }
+        }
+        int *tmp = prev; prev = curr; curr = tmp;
+        tmp = prev_m; prev_m = curr_m; curr_m = tmp;
+        tmp = prev_g; prev_g = curr_g; curr_g = tmp;
+    }
+
+    ScoreSummary res;
+    res.score = prev[lenB];
+    res.matches = prev_m[lenB];
+    res.gaps = prev_g[lenB];
+    res.mismatches = (lenA + lenB - res.gaps) / 2 - res.matches;
+    free(rows);
+    nt_profile_free(&prof);
+    return res;
+}
+
+/*
+    비트 병렬 점수 (--engine bitpar, common/bitpar.h)
+    한 열의 64칸을 워드 하나로 계산한다. 점수는 fill_score_only 와 같지만
+    경로를 따라가지 않으므로 일치/불일치/갭 개수는 -1 로 둔다.
+*/
+ScoreSummary fill_score_bitpar(const uint8_t *a, const uint8_t *b, int lenA, int lenB) {
+    INSTR_SCOPE("fill bitpar");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    ScoreSummary res = {bitpar_score(&scoring, a, lenA, b, lenB), -1, -1, -1};
+    return res;
+}
+
+// local / semi-global 이면 구간을 찾은 뒤 그 구간의 점수와 열 수만 센다 (--score-only)
+ScoreSummary score_only_codes(const uint8_t *codesA, int fullA, const uint8_t *codesB, int fullB, FillEngine engine) {
+    AlnRegion region = aln_region_full(fullA, fullB, 0);
+    if (aln_mode != ALN_GLOBAL) {
+        INSTR_SCOPE("locate");
+        region = aln_locate(&scoring, aln_mode, codesA, fullA, codesB, fullB);
+        if (verbose) printf("정렬 구간: A[%d, %d) B[%d, %d)\n", region.a_start, region.a_end, region.b_start, region.b_end);
+    }
+    if (engine == ENGINE_BITPAR)
+        return fill_score_bitpar(codesA + region.a_start, codesB + region.b_start,
+                                 region.a_end - region.a_start, region.b_end - region.b_start);
+    return fill_score_only(codesA + region.a_start, codesB + region.b_start,
+                           region.a_end - region.a_start, region.b_end - region.b_start);
+}
+
+/*
+    정렬 한 번: 구간 찾기, 채우기, traceback. 결과는 region 과 cigar 에 담고 점수를 돌려준다.
+    파일 쓰기는 하지 않는다. t 가 있으면 채우기 (구간 찾기, profile 포함) 와 traceback 시간을 적는다.
+*/
+int align_codes(const uint8_t *codesA, int fullA, const uint8_t *codesB, int fullB, FillEngine engine,
+                int threads, int band, int checkpoint, AlnRegion *region_out, Cigar *cigar, BenchPhases *t) {
+    INSTR_SCOPE("align");
+    double start = bench_now();
+
     /*
-    dp[0] → ┌──────────────┐
-            │ int, int, ...│ (lenB+1개)
-            └──────────────┘
-    
-    dp[1] → ┌──────────────┐
-            │ int, int, ...│
-        ...
+        local / semi-global 이면 점수 전용 두 번 (끝 칸 찾기, 뒤집은 접두사로 시작 칸 찾기) 으로
+        최적 정렬의 구간을 정하고, 아래 global 엔진과 traceback 은 그 구간만 계산한다.
+        traceback 메모리도 전체 행렬이 아니라 구간 크기만큼만 쓴다.
     */
+    AlnRegion region = aln_region_full(fullA, fullB, 0);
+    if (aln_mode != ALN_GLOBAL) {
+        INSTR_SCOPE("locate");
+        region = aln_locate(&scoring, aln_mode, codesA, fullA, codesB, fullB);
+        if (verbose)
+            printf("정렬 구간: A[%d, %d) B[%d, %d) (점수 %d)\n",
+                   region.a_start, region.a_end, region.b_start, region.b_end, region.score);
+    }
+    const uint8_t *ca = codesA + region.a_start;
+    const uint8_t *cb = codesB + region.b_start;
+    int lenA = region.a_end - region.a_start;
+    int lenB = region.b_end - region.b_start;
+    NtProfile prof;
+    nt_profile_build(&prof, cb, lenB, ca, lenA, scoring.table);
 
-    dp[0][0] = 0;
-    trace[0][0] = 'O';  // origin
+    TraceMatrix tm;
+    TraceMatrix *trace = &tm;
+    int final_score;
+    int banded = 0;
 
-    for (int i = 1; i <= lenA; i++) {
-        dp[i][0] = i * GAP;
-        trace[i][0] = 'U';
+    /*
+        band >= 0 이면 띠 채우기부터 시도한다 (0 은 자동 폭).
+        띠 안 점수가 band_escape_bound() 를 넘지 못하면 경로가 띠 가장자리 밖으로
+        나갔을 수 있으므로 폭을 두 배로 늘려 다시 계산하고, 띠가 행렬 전체를 덮으면
+        일반 엔진으로 넘어간다.
+    */
+    if (band >= 0) {
+        int w = band > 0 ? band : auto_band_width(lenA, lenB);
+        int delta = lenB - lenA;
+        while (w < (lenA > lenB ? lenA : lenB)) {
+            int dlo = (delta < 0 ? delta : 0) - w;
+            int dhi = (delta > 0 ? delta : 0) + w;
+            tm = trace_alloc_band(lenA, dlo, dhi);
+            final_score = fill_banded(ca, &prof, lenA, lenB, dlo, dhi, trace);
+            if (final_score >= band_escape_bound(lenA, lenB, w)) {
+                if (verbose) printf("띠 폭 %d 에서 최적 점수 확인\n", w);
+                banded = 1;
+                break;
+            }
+            free(tm.bits);
+            w *= 2;
+        }
+        if (!banded && verbose) printf("띠가 행렬 전체로 넓어짐: 전체 DP 로 계산\n");
     }
 
-    for (int j = 1; j <= lenB; j++) {
-        dp[0][j] = j * GAP;
-        trace[0][j] = 'L';
+    /*
+        checkpoint >= 0 이면 (0 은 자동 간격) 전체 traceback 행렬 대신 체크포인트 행만 남긴다.
+        띠 채우기가 성공하면 띠 traceback 이 더 작으므로 그쪽을 쓴다.
+    */
+    Checkpoints ck;
+    int use_ck = !banded && checkpoint >= 0;
+    if (use_ck) {
+        int step = checkpoint > 0 ? checkpoint : auto_checkpoint_step(lenA);
+        if (verbose) printf("체크포인트: %d 행마다 (점수 행 %d 개)\n", step, lenA / step + 1);
+        final_score = fill_checkpoint(ca, &prof, lenA, lenB, step, &ck);
+    } else if (!banded) {
+        tm = trace_alloc(lenA, lenB);
     }
 
     /*
@@ -100,87 +670,268 @@ void needleman_wunsch(char *a, char *b, int test_index) {
     A₂     U
     A₃     U
     
+    경계 행/열은 trace_get() 이 바로 U/L 을 돌려준다
     */
 
-    for (int i = 1; i <= lenA; i++) {
-        for (int j = 1; j <= lenB; j++) {
-            int diag = dp[i - 1][j - 1] + score(a[i - 1], b[j - 1]);
-            int up = dp[i - 1][j] + GAP;
-            int left = dp[i][j - 1] + GAP;
-
-            dp[i][j] = max_of_three(diag, up, left);
-            if (dp[i][j] == diag) trace[i][j] = 'D';
-            else if (dp[i][j] == up) trace[i][j] = 'U';
-            else trace[i][j] = 'L';
-        }
+    if (banded || use_ck)
+        ;
+    else if (threads > 1 && lenA > 0 && lenB > 0)
+        final_score = fill_tiled(ca, &prof, lenA, lenB, trace);
+#ifdef NW_X86_SIMD
+    else if (engine != ENGINE_SCALAR)
+        final_score = fill_simd(ca, cb, lenA, lenB, trace, engine);
+    else
+#endif
+        final_score = fill_scalar(ca, &prof, lenA, lenB, trace);
+
+    double filled = bench_now();
+
+    // Traceback: 끝에서부터 걸으며 CIGAR 를 앞쪽으로 쌓으므로 뒤집을 필요가 없다
+    cigar_clear(cigar);
+    if (use_ck) {
+        traceback_checkpoint(ca, cb, &prof, lenA, lenB, &ck, cigar);
+        free(ck.rows);
+    } else {
+        INSTR_SCOPE("traceback");
+        int i = lenA, j = lenB;
+        trace_walk(trace, 0, ca, cb, &i, &j, cigar);
+        free(tm.bits);
     }
+    nt_profile_free(&prof);
 
-    // Traceback
-    char *alignedA = malloc(lenA + lenB + 1);
-    char *alignedB = malloc(lenA + lenB + 1);
-    int ai = 0, bi = 0;
-    int i = lenA, j = lenB;
+    if (t) {
+        t->fill = filled - start;
+        t->traceback = bench_now() - filled;
+    }
+    region.score = final_score;
+    *region_out = region;
+    return final_score;
+}
 
-    while (i > 0 || j > 0) {
-        if (i > 0 && j > 0 && trace[i][j] == 'D') {
-            alignedA[ai++] = a[i - 1];
-            alignedB[bi++] = b[j - 1];
-            i--; j--;
-        } else if (i > 0 && trace[i][j] == 'U') {
-            alignedA[ai++] = a[i - 1];
-            alignedB[bi++] = '_';
-            i--;
-        } else if (j > 0 && trace[i][j] == 'L') {
-            alignedA[ai++] = '_';
-            alignedB[bi++] = b[j - 1];
-            j--;
-        } else break;
-        
+// 결과 한 건을 --format 으로 쓴다 (text 만 정렬 문자열을 만든다)
+void write_result(FILE *fout, int test_index, const char *a, const char *b, int fullA, int fullB,
+                  const AlnRegion *region, const Cigar *cigar) {
+    INSTR_SCOPE("output");
+    if (out_format == ALN_TEXT) {
+        char *alignedA, *alignedB;
+        cigar_gapped(cigar, a + region->a_start, b + region->b_start, &alignedA, &alignedB);
+        char scheme[160];
+        scoring_describe(&scoring, scheme, sizeof(scheme));
+        fprintf(fout, "[Run %d]\n", test_index);
+        fprintf(fout, "Scoring: %s\n", scheme);
+        if (aln_mode != ALN_GLOBAL) {
+            char mode[64];
+            aln_mode_describe(aln_mode, mode, sizeof(mode));
+            fprintf(fout, "Mode: %s\n", mode);
+            fprintf(fout, "Region: A[%d, %d) B[%d, %d)\n", region->a_start, region->a_end, region->b_start, region->b_end);
+        }
+        fprintf(fout, "Alignment Score: %d\n", region->score);
+        fprintf(fout, "Aligned A:\n%s\n\n", alignedA);
+        fprintf(fout, "Aligned B:\n%s\n", alignedB);
+        free(alignedA); free(alignedB);
+    } else {
+        const char *target = "B";
+        AlnRecord rec = aln_record_region("A", fullA, target, fullB, region, cigar);
+        aln_write_header(fout, out_format, "nw_linear", &target, &fullB, 1);
+        aln_write(fout, out_format, &rec);
     }
+}
+
+// 정렬하고 파일로 저장한다. 돌려주는 시간 (초) 에 파일 쓰기는 들어가지 않는다
+double needleman_wunsch(char *a, char *b, int test_index, FillEngine engine, int threads, int band, int checkpoint) {
+    double start = bench_now();
+    int fullA = strlen(a);
+    int fullB = strlen(b);
+
+    // 한 번만 코드로 바꾸고 B 의 query profile 을 만든다. 문자는 traceback 출력에만 쓴다.
+    uint8_t *codesA = nt_encode_dup(a, fullA);
+    uint8_t *codesB = nt_encode_dup(b, fullB);
 
-    alignedA[ai] = '\0';
-    alignedB[bi] = '\0';
-    //문자열이므로 끝에 null 삽입
-    // 정렬 결과는 뒤집어져 있으니까 다시 rev
-    rev(alignedA);
-    rev(alignedB);
+    AlnRegion region;
+    Cigar cigar;
+    cigar_init(&cigar);
+    int final_score = align_codes(codesA, fullA, codesB, fullB, engine, threads, band, checkpoint, &region, &cigar, NULL);
+    double duration = bench_now() - start;
 
-    // Save result
     char filename[64];
-    sprintf(filename, "aligned_result_%d_linear.txt", test_index);
-    FILE *fout = fopen(filename, "w");
-    fprintf(fout, "[Run %d]\n", test_index);
-    fprintf(fout, "Alignment Score: %d\n", dp[lenA][lenB]);
-    fprintf(fout, "Aligned A:\n%s\n\n", alignedA);
-    fprintf(fout, "Aligned B:\n%s\n", alignedB);
+    sprintf(filename, "aligned_result_%d_linear.%s", test_index, aln_format_ext(out_format));
+    FILE *fout = fopen(filename, out_format == ALN_BIN ? "wb" : "w");
+    write_result(fout, test_index, a, b, fullA, fullB, &region, &cigar);
     fclose(fout);
     printf("파일 저장 완료: %s\n", filename);
 
-    for (int i = 0; i <= lenA; i++) {
-        free(dp[i]);
-        free(trace[i]);
+    // text 가 아니면 파일을 다시 읽지 않고 여기서 검증한다
+    if (out_format != ALN_TEXT) {
+        int recomputed = 0;
+        int valid = validate_cigar(&cigar, codesA + region.a_start, codesB + region.b_start, final_score, &recomputed);
+        printf("[%d] 검증 결과: %s (Recomputed=%d, Expected=%d)\n", test_index, valid ? "PASS" : "FAIL",
+               recomputed, final_score);
+    }
+
+    free(codesA);
+    free(codesB);
+    cigar_free(&cigar);
+    return duration;
+}
+
+// --bench 에서 쓰는 옵션
+typedef struct {
+    FillEngine engine;
+    int threads;
+    int band;
+    int checkpoint;
+    int score_only;
+} LinearBench;
+
+// bench.h 가 부르는 한 번의 정렬. 코드 변환은 채우기 시간에, 결과 쓰기는 I/O 시간에 넣는다
+int bench_linear(void *ctx, const char *a, int lenA, const char *b, int lenB, FILE *io, BenchPhases *t) {
+    const LinearBench *opt = ctx;
+    double start = bench_now();
+    uint8_t *ca = nt_encode_dup(a, lenA);
+    uint8_t *cb = nt_encode_dup(b, lenB);
+    int score;
+
+    if (opt->score_only) {
+        score = score_only_codes(ca, lenA, cb, lenB, opt->engine).score;
+        t->fill = bench_now() - start;
+    } else {
+        double encoded = bench_now() - start;
+        AlnRegion region;
+        Cigar cigar;
+        cigar_init(&cigar);
+        score = align_codes(ca, lenA, cb, lenB, opt->engine, opt->threads, opt->band, opt->checkpoint, &region, &cigar, t);
+        t->fill += encoded;
+
+        double io_start = bench_now();
+        write_result(io, 1, a, b, lenA, lenB, &region, &cigar);
+        fflush(io);
+        t->io = bench_now() - io_start;
+        cigar_free(&cigar);
     }
-    free(dp); free(trace);
-    free(alignedA); free(alignedB);
+    free(ca);
+    free(cb);
+    return score;
 }
 
-int main() {
+int main(int argc, char *argv[]) {
+    INSTR_INIT();
+    FillEngine engine = detect_fill_engine();
+    int threads = 1;
+    int score_only = 0;
+    int band = -1;
+    int checkpoint = -1;
+    BenchConfig bench;
+    bench_init(&bench);
+    scoring_init(&scoring);
+    for (int i = 1; i < argc; i++) {
+        int opt = scoring_arg(&scoring, argc, argv, &i);
+        if (opt == 0) opt = aln_mode_arg(&aln_mode, argc, argv, &i);
+        if (opt == 0) opt = bench_arg(&bench, argc, argv, &i);
+        if (opt < 0) return 1;
+        if (opt > 0) continue;
+        if (strcmp(argv[i], "--engine") == 0 && i + 1 < argc) {
+            const char *name = argv[++i];
+            if (strcmp(name, "scalar") == 0) engine = ENGINE_SCALAR;
+            else if (strcmp(name, "sse4.1") == 0 && engine != ENGINE_SCALAR) engine = ENGINE_SSE41;
+            else if (strcmp(name, "avx2") == 0 && engine == ENGINE_AVX2) engine = ENGINE_AVX2;
+            else if (strcmp(name, "bitpar") == 0) engine = ENGINE_BITPAR;
+            else printf("엔진 %s 사용 불가, %s 사용\n", name, engine_name(engine));
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+            if (threads < 1) threads = 1;
+        } else if (strcmp(argv[i], "--score-only") == 0) {
+            score_only = 1;
+        } else if (strcmp(argv[i], "--band") == 0 && i + 1 < argc) {
+            const char *w = argv[++i];
+            band = strcmp(w, "auto") == 0 ? 0 : atoi(w);
+            if (band < 0) band = 0;
+        } else if (strcmp(argv[i], "--checkpoint") == 0 && i + 1 < argc) {
+            const char *k = argv[++i];
+            checkpoint = strcmp(k, "auto") == 0 ? 0 : atoi(k);
+            if (checkpoint < 0) checkpoint = 0;
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            int f = aln_format_parse(argv[++i]);
+            if (f < 0) return 1;
+            out_format = (AlnFormat)f;
+        } else {
+            printf("Usage: %s [--engine scalar|sse4.1|avx2|bitpar] [--threads N] [--score-only] [--band W|auto] [--checkpoint K|auto] [--format %s]\n",
+                   argv[0], ALN_FORMATS);
+            printf("       %s\n", SCORING_OPTIONS);
+            printf("       %s\n", ALN_MODE_OPTIONS);
+            printf("       %s\n", BENCH_OPTIONS);
+            return 1;
+        }
+    }
+    if (scoring_finish(&scoring, GAP_LINEAR, SCORING_MODEL(GAP_LINEAR)) != 0) return 1;
+    if (engine == ENGINE_BITPAR && !score_only) {
+        engine = detect_fill_engine();
+        printf("bitpar 엔진은 --score-only 전용 (traceback 없음): %s 사용\n", engine_name(engine));
+    } else if (engine == ENGINE_BITPAR && !bitpar_supported(&scoring)) {
+        printf("bitpar 엔진은 이 점수 체계를 지원하지 않음 (match/mismatch, match - 2*gap <= 3): scalar 사용\n");
+        engine = ENGINE_SCALAR;
+    }
+    if (!scoring.identity && engine != ENGINE_SCALAR && engine != ENGINE_BITPAR) {
+        printf("치환 행렬은 벡터 엔진이 지원하지 않음: scalar 사용\n");
+        engine = ENGINE_SCALAR;
+    }
+    char scheme[160];
+    scoring_describe(&scoring, scheme, sizeof(scheme));
+    printf("점수 체계: %s\n", scheme);
+    if (aln_mode != ALN_GLOBAL) {
+        char mode[64];
+        aln_mode_describe(aln_mode, mode, sizeof(mode));
+        printf("정렬 모드: %s (구간을 찾은 뒤 그 구간만 global 엔진으로 정렬)\n", mode);
+    }
+#ifdef _OPENMP
+    omp_set_num_threads(threads);
+#else
+    if (threads > 1) printf("OpenMP 없이 컴파일됨: 타일 엔진을 단일 스레드로 실행\n");
+#endif
+    if (score_only && engine == ENGINE_BITPAR) printf("채우기 엔진: bitpar score-only (64칸 비트 병렬, 개수 없음)\n");
+    else if (score_only) printf("채우기 엔진: score-only (traceback 없음)\n");
+    else if (checkpoint >= 0) printf("채우기 엔진: checkpoint (scalar, 블록마다 다시 채우는 traceback)\n");
+    else if (threads > 1) printf("채우기 엔진: tiled wavefront (%d threads)\n", threads);
+    else printf("채우기 엔진: %s\n", engine_name(engine));
+
+    if (bench.enabled) {
+        char name[32], mode[64];
+        LinearBench opt = {engine, threads, band, checkpoint, score_only};
+        snprintf(name, sizeof(name), "%s%s", score_only ? (engine == ENGINE_BITPAR ? "bitpar" : "score-only") : checkpoint >= 0 ? "checkpoint"
+                 : threads > 1 ? "tiled" : engine_name(engine),
+                 band >= 0 && !score_only ? "+band" : "");
+        aln_mode_describe(aln_mode, mode, sizeof(mode));
+        BenchInfo info = {"nw_linear", name, threads, scheme, mode};
+        verbose = 0;
+        return bench_run(&bench, &info, bench_linear, &opt);
+    }
+
     srand(time(NULL));
     for (int t = 1; t <= TEST_CASES; t++) {
         printf("\n==== 테스트 %d ====\n", t);
         char *A = generate_random_sequence(SEQ_LEN);
         char *B = generate_random_sequence(SEQ_LEN);
 
-        clock_t start = clock();
-        needleman_wunsch(A, B, t);
-        clock_t end = clock();
-
-        double duration = (double)(end - start) / CLOCKS_PER_SEC;
+        // 벽시계 (CLOCK_MONOTONIC) 로 잰다. clock() 은 OpenMP 스레드의 CPU 시간을 모두 더한다
+        double duration;
+        if (score_only) {
+            double start = bench_now();
+            uint8_t *ca = nt_encode_dup(A, SEQ_LEN);
+            uint8_t *cb = nt_encode_dup(B, SEQ_LEN);
+            ScoreSummary res = score_only_codes(ca, SEQ_LEN, cb, SEQ_LEN, engine);
+            free(ca); free(cb);
+            duration = bench_now() - start;
+            if (res.matches < 0) printf("점수: %d\n", res.score);
+            else printf("점수: %d | 일치: %d, 불일치: %d, 갭: %d\n", res.score, res.matches, res.mismatches, res.gaps);
+        } else {
+            duration = needleman_wunsch(A, B, t, engine, threads, band, checkpoint);
+        }
         printf("수행 시간: %.4f초\n", duration);
 
         free(A); free(B);
     }
 
+    if (score_only || out_format != ALN_TEXT) return 0;
+
     // 검증
     for (int i = 1; i <= TEST_CASES; i++) {
         char filename[64];
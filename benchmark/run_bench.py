@@ -0,0 +1,223 @@
+import sys
+import os
+import csv
+import json
+import platform
+import subprocess
+import tempfile
+from datetime import datetime, timezone
+
+# Builds every program with the README flags, runs each configuration in
+# --bench mode (common/bench.h) over the same fixed-seed matrix and merges
+# the per-program CSV files into one CSV and one JSON file with the machine,
+# compiler and revision they were measured on.
+#
+#   python3 run_bench.py                          # full matrix -> bench_results.csv / .json
+#   python3 run_bench.py --quick                  # small matrix, one repetition
+#   python3 run_bench.py --threads 8 --out v1.2   # also the OpenMP engines with 8 threads
+#   python3 run_bench.py --compare v1.1.json v1.2.json
+#
+# --compare matches rows on configuration, length and divergence and lists
+# the ones whose median time got worse by more than --tolerance (default 10%).
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+PROGRAMS = {
+    'nw_linear': ('Basic_implementations/nw_linear.c', []),
+    'nw_affine': ('Basic_implementations/nw_affine.c', []),
+    'hirschberg_generic': ('Basic_implementations/hirschberg_generic.c', []),
+    'nw_ocl_generic': ('Accerlerated_implementations/nw_ocl_generic.c',
+                       ['-framework', 'OpenCL'] if sys.platform == 'darwin' else ['-lOpenCL']),
+}
+
+AFFINE = ['--gap-open', '-10', '--gap-extend', '-1']
+
+QUICK = ['--bench-lengths', '500,2000', '--bench-div', '0,0.15', '--bench-reps', '1']
+
+
+def configurations(threads):
+    """(program, extra arguments) for every engine that is benchmarked."""
+    runs = [
+        ('nw_linear', []),
+        ('nw_linear', ['--engine', 'scalar']),
+        ('nw_linear', ['--score-only']),
+        ('nw_linear', ['--score-only', '--engine', 'bitpar']),
+        ('nw_linear', ['--checkpoint', 'auto']),
+        ('nw_affine', AFFINE),
+        ('nw_affine', AFFINE + ['--checkpoint', 'auto']),
+        ('hirschberg_generic', []),
+        ('hirschberg_generic', ['--no-bitpar']),
+        ('hirschberg_generic', ['--affine']),
+        ('nw_ocl_generic', []),
+    ]
+    if threads > 1:
+        t = ['--threads', str(threads)]
+        runs += [
+            ('nw_linear', t),
+            ('nw_affine', AFFINE + t),
+            ('hirschberg_generic', t),
+        ]
+    return runs
+
+
+def parse_args(args):
+    opts = {'threads': 1, 'out': 'bench_results', 'cc': os.environ.get('CC', 'gcc'),
+            'cflags': '-O3 -fopenmp', 'bench': [], 'only': None, 'compare': None, 'tolerance': 0.10}
+    i = 0
+    while i < len(args):
+        a = args[i]
+        if a == '--quick':
+            opts['bench'] += QUICK
+        elif a == '--compare' and i + 2 < len(args):
+            opts['compare'] = (args[i + 1], args[i + 2])
+            i += 2
+        elif a.startswith('--bench-') and i + 1 < len(args):
+            opts['bench'] += [a, args[i + 1]]
+            i += 1
+        elif a in ('--threads', '--out', '--cc', '--cflags', '--only', '--tolerance') and i + 1 < len(args):
+            opts[a[2:]] = args[i + 1]
+            i += 1
+        else:
+            print(f"Unknown option: {a}")
+            print("Usage: run_bench.py [--quick] [--threads N] [--out NAME] [--only PROGRAM[,PROGRAM]]")
+            print("                    [--cc CC] [--cflags FLAGS] [--bench-lengths L,L] [--bench-div D,D]")
+            print("                    [--bench-reps N] [--bench-warmup N] [--bench-seed N]")
+            print("       run_bench.py --compare BASE.json NEW.json [--tolerance 0.10]")
+            sys.exit(1)
+        i += 1
+    opts['threads'] = int(opts['threads'])
+    opts['tolerance'] = float(opts['tolerance'])
+    return opts
+
+
+def build(name, build_dir, cc, cflags):
+    source, libs = PROGRAMS[name]
+    binary = os.path.join(build_dir, name)
+    cmd = [cc] + cflags.split() + [os.path.join(ROOT, source), '-o', binary] + libs
+    r = subprocess.run(cmd, capture_output=True, text=True)
+    if r.returncode != 0:
+        first = (r.stderr.strip().splitlines() or ['?'])[-1]
+        print(f"  {name}: build failed, skipped ({first})")
+        return None
+    return binary
+
+
+def run_config(binary, extra, bench_args, csv_path, cwd):
+    cmd = [binary] + extra + bench_args + ['--bench', '--bench-out', csv_path]
+    print(f"  {' '.join([os.path.basename(binary)] + extra)}")
+    r = subprocess.run(cmd, cwd=cwd, stdout=subprocess.PIPE, stderr=sys.stderr, text=True)
+    if r.returncode != 0 or not os.path.exists(csv_path):
+        print(f"    failed (exit {r.returncode})")
+        return []
+    with open(csv_path, newline='') as f:
+        return list(csv.DictReader(f))
+
+
+def machine_info(cc):
+    info = {
+        'date': datetime.now(timezone.utc).strftime('%Y-%m-%dT%H:%M:%SZ'),
+        'host': platform.node(),
+        'platform': platform.platform(),
+        'cpu': platform.processor(),
+        'cpus': os.cpu_count(),
+    }
+    try:
+        with open('/proc/cpuinfo') as f:
+            for line in f:
+                if line.startswith('model name'):
+                    info['cpu'] = line.split(':', 1)[1].strip()
+                    break
+    except OSError:
+        pass
+    for key, cmd in (('compiler', [cc, '--version']), ('revision', ['git', '-C', ROOT, 'describe', '--always', '--dirty'])):
+        try:
+            out = subprocess.run(cmd, capture_output=True, text=True).stdout.strip()
+            info[key] = out.splitlines()[0] if out else ''
+        except OSError:
+            info[key] = ''
+    return info
+
+
+NUMERIC = ('threads', 'seed', 'length', 'len_a', 'len_b', 'warmup', 'reps', 'score', 'cells', 'peak_rss_kb')
+
+
+def typed(row):
+    out = {}
+    for k, v in row.items():
+        if k in NUMERIC:
+            out[k] = int(v)
+        elif k in ('divergence',) or k.endswith('_s') or k == 'gcups':
+            out[k] = float(v)
+        else:
+            out[k] = v
+    return out
+
+
+def run_all(opts):
+    names = opts['only'].split(',') if opts['only'] else list(PROGRAMS)
+    rows = []
+    with tempfile.TemporaryDirectory(prefix='nw_bench_') as build_dir:
+        print(f"Building ({opts['cc']} {opts['cflags']})")
+        binaries = {n: build(n, build_dir, opts['cc'], opts['cflags']) for n in names if n in PROGRAMS}
+        print("Running")
+        for k, (name, extra) in enumerate(configurations(opts['threads'])):
+            if not binaries.get(name):
+                continue
+            csv_path = os.path.join(build_dir, f"run_{k}.csv")
+            for row in run_config(binaries[name], extra, opts['bench'], csv_path, build_dir):
+                row = typed(row)
+                row['config'] = ' '.join([name] + extra)
+                rows.append(row)
+    if not rows:
+        print("No results")
+        return 1
+
+    fields = ['config'] + [k for k in rows[0] if k != 'config']
+    with open(opts['out'] + '.csv', 'w', newline='') as f:
+        w = csv.DictWriter(f, fieldnames=fields)
+        w.writeheader()
+        w.writerows(rows)
+    with open(opts['out'] + '.json', 'w') as f:
+        json.dump({'machine': machine_info(opts['cc']), 'cflags': opts['cflags'], 'results': rows}, f, indent=1)
+    print(f"{len(rows)} rows written to {opts['out']}.csv and {opts['out']}.json")
+    return 0
+
+
+def load_rows(path):
+    if path.endswith('.json'):
+        with open(path) as f:
+            return json.load(f)['results']
+    with open(path, newline='') as f:
+        return [typed(r) for r in csv.DictReader(f)]
+
+
+def compare(base_path, new_path, tolerance):
+    key = lambda r: (r['config'], r['mode'], r['scoring'], r['length'], r['divergence'])
+    base = {key(r): r for r in load_rows(base_path)}
+    worse = 0
+    matched = 0
+    print(f"{'config':<40} {'len':>6} {'div':>5} {'base s':>10} {'new s':>10} {'change':>8}")
+    for r in load_rows(new_path):
+        b = base.get(key(r))
+        if not b or b['time_median_s'] <= 0:
+            continue
+        matched += 1
+        change = r['time_median_s'] / b['time_median_s'] - 1
+        flag = ''
+        if change > tolerance:
+            flag = '  SLOWER'
+            worse += 1
+        if r['score'] != b['score']:
+            flag += f"  SCORE {b['score']} -> {r['score']}"
+            worse += 1
+        print(f"{r['config']:<40} {r['length']:>6} {r['divergence']:>5} {b['time_median_s']:>10.4f} "
+              f"{r['time_median_s']:>10.4f} {change:>+7.1%}{flag}")
+    print(f"{matched} rows compared, {worse} regressions (tolerance {tolerance:.0%})")
+    return 1 if worse else 0
+
+
+if __name__ == "__main__":
+    opts = parse_args(sys.argv[1:])
+    if opts['compare']:
+        sys.exit(compare(*opts['compare'], opts['tolerance']))
+    sys.exit(run_all(opts))
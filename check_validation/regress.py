@@ -0,0 +1,419 @@
+import sys
+import os
+import csv
+import subprocess
+import tempfile
+import random
+import shlex
+import re
+
+# Regression checks for what validate.py does not reach: paths of the same
+# program (or of different programs) that must agree, and corner cases of the
+# shared headers. Builds the programs with gcc into a temporary directory.
+#
+#   python3 regress.py                        # every check
+#   python3 regress.py score_only_asymmetric  # only the named checks
+#
+# A check that needs something the machine lacks (an OpenCL runtime) is
+# reported as skipped, not failed. OCL_CFLAGS and OCL_LIBS (default
+# -lOpenCL) replace the OpenCL compile flags, e.g. for another ICD loader.
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+PROGRAMS = {
+    'nw_linear': 'Basic_implementations/nw_linear.c',
+    'hirschberg_generic': 'Basic_implementations/hirschberg_generic.c',
+    'nw_ocl_generic': 'Accerlerated_implementations/nw_ocl_generic.c',
+}
+
+# A, C, G and T score differently against each other depending on which
+# sequence the letter comes from (row: first sequence, column: second).
+ASYMMETRIC = (
+    "   A  C  G  T\n"
+    "A  3 -4  2 -2\n"
+    "C -1  3 -3  1\n"
+    "G -5  0  4 -1\n"
+    "T  1 -3 -2  3\n"
+)
+
+
+class Skip(Exception):
+    pass
+
+
+def build(name, work, cflags=('-O2', '-fopenmp'), libs=()):
+    binary = os.path.join(work, name)
+    if os.path.exists(binary):
+        return binary
+    cmd = ['gcc'] + list(cflags) + [os.path.join(ROOT, PROGRAMS[name]), '-o', binary] + list(libs)
+    r = subprocess.run(cmd, capture_output=True, text=True)
+    if r.returncode != 0:
+        raise RuntimeError(f"build of {name} failed:\n{r.stderr}")
+    return binary
+
+
+def build_ocl(work):
+    """nw_ocl_generic, or Skip when there is no OpenCL to build against or run on."""
+    cflags = ['-O2', '-fopenmp'] + shlex.split(os.environ.get('OCL_CFLAGS', ''))
+    libs = shlex.split(os.environ.get('OCL_LIBS', '-lOpenCL'))
+    try:
+        binary = build('nw_ocl_generic', work, cflags, libs)
+    except RuntimeError as e:
+        raise Skip(f"no OpenCL build ({str(e).splitlines()[-1]})")
+    probe = os.path.join(work, 'probe.fa')
+    with open(probe, 'w') as f:
+        f.write('>probe\nACGT\n')
+    r = subprocess.run([binary, '--batch', '--out', os.devnull, probe, probe], cwd=work, capture_output=True, text=True)
+    if r.returncode != 0:
+        raise Skip(f"no OpenCL device ({(r.stdout + r.stderr).strip().splitlines()[-1]})")
+    return binary
+
+
+def write_fasta(path, records):
+    with open(path, 'w') as f:
+        for name, seq in records:
+            f.write(f">{name}\n{seq}\n")
+
+
+def paf_by_pair(text):
+    """PAF lines keyed by (query, target)."""
+    rows = {}
+    for line in text.splitlines():
+        cols = line.split('\t')
+        if len(cols) >= 12:
+            rows[(cols[0], cols[5])] = line
+    return rows
+
+
+def tie_heavy_pairs(rng, count):
+    """Repeats, homopolymers and two-letter sequences: many equally good regions and paths."""
+    units = ['A', 'AC', 'ACG', 'AAT', 'CA']
+    pairs = []
+    for k in range(count):
+        unit = rng.choice(units)
+        if k % 3 == 0:
+            read = (unit * 40)[:rng.randint(5, 60)]
+            target = ''.join(rng.choice('GT') for _ in range(rng.randint(0, 15))) + unit * rng.randint(5, 30) \
+                + ''.join(rng.choice('GT') for _ in range(rng.randint(0, 15)))
+        elif k % 3 == 1:
+            read = ''.join(rng.choice('AC') for _ in range(rng.randint(1, 80)))
+            target = ''.join(rng.choice('AC') for _ in range(rng.randint(1, 120)))
+        else:
+            target = ''.join(rng.choice(unit + 'G') for _ in range(rng.randint(20, 150)))
+            st = rng.randint(0, len(target) - 1)
+            read = target[st:st + rng.randint(1, 60)][::-1 if k % 2 else 1]
+        pairs.append((f"p{k}", read, f"t{k}", target))
+    return pairs
+
+
+def run(cmd, cwd):
+    r = subprocess.run(cmd, cwd=cwd, capture_output=True, text=True)
+    if r.returncode != 0:
+        raise RuntimeError(f"{' '.join(cmd)} exited with {r.returncode}:\n{r.stdout}{r.stderr}")
+    return r.stdout
+
+
+def bench_scores(binary, args, work, tag):
+    """Scores of the fixed-seed --bench pairs, keyed by (length, divergence)."""
+    out = os.path.join(work, f"{tag}.csv")
+    run([binary] + args + ['--bench', '--bench-out', out], work)
+    with open(out, newline='') as f:
+        return {(r['length'], r['divergence']): int(r['score']) for r in csv.DictReader(f)}
+
+
+def check_score_only_asymmetric(work):
+    """--score-only puts the shorter sequence on the row; an asymmetric matrix must still score A against B."""
+    matrix = os.path.join(work, 'asym.txt')
+    with open(matrix, 'w') as f:
+        f.write(ASYMMETRIC)
+    pairs = ['--bench-lengths', '200,301,1000', '--bench-div', '0.05,0.2,0.4', '--bench-reps', '1',
+             '--bench-warmup', '0', '--matrix', matrix, '--gap', '-3']
+    errors = []
+    binaries = [(name, build(name, work)) for name in ('nw_linear', 'hirschberg_generic')]
+    try:
+        binaries.append(('nw_ocl_generic', build_ocl(work)))
+    except Skip:
+        pass
+    for name, binary in binaries:
+        for seed in ('1', '2', '3'):
+            args = pairs + ['--bench-seed', seed]
+            full = bench_scores(binary, args, work, f"{name}_full")
+            score = bench_scores(binary, args + ['--score-only'], work, f"{name}_score")
+            for key in full:
+                if full[key] != score[key]:
+                    errors.append(f"{name} seed {seed} {key}: alignment {full[key]}, --score-only {score[key]}")
+    return errors
+
+
+def check_batch_matches_pairs(work):
+    """--batch places regions and breaks ties like --pairs (aln_locate) in local, glocal and overlap modes."""
+    binary = build_ocl(work)
+    pairs = tie_heavy_pairs(random.Random(20), 36)
+    sub = os.path.join(work, 'batch_pairs')
+    os.makedirs(sub, exist_ok=True)
+    write_fasta(os.path.join(sub, 'reads.fa'), [(q, a) for q, a, _, _ in pairs])
+    write_fasta(os.path.join(sub, 'targets.fa'), [(t, b) for _, _, t, b in pairs])
+    with open(os.path.join(sub, 'list.txt'), 'w') as f:
+        for q, a, t, b in pairs:
+            write_fasta(os.path.join(sub, f"{q}.fa"), [(q, a)])
+            write_fasta(os.path.join(sub, f"{t}.fa"), [(t, b)])
+            f.write(f"{q}.fa {t}.fa\n")
+
+    errors = []
+    for mode in ('local', 'glocal', 'overlap'):
+        for scheme in ([], ['--match', '2', '--mismatch', '-3', '--gap', '-2']):
+            args = [binary, '--mode', mode, '--format', 'paf'] + scheme
+            run(args + ['--batch', '--out', 'batch.paf', 'reads.fa', 'targets.fa'], sub)
+            run(args + ['--out', 'pairs.paf', '--pairs', 'list.txt'], sub)
+            with open(os.path.join(sub, 'batch.paf')) as f:
+                batch = paf_by_pair(f.read())
+            with open(os.path.join(sub, 'pairs.paf')) as f:
+                single = paf_by_pair(f.read())
+            for key in sorted(single):
+                if batch.get(key) != single[key]:
+                    errors.append(f"{mode} {' '.join(scheme) or 'default'} {key}:\n"
+                                  f"    --pairs {single[key]}\n    --batch {batch.get(key)}")
+            if len(single) != len(pairs):
+                errors.append(f"{mode}: --pairs wrote {len(single)} of {len(pairs)} records")
+    return errors
+
+
+def check_bench_options(work):
+    """--bench-reps/-warmup/-seed take whole numbers in range; anything else is an error, not a silent 0."""
+    binary = build('nw_linear', work)
+    base = [binary, '--bench', '--bench-lengths', '50', '--bench-div', '0', '--bench-out', os.devnull]
+    bad = [['--bench-reps', '0'], ['--bench-reps', '3x'], ['--bench-reps', ''], ['--bench-reps', '99999999999'],
+           ['--bench-warmup', '-1'], ['--bench-warmup', '1.5'],
+           ['--bench-seed', '-1'], ['--bench-seed', 'x'], ['--bench-seed', '99999999999999999999999']]
+    good = [['--bench-reps', '2', '--bench-warmup', '0', '--bench-seed', '18446744073709551615']]
+    errors = []
+    for args in bad:
+        r = subprocess.run(base + args, cwd=work, capture_output=True, text=True)
+        if r.returncode == 0:
+            errors.append(f"accepted {' '.join(args)}")
+    for args in good:
+        r = subprocess.run(base + args, cwd=work, capture_output=True, text=True)
+        if r.returncode != 0:
+            errors.append(f"rejected {' '.join(args)}: {r.stdout.strip()}")
+    return errors
+
+
+# Writes SAM records: real alignments through libnw, then hand-made records
+# for the cases a traceback rarely produces.
+SAM_HARNESS = r"""
+#include "libnw/nw.h"
+
+static void align(const char* name, int mode, const char* a, const char* b) {
+    Scoring sc;
+    scoring_init(&sc);
+    if (scoring_finish(&sc, GAP_LINEAR, NW_GAP_MODELS) != 0) return;
+    NwAligner* al = nw_aligner_new(&sc, mode);
+    NwResult res;
+    nw_result_init(&res);
+    nw_align(al, a, (int)strlen(a), b, (int)strlen(b), &res);
+    AlnRecord rec = aln_record_region(name, (int)strlen(a), "t", (int)strlen(b), &res.region, &res.cigar);
+    aln_write(stdout, ALN_SAM, &rec);
+    nw_result_free(&res);
+    nw_aligner_free(al);
+}
+
+static void record(const char* name, int qlen, int qstart, int qend, int tstart, int tend, const char* ops) {
+    Cigar c;
+    cigar_init(&c);
+    for (const char* p = ops; *p; ) {
+        int n = (int)strtol(p, (char**)&p, 10);
+        int op = *p == '=' ? CIGAR_EQ : *p == 'X' ? CIGAR_X : *p == 'I' ? CIGAR_INS : CIGAR_DEL;
+        cigar_append(&c, op, n);
+        p++;
+    }
+    AlnRegion region = {1, qstart, qend, tstart, tend};
+    AlnRecord rec = aln_record_region(name, qlen, "t", 40, &region, &c);
+    aln_write(stdout, ALN_SAM, &rec);
+    cigar_free(&c);
+}
+
+int main(void) {
+    align("local_empty", ALN_MODE_LOCAL, "AAAAA", "CCCCCCC");
+    align("global_lead_del", ALN_GLOBAL, "ACGTACGT", "TTACGTACGT");
+    align("global_trail_del", ALN_GLOBAL, "ACGTACGT", "ACGTACGTGG");
+    align("local_hit", ALN_MODE_LOCAL, "GGGACGTACGTGGG", "TTTTACGTACGTTTTT");
+    record("empty_clipped", 6, 3, 3, 5, 5, "");
+    record("ins_only", 6, 2, 4, 5, 5, "2I");
+    record("del_only", 6, 3, 3, 5, 8, "3D");
+    record("lead_del", 10, 2, 10, 10, 21, "3D8=");
+    record("trail_del", 10, 0, 6, 4, 12, "4=2X2D");
+    record("both_del", 10, 1, 9, 0, 14, "2D4=1I3=2D");
+    record("inner_del", 10, 1, 9, 0, 10, "4=2D4=");
+    return 0;
+}
+"""
+
+# name -> query length, then the expected FLAG, POS, CIGAR and NM (None: not written)
+SAM_EXPECTED = {
+    'local_empty': (5, 4, 0, '*', None),
+    'global_lead_del': (8, 0, 3, '8=', 0),
+    'global_trail_del': (8, 0, 1, '8=', 0),
+    'local_hit': (14, 0, 5, '3S8=3S', 0),
+    'empty_clipped': (6, 4, 0, '*', None),
+    'ins_only': (6, 4, 0, '*', None),
+    'del_only': (6, 4, 0, '*', None),
+    'lead_del': (10, 0, 14, '2S8=', 0),
+    'trail_del': (10, 0, 5, '4=2X4S', 2),
+    'both_del': (10, 0, 3, '1S4=1I3=1S', 1),
+    'inner_del': (10, 0, 1, '1S4=2D4=1S', 2),
+}
+
+
+def sam_cigar_problems(cigar, qlen):
+    """What a SAM reader would reject in a mapped record's CIGAR."""
+    if cigar == '*':
+        return ['mapped record without a CIGAR']
+    runs = []
+    num = ''
+    for ch in cigar:
+        if ch.isdigit():
+            num += ch
+        else:
+            runs.append((int(num or 0), ch))
+            num = ''
+    problems = []
+    if sum(n for n, op in runs if op in 'MIS=X') != qlen:
+        problems.append(f"query length {sum(n for n, op in runs if op in 'MIS=X')} != {qlen}")
+    core = [op for _, op in runs if op != 'S']
+    if 'S' in [op for _, op in runs[1:-1]]:
+        problems.append('S inside the CIGAR')
+    if not core or not any(op in 'M=X' for op in core):
+        problems.append('no aligned base')
+    elif core[0] == 'D' or core[-1] == 'D':
+        problems.append('D at an end')
+    return problems
+
+
+def check_sam_ends(work):
+    """SAM: empty regions are unmapped, and no D run sits next to a clip or a read end."""
+    src = os.path.join(work, 'sam_harness.c')
+    binary = os.path.join(work, 'sam_harness')
+    with open(src, 'w') as f:
+        f.write(SAM_HARNESS)
+    r = subprocess.run(['gcc', '-O2', '-I', ROOT, src, os.path.join(ROOT, 'libnw', 'nw.c'), '-o', binary],
+                       capture_output=True, text=True)
+    if r.returncode != 0:
+        raise RuntimeError(f"build of the SAM harness failed:\n{r.stderr}")
+    out = run([binary], work)
+
+    errors = []
+    seen = set()
+    for line in out.splitlines():
+        cols = line.split('\t')
+        name, flag, pos, cigar = cols[0], int(cols[1]), int(cols[3]), cols[5]
+        tags = dict(t.split(':', 1) for t in cols[11:])
+        seen.add(name)
+        qlen, *want = SAM_EXPECTED[name]
+        got = [flag, pos, cigar, int(tags['NM'][2:]) if 'NM' in tags else None]
+        if got != want:
+            errors.append(f"{name}: FLAG/POS/CIGAR/NM {got}, expected {want}")
+        if len(cols) < 11:
+            errors.append(f"{name}: {len(cols)} columns")
+        if flag & 4:
+            if cigar != '*' or cols[2] != '*':
+                errors.append(f"{name}: unmapped record with RNAME {cols[2]} CIGAR {cigar}")
+        else:
+            errors += [f"{name}: {p} ({cigar})" for p in sam_cigar_problems(cigar, qlen)]
+    errors += [f"{name}: no record" for name in SAM_EXPECTED if name not in seen]
+    return errors
+
+
+def check_instrument_sites(work):
+    """-DNW_INSTRUMENT: call sites past the table size share "(other)" and leave the last real site alone."""
+    nsites = 130
+    src = os.path.join(work, 'instr_harness.c')
+    binary = os.path.join(work, 'instr_harness')
+    with open(src, 'w') as f:
+        f.write('#include "common/instrument.h"\nint main(void) {\n    INSTR_INIT();\n')
+        for k in range(nsites):
+            f.write(f'    for (int i = 0; i <= {k}; i++) {{ INSTR_SCOPE("site {k}"); }}\n')
+        f.write('    return 0;\n}\n')
+    r = subprocess.run(['gcc', '-O2', '-DNW_INSTRUMENT', '-I', ROOT, src, '-o', binary],
+                       capture_output=True, text=True)
+    if r.returncode != 0:
+        raise RuntimeError(f"build of the instrument harness failed:\n{r.stderr}")
+    summary = os.path.join(work, 'instr_summary.txt')
+    subprocess.run([binary], cwd=work, env=dict(os.environ, NW_INSTRUMENT=summary), capture_output=True, check=True)
+
+    calls = {}
+    with open(summary) as f:
+        for line in f:
+            m = re.match(r'^(.*?)\s+(\d+)(\s+[\d.]+){3}\s+[\d.]+%$', line.rstrip('\n'))
+            if m:
+                calls[m.group(1)] = int(m.group(2))
+    # the table holds 128 sites; site k runs k + 1 times
+    want = {f"site {k}": k + 1 for k in range(128)}
+    want["(other)"] = sum(k + 1 for k in range(128, nsites))
+    return [f"{name}: {calls.get(name)} calls, expected {n}" for name, n in want.items() if calls.get(name) != n] + \
+           [f"unexpected scope {name}" for name in calls if name not in want]
+
+
+def check_validate_matrix(work):
+    """validate.py rescores results made with a matrix file and with the EDNAFULL alias."""
+    try:
+        sys.path.insert(0, os.path.dirname(os.path.abspath(__file__)))
+        import validate
+    except ImportError as e:
+        raise Skip(f"no BioPython ({e})")
+    matrix = os.path.join(work, 'asym.txt')
+    with open(matrix, 'w') as f:
+        f.write(ASYMMETRIC)
+    rng = random.Random(5)
+    seq = ''.join(rng.choice('ACGT') for _ in range(400))
+    write_fasta(os.path.join(work, 'A.fasta'), [('A', seq)])
+    write_fasta(os.path.join(work, 'B.fasta'), [('B', ''.join(c if rng.random() > 0.2 else rng.choice('ACGT') for c in seq))])
+
+    binary = build('hirschberg_generic', work)
+    result = os.path.join(work, 'A_vs_B_hirschberg_alignment.txt')
+    errors = []
+    for scheme in (['--matrix', matrix, '--gap', '-3'], ['--matrix', 'EDNAFULL', '--gap', '-8']):
+        run([binary] + scheme + ['A.fasta', 'B.fasta'], work)
+        seq_a, seq_b, score, opts = validate.parse_alignment(result)
+        if seq_a is None or opts.get('--matrix') != scheme[1]:
+            errors.append(f"{' '.join(scheme)}: result file not read back ({opts})")
+            continue
+        seq_a, seq_b = validate.strip_gaps(seq_a, seq_b)
+        bio = int(validate.make_aligner(opts).score(seq_a, seq_b))
+        if bio != score:
+            errors.append(f"{' '.join(scheme)}: program {score}, BioPython {bio}")
+    return errors
+
+
+CHECKS = [v for k, v in list(globals().items()) if k.startswith('check_')]
+
+
+def main(args):
+    names = set(args)
+    unknown = names - {c.__name__[6:] for c in CHECKS}
+    if unknown:
+        print(f"Unknown check(s): {', '.join(sorted(unknown))}")
+        print(f"Checks: {', '.join(c.__name__[6:] for c in CHECKS)}")
+        return 1
+    failed = 0
+    with tempfile.TemporaryDirectory(prefix='nw_regress_') as work:
+        for check in CHECKS:
+            name = check.__name__[6:]
+            if names and name not in names:
+                continue
+            try:
+                errors = check(work)
+            except Skip as e:
+                print(f"SKIP {name}: {e}")
+                continue
+            if errors:
+                failed += 1
+                print(f"FAIL {name}")
+                for e in errors[:20]:
+                    print(f"  {e}")
+            else:
+                print(f"ok   {name}")
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
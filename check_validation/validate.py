@@ -1,9 +1,55 @@
 import sys
 import os
-from Bio.Align import PairwiseAligner
+from Bio.Align import PairwiseAligner, substitution_matrices
 from Bio import SeqIO
 import glob
 
+# Scoring options given on the command line (same names as common/scoring.h).
+# A result file that records its own "Scoring:" line is checked with that scheme instead.
+SCORING = {}
+
+
+def parse_scoring(args):
+    opts = {}
+    for i in range(0, len(args) - 1, 2):
+        if args[i].startswith('--'):
+            opts[args[i]] = args[i + 1]
+    return opts
+
+
+def load_matrix(spec):
+    # Same lookup as scoring_load_matrix(): built-in names (EDNAFULL is NUC.4.4), else a matrix file
+    name = spec.upper()
+    if name == 'EDNAFULL':
+        name = 'NUC.4.4'
+    if name in ('NUC.4.4', 'BLOSUM62') or not os.path.exists(spec):
+        return substitution_matrices.load(name)
+    return substitution_matrices.read(spec)
+
+
+def make_aligner(opts):
+    aligner = PairwiseAligner()
+    aligner.mode = 'global'
+    if '--matrix' in opts:
+        aligner.substitution_matrix = load_matrix(opts['--matrix'])
+    else:
+        aligner.match_score = int(opts.get('--match', 1))
+        aligner.mismatch_score = int(opts.get('--mismatch', -1))
+    if '--gap-open2' in opts:
+        # convex: the cheaper of two affine pieces for every gap length
+        o, e = int(opts['--gap-open']), int(opts['--gap-extend'])
+        o2, e2 = int(opts['--gap-open2']), int(opts['--gap-extend2'])
+        cost = lambda i, n: max(o + n * e, o2 + n * e2)
+        aligner.insertion_score = cost
+        aligner.deletion_score = cost
+    elif '--gap-open' in opts:
+        # scoring.h charges open + k * extend; BioPython's open score already covers the first base
+        aligner.open_gap_score = int(opts['--gap-open']) + int(opts['--gap-extend'])
+        aligner.extend_gap_score = int(opts['--gap-extend'])
+    else:
+        aligner.gap_score = int(opts.get('--gap', -1))
+    return aligner
+
 
 def read_fasta(filepath):
     try:
@@ -21,10 +67,12 @@ def parse_alignment(filename):
             
         score_line = [line for line in content.split('\n') if 'Alignment Score:' in line]
         if not score_line:
-            return None, None, None
+            return None, None, None, None
             
         score = int(score_line[0].split(':')[1].strip())
         lines = content.split('\n')
+        scheme = [line for line in lines if line.startswith('Scoring:')]
+        opts = parse_scoring(scheme[0].split(':', 1)[1].split()) if scheme else SCORING
         seq_a, seq_b = None, None
         
         for i, line in enumerate(lines):
@@ -37,21 +85,17 @@ def parse_alignment(filename):
                   or 'Aligned B:' in line) and i + 1 < len(lines):
                 seq_b = lines[i + 1].strip()
         
-        return seq_a, seq_b, score if seq_a and seq_b else (None, None, None)
+        return (seq_a, seq_b, score, opts) if seq_a and seq_b else (None, None, None, None)
     except FileNotFoundError:
-        return None, None, None
+        return None, None, None, None
 
 
 def strip_gaps(seq_a, seq_b):
     return seq_a.replace('_', ''), seq_b.replace('_', '')
 
 
-def validate_with_biopython(orig_a, orig_b, c_score, species, ref_seq):
-    aligner = PairwiseAligner()
-    aligner.mode = 'global'
-    aligner.match_score = 1
-    aligner.mismatch_score = -1
-    aligner.gap_score = -1
+def validate_with_biopython(orig_a, orig_b, c_score, species, ref_seq, opts):
+    aligner = make_aligner(opts)
     
     ref_match = orig_a == ref_seq
     alignments = aligner.align(orig_a, orig_b)
@@ -135,7 +179,7 @@ def validate_results(seqs, files, ref):
     total = score_ok = ref_ok = 0
     
     for species, filename in files:
-        seq_a, seq_b, c_score = parse_alignment(filename)
+        seq_a, seq_b, c_score, opts = parse_alignment(filename)
         if not all([seq_a, seq_b, c_score is not None]):
             print(f"[{species}] Failed to read: {filename}")
             continue
@@ -148,7 +192,7 @@ def validate_results(seqs, files, ref):
         
         try:
             score_match, bio_score, ref_match = validate_with_biopython(
-                orig_a, orig_b, c_score, species, ref
+                orig_a, orig_b, c_score, species, ref, opts
             )
             
             total += 1
@@ -237,11 +281,7 @@ def quick_align():
         return
         
     human_seq = seqs['human']
-    aligner = PairwiseAligner()
-    aligner.mode = 'global'
-    aligner.match_score = 1
-    aligner.mismatch_score = -1
-    aligner.gap_score = -1
+    aligner = make_aligner(SCORING)
     
     print(f"Reference length: {len(human_seq)} bp\n")
     
@@ -278,7 +318,9 @@ def quick_align():
 
 
 if __name__ == "__main__":
-    if len(sys.argv) > 1 and sys.argv[1] == "--mito":
+    mito = len(sys.argv) > 1 and sys.argv[1] == "--mito"
+    SCORING.update(parse_scoring(sys.argv[2 if mito else 1:]))
+    if mito:
         validate_mito()
     else:
         validate_mrna()
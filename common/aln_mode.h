@@ -0,0 +1,289 @@
+/*
+ * aln_mode.h - local and semi-global alignment modes
+ *
+ * Header-only, like scoring.h (which it includes, with aln_output.h):
+ *     #include "../common/aln_mode.h"
+ *
+ * A mode is a set of ALN_FREE_* flags saying which sequence ends may be left
+ * unaligned at no cost, plus ALN_LOCAL for Smith-Waterman:
+ *   global   no free ends (Needleman-Wunsch, the default)
+ *   local    Smith-Waterman: any ends, scores floor at 0
+ *   glocal   both ends of B: A (the query) is placed inside B (the target)
+ *   overlap  all four ends: a suffix of one sequence against a prefix of the other
+ * --free-ends picks any other combination, e.g. "b-start,b-end" is glocal.
+ *
+ * The programs keep their global DP kernels and use them on a region:
+ *
+ *   1. aln_scan() runs one score-only pass (two rows, O(lenB) memory) over the
+ *      whole matrix in the mode and returns the best score and the cell it
+ *      ends in.
+ *   2. aln_locate() runs aln_scan() again over the reversed prefixes, anchored
+ *      at that end, to find where the best alignment starts.
+ *   3. The program aligns A[a_start, a_end) with B[b_start, b_end) globally,
+ *      with its usual traceback.
+ *
+ * Every global path through the region is a path the mode allows, and the
+ * reverse pass makes sure the best one scores as high as the whole search, so
+ * step 3 finds the optimal local / semi-global alignment. Its traceback
+ * memory is that of the region, not of the whole matrix, which is what makes
+ * a transcript placed in a long genomic window cheap to trace back.
+ *
+ * aln_scan() handles linear, affine and convex gaps (linear is affine with
+ * open 0). Ties go to the first cell in row-major order, so every program,
+ * and the OpenCL kernels, pick the same region.
+ */
+#ifndef ALN_MODE_H
+#define ALN_MODE_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include "scoring.h"
+#include "aln_output.h"
+#include "instrument.h"
+
+#define ALN_FREE_A_START 1    /* leading bases of A may stay unaligned */
+#define ALN_FREE_A_END 2      /* trailing bases of A */
+#define ALN_FREE_B_START 4
+#define ALN_FREE_B_END 8
+#define ALN_LOCAL 16          /* scores floor at 0 and the alignment may end anywhere */
+#define ALN_END_ANYWHERE 32   /* ends anywhere without the floor: reverse pass of ALN_LOCAL */
+
+#define ALN_FREE_ENDS (ALN_FREE_A_START | ALN_FREE_A_END | ALN_FREE_B_START | ALN_FREE_B_END)
+
+#define ALN_GLOBAL 0
+#define ALN_MODE_LOCAL (ALN_LOCAL | ALN_FREE_ENDS)
+#define ALN_MODE_GLOCAL (ALN_FREE_B_START | ALN_FREE_B_END)
+#define ALN_MODE_OVERLAP ALN_FREE_ENDS
+
+#define ALN_MODE_OPTIONS "[--mode global|local|glocal|overlap] [--free-ends a-start,a-end,b-start,b-end]"
+
+#define ALN_NEG_INF (INT_MIN / 4)
+
+/* Best cell of a scan: the alignment ends after A[0, i) and B[0, j). */
+typedef struct {
+    int score;
+    int i, j;
+} AlnEnd;
+
+/* Aligned part of each sequence, 0-based half-open, and its score. */
+typedef struct {
+    int score;
+    int a_start, a_end;
+    int b_start, b_end;
+} AlnRegion;
+
+/*
+ * Consumes argv[*i] (and its value) when it is a mode option, like
+ * scoring_arg(): 1 if it was one, 0 if not, -1 after printing the problem.
+ * --free-ends adds to what --mode selected.
+ */
+static inline int aln_mode_arg(int* mode, int argc, char** argv, int* i) {
+    const char* opt = argv[*i];
+    if (strcmp(opt, "--mode") != 0 && strcmp(opt, "--free-ends") != 0) return 0;
+    if (*i + 1 >= argc) {
+        printf("%s needs a value: %s\n", opt, ALN_MODE_OPTIONS);
+        return -1;
+    }
+    const char* val = argv[++*i];
+
+    if (strcmp(opt, "--mode") == 0) {
+        if (strcmp(val, "global") == 0) *mode = ALN_GLOBAL;
+        else if (strcmp(val, "local") == 0) *mode = ALN_MODE_LOCAL;
+        else if (strcmp(val, "glocal") == 0 || strcmp(val, "semi-global") == 0) *mode = ALN_MODE_GLOCAL;
+        else if (strcmp(val, "overlap") == 0) *mode = ALN_MODE_OVERLAP;
+        else {
+            printf("Unknown mode: %s (expected global|local|glocal|overlap)\n", val);
+            return -1;
+        }
+        return 1;
+    }
+
+    static const char* names[] = {"a-start", "a-end", "b-start", "b-end"};
+    const char* p = val;
+    while (*p) {
+        size_t n = strcspn(p, ",");
+        int f = 0;
+        while (f < 4 && !(strlen(names[f]) == n && strncmp(p, names[f], n) == 0)) f++;
+        if (f == 4) {
+            printf("Unknown end in --free-ends %s (expected a-start,a-end,b-start,b-end)\n", val);
+            return -1;
+        }
+        *mode |= 1 << f;
+        p += n;
+        if (*p == ',') p++;
+    }
+    return 1;
+}
+
+/* The mode as a name ("glocal") or as its free ends ("free-ends a-start,b-end"). */
+static inline void aln_mode_describe(int mode, char* buf, size_t size) {
+    if (mode & ALN_LOCAL) snprintf(buf, size, "local");
+    else if (mode == ALN_GLOBAL) snprintf(buf, size, "global");
+    else if (mode == ALN_MODE_GLOCAL) snprintf(buf, size, "glocal");
+    else if (mode == ALN_MODE_OVERLAP) snprintf(buf, size, "overlap");
+    else {
+        static const char* names[] = {"a-start", "a-end", "b-start", "b-end"};
+        int n = snprintf(buf, size, "free-ends");
+        for (int f = 0; f < 4 && n > 0 && (size_t)n < size; f++)
+            if (mode & (1 << f)) n += snprintf(buf + n, size - n, "%c%s", n == 9 ? ' ' : ',', names[f]);
+    }
+}
+
+/* Mode of the reverse pass: anchored at the found end, free where the forward pass could start. */
+static inline int aln_mode_reverse(int mode) {
+    if (mode & ALN_LOCAL) return ALN_END_ANYWHERE;
+    return ((mode & ALN_FREE_A_START) ? ALN_FREE_A_END : 0) | ((mode & ALN_FREE_B_START) ? ALN_FREE_B_END : 0);
+}
+
+/* Whether the alignment may end in cell (i, j) of a lenA x lenB matrix. */
+static inline int aln_end_cell(int mode, int i, int j, int lenA, int lenB) {
+    return (mode & (ALN_LOCAL | ALN_END_ANYWHERE)) || (i == lenA && j == lenB) ||
+           ((mode & ALN_FREE_A_END) && j == lenB) || ((mode & ALN_FREE_B_END) && i == lenA);
+}
+
+/* Keeps the first best of the cells offered in row-major order. */
+static inline void aln_end_offer(AlnEnd* best, int score, int i, int j) {
+    if (score > best->score) {
+        best->score = score;
+        best->i = i;
+        best->j = j;
+    }
+}
+
+/* Score of the boundary cell (0, j) (free_start: ALN_FREE_B_START) or (i, 0) (ALN_FREE_A_START). */
+static inline int aln_edge_score(const Scoring* sc, int mode, int free_start, int k) {
+    return (mode & free_start) ? 0 : scoring_gap(sc, k);
+}
+
+/*
+ * Score-only pass over A x B in the given mode; returns the best score and
+ * the cell it ends in. Two gap pieces are kept (Gotoh with a second affine
+ * piece for convex gaps); linear gaps run as affine with open 0.
+ * aln_scan_into() takes its rows from work (ALN_SCAN_WORK(lenB) ints) so a
+ * caller that keeps a workspace does not allocate per pair.
+ */
+#define ALN_SCAN_WORK(lenB) (3 * ((size_t)(lenB) + 1))
+
+static inline AlnEnd aln_scan_into(const Scoring* sc, int mode, const uint8_t* a, int lenA, const uint8_t* b, int lenB,
+                                   int* work) {
+    INSTR_SCOPE("scan");
+    INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+    int o1 = 0, e1 = sc->gap;
+    if (sc->gap_model != GAP_LINEAR) {
+        o1 = sc->gap_open;
+        e1 = sc->gap_extend;
+    }
+    int convex = sc->gap_model == GAP_CONVEX;
+    int o2 = convex ? sc->gap_open2 : o1, e2 = convex ? sc->gap_extend2 : e1;
+    int local = (mode & ALN_LOCAL) != 0;
+    int anywhere = (mode & (ALN_LOCAL | ALN_END_ANYWHERE)) != 0;
+
+    int* H = work;
+    int* F1 = H + lenB + 1;     /* vertical gap states, one per column */
+    int* F2 = F1 + lenB + 1;
+
+    AlnEnd best = {ALN_NEG_INF, -1, -1};
+    for (int j = 0; j <= lenB; j++) {
+        H[j] = j ? aln_edge_score(sc, mode, ALN_FREE_B_START, j) : 0;
+        F1[j] = F2[j] = ALN_NEG_INF;
+        if (aln_end_cell(mode, 0, j, lenA, lenB)) aln_end_offer(&best, H[j], 0, j);
+    }
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* row = sc->table + a[i - 1] * NT_CODES;
+        int diag = H[0];
+        int E1 = ALN_NEG_INF, E2 = ALN_NEG_INF;
+        H[0] = aln_edge_score(sc, mode, ALN_FREE_A_START, i);
+        if (aln_end_cell(mode, i, 0, lenA, lenB)) aln_end_offer(&best, H[0], i, 0);
+
+        for (int j = 1; j <= lenB; j++) {
+            int h = diag + row[b[j - 1]];
+            diag = H[j];
+            E1 = (H[j - 1] + o1 > E1 ? H[j - 1] + o1 : E1) + e1;
+            F1[j] = (diag + o1 > F1[j] ? diag + o1 : F1[j]) + e1;
+            if (h < E1) h = E1;
+            if (h < F1[j]) h = F1[j];
+            if (convex) {
+                E2 = (H[j - 1] + o2 > E2 ? H[j - 1] + o2 : E2) + e2;
+                F2[j] = (diag + o2 > F2[j] ? diag + o2 : F2[j]) + e2;
+                if (h < E2) h = E2;
+                if (h < F2[j]) h = F2[j];
+            }
+            if (local && h < 0) h = 0;
+            H[j] = h;
+            if (anywhere && h > best.score) {
+                best.score = h;
+                best.i = i;
+                best.j = j;
+            }
+        }
+
+        if (anywhere || lenB == 0) continue;
+        if ((mode & ALN_FREE_B_END) && i == lenA) {
+            for (int j = 1; j <= lenB; j++) aln_end_offer(&best, H[j], i, j);
+        } else if ((mode & ALN_FREE_A_END) || i == lenA) {
+            aln_end_offer(&best, H[lenB], i, lenB);
+        }
+    }
+
+    return best;
+}
+
+static inline AlnEnd aln_scan(const Scoring* sc, int mode, const uint8_t* a, int lenA, const uint8_t* b, int lenB) {
+    int* work = (int*)malloc(ALN_SCAN_WORK(lenB) * sizeof(int));
+    AlnEnd best = aln_scan_into(sc, mode, a, lenA, b, lenB, work);
+    free(work);
+    return best;
+}
+
+/* Reversed copy of codes[0, n). */
+static inline uint8_t* aln_reverse_dup(const uint8_t* codes, int n) {
+    uint8_t* r = (uint8_t*)malloc((size_t)n + 1);
+    for (int k = 0; k < n; k++) r[k] = codes[n - 1 - k];
+    r[n] = 0;
+    return r;
+}
+
+/* Start of the best alignment that ends at end, from a scan of the reversed prefixes. */
+static inline AlnRegion aln_region_from(const Scoring* sc, int mode, const uint8_t* a, const uint8_t* b, AlnEnd end) {
+    uint8_t* ra = aln_reverse_dup(a, end.i);
+    uint8_t* rb = aln_reverse_dup(b, end.j);
+    AlnEnd start = aln_scan(sc, aln_mode_reverse(mode), ra, end.i, rb, end.j);
+    free(ra);
+    free(rb);
+
+    AlnRegion r;
+    r.score = end.score;
+    r.a_start = end.i - start.i;
+    r.a_end = end.i;
+    r.b_start = end.j - start.j;
+    r.b_end = end.j;
+    return r;
+}
+
+/* Region of the best alignment of A and B in a non-global mode (steps 1 and 2 above). */
+static inline AlnRegion aln_locate(const Scoring* sc, int mode, const uint8_t* a, int lenA, const uint8_t* b, int lenB) {
+    return aln_region_from(sc, mode, a, b, aln_scan(sc, mode, a, lenA, b, lenB));
+}
+
+/* The region of a global alignment: both sequences end to end. */
+static inline AlnRegion aln_region_full(int lenA, int lenB, int score) {
+    AlnRegion r = {score, 0, lenA, 0, lenB};
+    return r;
+}
+
+/* Record of an alignment covering region; the CIGAR spans only the region. */
+static inline AlnRecord aln_record_region(const char* qname, int qlen, const char* tname, int tlen,
+                                          const AlnRegion* region, const Cigar* cigar) {
+    AlnRecord r = aln_record_global(qname, qlen, tname, tlen, region->score, cigar);
+    r.qstart = region->a_start;
+    r.qend = region->a_end;
+    r.tstart = region->b_start;
+    r.tend = region->b_end;
+    return r;
+}
+
+#endif
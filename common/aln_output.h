@@ -0,0 +1,307 @@
+/*
+ * aln_output.h - run-length CIGAR and compact alignment records
+ *
+ * Header-only, like nt_code.h (which it includes):
+ *     #include "../common/aln_output.h"
+ *
+ * A traceback walks from the last cell back to the first, so it produces
+ * its operations last to first. A Cigar keeps its runs at the back of its
+ * buffer and cigar_prepend() grows them towards the front, so the finished
+ * CIGAR is already in order: there is no reversal pass and no gapped
+ * strings. Builders that run forward (the Hirschberg squeeze) use
+ * cigar_append() on the same type.
+ *
+ * Runs are BAM-encoded, len << 4 | op, with only =, X, I and D. The first
+ * sequence is the query and the second the target: I consumes a query base
+ * (a gap in the target), D a target base.
+ *
+ * aln_write() writes one AlnRecord as
+ *   ALN_CIGAR  TSV: qname tname qlen tlen qstart qend tstart tend score cigar
+ *   ALN_PAF    PAF, with NM:i:, AS:i: and cg:Z: tags
+ *   ALN_SAM    SAM with SEQ and QUAL '*' (the bases are in the FASTA input);
+ *              unaligned query ends become soft clips, D runs at the ends
+ *              move into POS or are dropped, and a record without an =/X
+ *              column is unmapped (FLAG 4, CIGAR '*')
+ *   ALN_BIN    binary, see below
+ * ALN_TEXT is the programs' own report with gapped strings, which
+ * cigar_gapped() builds on demand.
+ *
+ * Binary layout (little-endian): the file starts with the 4 bytes "NWB1",
+ * then one record per alignment:
+ *   uint32 qname_len, tname_len, n_ops
+ *   int32  qlen, tlen, qstart, qend, tstart, tend, score
+ *   qname, tname (no terminating NUL), n_ops uint32 runs
+ * A 10 kbp pair with a few hundred gaps takes a few KB instead of the
+ * ~40 KB of the two gapped strings.
+ */
+#ifndef ALN_OUTPUT_H
+#define ALN_OUTPUT_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "nt_code.h"
+
+#define CIGAR_INS 1
+#define CIGAR_DEL 2
+#define CIGAR_EQ 7
+#define CIGAR_X 8
+
+/* BAM op code -> SAM letter */
+#define CIGAR_LETTERS "MIDNSHP=XB"
+
+typedef struct {
+    uint32_t* buf;
+    int cap;
+    int start, end;     /* runs are buf[start..end) */
+} Cigar;
+
+static inline void cigar_init(Cigar* c) {
+    c->buf = NULL;
+    c->cap = c->start = c->end = 0;
+}
+
+/* Empties c but keeps its buffer for the next alignment. */
+static inline void cigar_clear(Cigar* c) {
+    c->start = c->end = 0;
+}
+
+static inline void cigar_free(Cigar* c) {
+    free(c->buf);
+    cigar_init(c);
+}
+
+static inline const uint32_t* cigar_ops(const Cigar* c) { return c->buf + c->start; }
+static inline int cigar_count(const Cigar* c) { return c->end - c->start; }
+
+/* Moves the runs to the back (front != 0) or the front of the buffer, growing it when half full. */
+static inline void cigar_make_room(Cigar* c, int front) {
+    int n = c->end - c->start;
+    int cap = c->cap;
+    if (n + 1 > cap / 2) {
+        cap = cap * 2 + 64;
+        c->buf = (uint32_t*)realloc(c->buf, sizeof(uint32_t) * cap);
+    }
+    int start = front ? cap - n : 0;
+    memmove(c->buf + start, c->buf + c->start, sizeof(uint32_t) * n);
+    c->start = start;
+    c->end = start + n;
+    c->cap = cap;
+}
+
+static inline void cigar_prepend(Cigar* c, int op, uint32_t len) {
+    if (c->end > c->start && (int)(c->buf[c->start] & 15) == op) {
+        c->buf[c->start] += len << 4;
+        return;
+    }
+    if (c->start == 0) cigar_make_room(c, 1);
+    c->buf[--c->start] = len << 4 | op;
+}
+
+static inline void cigar_append(Cigar* c, int op, uint32_t len) {
+    if (c->end > c->start && (int)(c->buf[c->end - 1] & 15) == op) {
+        c->buf[c->end - 1] += len << 4;
+        return;
+    }
+    if (c->end == c->cap) cigar_make_room(c, 0);
+    c->buf[c->end++] = len << 4 | op;
+}
+
+/* Column counts of the alignment; returns its length. */
+static inline int cigar_stats(const Cigar* c, int* matches, int* mismatches, int* gaps) {
+    int m = 0, x = 0, g = 0;
+    for (int k = c->start; k < c->end; k++) {
+        int run = c->buf[k] >> 4, op = c->buf[k] & 15;
+        if (op == CIGAR_EQ) m += run;
+        else if (op == CIGAR_X) x += run;
+        else g += run;
+    }
+    *matches = m;
+    *mismatches = x;
+    *gaps = g;
+    return m + x + g;
+}
+
+/* Writes the CIGAR text ("12=1X3I..."), or "*" when empty. */
+static inline void cigar_write(FILE* out, const Cigar* c) {
+    if (c->end == c->start) putc('*', out);
+    for (int k = c->start; k < c->end; k++)
+        fprintf(out, "%u%c", c->buf[k] >> 4, CIGAR_LETTERS[c->buf[k] & 15]);
+}
+
+/*
+ * Gapped strings ('_' for gaps) of query a and target b, from their first
+ * aligned bases. Only text reports need these; with decode set, a and b
+ * are nt_code.h codes instead of letters.
+ */
+static inline void cigar_gapped_impl(const Cigar* c, const void* a, const void* b, int decode,
+                                     char** outA, char** outB) {
+    int m, x, g;
+    int len = cigar_stats(c, &m, &x, &g);
+    char* sa = (char*)malloc(len + 1);
+    char* sb = (char*)malloc(len + 1);
+    const char* la = (const char*)a;
+    const char* lb = (const char*)b;
+    const uint8_t* ca = (const uint8_t*)a;
+    const uint8_t* cb = (const uint8_t*)b;
+    int i = 0, j = 0, p = 0;
+    for (int k = c->start; k < c->end; k++) {
+        int run = c->buf[k] >> 4, op = c->buf[k] & 15;
+        for (int r = 0; r < run; r++, p++) {
+            sa[p] = op == CIGAR_DEL ? '_' : decode ? nt_decode_base(ca[i++]) : la[i++];
+            sb[p] = op == CIGAR_INS ? '_' : decode ? nt_decode_base(cb[j++]) : lb[j++];
+        }
+    }
+    sa[len] = sb[len] = '\0';
+    *outA = sa;
+    *outB = sb;
+}
+
+static inline void cigar_gapped(const Cigar* c, const char* a, const char* b, char** outA, char** outB) {
+    cigar_gapped_impl(c, a, b, 0, outA, outB);
+}
+
+static inline void cigar_gapped_codes(const Cigar* c, const uint8_t* a, const uint8_t* b,
+                                      char** outA, char** outB) {
+    cigar_gapped_impl(c, a, b, 1, outA, outB);
+}
+
+/* ---------------------------------------------------------------------
+ * Records
+ * ------------------------------------------------------------------- */
+
+typedef enum { ALN_TEXT, ALN_CIGAR, ALN_PAF, ALN_SAM, ALN_BIN } AlnFormat;
+
+#define ALN_FORMATS "text|cigar|paf|sam|bin"
+
+/* Format by name, or -1 (with a message) when unknown. */
+static inline int aln_format_parse(const char* name) {
+    static const char* names[] = {"text", "cigar", "paf", "sam", "bin"};
+    for (int f = 0; f < 5; f++)
+        if (strcmp(name, names[f]) == 0) return f;
+    printf("Unknown output format: %s (expected %s)\n", name, ALN_FORMATS);
+    return -1;
+}
+
+/* File extension for a format. */
+static inline const char* aln_format_ext(AlnFormat fmt) {
+    static const char* ext[] = {"txt", "cigar", "paf", "sam", "nwb"};
+    return ext[fmt];
+}
+
+typedef struct {
+    const char* qname;
+    const char* tname;
+    int qlen, tlen;
+    int qstart, qend;       /* aligned part of the query, 0-based half-open */
+    int tstart, tend;       /* and of the target */
+    int score;
+    const Cigar* cigar;
+} AlnRecord;
+
+/* Record of a global alignment: both sequences are covered end to end. */
+static inline AlnRecord aln_record_global(const char* qname, int qlen, const char* tname, int tlen,
+                                          int score, const Cigar* cigar) {
+    AlnRecord r;
+    r.qname = qname;
+    r.tname = tname;
+    r.qlen = qlen;
+    r.tlen = tlen;
+    r.qstart = 0;
+    r.qend = qlen;
+    r.tstart = 0;
+    r.tend = tlen;
+    r.score = score;
+    r.cigar = cigar;
+    return r;
+}
+
+static inline void aln_put_u32(FILE* out, const uint32_t* v, size_t n) {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    for (size_t k = 0; k < n; k++) {
+        uint32_t le = __builtin_bswap32(v[k]);
+        fwrite(&le, 4, 1, out);
+    }
+#else
+    fwrite(v, 4, n, out);
+#endif
+}
+
+/*
+ * Once per output file: @HD/@PG for SAM, the magic for binary output.
+ * targets/target_lens (may be 0) become @SQ lines; a SAM file whose
+ * targets are not known up front has records without a matching @SQ.
+ */
+static inline void aln_write_header(FILE* out, AlnFormat fmt, const char* program,
+                                    const char* const* targets, const int* target_lens, int ntargets) {
+    if (fmt == ALN_SAM) {
+        fprintf(out, "@HD\tVN:1.6\tSO:unsorted\n");
+        for (int t = 0; t < ntargets; t++) fprintf(out, "@SQ\tSN:%s\tLN:%d\n", targets[t], target_lens[t]);
+        fprintf(out, "@PG\tID:%s\tPN:%s\n", program, program);
+    } else if (fmt == ALN_BIN) {
+        fwrite("NWB1", 1, 4, out);
+    }
+}
+
+static inline void aln_write(FILE* out, AlnFormat fmt, const AlnRecord* r) {
+    int matches, mismatches, gaps;
+    int len = cigar_stats(r->cigar, &matches, &mismatches, &gaps);
+
+    switch (fmt) {
+    case ALN_CIGAR:
+        fprintf(out, "%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%d\t", r->qname, r->tname, r->qlen, r->tlen,
+                r->qstart, r->qend, r->tstart, r->tend, r->score);
+        cigar_write(out, r->cigar);
+        putc('\n', out);
+        break;
+    case ALN_PAF:
+        fprintf(out, "%s\t%d\t%d\t%d\t+\t%s\t%d\t%d\t%d\t%d\t%d\t255\tNM:i:%d\tAS:i:%d\tcg:Z:",
+                r->qname, r->qlen, r->qstart, r->qend, r->tname, r->tlen, r->tstart, r->tend,
+                matches, len, mismatches + gaps, r->score);
+        cigar_write(out, r->cigar);
+        putc('\n', out);
+        break;
+    case ALN_SAM: {
+        /*
+         * Only =/X columns place the query on the target: without one (an
+         * empty local region, or insertions only) the record is unmapped.
+         * A D run at either end would sit next to a soft clip or the read
+         * end, so a leading one moves POS and a trailing one is dropped.
+         */
+        if (matches + mismatches == 0) {
+            fprintf(out, "%s\t4\t*\t0\t0\t*\t*\t0\t0\t*\t*\tAS:i:%d\n", r->qname, r->score);
+            break;
+        }
+        const uint32_t* ops = cigar_ops(r->cigar);
+        int first = 0, last = cigar_count(r->cigar), pos = r->tstart, nm = mismatches + gaps;
+        if ((ops[first] & 15) == CIGAR_DEL) {
+            pos += ops[first] >> 4;
+            nm -= ops[first++] >> 4;
+        }
+        if ((ops[last - 1] & 15) == CIGAR_DEL) nm -= ops[--last] >> 4;
+        fprintf(out, "%s\t0\t%s\t%d\t255\t", r->qname, r->tname, pos + 1);
+        if (r->qstart > 0) fprintf(out, "%dS", r->qstart);
+        for (int k = first; k < last; k++) fprintf(out, "%u%c", ops[k] >> 4, CIGAR_LETTERS[ops[k] & 15]);
+        if (r->qend < r->qlen) fprintf(out, "%dS", r->qlen - r->qend);
+        fprintf(out, "\t*\t0\t0\t*\t*\tNM:i:%d\tAS:i:%d\n", nm, r->score);
+        break;
+    }
+    case ALN_BIN: {
+        uint32_t head[10] = {
+            (uint32_t)strlen(r->qname), (uint32_t)strlen(r->tname), (uint32_t)cigar_count(r->cigar),
+            (uint32_t)r->qlen, (uint32_t)r->tlen, (uint32_t)r->qstart, (uint32_t)r->qend,
+            (uint32_t)r->tstart, (uint32_t)r->tend, (uint32_t)r->score,
+        };
+        aln_put_u32(out, head, 10);
+        fwrite(r->qname, 1, head[0], out);
+        fwrite(r->tname, 1, head[1], out);
+        aln_put_u32(out, cigar_ops(r->cigar), head[2]);
+        break;
+    }
+    case ALN_TEXT:
+        break;
+    }
+}
+
+#endif
@@ -0,0 +1,438 @@
+/*
+ * bench.h - the --bench mode the programs share
+ *
+ * Header-only, like scoring.h:
+ *     #include "../common/bench.h"
+ *
+ * --bench replaces a program's usual run with a fixed matrix of sequence
+ * lengths x divergence levels. Every cell aligns one generated pair:
+ *
+ *   - A is uniform random ACGT from a splitmix64 stream seeded with
+ *     (--bench-seed, length); B is A with a fraction --bench-div of its bases
+ *     mutated (70% substitutions, 15% insertions, 15% deletions) from a
+ *     stream seeded with (seed, length, divergence). The same seed gives the
+ *     same pairs in every program, on every machine, in any matrix order.
+ *   - The pair is aligned --bench-warmup times untimed, then --bench-reps
+ *     times timed with CLOCK_MONOTONIC (wall clock, not clock()'s CPU time,
+ *     which counts every OpenMP thread).
+ *   - The program reports three phases of each run: fill (encoding, region
+ *     search and the DP fill), traceback, and I/O (writing the alignment in
+ *     its --format to a temporary file). The row gets the median of each.
+ *   - Peak RSS is the high-water mark over the timed runs: VmHWM, reset
+ *     before the first one through /proc/self/clear_refs on Linux; elsewhere
+ *     it is getrusage()'s peak for the whole process so far.
+ *
+ * GCUPS is lenA * lenB / median run time / 1e9, the full matrix also in the
+ * local and semi-global modes (which fill it more than once).
+ *
+ * Results go to --bench-out (default bench_<program>.csv), one row per cell;
+ * a name ending in .json gives a JSON array of the same fields instead.
+ * benchmark/run_bench.py builds every program and merges their files.
+ *
+ * In main():
+ *     BenchConfig bench;
+ *     bench_init(&bench);
+ *     for (...) {
+ *         int r = bench_arg(&bench, argc, argv, &i);   // like scoring_arg()
+ *         ...
+ *     }
+ *     if (bench.enabled) return bench_run(&bench, &info, run_one, ctx);
+ * where run_one() aligns one pair, fills in a BenchPhases and returns the
+ * score.
+ */
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/resource.h>
+
+#define BENCH_MAX_POINTS 16
+
+#define BENCH_OPTIONS "[--bench] [--bench-lengths L,L,...] [--bench-div D,D,...] [--bench-reps N] " \
+    "[--bench-warmup N] [--bench-seed N] [--bench-out FILE.csv|FILE.json]"
+
+typedef struct {
+    int enabled;
+    int lengths[BENCH_MAX_POINTS];
+    int nlengths;
+    double divs[BENCH_MAX_POINTS];
+    int ndivs;
+    int reps;
+    int warmup;
+    uint64_t seed;
+    const char* out_path;   /* NULL: bench_<program>.csv */
+} BenchConfig;
+
+/* What the rows say about the run besides the matrix cell. */
+typedef struct {
+    const char* program;
+    const char* engine;     /* e.g. "avx2", "tiled", "opencl" */
+    int threads;
+    const char* scoring;    /* scoring_describe() */
+    const char* mode;       /* aln_mode_describe() */
+} BenchInfo;
+
+/* Seconds spent in each phase of one run. */
+typedef struct {
+    double fill;
+    double traceback;
+    double io;
+} BenchPhases;
+
+/* Aligns a with b once, writes the alignment to io (a temporary file) and returns the score. */
+typedef int (*BenchFn)(void* ctx, const char* a, int lenA, const char* b, int lenB, FILE* io, BenchPhases* t);
+
+static inline double bench_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline void bench_init(BenchConfig* cfg) {
+    static const int lengths[] = {1000, 5000, 10000};
+    static const double divs[] = {0.0, 0.05, 0.15, 0.30};
+    cfg->enabled = 0;
+    cfg->nlengths = 3;
+    memcpy(cfg->lengths, lengths, sizeof(lengths));
+    cfg->ndivs = 4;
+    memcpy(cfg->divs, divs, sizeof(divs));
+    cfg->reps = 3;
+    cfg->warmup = 1;
+    cfg->seed = 1;
+    cfg->out_path = NULL;
+}
+
+/* Parses a comma-separated list into ints (divs == NULL) or doubles; the count, or -1. */
+static inline int bench_parse_list(const char* val, int* ints, double* divs) {
+    int n = 0;
+    const char* p = val;
+    while (*p) {
+        char* end;
+        if (n == BENCH_MAX_POINTS) return -1;
+        if (divs) {
+            divs[n] = strtod(p, &end);
+            if (end == p || divs[n] < 0 || divs[n] > 1) return -1;
+        } else {
+            long v = strtol(p, &end, 10);
+            if (end == p || v < 1 || v > 1000000000L) return -1;
+            ints[n] = (int)v;
+        }
+        n++;
+        if (*end == ',') end++;
+        else if (*end) return -1;
+        p = end;
+    }
+    return n;
+}
+
+/* Parses a whole decimal integer in [lo, hi] into *out; 0 when val is not one. */
+static inline int bench_parse_count(const char* val, long lo, long hi, int* out) {
+    char* end;
+    errno = 0;
+    long v = strtol(val, &end, 10);
+    if (end == val || *end || errno == ERANGE || v < lo || v > hi) return 0;
+    *out = (int)v;
+    return 1;
+}
+
+/* Like scoring_arg(): 1 if argv[*i] was a --bench option (consumed), 0 if not, -1 on error. */
+static inline int bench_arg(BenchConfig* cfg, int argc, char** argv, int* i) {
+    const char* opt = argv[*i];
+    if (strncmp(opt, "--bench", 7) != 0) return 0;
+    if (strcmp(opt, "--bench") == 0) {
+        cfg->enabled = 1;
+        return 1;
+    }
+    if (strcmp(opt, "--bench-lengths") != 0 && strcmp(opt, "--bench-div") != 0 &&
+        strcmp(opt, "--bench-reps") != 0 && strcmp(opt, "--bench-warmup") != 0 &&
+        strcmp(opt, "--bench-seed") != 0 && strcmp(opt, "--bench-out") != 0)
+        return 0;
+    if (*i + 1 >= argc) {
+        printf("%s needs a value: %s\n", opt, BENCH_OPTIONS);
+        return -1;
+    }
+    const char* val = argv[++*i];
+    const char* want = NULL;
+    int ok = 1, list = 0;
+    cfg->enabled = 1;
+
+    if (strcmp(opt, "--bench-lengths") == 0) {
+        int n = bench_parse_list(val, cfg->lengths, NULL);
+        if (n > 0) cfg->nlengths = n;
+        else ok = 0;
+        want = "counts >= 1";
+        list = 1;
+    } else if (strcmp(opt, "--bench-div") == 0) {
+        int n = bench_parse_list(val, NULL, cfg->divs);
+        if (n > 0) cfg->ndivs = n;
+        else ok = 0;
+        want = "divergences in [0, 1]";
+        list = 1;
+    } else if (strcmp(opt, "--bench-reps") == 0) {
+        ok = bench_parse_count(val, 1, 1000000L, &cfg->reps);
+        want = "an integer in 1..1000000";
+    } else if (strcmp(opt, "--bench-warmup") == 0) {
+        ok = bench_parse_count(val, 0, 1000000L, &cfg->warmup);
+        want = "an integer in 0..1000000";
+    } else if (strcmp(opt, "--bench-seed") == 0) {
+        /* strtoull() would take "-1" as 2^64 - 1 */
+        char* end;
+        errno = 0;
+        cfg->seed = strtoull(val, &end, 10);
+        ok = val[0] >= '0' && val[0] <= '9' && *end == '\0' && errno != ERANGE;
+        want = "an unsigned 64-bit integer";
+    } else {
+        cfg->out_path = val;
+    }
+    if (!ok) {
+        if (list)
+            printf("Bad value for %s: %s (%s, at most %d)\n", opt, val, want, BENCH_MAX_POINTS);
+        else
+            printf("Bad value for %s: %s (%s)\n", opt, val, want);
+        return -1;
+    }
+    return 1;
+}
+
+/* ---------------------------------------------------------------------
+ * Pairs
+ * ------------------------------------------------------------------- */
+
+static inline uint64_t bench_rand(uint64_t* s) {
+    uint64_t z = (*s += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1). */
+static inline double bench_unit(uint64_t* s) {
+    return (bench_rand(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* The pair of one matrix cell; the caller frees *a and *b. */
+static inline void bench_pair(uint64_t seed, int len, double div, char** a, int* lenA, char** b, int* lenB) {
+    static const char bases[] = "ACGT";
+    uint64_t sa = seed ^ (uint64_t)len * 0xD1B54A32D192ED03ULL;
+    uint64_t sb = sa ^ 0xA0761D6478BD642FULL ^ (uint64_t)(div * 1e6 + 0.5) * 0x8CB92BA72F3D8DD7ULL;
+
+    char* x = (char*)malloc((size_t)len + 1);
+    for (int i = 0; i < len; i++) x[i] = bases[bench_rand(&sa) & 3];
+    x[len] = '\0';
+
+    char* y = (char*)malloc(2 * (size_t)len + 1);
+    int n = 0;
+    for (int i = 0; i < len; i++) {
+        if (bench_unit(&sb) >= div) {
+            y[n++] = x[i];
+            continue;
+        }
+        double kind = bench_unit(&sb);
+        if (kind < 0.70) {
+            /* one of the three other bases */
+            int code = (int)(strchr(bases, x[i]) - bases);
+            y[n++] = bases[(code + 1 + bench_rand(&sb) % 3) & 3];
+        } else if (kind < 0.85) {
+            y[n++] = bases[bench_rand(&sb) & 3];
+            y[n++] = x[i];
+        }
+        /* else deleted */
+    }
+    y[n] = '\0';
+
+    *a = x;
+    *lenA = len;
+    *b = y;
+    *lenB = n;
+}
+
+/* ---------------------------------------------------------------------
+ * Measurement
+ * ------------------------------------------------------------------- */
+
+/* Starts a new peak RSS window where the kernel allows it. */
+static inline void bench_peak_reset(void) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (f) {
+        fputs("5", f);
+        fclose(f);
+    }
+#endif
+}
+
+/* Peak resident set in KiB since bench_peak_reset() (or process start). */
+static inline long bench_peak_rss_kb(void) {
+#ifdef __linux__
+    FILE* f = fopen("/proc/self/status", "r");
+    if (f) {
+        char line[256];
+        long kb = -1;
+        while (fgets(line, sizeof(line), f))
+            if (strncmp(line, "VmHWM:", 6) == 0) kb = atol(line + 6);
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+#endif
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+    return ru.ru_maxrss / 1024;
+#else
+    return ru.ru_maxrss;
+#endif
+}
+
+static inline int bench_cmp_double(const void* x, const void* y) {
+    double a = *(const double*)x, b = *(const double*)y;
+    return (a > b) - (a < b);
+}
+
+/* Median of v[0..n), reordering v. */
+static inline double bench_median(double* v, int n) {
+    qsort(v, n, sizeof(double), bench_cmp_double);
+    return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+/* ---------------------------------------------------------------------
+ * Report
+ * ------------------------------------------------------------------- */
+
+#define BENCH_CSV_HEADER "program,engine,threads,scoring,mode,seed,length,divergence,len_a,len_b,warmup,reps," \
+    "score,cells,time_min_s,time_median_s,fill_s,traceback_s,io_s,gcups,peak_rss_kb"
+
+/* String field: always quoted in CSV, escaped in JSON. */
+static inline void bench_put_str(FILE* out, const char* s, int json) {
+    putc('"', out);
+    for (; *s; s++) {
+        if (*s == '"') fputs(json ? "\\\"" : "\"\"", out);
+        else if (*s == '\\' && json) fputs("\\\\", out);
+        else putc(*s, out);
+    }
+    putc('"', out);
+}
+
+typedef struct {
+    int score;
+    int len, lenA, lenB;
+    double div;
+    double time_min, time_median;
+    double fill, traceback, io;
+    long peak_rss_kb;
+} BenchCell;
+
+static inline void bench_write_row(FILE* out, int json, int first, const BenchConfig* cfg,
+                                   const BenchInfo* info, const BenchCell* c) {
+    double cells = (double)c->lenA * c->lenB;
+    double gcups = c->time_median > 0 ? cells / c->time_median / 1e9 : 0;
+    const char* sep = json ? ", " : ",";
+    if (json) {
+        fputs(first ? "  {" : ",\n  {", out);
+        fputs("\"program\": ", out);
+    }
+    bench_put_str(out, info->program, json);
+    fprintf(out, "%s%s", sep, json ? "\"engine\": " : "");
+    bench_put_str(out, info->engine, json);
+    fprintf(out, "%s%s%d", sep, json ? "\"threads\": " : "", info->threads);
+    fprintf(out, "%s%s", sep, json ? "\"scoring\": " : "");
+    bench_put_str(out, info->scoring, json);
+    fprintf(out, "%s%s", sep, json ? "\"mode\": " : "");
+    bench_put_str(out, info->mode, json);
+    if (json) {
+        fprintf(out, ", \"seed\": %llu, \"length\": %d, \"divergence\": %g, \"len_a\": %d, \"len_b\": %d, "
+                     "\"warmup\": %d, \"reps\": %d, \"score\": %d, \"cells\": %.0f, "
+                     "\"time_min_s\": %.6f, \"time_median_s\": %.6f, \"fill_s\": %.6f, \"traceback_s\": %.6f, "
+                     "\"io_s\": %.6f, \"gcups\": %.4f, \"peak_rss_kb\": %ld}",
+                (unsigned long long)cfg->seed, c->len, c->div, c->lenA, c->lenB, cfg->warmup, cfg->reps,
+                c->score, cells, c->time_min, c->time_median, c->fill, c->traceback, c->io, gcups,
+                c->peak_rss_kb);
+    } else {
+        fprintf(out, ",%llu,%d,%g,%d,%d,%d,%d,%d,%.0f,%.6f,%.6f,%.6f,%.6f,%.6f,%.4f,%ld\n",
+                (unsigned long long)cfg->seed, c->len, c->div, c->lenA, c->lenB, cfg->warmup, cfg->reps,
+                c->score, cells, c->time_min, c->time_median, c->fill, c->traceback, c->io, gcups,
+                c->peak_rss_kb);
+    }
+}
+
+/*
+ * Runs the whole matrix through fn and writes the report; returns main()'s
+ * exit code. Progress goes to stderr, one line per cell.
+ */
+static inline int bench_run(const BenchConfig* cfg, const BenchInfo* info, BenchFn fn, void* ctx) {
+    char path[256];
+    if (cfg->out_path) snprintf(path, sizeof(path), "%s", cfg->out_path);
+    else snprintf(path, sizeof(path), "bench_%s.csv", info->program);
+    size_t plen = strlen(path);
+    int json = plen >= 5 && strcmp(path + plen - 5, ".json") == 0;
+
+    FILE* out = fopen(path, "w");
+    FILE* io = tmpfile();
+    if (!out || !io) {
+        printf("Cannot open %s\n", out ? "a temporary file" : path);
+        if (out) fclose(out);
+        if (io) fclose(io);
+        return 1;
+    }
+    if (json) fputs("[\n", out);
+    else fprintf(out, "%s\n", BENCH_CSV_HEADER);
+
+    double* total = (double*)malloc(sizeof(double) * 4 * cfg->reps);
+    double* fill = total + cfg->reps;
+    double* tb = fill + cfg->reps;
+    double* wr = tb + cfg->reps;
+    int rows = 0;
+
+    for (int li = 0; li < cfg->nlengths; li++) {
+        for (int di = 0; di < cfg->ndivs; di++) {
+            BenchCell c;
+            char *a, *b;
+            c.score = 0;
+            c.len = cfg->lengths[li];
+            c.div = cfg->divs[di];
+            bench_pair(cfg->seed, c.len, c.div, &a, &c.lenA, &b, &c.lenB);
+
+            for (int r = -cfg->warmup; r < cfg->reps; r++) {
+                BenchPhases t = {0, 0, 0};
+                if (r == 0) bench_peak_reset();
+                rewind(io);
+                double start = bench_now();
+                c.score = fn(ctx, a, c.lenA, b, c.lenB, io, &t);
+                double elapsed = bench_now() - start;
+                if (r < 0) continue;
+                total[r] = elapsed;
+                fill[r] = t.fill;
+                tb[r] = t.traceback;
+                wr[r] = t.io;
+            }
+            c.peak_rss_kb = bench_peak_rss_kb();
+            c.time_median = bench_median(total, cfg->reps);
+            c.time_min = total[0];
+            c.fill = bench_median(fill, cfg->reps);
+            c.traceback = bench_median(tb, cfg->reps);
+            c.io = bench_median(wr, cfg->reps);
+
+            bench_write_row(out, json, rows == 0, cfg, info, &c);
+            fflush(out);
+            rows++;
+            fprintf(stderr, "%s %s: length %d divergence %g -> score %d, %.4f s, %.3f GCUPS, %ld KiB\n",
+                    info->program, info->engine, c.len, c.div, c.score, c.time_median,
+                    c.time_median > 0 ? (double)c.lenA * c.lenB / c.time_median / 1e9 : 0.0, c.peak_rss_kb);
+            free(a);
+            free(b);
+        }
+    }
+    if (json) fputs("\n]\n", out);
+
+    free(total);
+    fclose(io);
+    fclose(out);
+    printf("Benchmark: %d rows written to %s\n", rows, path);
+    return 0;
+}
+
+#endif
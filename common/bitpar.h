@@ -0,0 +1,148 @@
+/*
+ * bitpar.h - bit-parallel global score passes for small linear schemes
+ *
+ * Header-only, like scoring.h (which it includes):
+ *     #include "../common/bitpar.h"
+ *
+ * For match / mismatch scoring with a linear gap, shifting every cell by
+ * its gaps' worth, H'(i, j) = H(i, j) - (i + j) * gap, turns the global DP into
+ *     H'(i, j) = max(H'(i-1, j-1) + w, H'(i-1, j), H'(i, j-1)),  H'(i, 0) = H'(0, j) = 0
+ * with the diagonal weight w = match - 2 * gap or mismatch - 2 * gap and
+ * free gaps. H' never decreases along a row or a column, and neighbouring
+ * cells differ by at most max(w). When that is 3 or less (the default
+ * +1 / -1 / -1 gives 3 and 1, Levenshtein-style 0 / -1 / -1 gives 2 and 1,
+ * LCS-style 1 / 0 / 0 gives 1 and 0), every difference fits in two bits and
+ * a column of the matrix is a handful of 64-bit words (Myers 1999 and Hyyrö's
+ * LCS form, with the differences widened from one bit to two as in BitPAl).
+ *
+ * Rows are the positions of a, 64 per word; columns are the characters of b.
+ * For column j and row i let a_i be the vertical difference of column j - 1
+ * and b_i the horizontal difference H'(i, j) - H'(i, j-1). Then
+ *     b_i = max(max(w_ij - a_i, 0), b_{i-1} - a_i),   b_0 = 0
+ * which, split by threshold t = 1..3, is a carry chain: b_i >= t starts where
+ * the cell alone gives t, passes down rows with a_i = 0, and steps down a
+ * level on rows with a_i = 1 or 2. Each chain is one 64-bit addition. The new
+ * vertical difference a'_i = a_i + b_i - b_{i-1} is two-bit arithmetic on
+ * bit planes. About 45 word operations cover 64 cells; the chains carry from
+ * word to word down the column, so a column is a serial walk over the words.
+ *
+ * bitpar_row() returns the last DP row of the two-row recurrence,
+ * row[j] = H(lenA, j), for Hirschberg's split passes (reverse reads both
+ * sequences back to front, as nw_score() does). bitpar_score() returns
+ * H(lenA, lenB) alone. Both give exactly the scores of the scalar DP; there
+ * is no traceback. Use them only when bitpar_supported() says so.
+ */
+#ifndef BITPAR_H
+#define BITPAR_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "scoring.h"
+
+/* 1 when the scheme fits: linear gap, match / mismatch only, diagonal weights <= 3. */
+static inline int bitpar_supported(const Scoring* sc) {
+    if (sc->gap_model != GAP_LINEAR || !sc->identity) return 0;
+    int wm = sc->match - 2 * sc->gap, wx = sc->mismatch - 2 * sc->gap;
+    return wm <= 3 && wx <= 3;
+}
+
+/* Rows with vertical difference <= k, from its bit planes v0 (bit 0) and v1 (bit 1). */
+static inline uint64_t bitpar_le(int k, uint64_t v0, uint64_t v1) {
+    if (k < 0) return 0;
+    if (k == 0) return ~v0 & ~v1;
+    if (k == 1) return ~v1;
+    if (k == 2) return ~(v0 & v1);
+    return ~(uint64_t)0;
+}
+
+/* x_i = s_i | (p_i & x_{i-1}) with x_{-1} = cin, as the carries of (s | p) + s. */
+static inline uint64_t bitpar_chain(uint64_t s, uint64_t p, uint64_t cin) {
+    s |= p & cin;
+    uint64_t x = s | p;
+    uint64_t sum = x + s;
+    return ((sum ^ x ^ s) >> 1) | ((uint64_t)(sum < x) << 63);
+}
+
+/*
+ * Shared pass: fills row[0..lenB] when row is not NULL and returns
+ * H(lenA, lenB). a and b are read back to front when reverse is set.
+ */
+static inline int bitpar_pass(const Scoring* sc, const uint8_t* a, int lenA, const uint8_t* b, int lenB,
+                              int reverse, int* row) {
+    const int gap = sc->gap;
+    if (lenA == 0) {
+        if (row)
+            for (int j = 0; j <= lenB; j++) row[j] = j * gap;
+        return lenB * gap;
+    }
+
+    const int wm = sc->match - 2 * gap, wx = sc->mismatch - 2 * gap;
+    int words = (lenA + 63) / 64;
+    uint64_t* peq = (uint64_t*)calloc((size_t)NT_CODES * words, sizeof(uint64_t));
+    uint64_t* v0 = (uint64_t*)calloc(words, sizeof(uint64_t));    /* column 0: H' = 0, no differences */
+    uint64_t* v1 = (uint64_t*)calloc(words, sizeof(uint64_t));
+    for (int i = 0; i < lenA; i++) {
+        uint8_t c = reverse ? a[lenA - 1 - i] : a[i];
+        peq[(size_t)c * words + i / 64] |= (uint64_t)1 << (i % 64);
+    }
+
+    const int last_bit = (lenA - 1) % 64;
+    long shifted = 0;   /* H'(lenA, j) */
+    if (row) row[0] = lenA * gap;
+
+    for (int j = 1; j <= lenB; j++) {
+        const uint64_t* eq = peq + (size_t)(reverse ? b[lenB - j] : b[j - 1]) * words;
+        uint64_t cin1 = 0, cin2 = 0, cin3 = 0;      /* b_{i-1} >= t for the row above the word; b_0 = 0 */
+        uint64_t B1 = 0, B2 = 0, B3 = 0;
+        for (int w = 0; w < words; w++) {
+            uint64_t x0 = v0[w], x1 = v1[w];
+            uint64_t m = eq[w];
+            uint64_t a0 = ~x0 & ~x1, a1 = x0 & ~x1, a2 = ~x0 & x1;
+
+            /* c_i >= t: a_i <= w_ij - t */
+            uint64_t c3 = (m & bitpar_le(wm - 3, x0, x1)) | (~m & bitpar_le(wx - 3, x0, x1));
+            uint64_t c2 = (m & bitpar_le(wm - 2, x0, x1)) | (~m & bitpar_le(wx - 2, x0, x1));
+            uint64_t c1 = (m & bitpar_le(wm - 1, x0, x1)) | (~m & bitpar_le(wx - 1, x0, x1));
+
+            /* b_i >= t, and S_t: b_{i-1} >= t */
+            B3 = bitpar_chain(c3, a0, cin3);
+            uint64_t S3 = (B3 << 1) | cin3;
+            B2 = bitpar_chain(c2 | (a1 & S3), a0, cin2);
+            uint64_t S2 = (B2 << 1) | cin2;
+            B1 = bitpar_chain(c1 | (a1 & S2) | (a2 & S3), a0, cin1);
+            uint64_t S1 = (B1 << 1) | cin1;
+            cin1 = B1 >> 63;
+            cin2 = B2 >> 63;
+            cin3 = B3 >> 63;
+
+            /* a' = a + b - b_{i-1} (mod 4, the true value is 0..3); thermometer -> binary */
+            uint64_t b0 = B1 ^ B2 ^ B3, b1 = B2;
+            uint64_t p0 = S1 ^ S2 ^ S3, p1 = S2;
+            uint64_t s0 = x0 ^ b0, s1 = x1 ^ b1 ^ (x0 & b0);
+            v0[w] = s0 ^ p0;
+            v1[w] = s1 ^ p1 ^ (~s0 & p0);
+        }
+        /* B1..B3 are the last word's: add b_lenA */
+        shifted += ((B1 >> last_bit) & 1) + ((B2 >> last_bit) & 1) + ((B3 >> last_bit) & 1);
+        if (row) row[j] = (int)(shifted + (long)(lenA + j) * gap);
+    }
+
+    free(peq);
+    free(v0);
+    free(v1);
+    return (int)(shifted + (long)(lenA + lenB) * gap);
+}
+
+/* row[j] = score of a against b[0..j) (reversed views when reverse is set), j = 0..lenB. */
+static inline void bitpar_row(const Scoring* sc, const uint8_t* a, int lenA, const uint8_t* b, int lenB,
+                              int reverse, int* row) {
+    bitpar_pass(sc, a, lenA, b, lenB, reverse, row);
+}
+
+/* Global score of a against b. The shorter sequence is put on the bit side. */
+static inline int bitpar_score(const Scoring* sc, const uint8_t* a, int lenA, const uint8_t* b, int lenB) {
+    if (lenA > lenB) return bitpar_pass(sc, b, lenB, a, lenA, 0, NULL);
+    return bitpar_pass(sc, a, lenA, b, lenB, 0, NULL);
+}
+
+#endif
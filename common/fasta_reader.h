@@ -0,0 +1,276 @@
+/*
+ * fasta_reader.h - shared FASTA / multi-FASTA reader
+ *
+ * Header-only so every program keeps its single-file build:
+ *     #include "../common/fasta_reader.h"
+ *
+ * Plain files are memory-mapped and scanned in place: record and line
+ * boundaries are found with memchr (vectorized in libc) directly in the
+ * mapping, and each base is copied exactly once into the record buffer.
+ * Gzip input (detected by its magic bytes) and non-seekable input such as
+ * "-" for stdin are read through a growing stream buffer instead. Gzip
+ * needs zlib: build with -DFASTA_ZLIB ... -lz.
+ *
+ * Records are produced one at a time, so batch jobs can start aligning
+ * before the rest of the file is parsed:
+ *
+ *     FastaReader r;
+ *     if (fasta_open(&r, path) == 0) {
+ *         while (fasta_next(&r) > 0) use(r.name, r.seq, r.seq_len);
+ *         fasta_close(&r);
+ *     }
+ *
+ * Sequence letters are upper-cased (soft-masked bases are kept, not dropped)
+ * unless keep_case is set after fasta_open; anything that is not a letter
+ * (digits, '*', '-', whitespace, '\r') is skipped. The record name is the
+ * header up to the first whitespace.
+ */
+#ifndef FASTA_READER_H
+#define FASTA_READER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef FASTA_ZLIB
+#include <zlib.h>
+#endif
+
+#ifndef FASTA_STREAM_CHUNK
+#define FASTA_STREAM_CHUNK (1 << 20)
+#endif
+
+typedef struct {
+    /* current record, valid until the next fasta_next() */
+    char* name;
+    char* seq;
+    size_t seq_len;
+    int keep_case;          /* 1: keep lowercase bases as they are */
+
+    /* input window: the whole mapping, or the stream buffer */
+    const char* buf;
+    size_t len;
+    size_t pos;
+    int eof;
+
+    /* mapping (mapped_size > 0) or stream source */
+    int fd;
+    size_t mapped_size;
+    char* stream_buf;
+    size_t stream_cap;
+    FILE* file;
+#ifdef FASTA_ZLIB
+    gzFile gz;
+#endif
+
+    /* parser state */
+    char* next_name;        /* header already read for the following record */
+    int pending;
+    size_t name_cap, next_name_cap, seq_cap;
+} FastaReader;
+
+static inline void fasta_set_name(char** dst, size_t* cap, const char* header, size_t len) {
+    size_t n = 0;
+    while (n < len && header[n] != ' ' && header[n] != '\t' && header[n] != '\r') n++;
+    if (*cap < n + 1) {
+        *cap = n + 1 > 64 ? n + 1 : 64;
+        *dst = (char*)realloc(*dst, *cap);
+    }
+    memcpy(*dst, header, n);
+    (*dst)[n] = '\0';
+}
+
+/* Stream mode: keep the unread tail and append the next chunk. */
+static inline void fasta_fill(FastaReader* r) {
+    size_t tail = r->len - r->pos;
+    if (r->pos > 0) memmove(r->stream_buf, r->stream_buf + r->pos, tail);
+    r->pos = 0;
+    r->len = tail;
+    if (r->stream_cap - r->len < FASTA_STREAM_CHUNK) {
+        r->stream_cap = r->stream_cap * 2 + FASTA_STREAM_CHUNK;
+        r->stream_buf = (char*)realloc(r->stream_buf, r->stream_cap);
+    }
+    size_t want = r->stream_cap - r->len;
+    long got;
+#ifdef FASTA_ZLIB
+    if (r->gz) {
+        got = gzread(r->gz, r->stream_buf + r->len, want > (1u << 30) ? (1u << 30) : (unsigned)want);
+    } else
+#endif
+    got = (long)fread(r->stream_buf + r->len, 1, want, r->file);
+    if (got <= 0) r->eof = 1;
+    else r->len += got;
+    r->buf = r->stream_buf;
+}
+
+/* Next line without its '\n' (and trailing '\r'); 0 at end of input. */
+static inline int fasta_getline(FastaReader* r, const char** line, size_t* len) {
+    for (;;) {
+        const char* start = r->buf + r->pos;
+        size_t avail = r->len - r->pos;
+        const char* nl = avail ? (const char*)memchr(start, '\n', avail) : NULL;
+        if (nl || (r->eof && avail > 0)) {
+            size_t n = nl ? (size_t)(nl - start) : avail;
+            r->pos += nl ? n + 1 : n;
+            if (n > 0 && start[n - 1] == '\r') n--;
+            *line = start;
+            *len = n;
+            return 1;
+        }
+        if (r->eof) return 0;
+        fasta_fill(r);
+    }
+}
+
+static inline void fasta_append(FastaReader* r, const char* line, size_t len) {
+    if (r->seq_cap < r->seq_len + len + 1) {
+        r->seq_cap = (r->seq_len + len + 1) * 2;
+        r->seq = (char*)realloc(r->seq, r->seq_cap);
+    }
+    char* out = r->seq + r->seq_len;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)line[i];
+        if (c >= 'A' && c <= 'Z') *out++ = c;
+        else if (c >= 'a' && c <= 'z') *out++ = r->keep_case ? c : c - 'a' + 'A';
+    }
+    r->seq_len = out - r->seq;
+}
+
+/* Opens path ("-" for stdin). Returns 0 on success, -1 (with a message) on error. */
+static inline int fasta_open(FastaReader* r, const char* path) {
+    memset(r, 0, sizeof(*r));
+    r->fd = -1;
+
+    int stdin_input = strcmp(path, "-") == 0;
+    int fd = stdin_input ? dup(STDIN_FILENO) : open(path, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open file: %s\n", path);
+        return -1;
+    }
+
+    struct stat st;
+    int regular = fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+    if (regular && st.st_size == 0) {
+        close(fd);
+        r->eof = 1;
+        return 0;
+    }
+
+    unsigned char magic[2] = {0, 0};
+    if (regular) {
+        void* map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            memcpy(magic, map, st.st_size >= 2 ? 2 : 1);
+            if (magic[0] != 0x1f || magic[1] != 0x8b) {
+                madvise(map, st.st_size, MADV_SEQUENTIAL);
+                r->fd = fd;
+                r->buf = (const char*)map;
+                r->len = r->mapped_size = st.st_size;
+                r->eof = 1;
+                return 0;
+            }
+            munmap(map, st.st_size);
+        }
+    }
+
+    /* Stream input: gzip (by magic bytes) or anything that cannot be mapped. */
+#ifdef FASTA_ZLIB
+    r->gz = gzdopen(fd, "rb");
+    if (!r->gz) {
+        close(fd);
+        printf("Cannot open file: %s\n", path);
+        return -1;
+    }
+#else
+    if (magic[0] == 0x1f && magic[1] == 0x8b) {
+        close(fd);
+        printf("gzip input needs a build with -DFASTA_ZLIB -lz: %s\n", path);
+        return -1;
+    }
+    r->file = fdopen(fd, "rb");
+    if (!r->file) {
+        close(fd);
+        printf("Cannot open file: %s\n", path);
+        return -1;
+    }
+#endif
+    r->buf = r->stream_buf;
+    return 0;
+}
+
+/* Advances to the next record. Returns 1 with name/seq/seq_len set, 0 at the end. */
+static inline int fasta_next(FastaReader* r) {
+    const char* line;
+    size_t len;
+    r->seq_len = 0;
+
+    if (r->pending) {
+        char* tmp = r->name; r->name = r->next_name; r->next_name = tmp;
+        size_t cap = r->name_cap; r->name_cap = r->next_name_cap; r->next_name_cap = cap;
+        r->pending = 0;
+    } else {
+        /* First record: skip blank lines; a file without a header is one unnamed record. */
+        for (;;) {
+            if (!fasta_getline(r, &line, &len)) return 0;
+            if (len == 0) continue;
+            if (line[0] == '>') {
+                fasta_set_name(&r->name, &r->name_cap, line + 1, len - 1);
+            } else {
+                fasta_set_name(&r->name, &r->name_cap, "", 0);
+                fasta_append(r, line, len);
+            }
+            break;
+        }
+    }
+
+    while (fasta_getline(r, &line, &len)) {
+        if (len > 0 && line[0] == '>') {
+            fasta_set_name(&r->next_name, &r->next_name_cap, line + 1, len - 1);
+            r->pending = 1;
+            break;
+        }
+        fasta_append(r, line, len);
+    }
+
+    if (r->seq_cap == 0) {
+        r->seq_cap = 64;
+        r->seq = (char*)malloc(r->seq_cap);
+    }
+    r->seq[r->seq_len] = '\0';
+    return 1;
+}
+
+static inline void fasta_close(FastaReader* r) {
+    if (r->mapped_size) munmap((void*)r->buf, r->mapped_size);
+    if (r->fd >= 0) close(r->fd);
+    if (r->file) fclose(r->file);
+#ifdef FASTA_ZLIB
+    if (r->gz) gzclose(r->gz);
+#endif
+    free(r->stream_buf);
+    free(r->name);
+    free(r->next_name);
+    free(r->seq);
+}
+
+/* First record of a file as a malloc'd string (NULL if the file cannot be
+ * read). Additional records are ignored with a warning. */
+static inline char* fasta_read_first(const char* path) {
+    FastaReader r;
+    if (fasta_open(&r, path) != 0) return NULL;
+    char* seq = NULL;
+    if (fasta_next(&r) > 0) {
+        seq = r.seq;
+        r.seq = NULL;
+        if (r.pending) fprintf(stderr, "%s: more than one record, using only the first (%s)\n", path, r.name);
+    } else {
+        seq = strdup("");
+    }
+    fasta_close(&r);
+    return seq;
+}
+
+#endif
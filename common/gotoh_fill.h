@@ -0,0 +1,289 @@
+/*
+ * gotoh_fill.h - affine and convex gap DP (Gotoh) with a 4-bit traceback
+ *
+ * Header-only, like linear_fill.h (it includes scoring.h, nt_code.h and
+ * aln_output.h):
+ *     #include "../common/gotoh_fill.h"
+ *
+ * States: M, DX (gap in b, consumes a: I), DY (gap in a, consumes b: D).
+ * Convex gaps add DX2 / DY2 for the second affine piece and charge the better
+ * of the two. Each cell (i >= 1, j >= 1) keeps 4 bits, two cells per byte:
+ *     bits 0-1  the state M came from (GOTOH_M, GOTOH_DX, GOTOH_DY)
+ *     bit 2     GOTOH_DX_EXT: DX extends (else it opens from M)
+ *     bit 3     GOTOH_DY_EXT: DY extends
+ * Convex keeps a second plane of the same shape, bits2:
+ *     bit 0     GOTOH_PIECE2: M came from DX2 / DY2 (which one: bits 0-1 above)
+ *     bit 2/3   DX2 / DY2 extend
+ * Ties go M > DX > DY, extend over open, and the first piece over the second.
+ * Row 0 and column 0 are not stored: they are one gap each, in either piece.
+ *
+ * Cell (i, j) sits in column j - shift * i - col0 of row i - 1. The full
+ * matrix has shift 0, col0 1; a band of diagonals j - i in [dlo, dhi] has
+ * shift 1, col0 dlo. nw_affine's full, banded, tiled and checkpointed fills
+ * and libnw all use gotoh_cell() and gotoh_traceback_walk(), so every one of
+ * them breaks ties the same way.
+ */
+#ifndef GOTOH_FILL_H
+#define GOTOH_FILL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include "nt_code.h"
+#include "scoring.h"
+#include "aln_output.h"
+
+#define GOTOH_INF (-1000000000)
+
+/* GOTOH_DX2 / GOTOH_DY2 only appear while walking the trace. */
+typedef enum { GOTOH_M, GOTOH_DX, GOTOH_DY, GOTOH_DX2, GOTOH_DY2 } GotohState;
+
+#define GOTOH_DX_EXT 4
+#define GOTOH_DY_EXT 8
+#define GOTOH_PIECE2 1
+
+/* Gap scores copied into locals at the top of a fill. Affine leaves the second piece unused. */
+typedef struct {
+    int open, extend;
+    int open2, extend2;
+} GotohCosts;
+
+static inline GotohCosts gotoh_costs(const Scoring* sc) {
+    GotohCosts g = {sc->gap_open, sc->gap_extend, sc->gap_open2, sc->gap_extend2};
+    return g;
+}
+
+typedef struct {
+    unsigned char* bits;
+    unsigned char* bits2;   /* convex only, else NULL */
+    size_t stride;
+    int shift;
+    int col0;
+} GotohTrace;
+
+/* Bytes per row of a full trace over lenB columns. */
+static inline size_t gotoh_trace_stride(int lenB) {
+    return ((size_t)lenB + 1) / 2;
+}
+
+/* Full lenA x lenB trace over caller memory: bits (and bits2 when convex), lenA * stride bytes each. */
+static inline GotohTrace gotoh_trace_full(unsigned char* bits, unsigned char* bits2, int lenB) {
+    GotohTrace t = {bits, bits2, gotoh_trace_stride(lenB), 0, 1};
+    return t;
+}
+
+static inline size_t gotoh_trace_index(const GotohTrace* t, int i, int j, int* shift) {
+    int col = j - t->shift * i - t->col0;
+    *shift = 4 * (col & 1);
+    return (size_t)(i - 1) * t->stride + col / 2;
+}
+
+/* Cells are ORed in, so the trace must start zeroed. */
+static inline void gotoh_trace_set(GotohTrace* t, int i, int j, int cell) {
+    int sh;
+    size_t k = gotoh_trace_index(t, i, j, &sh);
+    t->bits[k] |= (unsigned char)(cell << sh);
+}
+
+static inline void gotoh_trace_set2(GotohTrace* t, int i, int j, int cell) {
+    int sh;
+    size_t k = gotoh_trace_index(t, i, j, &sh);
+    t->bits2[k] |= (unsigned char)(cell << sh);
+}
+
+static inline int gotoh_trace_get(const GotohTrace* t, int i, int j) {
+    if (i == 0) return GOTOH_DY | GOTOH_DY_EXT;
+    if (j == 0) return GOTOH_DX | GOTOH_DX_EXT;
+    int sh;
+    size_t k = gotoh_trace_index(t, i, j, &sh);
+    return (t->bits[k] >> sh) & 0xF;
+}
+
+/* On the edges either piece extends to the corner. */
+static inline int gotoh_trace_get2(const GotohTrace* t, int i, int j) {
+    if (i == 0 || j == 0) return GOTOH_DX_EXT | GOTOH_DY_EXT;
+    int sh;
+    size_t k = gotoh_trace_index(t, i, j, &sh);
+    return (t->bits2[k] >> sh) & 0xF;
+}
+
+/*
+ * One cell: DX from the cell above, DY from the cell to the left, M from the
+ * diagonal plus s. Writes the new scores and returns the trace nibble; with
+ * convex (always a constant, so the affine loops carry no second piece) it
+ * also computes DX2 / DY2 and writes their nibble to *cell2.
+ */
+static inline __attribute__((always_inline))
+int gotoh_cell(const int convex, const GotohCosts g,
+               int up_dp, int up_dx, int up_dx2, int left_dp, int left_dy, int left_dy2, int diag_dp, int s,
+               int* out_dp, int* out_dx, int* out_dy, int* out_dx2, int* out_dy2, int* cell2) {
+    int cell = 0;
+
+    int up_ext = up_dx + g.extend;
+    int up_open = up_dp + g.open + g.extend;
+    if (up_ext >= up_open) {
+        *out_dx = up_ext;
+        cell |= GOTOH_DX_EXT;
+    } else {
+        *out_dx = up_open;
+    }
+
+    int left_ext = left_dy + g.extend;
+    int left_open = left_dp + g.open + g.extend;
+    if (left_ext >= left_open) {
+        *out_dy = left_ext;
+        cell |= GOTOH_DY_EXT;
+    } else {
+        *out_dy = left_open;
+    }
+
+    int m = diag_dp + s;
+    int best;
+
+    if (m >= *out_dx && m >= *out_dy) {
+        best = m;
+        cell |= GOTOH_M;
+    } else if (*out_dx >= *out_dy) {
+        best = *out_dx;
+        cell |= GOTOH_DX;
+    } else {
+        best = *out_dy;
+        cell |= GOTOH_DY;
+    }
+
+    if (convex) {
+        int c2 = 0;
+        int up_ext2 = up_dx2 + g.extend2;
+        int up_open2 = up_dp + g.open2 + g.extend2;
+        if (up_ext2 >= up_open2) {
+            *out_dx2 = up_ext2;
+            c2 |= GOTOH_DX_EXT;
+        } else {
+            *out_dx2 = up_open2;
+        }
+
+        int left_ext2 = left_dy2 + g.extend2;
+        int left_open2 = left_dp + g.open2 + g.extend2;
+        if (left_ext2 >= left_open2) {
+            *out_dy2 = left_ext2;
+            c2 |= GOTOH_DY_EXT;
+        } else {
+            *out_dy2 = left_open2;
+        }
+
+        if (*out_dx2 > best || *out_dy2 > best) {
+            cell &= ~3;
+            if (*out_dx2 >= *out_dy2) {
+                best = *out_dx2;
+                cell |= GOTOH_DX;
+            } else {
+                best = *out_dy2;
+                cell |= GOTOH_DY;
+            }
+            c2 |= GOTOH_PIECE2;
+        }
+        *cell2 = c2;
+    }
+
+    *out_dp = best;
+    return cell;
+}
+
+static inline __attribute__((always_inline))
+int gotoh_fill_rows_impl(const Scoring* sc, const uint8_t* a, int lenA, int lenB, const NtProfile* prof, int* rows,
+                         GotohTrace* trace, const int convex) {
+    const GotohCosts g = gotoh_costs(sc);
+    const size_t n = (size_t)lenB + 1;
+    int* prev_dp = rows;
+    int* prev_dx = prev_dp + n;
+    int* prev_dx2 = prev_dx + n;
+    int* curr_dp = prev_dx2 + n;
+    int* curr_dx = curr_dp + n;
+    int* curr_dx2 = curr_dx + n;
+
+    prev_dp[0] = 0;
+    for (int j = 1; j <= lenB; j++) {
+        prev_dp[j] = scoring_gap(sc, j);
+        prev_dx[j] = prev_dx2[j] = GOTOH_INF;
+    }
+
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = prof->row[a[i - 1]] - 1;
+        curr_dp[0] = scoring_gap(sc, i);
+        int left_dy = GOTOH_INF, left_dy2 = GOTOH_INF;
+        for (int j = 1; j <= lenB; j++) {
+            int dy, dy2 = GOTOH_INF, cell2 = 0;
+            int cell = gotoh_cell(convex, g, prev_dp[j], prev_dx[j], prev_dx2[j], curr_dp[j - 1], left_dy, left_dy2,
+                                  prev_dp[j - 1], s[j], &curr_dp[j], &curr_dx[j], &dy, &curr_dx2[j], &dy2, &cell2);
+            gotoh_trace_set(trace, i, j, cell);
+            if (convex) gotoh_trace_set2(trace, i, j, cell2);
+            left_dy = dy;
+            left_dy2 = dy2;
+        }
+        int* tmp = prev_dp; prev_dp = curr_dp; curr_dp = tmp;
+        tmp = prev_dx; prev_dx = curr_dx; curr_dx = tmp;
+        tmp = prev_dx2; prev_dx2 = curr_dx2; curr_dx2 = tmp;
+    }
+    return prev_dp[lenB];
+}
+
+/*
+ * Row DP of the whole matrix; returns DP[lenA][lenB]. prof is the profile of
+ * b against a, rows has 6 * (lenB + 1) ints. DP and DX keep two rows, DY one
+ * value. The trace is convex when trace->bits2 is set, and must start zeroed.
+ */
+static inline int gotoh_fill_rows(const Scoring* sc, const uint8_t* a, int lenA, int lenB, const NtProfile* prof,
+                                  int* rows, GotohTrace* trace) {
+    if (trace->bits2) return gotoh_fill_rows_impl(sc, a, lenA, lenB, prof, rows, trace, 1);
+    return gotoh_fill_rows_impl(sc, a, lenA, lenB, prof, rows, trace, 0);
+}
+
+/*
+ * Walks from (*pi, *pj) in *pstate until row row0 (to (0, 0) when row0 is 0),
+ * prepending =/X/I/D to cigar. Row i of the alignment is row i - row0 of tm.
+ * The state carries over, so a gap that crosses into the next block of a
+ * checkpointed traceback keeps going.
+ */
+static inline void gotoh_traceback_walk(const GotohTrace* tm, int row0, const uint8_t* a, const uint8_t* b,
+                                        int* pi, int* pj, GotohState* pstate, Cigar* cigar) {
+    int i = *pi, j = *pj;
+    GotohState state = *pstate;
+
+    while (i > row0 || (row0 == 0 && j > 0)) {
+        int cell = gotoh_trace_get(tm, i - row0, j);
+        if (state == GOTOH_M) {
+            GotohState prev = (GotohState)(cell & 3);
+            int piece2 = tm->bits2 && (gotoh_trace_get2(tm, i - row0, j) & GOTOH_PIECE2);
+            if (prev == GOTOH_M) {
+                cigar_prepend(cigar, a[i - 1] == b[j - 1] ? CIGAR_EQ : CIGAR_X, 1);
+                i--; j--;
+            } else if (prev == GOTOH_DX) {
+                state = piece2 ? GOTOH_DX2 : GOTOH_DX;
+            } else {
+                state = piece2 ? GOTOH_DY2 : GOTOH_DY;
+            }
+        } else if (state == GOTOH_DX || state == GOTOH_DX2) {
+            int ext = state == GOTOH_DX ? cell & GOTOH_DX_EXT : gotoh_trace_get2(tm, i - row0, j) & GOTOH_DX_EXT;
+            cigar_prepend(cigar, CIGAR_INS, 1);
+            i--;
+            if (!ext) state = GOTOH_M;
+        } else {
+            int ext = state == GOTOH_DY ? cell & GOTOH_DY_EXT : gotoh_trace_get2(tm, i - row0, j) & GOTOH_DY_EXT;
+            cigar_prepend(cigar, CIGAR_DEL, 1);
+            j--;
+            if (!ext) state = GOTOH_M;
+        }
+    }
+    *pi = i;
+    *pj = j;
+    *pstate = state;
+}
+
+/* Walks the whole trace from (lenA, lenB) to (0, 0). */
+static inline void gotoh_traceback(const GotohTrace* tm, const uint8_t* a, const uint8_t* b, int lenA, int lenB,
+                                   Cigar* cigar) {
+    int i = lenA, j = lenB;
+    GotohState state = GOTOH_M;
+    gotoh_traceback_walk(tm, 0, a, b, &i, &j, &state, cigar);
+}
+
+#endif
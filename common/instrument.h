@@ -0,0 +1,249 @@
+/*
+ * instrument.h - optional scoped timers and counters
+ *
+ * Header-only, like bench.h:
+ *     #include "../common/instrument.h"
+ *
+ * Everything is compiled out unless the program is built with
+ * -DNW_INSTRUMENT: the macros below then expand to ((void)0) and leave no
+ * code or data behind.
+ *
+ *     INSTR_INIT();                              // once, at the top of main()
+ *     ...
+ *     {
+ *         INSTR_SCOPE("fill");                   // timed until the end of the block
+ *         ...
+ *         INSTR_COUNT(INSTR_CELLS, (long long)lenA * lenB);
+ *     }
+ *
+ * At exit the results go to $NW_INSTRUMENT:
+ *   unset       a summary table on stderr: calls, total, mean and max time
+ *               per scope name, its share of the run, and the counters
+ *   *.json      Chrome trace-event JSON (chrome://tracing, ui.perfetto.dev):
+ *               one complete ("X") event per scope with its thread, and the
+ *               counters as a final "C" event
+ *   other       the summary table, written to that file
+ *
+ * Cost when enabled: two clock_gettime() calls and a few relaxed atomic adds
+ * per scope, one atomic add per counter update. Scopes go around phases and
+ * per-row or per-tile work, not single cells, and counters are added in
+ * bulk (cells per fill, bytes per transfer). Scopes nest and may run on any
+ * thread; each thread gets a small id the first time it opens one. The trace
+ * keeps the first INSTR_MAX_EVENTS scopes; the summary counts all of them.
+ * Call sites past the first INSTR_MAX_SITES share one "(other)" entry.
+ *
+ * INSTR_SCOPE declares variables, so it must stand in a block (not as the
+ * body of an unbraced if / for), at most once per line.
+ */
+#ifndef INSTRUMENT_H
+#define INSTRUMENT_H
+
+#ifdef NW_INSTRUMENT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+typedef enum {
+    INSTR_CELLS,        /* DP cells computed (score-only passes included) */
+    INSTR_ALLOCS,       /* large buffers: traceback matrices, DP rows, profiles */
+    INSTR_ALLOC_BYTES,
+    INSTR_H2D_BYTES,    /* OpenCL host -> device */
+    INSTR_D2H_BYTES,    /* OpenCL device -> host */
+    INSTR_LAUNCHES,     /* OpenCL kernel launches */
+    INSTR_COUNTERS
+} InstrCounter;
+
+#define INSTR_MAX_SITES 128
+#define INSTR_SITE_OTHER INSTR_MAX_SITES    /* shared by the call sites past the first INSTR_MAX_SITES */
+#define INSTR_MAX_EVENTS (1 << 20)
+
+typedef struct {
+    const char* name;
+    long long calls;
+    uint64_t total_ns;
+    uint64_t max_ns;
+} InstrSite;
+
+typedef struct {
+    const char* name;
+    uint64_t start_ns;      /* since instr_init() */
+    uint64_t dur_ns;
+    int tid;
+} InstrEvent;
+
+typedef struct {
+    int site;
+    uint64_t start_ns;
+} InstrScope;
+
+static struct {
+    uint64_t t0;
+    const char* out;        /* $NW_INSTRUMENT */
+    InstrSite sites[INSTR_MAX_SITES + 1];
+    int nsites;
+    InstrEvent* events;     /* trace only */
+    size_t nevents;
+    long long counters[INSTR_COUNTERS];
+    int nthreads;
+} instr;
+
+static __thread int instr_tid = -1;
+
+static inline uint64_t instr_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+static inline InstrScope instr_scope_begin(int* site, const char* name) {
+    InstrScope s;
+    s.site = __atomic_load_n(site, __ATOMIC_ACQUIRE);
+    if (s.site < 0) {
+        /* First pass through this call site; a racing thread may register it twice, merged by name on output. */
+        s.site = __atomic_fetch_add(&instr.nsites, 1, __ATOMIC_RELAXED);
+        if (s.site < INSTR_MAX_SITES) instr.sites[s.site].name = name;
+        else s.site = INSTR_SITE_OTHER;
+        __atomic_store_n(site, s.site, __ATOMIC_RELEASE);
+    }
+    if (instr_tid < 0) instr_tid = __atomic_fetch_add(&instr.nthreads, 1, __ATOMIC_RELAXED);
+    s.start_ns = instr_now();
+    return s;
+}
+
+static inline void instr_scope_end(InstrScope* s) {
+    uint64_t end = instr_now();
+    uint64_t dur = end - s->start_ns;
+    InstrSite* site = &instr.sites[s->site];
+    __atomic_fetch_add(&site->calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&site->total_ns, dur, __ATOMIC_RELAXED);
+    uint64_t max = __atomic_load_n(&site->max_ns, __ATOMIC_RELAXED);
+    while (dur > max && !__atomic_compare_exchange_n(&site->max_ns, &max, dur, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+    if (instr.events) {
+        size_t k = __atomic_fetch_add(&instr.nevents, 1, __ATOMIC_RELAXED);
+        if (k < INSTR_MAX_EVENTS) {
+            InstrEvent* e = &instr.events[k];
+            e->name = site->name;
+            e->start_ns = s->start_ns - instr.t0;
+            e->dur_ns = dur;
+            e->tid = instr_tid;
+        }
+    }
+}
+
+static inline void instr_count(InstrCounter c, long long n) {
+    __atomic_fetch_add(&instr.counters[c], n, __ATOMIC_RELAXED);
+}
+
+static const char* const instr_counter_names[INSTR_COUNTERS] = {
+    "cells", "allocations", "allocated bytes", "bytes to device", "bytes from device", "kernel launches",
+};
+
+static inline int instr_cmp_total(const void* x, const void* y) {
+    uint64_t a = ((const InstrSite*)x)->total_ns, b = ((const InstrSite*)y)->total_ns;
+    return (a < b) - (a > b);
+}
+
+static inline void instr_write_summary(FILE* out) {
+    double wall = (instr_now() - instr.t0) * 1e-9;
+    int nsites = instr.nsites < INSTR_MAX_SITES ? instr.nsites : INSTR_MAX_SITES;
+
+    /* merge call sites with the same name; the overflow slot comes last, if it was used */
+    InstrSite merged[INSTR_MAX_SITES + 1];
+    int n = 0;
+    for (int k = 0; k <= nsites; k++) {
+        const InstrSite* s = &instr.sites[k == nsites ? INSTR_SITE_OTHER : k];
+        if (k == nsites && s->calls == 0) break;
+        int m = 0;
+        while (m < n && strcmp(merged[m].name, s->name) != 0) m++;
+        if (m == n) {
+            merged[n++] = *s;
+            continue;
+        }
+        merged[m].calls += s->calls;
+        merged[m].total_ns += s->total_ns;
+        if (s->max_ns > merged[m].max_ns) merged[m].max_ns = s->max_ns;
+    }
+    qsort(merged, n, sizeof(InstrSite), instr_cmp_total);
+
+    fprintf(out, "== instrumentation: %.4f s wall, %d thread(s) ==\n", wall, instr.nthreads);
+    fprintf(out, "%-24s %10s %12s %12s %12s %8s\n", "scope", "calls", "total ms", "mean us", "max ms", "% wall");
+    for (int k = 0; k < n; k++) {
+        const InstrSite* s = &merged[k];
+        fprintf(out, "%-24s %10lld %12.3f %12.3f %12.3f %7.1f%%\n", s->name, s->calls, s->total_ns * 1e-6,
+                s->calls ? s->total_ns * 1e-3 / s->calls : 0.0, s->max_ns * 1e-6,
+                wall > 0 ? s->total_ns * 1e-7 / wall : 0.0);
+    }
+    for (int c = 0; c < INSTR_COUNTERS; c++)
+        if (instr.counters[c]) fprintf(out, "%-24s %lld\n", instr_counter_names[c], instr.counters[c]);
+}
+
+static inline void instr_write_trace(FILE* out) {
+    size_t n = instr.nevents < INSTR_MAX_EVENTS ? instr.nevents : INSTR_MAX_EVENTS;
+    fprintf(out, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+    for (size_t k = 0; k < n; k++) {
+        const InstrEvent* e = &instr.events[k];
+        fprintf(out, "{\"name\": \"%s\", \"cat\": \"nw\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                     "\"ts\": %.3f, \"dur\": %.3f},\n", e->name, e->tid, e->start_ns * 1e-3, e->dur_ns * 1e-3);
+    }
+    fprintf(out, "{\"name\": \"counters\", \"ph\": \"C\", \"pid\": 1, \"tid\": 0, \"ts\": %.3f, \"args\": {",
+            (instr_now() - instr.t0) * 1e-3);
+    for (int c = 0; c < INSTR_COUNTERS; c++)
+        fprintf(out, "%s\"%s\": %lld", c ? ", " : "", instr_counter_names[c], instr.counters[c]);
+    fprintf(out, "}}\n]}\n");
+    if (instr.nevents > n) fprintf(stderr, "instrument: trace kept the first %zu of %zu scopes\n", n, instr.nevents);
+}
+
+static void instr_report(void) {
+    const char* out = instr.out;
+    if (instr.nsites == 0) return;      /* nothing ran (usage error, --help) */
+    if (!out || !*out) {
+        instr_write_summary(stderr);
+        return;
+    }
+    FILE* f = fopen(out, "w");
+    if (!f) {
+        fprintf(stderr, "instrument: cannot open %s\n", out);
+        instr_write_summary(stderr);
+        return;
+    }
+    if (instr.events) instr_write_trace(f);
+    else instr_write_summary(f);
+    fclose(f);
+    fprintf(stderr, "instrument: %s written\n", out);
+}
+
+static inline void instr_init(void) {
+    instr.t0 = instr_now();
+    instr.out = getenv("NW_INSTRUMENT");
+    instr.sites[INSTR_SITE_OTHER].name = "(other)";
+    size_t len = instr.out ? strlen(instr.out) : 0;
+    if (len >= 5 && strcmp(instr.out + len - 5, ".json") == 0)
+        instr.events = (InstrEvent*)malloc(sizeof(InstrEvent) * INSTR_MAX_EVENTS);
+    atexit(instr_report);
+}
+
+#define INSTR_CAT2(a, b) a##b
+#define INSTR_CAT(a, b) INSTR_CAT2(a, b)
+
+#define INSTR_INIT() instr_init()
+#define INSTR_SCOPE(name)                                                                    \
+    static int INSTR_CAT(instr_site_, __LINE__) = -1;                                        \
+    InstrScope INSTR_CAT(instr_scope_, __LINE__) __attribute__((cleanup(instr_scope_end))) = \
+        instr_scope_begin(&INSTR_CAT(instr_site_, __LINE__), name)
+#define INSTR_COUNT(counter, n) instr_count(counter, (long long)(n))
+#define INSTR_ALLOC(bytes) (instr_count(INSTR_ALLOCS, 1), instr_count(INSTR_ALLOC_BYTES, (long long)(bytes)))
+
+#else
+
+#define INSTR_INIT() ((void)0)
+#define INSTR_SCOPE(name) ((void)0)
+#define INSTR_COUNT(counter, n) ((void)0)
+#define INSTR_ALLOC(bytes) ((void)0)
+
+#endif
+
+#endif
@@ -0,0 +1,282 @@
+/*
+ * linear_fill.h - CPU fill of the linear-gap DP with a 2-bit traceback
+ *
+ * Header-only, like scoring.h (which it includes, with nt_code.h and
+ * aln_output.h):
+ *     #include "../common/linear_fill.h"
+ *
+ * Cell (i, j), 1 <= i <= lenA, 1 <= j <= lenB, keeps where its score came
+ * from in bits 2 * ((j - 1) % 4) of trace[(i - 1) * stride + (j - 1) / 4]:
+ * 1 diagonal, 2 up (consumes a), 3 left (consumes b), ties D > U > L. Row 0
+ * and column 0 are not stored. This is the full TraceMatrix of nw_linear,
+ * the libnw workspace and the traceback nw_ocl_generic reads back from the
+ * device, so linear_traceback() walks all of them.
+ *
+ * Two fills, bit for bit the same trace and score:
+ *   - linear_fill_rows(): row DP on a query profile of b (nt_code.h), any
+ *     substitution matrix;
+ *   - linear_fill_diag(): SSE4.1 / AVX2 over anti-diagonals. Cells on one
+ *     diagonal are independent and, with b reversed, diag, up and left are
+ *     contiguous loads. Each lane has its own code of a, so instead of
+ *     gathering from the profile it compares codes bytewise: match /
+ *     mismatch only (sc->identity). 16-bit lanes when every score fits,
+ *     32-bit otherwise.
+ * linear_fill_engine() picks the widest one the CPU and the scheme allow.
+ */
+#ifndef LINEAR_FILL_H
+#define LINEAR_FILL_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "nt_code.h"
+#include "scoring.h"
+#include "aln_output.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LINEAR_FILL_SIMD 1
+#endif
+
+typedef enum { LINEAR_FILL_ROWS, LINEAR_FILL_SSE41, LINEAR_FILL_AVX2 } LinearFillEngine;
+
+/* Widest fill on this CPU (CPUID), ignoring the scheme. */
+static inline LinearFillEngine linear_fill_detect(void) {
+#ifdef LINEAR_FILL_SIMD
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) return LINEAR_FILL_AVX2;
+    if (__builtin_cpu_supports("sse4.1")) return LINEAR_FILL_SSE41;
+#endif
+    return LINEAR_FILL_ROWS;
+}
+
+/* Widest fill for sc on this CPU: the vector fills need match / mismatch scoring. */
+static inline LinearFillEngine linear_fill_engine(const Scoring* sc) {
+    if (sc->gap_model != GAP_LINEAR || !sc->identity) return LINEAR_FILL_ROWS;
+    return linear_fill_detect();
+}
+
+/*
+ * Row DP. prof is the profile of b against a, rows has lenB + 1 ints. Every
+ * trace byte of the lenA rows is written (the trace need not be zeroed).
+ */
+static inline int linear_fill_rows(const Scoring* sc, const uint8_t* a, int lenA, int lenB, const NtProfile* prof,
+                                   int* row, unsigned char* trace, size_t stride) {
+    const int gap = sc->gap;
+    for (int j = 0; j <= lenB; j++) row[j] = j * gap;
+    for (int i = 1; i <= lenA; i++) {
+        const int8_t* s = prof->row[a[i - 1]] - 1;
+        unsigned char* tr = trace + (size_t)(i - 1) * stride;
+        unsigned char packed = 0;
+        int diag = row[0];
+        row[0] = i * gap;
+        for (int j = 1; j <= lenB; j++) {
+            int up = row[j];
+            int best = diag + s[j], code = 1;
+            if (up + gap > best) { best = up + gap; code = 2; }
+            if (row[j - 1] + gap > best) { best = row[j - 1] + gap; code = 3; }
+            packed |= (unsigned char)(code << (2 * ((j - 1) & 3)));
+            if (((j - 1) & 3) == 3 || j == lenB) {
+                tr[(j - 1) / 4] = packed;
+                packed = 0;
+            }
+            row[j] = best;
+            diag = up;
+        }
+    }
+    return row[lenB];
+}
+
+/* Walks the trace from (lenA, lenB) to (0, 0), prepending =/X/I/D to cigar. */
+static inline void linear_traceback(const unsigned char* trace, size_t stride, const uint8_t* a, const uint8_t* b,
+                                    int lenA, int lenB, Cigar* cigar) {
+    int i = lenA, j = lenB;
+    while (i > 0 || j > 0) {
+        int code = (i == 0) ? 3 : (j == 0) ? 2
+                 : (trace[(size_t)(i - 1) * stride + (j - 1) / 4] >> (2 * ((j - 1) & 3))) & 3;
+        if (code == 1) {
+            cigar_prepend(cigar, a[i - 1] == b[j - 1] ? CIGAR_EQ : CIGAR_X, 1);
+            i--; j--;
+        } else if (code == 2) {
+            cigar_prepend(cigar, CIGAR_INS, 1);
+            i--;
+        } else {
+            cigar_prepend(cigar, CIGAR_DEL, 1);
+            j--;
+        }
+    }
+}
+
+#ifdef LINEAR_FILL_SIMD
+/* Vectors run past the last cell of a diagonal; buffers and sequence copies keep this much slack. */
+#define LINEAR_FILL_PAD 32
+
+typedef void (*LinearDiag16)(const Scoring* sc, int16_t* cur, const int16_t* prev, const int16_t* prev2,
+                             const uint8_t* a, const uint8_t* brev, int16_t* codes, int lo, int hi);
+typedef void (*LinearDiag32)(const Scoring* sc, int32_t* cur, const int32_t* prev, const int32_t* prev2,
+                             const uint8_t* a, const uint8_t* brev, int32_t* codes, int lo, int hi);
+
+/* 16-bit lanes use saturating adds; linear_fits_int16() keeps them from saturating. */
+__attribute__((target("sse4.1")))
+static inline void linear_diag16_sse41(const Scoring* sc, int16_t* cur, const int16_t* prev, const int16_t* prev2,
+                                       const uint8_t* a, const uint8_t* brev, int16_t* codes, int lo, int hi) {
+    const __m128i vmatch = _mm_set1_epi16(sc->match), vmismatch = _mm_set1_epi16(sc->mismatch);
+    const __m128i vgap = _mm_set1_epi16(sc->gap);
+    const __m128i cD = _mm_set1_epi16(1), cU = _mm_set1_epi16(2), cL = _mm_set1_epi16(3);
+    for (int i = lo; i <= hi; i += 8) {
+        __m128i ca = _mm_loadl_epi64((const __m128i*)(a + i - 1));
+        __m128i cb = _mm_loadl_epi64((const __m128i*)(brev + i));
+        __m128i eq = _mm_cvtepi8_epi16(_mm_cmpeq_epi8(ca, cb));
+        __m128i s = _mm_blendv_epi8(vmismatch, vmatch, eq);
+
+        __m128i diag = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(prev2 + i - 1)), s);
+        __m128i up = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(prev + i - 1)), vgap);
+        __m128i left = _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(prev + i)), vgap);
+        __m128i best = _mm_max_epi16(diag, _mm_max_epi16(up, left));
+        _mm_storeu_si128((__m128i*)(cur + i), best);
+
+        __m128i code = _mm_blendv_epi8(cL, cU, _mm_cmpeq_epi16(best, up));
+        code = _mm_blendv_epi8(code, cD, _mm_cmpeq_epi16(best, diag));
+        _mm_storeu_si128((__m128i*)(codes + i), code);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void linear_diag16_avx2(const Scoring* sc, int16_t* cur, const int16_t* prev, const int16_t* prev2,
+                                      const uint8_t* a, const uint8_t* brev, int16_t* codes, int lo, int hi) {
+    const __m256i vmatch = _mm256_set1_epi16(sc->match), vmismatch = _mm256_set1_epi16(sc->mismatch);
+    const __m256i vgap = _mm256_set1_epi16(sc->gap);
+    const __m256i cD = _mm256_set1_epi16(1), cU = _mm256_set1_epi16(2), cL = _mm256_set1_epi16(3);
+    for (int i = lo; i <= hi; i += 16) {
+        __m128i ca = _mm_loadu_si128((const __m128i*)(a + i - 1));
+        __m128i cb = _mm_loadu_si128((const __m128i*)(brev + i));
+        __m256i eq = _mm256_cvtepi8_epi16(_mm_cmpeq_epi8(ca, cb));
+        __m256i s = _mm256_blendv_epi8(vmismatch, vmatch, eq);
+
+        __m256i diag = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i*)(prev2 + i - 1)), s);
+        __m256i up = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i*)(prev + i - 1)), vgap);
+        __m256i left = _mm256_adds_epi16(_mm256_loadu_si256((const __m256i*)(prev + i)), vgap);
+        __m256i best = _mm256_max_epi16(diag, _mm256_max_epi16(up, left));
+        _mm256_storeu_si256((__m256i*)(cur + i), best);
+
+        __m256i code = _mm256_blendv_epi8(cL, cU, _mm256_cmpeq_epi16(best, up));
+        code = _mm256_blendv_epi8(code, cD, _mm256_cmpeq_epi16(best, diag));
+        _mm256_storeu_si256((__m256i*)(codes + i), code);
+    }
+}
+
+__attribute__((target("sse4.1")))
+static inline void linear_diag32_sse41(const Scoring* sc, int32_t* cur, const int32_t* prev, const int32_t* prev2,
+                                       const uint8_t* a, const uint8_t* brev, int32_t* codes, int lo, int hi) {
+    const __m128i vmatch = _mm_set1_epi32(sc->match), vmismatch = _mm_set1_epi32(sc->mismatch);
+    const __m128i vgap = _mm_set1_epi32(sc->gap);
+    const __m128i cD = _mm_set1_epi32(1), cU = _mm_set1_epi32(2), cL = _mm_set1_epi32(3);
+    for (int i = lo; i <= hi; i += 4) {
+        int32_t wa, wb;
+        memcpy(&wa, a + i - 1, 4);
+        memcpy(&wb, brev + i, 4);
+        __m128i eq = _mm_cvtepi8_epi32(_mm_cmpeq_epi8(_mm_cvtsi32_si128(wa), _mm_cvtsi32_si128(wb)));
+        __m128i s = _mm_blendv_epi8(vmismatch, vmatch, eq);
+
+        __m128i diag = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(prev2 + i - 1)), s);
+        __m128i up = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(prev + i - 1)), vgap);
+        __m128i left = _mm_add_epi32(_mm_loadu_si128((const __m128i*)(prev + i)), vgap);
+        __m128i best = _mm_max_epi32(diag, _mm_max_epi32(up, left));
+        _mm_storeu_si128((__m128i*)(cur + i), best);
+
+        __m128i code = _mm_blendv_epi8(cL, cU, _mm_cmpeq_epi32(best, up));
+        code = _mm_blendv_epi8(code, cD, _mm_cmpeq_epi32(best, diag));
+        _mm_storeu_si128((__m128i*)(codes + i), code);
+    }
+}
+
+__attribute__((target("avx2")))
+static inline void linear_diag32_avx2(const Scoring* sc, int32_t* cur, const int32_t* prev, const int32_t* prev2,
+                                      const uint8_t* a, const uint8_t* brev, int32_t* codes, int lo, int hi) {
+    const __m256i vmatch = _mm256_set1_epi32(sc->match), vmismatch = _mm256_set1_epi32(sc->mismatch);
+    const __m256i vgap = _mm256_set1_epi32(sc->gap);
+    const __m256i cD = _mm256_set1_epi32(1), cU = _mm256_set1_epi32(2), cL = _mm256_set1_epi32(3);
+    for (int i = lo; i <= hi; i += 8) {
+        __m128i ca = _mm_loadl_epi64((const __m128i*)(a + i - 1));
+        __m128i cb = _mm_loadl_epi64((const __m128i*)(brev + i));
+        __m256i eq = _mm256_cvtepi8_epi32(_mm_cmpeq_epi8(ca, cb));
+        __m256i s = _mm256_blendv_epi8(vmismatch, vmatch, eq);
+
+        __m256i diag = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(prev2 + i - 1)), s);
+        __m256i up = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(prev + i - 1)), vgap);
+        __m256i left = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(prev + i)), vgap);
+        __m256i best = _mm256_max_epi32(diag, _mm256_max_epi32(up, left));
+        _mm256_storeu_si256((__m256i*)(cur + i), best);
+
+        __m256i code = _mm256_blendv_epi8(cL, cU, _mm256_cmpeq_epi32(best, up));
+        code = _mm256_blendv_epi8(code, cD, _mm256_cmpeq_epi32(best, diag));
+        _mm256_storeu_si256((__m256i*)(codes + i), code);
+    }
+}
+
+/* Every cell satisfies |score| <= (lenA + lenB) * max |penalty|. */
+static inline int linear_fits_int16(const Scoring* sc, int lenA, int lenB) {
+    int step = abs(sc->match);
+    if (abs(sc->mismatch) > step) step = abs(sc->mismatch);
+    if (abs(sc->gap) > step) step = abs(sc->gap);
+    return (long)(lenA + lenB + 1) * step < INT16_MAX;
+}
+
+/*
+ * Three diagonal buffers (k - 2, k - 1, k) in turn. The kernel overwrites the
+ * border cells (i == 0, j == 0) past hi, so they are set again after it.
+ * One definition per lane width.
+ */
+#define LINEAR_FILL_DIAGONALS(NAME, T, KERNEL_T)                                                \
+static inline int NAME(const Scoring* sc, const uint8_t* a, const uint8_t* brev, int lenA, int lenB, \
+                       unsigned char* trace, size_t stride, KERNEL_T kernel) {                  \
+    const int gap = sc->gap;                                                                    \
+    T* buf[3];                                                                                  \
+    for (int t = 0; t < 3; t++) buf[t] = (T*)calloc(lenA + 1 + LINEAR_FILL_PAD, sizeof(T));     \
+    T* codes = (T*)calloc(lenA + 1 + LINEAR_FILL_PAD, sizeof(T));                               \
+    for (int k = 1; k <= lenA + lenB; k++) {                                                    \
+        T *cur = buf[k % 3], *prev = buf[(k + 2) % 3], *prev2 = buf[(k + 1) % 3];               \
+        int lo = k - lenB > 1 ? k - lenB : 1;                                                   \
+        int hi = k - 1 < lenA ? k - 1 : lenA;                                                   \
+        if (lo <= hi) {                                                                         \
+            kernel(sc, cur, prev, prev2, a, brev + lenB - k, codes, lo, hi);                    \
+            for (int i = lo; i <= hi; i++) {                                                    \
+                int col = k - i - 1;                                                            \
+                trace[(size_t)(i - 1) * stride + col / 4] |= (unsigned char)(codes[i] << (2 * (col & 3))); \
+            }                                                                                   \
+        }                                                                                       \
+        if (k <= lenB) cur[0] = (T)(k * gap);                                                   \
+        if (k <= lenA) cur[k] = (T)(k * gap);                                                   \
+    }                                                                                           \
+    int final_score = buf[(lenA + lenB) % 3][lenA];                                             \
+    for (int t = 0; t < 3; t++) free(buf[t]);                                                   \
+    free(codes);                                                                                \
+    return final_score;                                                                         \
+}
+
+LINEAR_FILL_DIAGONALS(linear_fill_diag16, int16_t, LinearDiag16)
+LINEAR_FILL_DIAGONALS(linear_fill_diag32, int32_t, LinearDiag32)
+
+/*
+ * Anti-diagonal fill with engine LINEAR_FILL_SSE41 or LINEAR_FILL_AVX2.
+ * Codes are ORed in, so the lenA * stride trace bytes must start zeroed.
+ */
+static inline int linear_fill_diag(const Scoring* sc, LinearFillEngine engine, const uint8_t* a, const uint8_t* b,
+                                   int lenA, int lenB, unsigned char* trace, size_t stride) {
+    uint8_t* apad = (uint8_t*)calloc(lenA + LINEAR_FILL_PAD, 1);
+    uint8_t* brev = (uint8_t*)calloc(lenB + LINEAR_FILL_PAD, 1);
+    memcpy(apad, a, lenA);
+    for (int j = 0; j < lenB; j++) brev[j] = b[lenB - 1 - j];
+
+    int avx2 = engine == LINEAR_FILL_AVX2;
+    int final_score = linear_fits_int16(sc, lenA, lenB)
+        ? linear_fill_diag16(sc, apad, brev, lenA, lenB, trace, stride, avx2 ? linear_diag16_avx2 : linear_diag16_sse41)
+        : linear_fill_diag32(sc, apad, brev, lenA, lenB, trace, stride, avx2 ? linear_diag32_avx2 : linear_diag32_sse41);
+
+    free(apad);
+    free(brev);
+    return final_score;
+}
+#endif
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * nt_code.h - compact nucleotide codes and query profiles
+ *
+ * Header-only, like fasta_reader.h:
+ *     #include "../common/nt_code.h"
+ *
+ * Sequences are converted once at load time and the DP loops never see the
+ * ASCII letters again. A, C, G and T are codes 0..3; every other letter (N
+ * and the IUPAC ambiguity codes) is an escape code NT_ESC + (letter - 'A').
+ * Two bases have equal codes exactly when they had equal (upper-case)
+ * letters, so every score is the same as on the original text.
+ *
+ * Two layouts:
+ *   - byte codes, one uint8_t per base: what the DP loops, the SIMD
+ *     kernels and the OpenCL kernels read;
+ *   - NtPacked, 2 bits per base plus a sorted list of the escaped
+ *     positions: a quarter of the size for plain ACGT input, for sequences
+ *     that are kept around for a whole batch.
+ *
+ * Scores come from an NT_CODES x NT_CODES table (nt_score_table). For a
+ * sequence b scanned by the inner loop, nt_profile_build() precomputes the
+ * query profile row[c][j] = table[c][b[j]] for every code c that occurs in
+ * the other sequence, so the inner loop is one load, row[a[i]][j], instead
+ * of a compare and a branch.
+ */
+#ifndef NT_CODE_H
+#define NT_CODE_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NT_ESC 4
+#define NT_CODES (NT_ESC + 26)
+
+static inline uint8_t nt_encode_base(unsigned char c) {
+    if (c >= 'a' && c <= 'z') c = c - 'a' + 'A';
+    switch (c) {
+        case 'A': return 0;
+        case 'C': return 1;
+        case 'G': return 2;
+        case 'T': return 3;
+    }
+    if (c < 'A' || c > 'Z') c = 'N';
+    return (uint8_t)(NT_ESC + (c - 'A'));
+}
+
+static inline char nt_decode_base(uint8_t code) {
+    return code < NT_ESC ? "ACGT"[code] : (char)('A' + code - NT_ESC);
+}
+
+static inline void nt_encode(const char* seq, size_t len, uint8_t* out) {
+    for (size_t i = 0; i < len; i++) out[i] = nt_encode_base((unsigned char)seq[i]);
+}
+
+/* Codes of seq[0..len) in a new buffer (never zero-sized). */
+static inline uint8_t* nt_encode_dup(const char* seq, size_t len) {
+    uint8_t* out = (uint8_t*)malloc(len + 1);
+    nt_encode(seq, len, out);
+    out[len] = 0;
+    return out;
+}
+
+/* Letters of code[0..len) as a new NUL-terminated string. */
+static inline char* nt_decode_dup(const uint8_t* code, size_t len) {
+    char* out = (char*)malloc(len + 1);
+    for (size_t i = 0; i < len; i++) out[i] = nt_decode_base(code[i]);
+    out[len] = '\0';
+    return out;
+}
+
+/* table[x * NT_CODES + y] = score of code x against code y. */
+static inline void nt_score_table(int8_t* table, int match, int mismatch) {
+    for (int x = 0; x < NT_CODES; x++)
+        for (int y = 0; y < NT_CODES; y++)
+            table[x * NT_CODES + y] = (int8_t)(x == y ? match : mismatch);
+}
+
+/* ---------------------------------------------------------------------
+ * 2-bit packed storage
+ * ------------------------------------------------------------------- */
+
+typedef struct {
+    uint8_t* bits;          /* base k in bits 2*(k%4) of bits[k/4]; 0 where escaped */
+    size_t len;
+    uint32_t* esc_pos;      /* ascending positions of the non-ACGT bases */
+    uint8_t* esc_code;
+    size_t nesc;
+} NtPacked;
+
+static inline void nt_pack(NtPacked* p, const char* seq, size_t len) {
+    p->len = len;
+    p->bits = (uint8_t*)calloc(len / 4 + 1, 1);
+    p->nesc = 0;
+    for (size_t i = 0; i < len; i++)
+        if (nt_encode_base((unsigned char)seq[i]) >= NT_ESC) p->nesc++;
+    p->esc_pos = (uint32_t*)malloc(p->nesc * sizeof(uint32_t) + 1);
+    p->esc_code = (uint8_t*)malloc(p->nesc + 1);
+
+    size_t e = 0;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = nt_encode_base((unsigned char)seq[i]);
+        if (c >= NT_ESC) {
+            p->esc_pos[e] = (uint32_t)i;
+            p->esc_code[e++] = c;
+        } else {
+            p->bits[i / 4] |= (uint8_t)(c << (2 * (i % 4)));
+        }
+    }
+}
+
+/* Byte codes of the whole sequence into out[0..len). */
+static inline void nt_unpack(const NtPacked* p, uint8_t* out) {
+    for (size_t i = 0; i < p->len; i++) out[i] = (p->bits[i / 4] >> (2 * (i % 4))) & 3;
+    for (size_t e = 0; e < p->nesc; e++) out[p->esc_pos[e]] = p->esc_code[e];
+}
+
+static inline void nt_packed_free(NtPacked* p) {
+    free(p->bits);
+    free(p->esc_pos);
+    free(p->esc_code);
+}
+
+/* ---------------------------------------------------------------------
+ * Query profile
+ * ------------------------------------------------------------------- */
+
+typedef struct {
+    int8_t* data;
+    const int8_t* row[NT_CODES];    /* NULL for codes that do not occur */
+    size_t len;
+} NtProfile;
+
+/* Bytes a profile of len positions needs for the codes present in other[0..other_len). */
+static inline size_t nt_profile_bytes(size_t len, const uint8_t* other, size_t other_len) {
+    int used[NT_CODES] = {0};
+    int rows = 0;
+    for (size_t i = 0; i < other_len; i++) used[other[i]] = 1;
+    for (int c = 0; c < NT_CODES; c++) rows += used[c];
+    return (size_t)rows * len + 1;
+}
+
+/*
+ * Profile of seq[0..len) for the codes present in other[0..other_len), in
+ * data (nt_profile_bytes() bytes, owned by the caller; nt_profile_free() is
+ * not needed).
+ */
+static inline void nt_profile_build_into(NtProfile* p, int8_t* data, const uint8_t* seq, size_t len,
+                                         const uint8_t* other, size_t other_len, const int8_t* table) {
+    int used[NT_CODES] = {0};
+    for (size_t i = 0; i < other_len; i++) used[other[i]] = 1;
+
+    p->len = len;
+    p->data = data;
+    int8_t* next = p->data;
+    for (int c = 0; c < NT_CODES; c++) {
+        p->row[c] = NULL;
+        if (!used[c]) continue;
+        const int8_t* scores = table + c * NT_CODES;
+        for (size_t j = 0; j < len; j++) next[j] = scores[seq[j]];
+        p->row[c] = next;
+        next += len;
+    }
+}
+
+/* Profile of seq[0..len) for the codes present in other[0..other_len). */
+static inline void nt_profile_build(NtProfile* p, const uint8_t* seq, size_t len,
+                                    const uint8_t* other, size_t other_len, const int8_t* table) {
+    int8_t* data = (int8_t*)malloc(nt_profile_bytes(len, other, other_len));
+    nt_profile_build_into(p, data, seq, len, other, other_len, table);
+}
+
+static inline void nt_profile_free(NtProfile* p) {
+    free(p->data);
+}
+
+#endif
@@ -0,0 +1,369 @@
+/*
+ * scoring.h - runtime scoring schemes
+ *
+ * Header-only, like nt_code.h (which it includes):
+ *     #include "../common/scoring.h"
+ *
+ * Substitution scores live in the NT_CODES x NT_CODES table of nt_code.h and
+ * come either from --match / --mismatch or from a substitution matrix
+ * (--matrix): the built-in NUC.4.4 (alias EDNAFULL) and BLOSUM62, or any file
+ * in the NCBI / EMBOSS text layout (a header row of letters, then one row per
+ * letter). Every letter has its own code, so protein sequences use the same
+ * table; letters a matrix does not list score its lowest entry.
+ *
+ * A gap of length k scores
+ *     linear   k * gap
+ *     affine   gap_open + k * gap_extend
+ *     convex   max(gap_open + k * gap_extend, gap_open2 + k * gap_extend2)
+ * The convex model is the two-piece affine approximation of a concave gap
+ * cost: with gap_open2 <= gap_open and gap_extend2 >= gap_extend the second
+ * piece takes over for long gaps.
+ *
+ * The scheme is parsed once in main():
+ *
+ *     Scoring sc;
+ *     scoring_init(&sc);
+ *     for (...) {
+ *         int r = scoring_arg(&sc, argc, argv, &i);
+ *         if (r < 0) return 1;
+ *         if (r > 0) continue;
+ *         ... the program's own options ...
+ *     }
+ *     if (scoring_finish(&sc, GAP_LINEAR, SCORING_MODEL(GAP_LINEAR)) != 0) return 1;
+ *
+ * A program has one DP kernel per gap model it supports and picks it once,
+ * so the inner loops read the scores from locals (or, for OpenCL, from -D
+ * build options) and never branch on the model.
+ */
+#ifndef SCORING_H
+#define SCORING_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include "nt_code.h"
+
+typedef enum { GAP_LINEAR, GAP_AFFINE, GAP_CONVEX } GapModel;
+
+#define SCORING_MODEL(m) (1u << (m))
+
+/* Scoring.set: gap options seen on the command line */
+#define SCORING_SET_GAP 1
+#define SCORING_SET_AFFINE 2
+#define SCORING_SET_OPEN2 4
+#define SCORING_SET_EXTEND2 8
+
+#define SCORING_OPTIONS "[--match N] [--mismatch N] [--matrix NAME|FILE] " \
+    "[--gap N | --gap-open N --gap-extend N [--gap-open2 N --gap-extend2 N]]"
+
+typedef struct {
+    int8_t table[NT_CODES * NT_CODES];
+    int match;
+    int mismatch;
+    const char* matrix;     /* --matrix argument, NULL for match / mismatch */
+    int identity;           /* table is match on equal codes and mismatch elsewhere */
+    int max_score;          /* largest table entry */
+    GapModel gap_model;
+    int gap;
+    int gap_open;
+    int gap_extend;
+    int gap_open2;
+    int gap_extend2;
+    int set;
+} Scoring;
+
+static const char scoring_nuc44[] =
+    "    A  T  G  C  S  W  R  Y  K  M  B  V  H  D  N\n"
+    "A   5 -4 -4 -4 -4  1  1 -4 -4  1 -4 -1 -1 -1 -2\n"
+    "T  -4  5 -4 -4 -4  1 -4  1  1 -4 -1 -4 -1 -1 -2\n"
+    "G  -4 -4  5 -4  1 -4  1 -4  1 -4 -1 -1 -4 -1 -2\n"
+    "C  -4 -4 -4  5  1 -4 -4  1 -4  1 -1 -1 -1 -4 -2\n"
+    "S  -4 -4  1  1 -1 -4 -2 -2 -2 -2 -1 -1 -3 -3 -1\n"
+    "W   1  1 -4 -4 -4 -1 -2 -2 -2 -2 -3 -3 -1 -1 -1\n"
+    "R   1 -4  1 -4 -2 -2 -1 -4 -2 -2 -3 -1 -3 -1 -1\n"
+    "Y  -4  1 -4  1 -2 -2 -4 -1 -2 -2 -1 -3 -1 -3 -1\n"
+    "K  -4  1  1 -4 -2 -2 -2 -2 -1 -4 -1 -3 -3 -1 -1\n"
+    "M   1 -4 -4  1 -2 -2 -2 -2 -4 -1 -3 -1 -1 -3 -1\n"
+    "B  -4 -1 -1 -1 -1 -3 -3 -1 -1 -3 -1 -2 -2 -2 -1\n"
+    "V  -1 -4 -1 -1 -1 -3 -1 -3 -3 -1 -2 -1 -2 -2 -1\n"
+    "H  -1 -1 -4 -1 -3 -1 -3 -1 -3 -1 -2 -2 -1 -2 -1\n"
+    "D  -1 -1 -1 -4 -3 -1 -1 -3 -1 -3 -2 -2 -2 -1 -1\n"
+    "N  -2 -2 -2 -2 -1 -1 -1 -1 -1 -1 -1 -1 -1 -1 -1\n";
+
+static const char scoring_blosum62[] =
+    "    A  R  N  D  C  Q  E  G  H  I  L  K  M  F  P  S  T  W  Y  V  B  Z  X  *\n"
+    "A   4 -1 -2 -2  0 -1 -1  0 -2 -1 -1 -1 -1 -2 -1  1  0 -3 -2  0 -2 -1  0 -4\n"
+    "R  -1  5  0 -2 -3  1  0 -2  0 -3 -2  2 -1 -3 -2 -1 -1 -3 -2 -3 -1  0 -1 -4\n"
+    "N  -2  0  6  1 -3  0  0  0  1 -3 -3  0 -2 -3 -2  1  0 -4 -2 -3  3  0 -1 -4\n"
+    "D  -2 -2  1  6 -3  0  2 -1 -1 -3 -4 -1 -3 -3 -1  0 -1 -4 -3 -3  4  1 -1 -4\n"
+    "C   0 -3 -3 -3  9 -3 -4 -3 -3 -1 -1 -3 -1 -2 -3 -1 -1 -2 -2 -1 -3 -3 -2 -4\n"
+    "Q  -1  1  0  0 -3  5  2 -2  0 -3 -2  1  0 -3 -1  0 -1 -2 -1 -2  0  3 -1 -4\n"
+    "E  -1  0  0  2 -4  2  5 -2  0 -3 -3  1 -2 -3 -1  0 -1 -3 -2 -2  1  4 -1 -4\n"
+    "G   0 -2  0 -1 -3 -2 -2  6 -2 -4 -4 -2 -3 -3 -2  0 -2 -2 -3 -3 -1 -2 -1 -4\n"
+    "H  -2  0  1 -1 -3  0  0 -2  8 -3 -3 -1 -2 -1 -2 -1 -2 -2  2 -3  0  0 -1 -4\n"
+    "I  -1 -3 -3 -3 -1 -3 -3 -4 -3  4  2 -3  1  0 -3 -2 -1 -3 -1  3 -3 -3 -1 -4\n"
+    "L  -1 -2 -3 -4 -1 -2 -3 -4 -3  2  4 -2  2  0 -3 -2 -1 -2 -1  1 -4 -3 -1 -4\n"
+    "K  -1  2  0 -1 -3  1  1 -2 -1 -3 -2  5 -1 -3 -1  0 -1 -3 -2 -2  0  1 -1 -4\n"
+    "M  -1 -1 -2 -3 -1  0 -2 -3 -2  1  2 -1  5  0 -2 -1 -1 -1 -1  1 -3 -1 -1 -4\n"
+    "F  -2 -3 -3 -3 -2 -3 -3 -3 -1  0  0 -3  0  6 -4 -2 -2  1  3 -1 -3 -3 -1 -4\n"
+    "P  -1 -2 -2 -1 -3 -1 -1 -2 -2 -3 -3 -1 -2 -4  7 -1 -1 -4 -3 -2 -2 -1 -2 -4\n"
+    "S   1 -1  1  0 -1  0  0  0 -1 -2 -2  0 -1 -2 -1  4  1 -3 -2 -2  0  0  0 -4\n"
+    "T   0 -1  0 -1 -1 -1 -1 -2 -2 -1 -1 -1 -1 -2 -1  1  5 -2 -2  0 -1 -1  0 -4\n"
+    "W  -3 -3 -4 -4 -2 -2 -3 -2 -2 -3 -2 -3 -1  1 -4 -3 -2 11  2 -3 -4 -3 -2 -4\n"
+    "Y  -2 -2 -2 -3 -2 -1 -2 -3  2 -1 -1 -2 -1  3 -3 -2 -2  2  7 -1 -3 -2 -1 -4\n"
+    "V   0 -3 -3 -3 -1 -2 -2 -3 -3  3  1 -2  1 -1 -2 -2  0 -3 -1  4 -3 -2 -1 -4\n"
+    "B  -2 -1  3  4 -3  0  1 -1  0 -3 -4  0 -3 -3 -2  0 -1 -4 -3 -3  4  1 -1 -4\n"
+    "Z  -1  0  0  1 -3  3  4 -2  0 -3 -3  1 -1 -3 -1  0 -1 -3 -2 -2  1  4 -1 -4\n"
+    "X   0 -1 -1 -1 -2 -1 -1 -1 -1 -1 -1 -1 -1 -1 -2  0  0 -2 -1 -1 -1 -1 -1 -4\n"
+    "*  -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4 -4  1\n";
+
+/* The values the programs used to hard-code: +1 / -1, gap -1, affine -10 / -1. */
+static inline void scoring_init(Scoring* sc) {
+    memset(sc, 0, sizeof(*sc));
+    sc->match = 1;
+    sc->mismatch = -1;
+    sc->gap = -1;
+    sc->gap_open = -10;
+    sc->gap_extend = -1;
+    sc->gap_model = GAP_LINEAR;
+}
+
+static inline const char* scoring_model_name(GapModel model) {
+    switch (model) {
+        case GAP_AFFINE: return "affine";
+        case GAP_CONVEX: return "convex";
+        default: return "linear";
+    }
+}
+
+/* Score of a gap of length k under the selected model. */
+static inline int scoring_gap(const Scoring* sc, long k) {
+    if (k <= 0) return 0;
+    if (sc->gap_model == GAP_LINEAR) return (int)(k * sc->gap);
+    long s = sc->gap_open + k * sc->gap_extend;
+    if (sc->gap_model == GAP_CONVEX) {
+        long s2 = sc->gap_open2 + k * sc->gap_extend2;
+        if (s2 > s) s = s2;
+    }
+    return (int)s;
+}
+
+static inline int scoring_pair(const Scoring* sc, char x, char y) {
+    return sc->table[nt_encode_base((unsigned char)x) * NT_CODES + nt_encode_base((unsigned char)y)];
+}
+
+/*
+ * out[x][y] = table[y][x]. A pass that swaps the two sequences (to put the
+ * shorter one on the row) reads this instead, since a matrix file need not be
+ * symmetric.
+ */
+static inline void scoring_transpose(const int8_t* table, int8_t* out) {
+    for (int x = 0; x < NT_CODES; x++)
+        for (int y = 0; y < NT_CODES; y++) out[x * NT_CODES + y] = table[y * NT_CODES + x];
+}
+
+/* Code of a one-letter matrix label, -1 for labels without one ('*'). */
+static inline int scoring_label_code(const char* tok) {
+    unsigned char c = (unsigned char)tok[0];
+    if (tok[1] != '\0') return -1;
+    if (!((c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z'))) return -1;
+    return nt_encode_base(c);
+}
+
+/* Fills table from matrix text; what names the source in error messages. */
+static inline int scoring_parse_matrix(int8_t* table, const char* text, const char* what) {
+    int cols[256];
+    int ncols = -1;
+    int lowest = INT_MAX;
+    unsigned char seen[NT_CODES * NT_CODES];
+    memset(seen, 0, sizeof(seen));
+
+    int line_no = 0;
+    const char* p = text;
+    while (*p) {
+        const char* eol = strchr(p, '\n');
+        size_t n = eol ? (size_t)(eol - p) : strlen(p);
+        char line[4096];
+        if (n >= sizeof(line)) n = sizeof(line) - 1;
+        memcpy(line, p, n);
+        line[n] = '\0';
+        p = eol ? eol + 1 : p + strlen(p);
+        line_no++;
+
+        char* save;
+        char* tok = strtok_r(line, " \t\r", &save);
+        if (!tok || tok[0] == '#') continue;
+
+        if (ncols < 0) {
+            for (ncols = 0; tok && ncols < 256; tok = strtok_r(NULL, " \t\r", &save))
+                cols[ncols++] = scoring_label_code(tok);
+            continue;
+        }
+
+        int row = scoring_label_code(tok);
+        for (int c = 0; c < ncols; c++) {
+            tok = strtok_r(NULL, " \t\r", &save);
+            char* end;
+            long v = tok ? strtol(tok, &end, 10) : 0;
+            if (!tok || *end != '\0' || v < -128 || v > 127) {
+                printf("%s: line %d: expected %d integer scores in [-128, 127]\n", what, line_no, ncols);
+                return -1;
+            }
+            if (row < 0 || cols[c] < 0) continue;
+            table[row * NT_CODES + cols[c]] = (int8_t)v;
+            seen[row * NT_CODES + cols[c]] = 1;
+            if (v < lowest) lowest = (int)v;
+        }
+    }
+
+    if (lowest == INT_MAX) {
+        printf("%s: no scores found\n", what);
+        return -1;
+    }
+    for (int k = 0; k < NT_CODES * NT_CODES; k++)
+        if (!seen[k]) table[k] = (int8_t)lowest;
+    return 0;
+}
+
+/* Built-in matrix by name (case-insensitive), otherwise a matrix file. */
+static inline int scoring_load_matrix(int8_t* table, const char* spec) {
+    if (strcasecmp(spec, "NUC.4.4") == 0 || strcasecmp(spec, "EDNAFULL") == 0)
+        return scoring_parse_matrix(table, scoring_nuc44, spec);
+    if (strcasecmp(spec, "BLOSUM62") == 0)
+        return scoring_parse_matrix(table, scoring_blosum62, spec);
+
+    FILE* f = fopen(spec, "rb");
+    if (!f) {
+        printf("Cannot open file: %s\n", spec);
+        return -1;
+    }
+    size_t len = 0, cap = 4096;
+    char* text = (char*)malloc(cap);
+    size_t got;
+    while ((got = fread(text + len, 1, cap - len - 1, f)) > 0) {
+        len += got;
+        if (cap - len - 1 == 0) {
+            cap *= 2;
+            text = (char*)realloc(text, cap);
+        }
+    }
+    fclose(f);
+    text[len] = '\0';
+    int rc = scoring_parse_matrix(table, text, spec);
+    free(text);
+    return rc;
+}
+
+/*
+ * Consumes argv[*i] (and its value) when it is a scoring option. Returns 1 if
+ * it was one, 0 if it is not, -1 after printing why its value is invalid.
+ */
+static inline int scoring_arg(Scoring* sc, int argc, char** argv, int* i) {
+    const char* opt = argv[*i];
+    int* field = NULL;
+    int set = 0;
+
+    if (strcmp(opt, "--matrix") == 0) {
+        if (*i + 1 >= argc) {
+            printf("--matrix needs a matrix name or file\n");
+            return -1;
+        }
+        sc->matrix = argv[++*i];
+        return 1;
+    }
+    if (strcmp(opt, "--match") == 0) field = &sc->match;
+    else if (strcmp(opt, "--mismatch") == 0) field = &sc->mismatch;
+    else if (strcmp(opt, "--gap") == 0) field = &sc->gap, set = SCORING_SET_GAP;
+    else if (strcmp(opt, "--gap-open") == 0) field = &sc->gap_open, set = SCORING_SET_AFFINE;
+    else if (strcmp(opt, "--gap-extend") == 0) field = &sc->gap_extend, set = SCORING_SET_AFFINE;
+    else if (strcmp(opt, "--gap-open2") == 0) field = &sc->gap_open2, set = SCORING_SET_OPEN2;
+    else if (strcmp(opt, "--gap-extend2") == 0) field = &sc->gap_extend2, set = SCORING_SET_EXTEND2;
+    else return 0;
+
+    char* end = NULL;
+    long v = *i + 1 < argc ? strtol(argv[*i + 1], &end, 10) : 0;
+    if (!end || end == argv[*i + 1] || *end != '\0' || v < -127 || v > 127) {
+        printf("%s needs an integer score in [-127, 127]\n", opt);
+        return -1;
+    }
+    ++*i;
+    *field = (int)v;
+    sc->set |= set;
+    return 1;
+}
+
+/*
+ * Picks the gap model (default_model unless a gap option selected one) and
+ * builds the score table. supported is a SCORING_MODEL() mask of the models
+ * the program has kernels for. Returns -1 after printing the problem.
+ */
+static inline int scoring_finish(Scoring* sc, GapModel default_model, unsigned supported) {
+    int convex = sc->set & (SCORING_SET_OPEN2 | SCORING_SET_EXTEND2);
+    if ((sc->set & SCORING_SET_GAP) && (sc->set & ~SCORING_SET_GAP)) {
+        printf("--gap (linear gaps) cannot be combined with --gap-open / --gap-extend\n");
+        return -1;
+    }
+    if (convex && convex != (SCORING_SET_OPEN2 | SCORING_SET_EXTEND2)) {
+        printf("convex gaps need both --gap-open2 and --gap-extend2\n");
+        return -1;
+    }
+    sc->gap_model = convex ? GAP_CONVEX
+                  : (sc->set & SCORING_SET_AFFINE) ? GAP_AFFINE
+                  : (sc->set & SCORING_SET_GAP) ? GAP_LINEAR
+                  : default_model;
+    if (!(supported & SCORING_MODEL(sc->gap_model))) {
+        printf("%s gaps are not supported by this program\n", scoring_model_name(sc->gap_model));
+        return -1;
+    }
+    if (sc->gap > 0 || sc->gap_open > 0 || sc->gap_extend > 0 || sc->gap_open2 > 0 || sc->gap_extend2 > 0) {
+        printf("gap scores must be <= 0\n");
+        return -1;
+    }
+    if (convex && (sc->gap_open2 > sc->gap_open || sc->gap_extend2 < sc->gap_extend)) {
+        printf("convex gaps need --gap-open2 <= --gap-open and --gap-extend2 >= --gap-extend\n");
+        return -1;
+    }
+
+    if (sc->matrix) {
+        if (scoring_load_matrix(sc->table, sc->matrix) != 0) return -1;
+    } else {
+        nt_score_table(sc->table, sc->match, sc->mismatch);
+    }
+
+    /* Identity tables let the SIMD kernels compare codes instead of looking scores up. */
+    sc->identity = 1;
+    sc->max_score = sc->table[0];
+    for (int x = 0; x < NT_CODES; x++) {
+        for (int y = 0; y < NT_CODES; y++) {
+            int s = sc->table[x * NT_CODES + y];
+            if (s > sc->max_score) sc->max_score = s;
+            if (s != sc->table[x == y ? 0 : 1]) sc->identity = 0;
+        }
+    }
+    if (sc->identity) {
+        sc->match = sc->table[0];
+        sc->mismatch = sc->table[1];
+    }
+    return 0;
+}
+
+/* The scheme as command-line options, e.g. "--match 1 --mismatch -1 --gap -1". */
+static inline void scoring_describe(const Scoring* sc, char* buf, size_t size) {
+    int n;
+    if (sc->matrix) n = snprintf(buf, size, "--matrix %s", sc->matrix);
+    else n = snprintf(buf, size, "--match %d --mismatch %d", sc->match, sc->mismatch);
+    if (n < 0 || (size_t)n >= size) return;
+
+    if (sc->gap_model == GAP_LINEAR) {
+        snprintf(buf + n, size - n, " --gap %d", sc->gap);
+    } else if (sc->gap_model == GAP_AFFINE) {
+        snprintf(buf + n, size - n, " --gap-open %d --gap-extend %d", sc->gap_open, sc->gap_extend);
+    } else {
+        snprintf(buf + n, size - n, " --gap-open %d --gap-extend %d --gap-open2 %d --gap-extend2 %d",
+                 sc->gap_open, sc->gap_extend, sc->gap_open2, sc->gap_extend2);
+    }
+}
+
+#endif
@@ -0,0 +1,46 @@
+/*
+ * util.h - small helpers shared by the programs
+ *
+ * Header-only, like fasta_reader.h:
+ *     #include "../common/util.h"
+ *
+ * Host code only. The OpenCL kernels keep their own max3 in the kernel
+ * source, since they are built by the device compiler.
+ */
+#ifndef UTIL_H
+#define UTIL_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <libgen.h>
+
+/* File name of path without its directory and last extension ("dir/a.fa" -> "a"). Caller frees. */
+static inline char* get_basename_without_ext(const char* path) {
+    char* path_copy = strdup(path);
+    char* base = basename(path_copy);
+    char* dot = strrchr(base, '.');
+    if (dot) *dot = '\0';
+
+    char* result = strdup(base);
+    free(path_copy);
+    return result;
+}
+
+/* Largest of three scores; ties keep the first. */
+static inline int max3(int a, int b, int c) {
+    if (a >= b && a >= c) return a;
+    if (b >= a && b >= c) return b;
+    return c;
+}
+
+/* Reverses a NUL-terminated string in place. */
+static inline void rev(char* str) {
+    int len = strlen(str);
+    for (int i = 0; i < len / 2; i++) {
+        char tmp = str[i];
+        str[i] = str[len - 1 - i];
+        str[len - 1 - i] = tmp;
+    }
+}
+
+#endif
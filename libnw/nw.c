@@ -0,0 +1,226 @@
+/*
+ * nw.c - libnw engines and workspace (see nw.h)
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "nw.h"
+#include "../common/linear_fill.h"
+#include "../common/gotoh_fill.h"
+
+/* Scratch buffers, grown to the largest pair seen. */
+struct NwAligner {
+    Scoring sc;
+    int mode;
+    LinearFillEngine engine;    /* linear gaps: row DP or the SSE4.1 / AVX2 anti-diagonal fill */
+    size_t trace_limit;
+    uint8_t* codes;         /* nw_align(): A then B as codes */
+    size_t codes_cap;
+    uint8_t* rev;           /* reversed prefixes for the locate pass */
+    size_t rev_cap;
+    int* rows;              /* DP rows, or the aln_scan_into() work */
+    size_t rows_cap;
+    int8_t* prof;           /* query profile of B */
+    size_t prof_cap;
+    unsigned char* trace;
+    size_t trace_cap;
+};
+
+/* Grows *buf to hold need bytes; keeps it when it already does. */
+static int ws_reserve(void** buf, size_t* cap, size_t need) {
+    if (need <= *cap) return NW_OK;
+    void* p = realloc(*buf, need);
+    if (!p) return NW_ERR_NOMEM;
+    *buf = p;
+    *cap = need;
+    return NW_OK;
+}
+
+#define WS_RESERVE(al, field, bytes) ws_reserve((void**)&(al)->field, &(al)->field##_cap, (bytes))
+
+NwAligner* nw_aligner_new(const Scoring* sc, int mode) {
+    NwAligner* al = (NwAligner*)calloc(1, sizeof(NwAligner));
+    if (!al) return NULL;
+    al->sc = *sc;
+    al->mode = mode;
+    al->engine = linear_fill_engine(sc);
+    return al;
+}
+
+void nw_aligner_shrink(NwAligner* al) {
+    free(al->codes);
+    free(al->rev);
+    free(al->rows);
+    free(al->prof);
+    free(al->trace);
+    al->codes = al->rev = NULL;
+    al->rows = NULL;
+    al->prof = NULL;
+    al->trace = NULL;
+    al->codes_cap = al->rev_cap = al->rows_cap = al->prof_cap = al->trace_cap = 0;
+}
+
+void nw_aligner_free(NwAligner* al) {
+    if (!al) return;
+    nw_aligner_shrink(al);
+    free(al);
+}
+
+void nw_aligner_set_trace_limit(NwAligner* al, size_t bytes) {
+    al->trace_limit = bytes;
+}
+
+size_t nw_aligner_workspace_bytes(const NwAligner* al) {
+    return al->codes_cap + al->rev_cap + al->rows_cap + al->prof_cap + al->trace_cap;
+}
+
+void nw_result_init(NwResult* res) {
+    memset(res, 0, sizeof(*res));
+    cigar_init(&res->cigar);
+}
+
+void nw_result_free(NwResult* res) {
+    cigar_free(&res->cigar);
+}
+
+const char* nw_strerror(int err) {
+    switch (err) {
+    case NW_OK: return "ok";
+    case NW_ERR_NOMEM: return "out of memory";
+    case NW_ERR_LIMIT: return "traceback larger than the trace limit";
+    }
+    return "unknown error";
+}
+
+/* ---------------------------------------------------------------------
+ * Region search (aln_mode.h on the workspace)
+ * ------------------------------------------------------------------- */
+
+static int scan(NwAligner* al, int mode, const uint8_t* a, int lenA, const uint8_t* b, int lenB, AlnEnd* end) {
+    if (WS_RESERVE(al, rows, ALN_SCAN_WORK(lenB) * sizeof(int)) != NW_OK) return NW_ERR_NOMEM;
+    *end = aln_scan_into(&al->sc, mode, a, lenA, b, lenB, al->rows);
+    return NW_OK;
+}
+
+/* aln_locate() without per-call allocation. */
+static int locate(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, AlnRegion* region) {
+    AlnEnd end, start;
+    if (scan(al, al->mode, a, lenA, b, lenB, &end) != NW_OK) return NW_ERR_NOMEM;
+    if (WS_RESERVE(al, rev, (size_t)end.i + end.j + 2) != NW_OK) return NW_ERR_NOMEM;
+    uint8_t* ra = al->rev;
+    uint8_t* rb = al->rev + end.i + 1;
+    for (int k = 0; k < end.i; k++) ra[k] = a[end.i - 1 - k];
+    for (int k = 0; k < end.j; k++) rb[k] = b[end.j - 1 - k];
+    if (scan(al, aln_mode_reverse(al->mode), ra, end.i, rb, end.j, &start) != NW_OK) return NW_ERR_NOMEM;
+
+    region->score = end.score;
+    region->a_start = end.i - start.i;
+    region->a_end = end.i;
+    region->b_start = end.j - start.j;
+    region->b_end = end.j;
+    return NW_OK;
+}
+
+static int find_region(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, AlnRegion* region) {
+    if (al->mode == ALN_GLOBAL) {
+        *region = aln_region_full(lenA, lenB, 0);
+        return NW_OK;
+    }
+    return locate(al, a, lenA, b, lenB, region);
+}
+
+/* ---------------------------------------------------------------------
+ * Calls
+ * ------------------------------------------------------------------- */
+
+static void result_stats(NwResult* res) {
+    res->length = cigar_stats(&res->cigar, &res->matches, &res->mismatches, &res->gaps);
+    res->similarity = res->length > 0 ? (double)res->matches / res->length * 100.0 : 0.0;
+}
+
+/* Global alignment of the region with traceback into res->cigar. */
+static int align_region(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, NwResult* res) {
+    int linear = al->sc.gap_model == GAP_LINEAR;
+    int convex = al->sc.gap_model == GAP_CONVEX;
+    size_t stride = linear ? ((size_t)lenB + 3) / 4 : gotoh_trace_stride(lenB);
+    size_t trace_bytes = (size_t)lenA * stride * (convex ? 2 : 1) + 1;
+    if (al->trace_limit && trace_bytes > al->trace_limit) return NW_ERR_LIMIT;
+
+    size_t row_ints = (linear ? 1 : 6) * ((size_t)lenB + 1);
+    if (WS_RESERVE(al, rows, row_ints * sizeof(int)) != NW_OK ||
+        WS_RESERVE(al, prof, nt_profile_bytes(lenB, a, lenA)) != NW_OK ||
+        WS_RESERVE(al, trace, trace_bytes) != NW_OK)
+        return NW_ERR_NOMEM;
+
+    NtProfile prof;
+    nt_profile_build_into(&prof, al->prof, b, lenB, a, lenA, al->sc.table);
+    cigar_clear(&res->cigar);
+    if (linear) {
+        /* linear_fill.h: the fills and the 2-bit walk of nw_linear, D > U > L */
+#ifdef LINEAR_FILL_SIMD
+        if (al->engine != LINEAR_FILL_ROWS) {
+            memset(al->trace, 0, trace_bytes);
+            res->score = linear_fill_diag(&al->sc, al->engine, a, b, lenA, lenB, al->trace, stride);
+        } else
+#endif
+            res->score = linear_fill_rows(&al->sc, a, lenA, lenB, &prof, al->rows, al->trace, stride);
+        linear_traceback(al->trace, stride, a, b, lenA, lenB, &res->cigar);
+    } else {
+        /* gotoh_fill.h: the Gotoh / convex fill and 4-bit walk of nw_affine */
+        GotohTrace trace = gotoh_trace_full(al->trace, convex ? al->trace + (size_t)lenA * stride : NULL, lenB);
+        memset(al->trace, 0, trace_bytes);
+        res->score = gotoh_fill_rows(&al->sc, a, lenA, lenB, &prof, al->rows, &trace);
+        gotoh_traceback(&trace, a, b, lenA, lenB, &res->cigar);
+    }
+    return NW_OK;
+}
+
+int nw_align_codes(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, NwResult* res) {
+    AlnRegion region;
+    int rc = find_region(al, a, lenA, b, lenB, &region);
+    if (rc != NW_OK) return rc;
+    rc = align_region(al, a + region.a_start, region.a_end - region.a_start,
+                      b + region.b_start, region.b_end - region.b_start, res);
+    if (rc != NW_OK) return rc;
+    region.score = res->score;
+    res->region = region;
+    result_stats(res);
+    return NW_OK;
+}
+
+int nw_score_codes(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, NwResult* res) {
+    AlnRegion region;
+    int rc;
+    if (al->mode == ALN_GLOBAL) {
+        AlnEnd end;
+        rc = scan(al, ALN_GLOBAL, a, lenA, b, lenB, &end);
+        region = aln_region_full(lenA, lenB, end.score);
+    } else {
+        rc = locate(al, a, lenA, b, lenB, &region);
+    }
+    if (rc != NW_OK) return rc;
+    cigar_clear(&res->cigar);
+    res->score = region.score;
+    res->region = region;
+    result_stats(res);
+    return NW_OK;
+}
+
+/* Encodes both sequences into the workspace: A at codes, B after it. */
+static int encode_pair(NwAligner* al, const char* a, int lenA, const char* b, int lenB) {
+    if (WS_RESERVE(al, codes, (size_t)lenA + lenB + 2) != NW_OK) return NW_ERR_NOMEM;
+    nt_encode(a, lenA, al->codes);
+    nt_encode(b, lenB, al->codes + lenA + 1);
+    return NW_OK;
+}
+
+int nw_align(NwAligner* al, const char* a, int lenA, const char* b, int lenB, NwResult* res) {
+    int rc = encode_pair(al, a, lenA, b, lenB);
+    if (rc != NW_OK) return rc;
+    return nw_align_codes(al, al->codes, lenA, al->codes + lenA + 1, lenB, res);
+}
+
+int nw_score(NwAligner* al, const char* a, int lenA, const char* b, int lenB, NwResult* res) {
+    int rc = encode_pair(al, a, lenA, b, lenB);
+    if (rc != NW_OK) return rc;
+    return nw_score_codes(al, al->codes, lenA, al->codes + lenA + 1, lenB, res);
+}
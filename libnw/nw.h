@@ -0,0 +1,107 @@
+/*
+ * nw.h - libnw, the aligners as a linkable library
+ *
+ * The programs in Basic_implementations/ each own a main() and are run once
+ * per input. libnw puts the CPU engines behind a handle that a long-running
+ * process keeps:
+ *
+ *     Scoring sc;
+ *     scoring_init(&sc);                      // scoring.h, as in the programs
+ *     sc.gap_open = -10; sc.gap_extend = -1; sc.set |= SCORING_SET_AFFINE;
+ *     if (scoring_finish(&sc, GAP_LINEAR, NW_GAP_MODELS) != 0) ...
+ *
+ *     NwAligner* al = nw_aligner_new(&sc, ALN_MODE_LOCAL);
+ *     NwResult res;
+ *     nw_result_init(&res);
+ *     for (each request)
+ *         if (nw_align(al, a, lenA, b, lenB, &res) == NW_OK) ... res.score, res.cigar, res.region
+ *     nw_result_free(&res);
+ *     nw_aligner_free(al);
+ *
+ * The handle owns every scratch buffer an alignment needs: encoded
+ * sequences, DP rows, the query profile and the traceback matrix. They grow
+ * to the largest pair seen and are then reused, so a steady stream of pairs
+ * allocates nothing. A result keeps its CIGAR buffer the same way when it is
+ * passed to the next call.
+ *
+ * Engines: linear gaps use the fills and 2-bit traceback of nw_linear
+ * (common/linear_fill.h); affine and convex gaps use the Gotoh fill and
+ * 4-bit traceback of nw_affine (common/gotoh_fill.h). The code is shared,
+ * so tie-breaking and CIGARs match the programs. Modes other than
+ * global locate their region with two score-only passes first (aln_mode.h)
+ * and trace back only the region.
+ *
+ * A handle is not thread-safe; use one per thread. Handles share nothing.
+ *
+ * Build:
+ *     gcc -O2 -fPIC -c libnw/nw.c -o nw.o && ar rcs libnw.a nw.o
+ *     gcc -O2 -fPIC -shared libnw/nw.c -o libnw.so
+ */
+#ifndef LIBNW_NW_H
+#define LIBNW_NW_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "../common/aln_mode.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Gap models libnw has engines for: all of them. */
+#define NW_GAP_MODELS (SCORING_MODEL(GAP_LINEAR) | SCORING_MODEL(GAP_AFFINE) | SCORING_MODEL(GAP_CONVEX))
+
+#define NW_OK 0
+#define NW_ERR_NOMEM -1     /* a workspace buffer could not be grown */
+#define NW_ERR_LIMIT -2     /* the traceback would exceed nw_aligner_set_trace_limit() */
+
+typedef struct NwAligner NwAligner;
+
+typedef struct {
+    int score;
+    int length;         /* alignment columns */
+    int matches;
+    int mismatches;
+    int gaps;
+    double similarity;  /* matches / length, in % */
+    Cigar cigar;        /* covers region only; empty after nw_score() */
+    AlnRegion region;   /* aligned part of each sequence (all of both in global mode) */
+} NwResult;
+
+/* sc must have been through scoring_finish(); it is copied. mode is an aln_mode.h mode. NULL if out of memory. */
+NwAligner* nw_aligner_new(const Scoring* sc, int mode);
+void nw_aligner_free(NwAligner* al);
+
+/* Largest traceback matrix (bytes) an alignment may allocate; 0 (the default) means no limit. */
+void nw_aligner_set_trace_limit(NwAligner* al, size_t bytes);
+
+/* Bytes currently held by the workspace. */
+size_t nw_aligner_workspace_bytes(const NwAligner* al);
+
+/* Frees the workspace; the next call grows it again. */
+void nw_aligner_shrink(NwAligner* al);
+
+void nw_result_init(NwResult* res);
+void nw_result_free(NwResult* res);
+
+/* Aligns letters (any case; see nt_code.h) with traceback. Returns NW_OK or an NW_ERR_ code. */
+int nw_align(NwAligner* al, const char* a, int lenA, const char* b, int lenB, NwResult* res);
+
+/* Same on nt_code.h codes. */
+int nw_align_codes(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, NwResult* res);
+
+/*
+ * Score and region only, in O(lenB) memory: no CIGAR, and length and the
+ * column counts are 0.
+ */
+int nw_score(NwAligner* al, const char* a, int lenA, const char* b, int lenB, NwResult* res);
+int nw_score_codes(NwAligner* al, const uint8_t* a, int lenA, const uint8_t* b, int lenB, NwResult* res);
+
+/* Message for an NW_ERR_ code. */
+const char* nw_strerror(int err);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif